@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+# Copyright 2024-present Barefoot Networks, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Compares two builds of a BMv2 compiler on the largest v1model programs of
+# testdata/p4_16_samples: wall time and peak RSS of each compilation, and
+# whether both builds write the same JSON.  Used to evaluate changes to the
+# way the backend produces its output, e.g.
+#   bench-json-output.py build-before/p4c-bm2-ss build/p4c-bm2-ss
+
+import argparse
+import filecmp
+import os
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+
+def parse_args():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("baseline", help="the compiler binary to compare against")
+    parser.add_argument("candidate", help="the compiler binary being evaluated")
+    parser.add_argument(
+        "--samples",
+        default=str(Path(__file__).resolve().parents[2] / "testdata" / "p4_16_samples"),
+        help="the directory of the P4 programs",
+    )
+    parser.add_argument("--count", type=int, default=10, help="how many programs to compile")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per program and binary")
+    parser.add_argument(
+        "--candidate-arg",
+        action="append",
+        default=[],
+        help="an extra option for the candidate binary; may be repeated",
+    )
+    return parser.parse_args()
+
+
+def largest_programs(samples, count):
+    programs = []
+    for path in Path(samples).glob("*.p4"):
+        text = path.read_text(errors="replace")
+        if "v1model.p4" in text:
+            programs.append(path)
+    programs.sort(key=lambda p: p.stat().st_size, reverse=True)
+    return programs[:count]
+
+
+def run(binary, program, output, extra):
+    """Returns the wall time in seconds and the peak RSS in KiB of one compilation, or None
+    if it failed."""
+    start = time.monotonic()
+    pid = os.fork()
+    if pid == 0:
+        devnull = os.open(os.devnull, os.O_WRONLY)
+        os.dup2(devnull, 1)
+        os.dup2(devnull, 2)
+        os.execv(binary, [binary, *extra, "-o", output, str(program)])
+    _, status, usage = os.wait4(pid, 0)
+    elapsed = time.monotonic() - start
+    if os.waitstatus_to_exitcode(status) != 0:
+        return None
+    return elapsed, usage.ru_maxrss
+
+
+def measure(binary, program, output, repeat, extra=()):
+    """The best time and peak RSS over @repeat runs."""
+    results = [run(binary, program, output, extra) for _ in range(repeat)]
+    if None in results:
+        return None
+    return min(r[0] for r in results), min(r[1] for r in results)
+
+
+def main():
+    args = parse_args()
+    programs = largest_programs(args.samples, args.count)
+    if not programs:
+        print("No v1model programs in", args.samples)
+        return 1
+    print(f"{'program':40} {'time':>17} {'peak RSS (MiB)':>19}  output")
+    mismatches = 0
+    with tempfile.TemporaryDirectory() as tmp:
+        for program in programs:
+            before = os.path.join(tmp, "baseline.json")
+            after = os.path.join(tmp, "candidate.json")
+            base = measure(args.baseline, program, before, args.repeat)
+            cand = measure(args.candidate, program, after, args.repeat, args.candidate_arg)
+            if base is None or cand is None:
+                print(f"{program.name:40} compilation failed")
+                continue
+            same = filecmp.cmp(before, after, shallow=False)
+            mismatches += not same
+            print(
+                f"{program.name:40} {base[0]:7.2f}s {cand[0]:7.2f}s"
+                f" {base[1] / 1024:9.1f} {cand[1] / 1024:9.1f}"
+                f"  {'identical' if same else 'DIFFERENT'}"
+            )
+    return 1 if mismatches else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
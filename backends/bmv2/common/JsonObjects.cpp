@@ -44,8 +44,11 @@ JsonObjects::JsonObjects() {
     register_arrays = insert_array_field(toplevel, "register_arrays"_cs);
     calculations = insert_array_field(toplevel, "calculations"_cs);
     learn_lists = insert_array_field(toplevel, "learn_lists"_cs);
-    actions = insert_array_field(toplevel, "actions"_cs);
-    pipelines = insert_array_field(toplevel, "pipelines"_cs);
+    // Elements of arrays held by the top-level object are at depth 2.
+    actions = new Util::JsonSpooledArray(2);
+    toplevel->emplace("actions"_cs, actions);
+    pipelines = new Util::JsonSpooledArray(2);
+    toplevel->emplace("pipelines"_cs, pipelines);
     checksums = insert_array_field(toplevel, "checksums"_cs);
     force_arith = insert_array_field(toplevel, "force_arith"_cs);
     externs = insert_array_field(toplevel, "extern_instances"_cs);
@@ -200,7 +200,9 @@ class JsonObjects {
 
     Util::JsonObject *toplevel;
     Util::JsonObject *meta;
-    Util::JsonArray *actions;
+    /// Actions and pipelines are final once added, and the largest sections: they are
+    /// serialized as they are added instead of being kept as trees until the end.
+    Util::JsonSpooledArray *actions;
     Util::JsonArray *calculations;
     Util::JsonArray *checksums;
     Util::JsonArray *counters;
@@ -221,7 +223,7 @@ class JsonObjects {
     Util::JsonArray *meter_arrays;
     Util::JsonArray *parsers;
     Util::JsonArray *parse_vsets;
-    Util::JsonArray *pipelines;
+    Util::JsonSpooledArray *pipelines;
     Util::JsonArray *register_arrays;
     Util::JsonArray *force_arith;
     Util::JsonArray *field_aliases;
@@ -78,7 +78,9 @@ class Backend {
           json(new BMV2::JsonObjects()) {
         refMap->setIsV1(options.isv1());
     }
-    void serialize(std::ostream &out) const { json->toplevel->serialize(out); }
+    /// Streams the JSON out rather than serializing the tree, which writes (and flushes)
+    /// one line at a time.
+    void serialize(std::ostream &out) const { Util::JsonWriter(out).write(json->toplevel); }
     virtual void convert(const IR::ToplevelBlock *block) = 0;
 };
 
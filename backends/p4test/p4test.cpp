@@ -25,6 +25,7 @@ limitations under the License.
 #include "frontends/p4/frontend.h"
 #include "frontends/p4/toP4/toP4.h"
 #include "ir/ir.h"
+#include "ir/ir_binary.h"
 #include "ir/json_loader.h"
 #include "ir/pass_utils.h"
 #include "lib/crash.h"
@@ -116,7 +117,14 @@ int main(int argc, char *const argv[]) {
     if (::errorCount() > 0) return 1;
     const IR::P4Program *program = nullptr;
     auto hook = options.getDebugHook();
-    if (options.loadIRFromJson) {
+    if (options.loadIRFromJson && IRBinaryReader::isBinaryIR(options.file)) {
+        // A file which doesn't decode has already been reported.
+        IRBinaryReader reader(options.file);
+        if (const IR::Node *node = reader.root()) program = node->to<IR::P4Program>();
+        if (!program && ::errorCount() == 0)
+            error(ErrorType::ERR_INVALID, "%s is not a P4Program in binary IR format",
+                  options.file);
+    } else if (options.loadIRFromJson) {
         std::ifstream json(options.file);
         if (json) {
             JSONLoader loader(json);
@@ -184,6 +192,8 @@ int main(int argc, char *const argv[]) {
         if (program) {
             if (!options.dumpJsonFile.empty())
                 JSONGenerator(*openFile(options.dumpJsonFile, true), true) << program << std::endl;
+            if (!options.dumpBinaryIRFile.empty())
+                IRBinaryWriter().write(*openFile(options.dumpBinaryIRFile, true), program);
             if (options.debugJson) {
                 std::stringstream ss1, ss2;
                 JSONGenerator gen1(ss1), gen2(ss2);
@@ -0,0 +1,542 @@
+#include "backend.h"
+
+#include <boost/format.hpp>
+
+#include "frontends/p4/fromv1.0/v1model.h"
+#include "lib/error.h"
+#include "codegen.h"
+#include "control.h"
+#include "deparser.h"
+#include "parser.h"
+#include "runtime/pie_runtime.h"
+
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
+
+namespace pie {
+
+namespace {
+
+/// Fields of `struct pie_metadata` (runtime/pie_runtime.h), in order.
+const struct {
+    const char* name;
+    unsigned width;
+} metadataFields[] = {
+    { "ingress_port", 32 },
+    { "egress_spec", 32 },
+    { "egress_port", 32 },
+    { "instance_type", 32 },
+    { "packet_length", 32 },
+    { "mcast_grp", 32 },
+    { "egress_rid", 32 },
+    { "checksum_error", 32 },
+    { "parser_error", 32 },
+    { "priority", 32 },
+    { "ingress_global_timestamp", 64 },
+    { "packet_offset", 32 },
+};
+
+/// packet_offset is set by the pipeline itself and comes last.
+const unsigned packetOffsetField = sizeof(metadataFields) / sizeof(metadataFields[0]) - 1;
+
+}  // namespace
+
+const IR::CompileTimeValue* PieBackend::find_block(const IR::PackageBlock* main, cstring name)
+{
+    auto block = main->findParameterValue(name);
+    if (block == nullptr) {
+        ::error(ErrorType::ERR_MODEL, "%1%: package has no '%2%' argument; is this a V1Switch?",
+                main, name);
+    }
+    return block;
+}
+
+bool PieBackend::build(const IR::ToplevelBlock* toplevel)
+{
+    auto& v1model = P4V1::V1Model::instance;
+    auto program = toplevel->getProgram();
+    for (auto object : program->objects) {
+        if (auto errorType = object->to<IR::Type_Error>())
+            types.set_error_type(errorType);
+    }
+
+    // Fields modified anywhere, so the deparser knows what may have changed.
+    program->apply(dirty);
+    if (!options.profileGenerate.empty())
+        profile.generate(options.profileGenerate);
+    if (!options.profileUse.empty() && !profile.use(options.profileUse))
+        return false;
+
+    auto main = toplevel->getMain();
+    auto parserBlock = find_block(main, v1model.sw.parser.name);
+    if (parserBlock == nullptr || ::errorCount() > 0)
+        return false;
+    if (!parserBlock->is<IR::ParserBlock>()) {
+        ::error(ErrorType::ERR_MODEL, "%1%: expected a parser as first argument", main);
+        return false;
+    }
+    parser = parserBlock->to<IR::ParserBlock>()->container;
+    PieParser parserGen(builder, refMap, typeMap, types, profile);
+    parserFunction = parserGen.build(parser, "pie_parser_" + parser->name.name);
+    if (::errorCount() > 0)
+        return false;
+
+    // Tables and externs are created by pie_init(), which the controls fill in.
+    auto& context = builder.get_context();
+    auto initType = llvm::FunctionType::get(builder.get_builder().getVoidTy(), false);
+    auto init = llvm::Function::Create(initType, llvm::Function::ExternalLinkage, "pie_init",
+                                       &builder.get_module());
+    auto initBlock = llvm::BasicBlock::Create(context, "entry", init);
+    // Externs declared outside the controls may be shared by several.
+    for (auto object : program->objects) {
+        auto instance = object->to<IR::Declaration_Instance>();
+        if (instance == nullptr)
+            continue;
+        auto type = typeMap->getType(instance, true);
+        if (auto specialized = type->to<IR::Type_SpecializedCanonical>())
+            type = specialized->baseType;
+        if (type->is<IR::Type_Extern>())
+            externs.declare(instance, initBlock);
+    }
+    verifyFunction = build_control(main, v1model.sw.verify.name, initBlock);
+    ingressFunction = build_control(main, v1model.sw.ingress.name, initBlock);
+    egressFunction = build_control(main, v1model.sw.egress.name, initBlock);
+    computeFunction = build_control(main, v1model.sw.compute.name, initBlock);
+    builder.get_builder().SetInsertPoint(initBlock);
+    builder.get_builder().CreateRetVoid();
+    profile.finish(initBlock);
+    if (::errorCount() > 0)
+        return false;
+
+    if (auto deparser = find_control(main, v1model.sw.deparser.name)) {
+        PieDeparser deparserGen(builder, refMap, typeMap, types, dirty);
+        deparserFunction = deparserGen.build(deparser, "pie_deparser_" + deparser->name.name);
+    }
+    if (::errorCount() > 0)
+        return false;
+
+    auto processPacket = build_process_packet();
+    if (::errorCount() > 0)
+        return false;
+    auto processBurst = build_process_burst(processPacket);
+    build_pipeline(init, processPacket, processBurst);
+    return ::errorCount() == 0;
+}
+
+const IR::P4Control* PieBackend::find_control(const IR::PackageBlock* main, cstring name)
+{
+    auto block = find_block(main, name);
+    if (block == nullptr)
+        return nullptr;
+    if (!block->is<IR::ControlBlock>()) {
+        ::error(ErrorType::ERR_MODEL, "%1%: expected a control for %2%", main, name);
+        return nullptr;
+    }
+    return block->to<IR::ControlBlock>()->container;
+}
+
+llvm::Function* PieBackend::build_control(const IR::PackageBlock* main, cstring name,
+                                          llvm::BasicBlock* init)
+{
+    auto control = find_control(main, name);
+    if (control == nullptr)
+        return nullptr;
+    PieControl controlGen(builder, refMap, typeMap, types, dirty, init, profile, externs);
+    auto function = controlGen.build(control, "pie_control_" + control->name.name);
+    auto& controlTables = controlGen.get_tables();
+    tables.insert(tables.end(), controlTables.begin(), controlTables.end());
+    return function;
+}
+
+llvm::Function* PieBackend::build_process_packet()
+{
+    auto& context = builder.get_context();
+    auto& ir = builder.get_builder();
+    auto& module = builder.get_module();
+    auto standardName = P4V1::V1Model::instance.standardMetadataType.name;
+
+    std::vector<llvm::Type*> metaFields;
+    for (auto& field : metadataFields)
+        metaFields.push_back(ir.getIntNTy(field.width));
+    metadataType = llvm::StructType::create(context, metaFields, "struct.pie_metadata");
+    auto sizeType = module.getDataLayout().getIntPtrType(context);
+    auto functionType = llvm::FunctionType::get(
+        ir.getInt32Ty(),
+        { builder.get_byte_ptr_type(), sizeType, llvm::PointerType::getUnqual(metadataType) },
+        false);
+    auto function = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage,
+                                           "process_packet", &module);
+    ir.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", function));
+    auto arg = function->arg_begin();
+    llvm::Value* packet = &*arg++;
+    packet->setName("packet");
+    llvm::Value* length = &*arg++;
+    length->setName("length");
+    llvm::Value* meta = &*arg++;
+    meta->setName("meta");
+    auto length32 = ir.CreateTrunc(length, ir.getInt32Ty());
+
+    // The headers, user metadata and standard metadata of the pipeline.
+    std::vector<llvm::Value*> args = { packet, length32, nullptr };
+    llvm::Value* standard = nullptr;
+    const IR::Type_Struct* standardType = nullptr;
+    for (auto param : parser->getApplyParameters()->parameters) {
+        auto type = types.canonical(param->type);
+        if (type->is<IR::Type_Extern>())
+            continue;
+        auto storageType = types.storage_type(type);
+        auto address = builder.create_entry_alloca(storageType, param->name.name.c_str());
+        ir.CreateStore(llvm::Constant::getNullValue(storageType), address);
+        args.push_back(address);
+        auto st = type->to<IR::Type_Struct>();
+        if (st != nullptr && st->name.name == standardName) {
+            standard = address;
+            standardType = st;
+        }
+    }
+    if (standard == nullptr) {
+        ::error(ErrorType::ERR_MODEL, "%1%: parser has no %2% parameter", parser, standardName);
+        return function;
+    }
+
+    // As in simple_switch, packet_length and parser_error are set by the target.
+    copy_metadata(meta, standard, standardType, true);
+    auto layout = types.get_layout(standardType);
+    auto setStandard = [&](const char* name, llvm::Value* value) {
+        auto index = layout->fieldIndex.find(cstring(name));
+        if (index == layout->fieldIndex.end())
+            return;
+        auto address = ir.CreateStructGEP(layout->type, standard, index->second);
+        auto fieldType = layout->type->getElementType(index->second);
+        ir.CreateStore(ir.CreateZExtOrTrunc(value, fieldType), address);
+    };
+    setStandard("packet_length", length32);
+
+    auto consumed = builder.create_entry_alloca(ir.getInt32Ty(), "consumed");
+    ir.CreateStore(ir.getInt32(0), consumed);
+    args[2] = consumed;
+    auto error = ir.CreateCall(parserFunction, args, "parser_error");
+    setStandard("parser_error", error);
+
+    // The controls and the deparser share the packet through a context.
+    auto contextType = PieCodeGen::context_type(builder);
+    auto packetContext = builder.create_entry_alloca(contextType, "context");
+    auto contextField = [&](unsigned field) {
+        return ir.CreateStructGEP(contextType, packetContext, field);
+    };
+    ir.CreateStore(packet, contextField(PieCodeGen::CONTEXT_PACKET));
+    ir.CreateStore(length32, contextField(PieCodeGen::CONTEXT_LENGTH));
+    ir.CreateStore(ir.CreateLoad(ir.getInt32Ty(), consumed),
+                   contextField(PieCodeGen::CONTEXT_CONSUMED));
+    ir.CreateStore(ir.getInt32(0), contextField(PieCodeGen::CONTEXT_CHECKSUM_ERROR));
+    ir.CreateStore(ir.getInt32(PIE_METER_GREEN), contextField(PieCodeGen::CONTEXT_METER_COLOR));
+    ir.CreateStore(ir.getInt32(0), contextField(PieCodeGen::CONTEXT_CHECKSUM_VERIFIED));
+
+    // Ingress and egress take the headers, metadata and standard metadata;
+    // the checksum controls the first two and the deparser the headers.
+    std::vector<llvm::Value*> controlArgs = { packetContext };
+    controlArgs.insert(controlArgs.end(), args.begin() + 3, args.end());
+    std::vector<llvm::Value*> checksumArgs(controlArgs.begin(), controlArgs.begin() + 3);
+    std::vector<llvm::Value*> deparserArgs(controlArgs.begin(), controlArgs.begin() + 2);
+    ir.CreateCall(verifyFunction, checksumArgs);
+    setStandard("checksum_error",
+                ir.CreateLoad(ir.getInt32Ty(), contextField(PieCodeGen::CONTEXT_CHECKSUM_ERROR)));
+
+    auto egressSpec = layout->fieldIndex.at("egress_spec"_cs);
+    auto egressSpecType = layout->type->getElementType(egressSpec);
+    auto dropBlock = llvm::BasicBlock::Create(context, "drop", function);
+    auto checkDrop = [&](const char* next) {
+        auto spec = ir.CreateLoad(egressSpecType,
+                                  ir.CreateStructGEP(layout->type, standard, egressSpec));
+        auto dropped = ir.CreateICmpEQ(spec, llvm::ConstantInt::get(egressSpecType,
+                                                                    PIE_DROP_PORT));
+        auto nextBlock = llvm::BasicBlock::Create(context, next, function, dropBlock);
+        ir.CreateCondBr(dropped, dropBlock, nextBlock);
+        ir.SetInsertPoint(nextBlock);
+    };
+    ir.CreateCall(ingressFunction, controlArgs);
+    checkDrop("egress");
+    // As in simple_switch, egress sees the port that ingress chose.
+    setStandard("egress_port",
+                ir.CreateLoad(egressSpecType,
+                              ir.CreateStructGEP(layout->type, standard, egressSpec)));
+    ir.CreateCall(egressFunction, controlArgs);
+    checkDrop("deparse");
+    ir.CreateCall(computeFunction, checksumArgs);
+    auto start = ir.CreateCall(deparserFunction, deparserArgs, "start");
+    auto tooLong = ir.CreateICmpSLT(start, ir.getInt32(-PIE_HEADROOM));
+    auto forward = llvm::BasicBlock::Create(context, "forward", function, dropBlock);
+    ir.CreateCondBr(tooLong, dropBlock, forward);
+    ir.SetInsertPoint(forward);
+    copy_metadata(meta, standard, standardType, false);
+    ir.CreateStore(start, ir.CreateStructGEP(metadataType, meta, packetOffsetField));
+    ir.CreateRet(ir.CreateSub(length32, start));
+
+    ir.SetInsertPoint(dropBlock);
+    copy_metadata(meta, standard, standardType, false);
+    ir.CreateStore(ir.getInt32(0), ir.CreateStructGEP(metadataType, meta, packetOffsetField));
+    ir.CreateRet(ir.getInt32(PIE_DROPPED));
+    return function;
+}
+
+llvm::Function* PieBackend::build_process_burst(llvm::Function* processPacket)
+{
+    auto& context = builder.get_context();
+    auto& ir = builder.get_builder();
+    auto& module = builder.get_module();
+
+    auto sizeType = module.getDataLayout().getIntPtrType(context);
+    auto bytePtrType = builder.get_byte_ptr_type();
+    auto metaPtrType = llvm::PointerType::getUnqual(metadataType);
+    auto functionType = llvm::FunctionType::get(
+        ir.getInt32Ty(),
+        { llvm::PointerType::getUnqual(bytePtrType), llvm::PointerType::getUnqual(sizeType),
+          metaPtrType, llvm::PointerType::getUnqual(ir.getInt32Ty()), ir.getInt32Ty() },
+        false);
+    auto function = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage,
+                                           PIE_PROCESS_BURST, &module);
+    auto arg = function->arg_begin();
+    llvm::Value* packets = &*arg++;
+    packets->setName("packets");
+    llvm::Value* lengths = &*arg++;
+    lengths->setName("lengths");
+    llvm::Value* meta = &*arg++;
+    meta->setName("meta");
+    llvm::Value* results = &*arg++;
+    results->setName("results");
+    llvm::Value* count = &*arg++;
+    count->setName("count");
+
+    // The per-packet pipeline is inlined into the loop so that the burst
+    // pays for a single call.
+    processPacket->addFnAttr(llvm::Attribute::AlwaysInline);
+
+    auto entry = llvm::BasicBlock::Create(context, "entry", function);
+    auto loop = llvm::BasicBlock::Create(context, "loop", function);
+    auto body = llvm::BasicBlock::Create(context, "body", function);
+    auto done = llvm::BasicBlock::Create(context, "done", function);
+
+    ir.SetInsertPoint(entry);
+    ir.CreateBr(loop);
+
+    ir.SetInsertPoint(loop);
+    auto index = ir.CreatePHI(ir.getInt32Ty(), 2, "i");
+    auto forwarded = ir.CreatePHI(ir.getInt32Ty(), 2, "forwarded");
+    index->addIncoming(ir.getInt32(0), entry);
+    forwarded->addIncoming(ir.getInt32(0), entry);
+    ir.CreateCondBr(ir.CreateICmpULT(index, count), body, done);
+
+    ir.SetInsertPoint(body);
+    if (options.prefetchDistance > 0) {
+        // Prefetch without a branch: near the end of the burst the current
+        // packet is prefetched again, which costs next to nothing.
+        auto ahead = ir.CreateAdd(index, ir.getInt32(options.prefetchDistance));
+        ahead = ir.CreateSelect(ir.CreateICmpULT(ahead, count), ahead, index, "ahead");
+        auto packet = ir.CreateLoad(bytePtrType, ir.CreateInBoundsGEP(bytePtrType, packets,
+                                                                      ahead));
+        // Ethernet, IPv4 and L4 headers span up to two cache lines.
+        builder.prefetch(packet, false);
+        builder.prefetch(ir.CreateConstInBoundsGEP1_32(ir.getInt8Ty(), packet, 64), false);
+        builder.prefetch(ir.CreateInBoundsGEP(metadataType, meta, ahead), true);
+    }
+    auto packet = ir.CreateLoad(bytePtrType, ir.CreateInBoundsGEP(bytePtrType, packets, index),
+                                "packet");
+    auto length = ir.CreateLoad(sizeType, ir.CreateInBoundsGEP(sizeType, lengths, index),
+                                "length");
+    auto packetMeta = ir.CreateInBoundsGEP(metadataType, meta, index);
+    auto result = ir.CreateCall(processPacket, { packet, length, packetMeta }, "result");
+    ir.CreateStore(result, ir.CreateInBoundsGEP(ir.getInt32Ty(), results, index));
+    auto kept = ir.CreateZExt(ir.CreateICmpNE(result, ir.getInt32(PIE_DROPPED)),
+                              ir.getInt32Ty());
+    index->addIncoming(ir.CreateAdd(index, ir.getInt32(1)), body);
+    forwarded->addIncoming(ir.CreateAdd(forwarded, kept), body);
+    ir.CreateBr(loop);
+
+    ir.SetInsertPoint(done);
+    ir.CreateRet(forwarded);
+    return function;
+}
+
+void PieBackend::build_pipeline(llvm::Function* init, llvm::Function* processPacket,
+                                llvm::Function* processBurst)
+{
+    auto& context = builder.get_context();
+    auto& ir = builder.get_builder();
+    auto& module = builder.get_module();
+    auto i32 = ir.getInt32Ty();
+    auto bytePtr = builder.get_byte_ptr_type();
+    auto string = [&](cstring value) {
+        return llvm::cast<llvm::Constant>(
+            ir.CreateGlobalStringPtr(value.c_str(), "pie.name", 0, &module));
+    };
+    // Arrays of the descriptor are private constants, referred to by pointer.
+    auto array = [&](llvm::Type* type, const std::vector<llvm::Constant*>& elements,
+                     const char* name) -> llvm::Constant* {
+        if (elements.empty())
+            return llvm::ConstantPointerNull::get(llvm::PointerType::getUnqual(type));
+        auto arrayType = llvm::ArrayType::get(type, elements.size());
+        auto global = new llvm::GlobalVariable(
+            module, arrayType, true, llvm::GlobalValue::PrivateLinkage,
+            llvm::ConstantArray::get(arrayType, elements), name);
+        return llvm::ConstantExpr::getBitCast(global, llvm::PointerType::getUnqual(type));
+    };
+
+    // struct pie_field_info, pie_action_info, pie_table_info and pie_pipeline
+    // (runtime/pie_runtime.h).
+    auto fieldInfoType = llvm::StructType::create(
+        context, { bytePtr, i32, i32, i32, i32 }, "struct.pie_field_info");
+    auto actionInfoType = llvm::StructType::create(
+        context, { bytePtr, i32, i32, llvm::PointerType::getUnqual(fieldInfoType) },
+        "struct.pie_action_info");
+    auto tableInfoType = llvm::StructType::create(
+        context, { bytePtr, i32, i32, i32, i32, llvm::PointerType::getUnqual(fieldInfoType), i32,
+                   llvm::PointerType::getUnqual(actionInfoType) },
+        "struct.pie_table_info");
+    // Offsets and sizes in the action data are left for LLVM to fold.
+    auto truncate = [&](llvm::Constant* value) {
+        return llvm::ConstantExpr::getTrunc(value, i32);
+    };
+    std::vector<llvm::Constant*> tableInfos;
+    for (auto table : tables) {
+        std::vector<llvm::Constant*> keyInfos;
+        for (auto& field : table->keys) {
+            keyInfos.push_back(llvm::ConstantStruct::get(fieldInfoType, {
+                string(field.name), ir.getInt32(field.match), ir.getInt32(field.width),
+                ir.getInt32(field.offset), ir.getInt32(field.size),
+            }));
+        }
+        std::vector<llvm::Constant*> actionInfos;
+        for (size_t id = 0; id < table->actions.size(); id++) {
+            auto action = table->declarations.at(id);
+            auto data = table->dataTypes.at(id);
+            std::vector<llvm::Constant*> paramInfos;
+            unsigned index = 0;
+            for (auto param : action->parameters->parameters) {
+                if (param->direction != IR::Direction::None || data == nullptr)
+                    continue;
+                auto fieldType = data->getElementType(index);
+                paramInfos.push_back(llvm::ConstantStruct::get(fieldInfoType, {
+                    string(param->controlPlaneName()), ir.getInt32(0),
+                    ir.getInt32(typeMap->getType(param, true)->width_bits()),
+                    truncate(llvm::ConstantExpr::getOffsetOf(data, index++)),
+                    truncate(llvm::ConstantExpr::getSizeOf(fieldType)),
+                }));
+            }
+            actionInfos.push_back(llvm::ConstantStruct::get(actionInfoType, {
+                string(action->controlPlaneName()),
+                data != nullptr ? truncate(llvm::ConstantExpr::getSizeOf(data)) : ir.getInt32(0),
+                ir.getInt32(paramInfos.size()),
+                array(fieldInfoType, paramInfos, "pie.params"),
+            }));
+        }
+        tableInfos.push_back(llvm::ConstantStruct::get(tableInfoType, {
+            string(table->name), ir.getInt32(table->kind), ir.getInt32(table->keySize),
+            ir.getInt32(table->lpmStart), ir.getInt32(keyInfos.size()),
+            array(fieldInfoType, keyInfos, "pie.keys"), ir.getInt32(actionInfos.size()),
+            array(actionInfoType, actionInfos, "pie.actions"),
+        }));
+    }
+    auto pipelineType = llvm::StructType::create(
+        context, { i32, bytePtr, processPacket->getType(), processBurst->getType(), i32,
+                   llvm::PointerType::getUnqual(tableInfoType) },
+        "struct.pie_pipeline");
+    auto pipeline = new llvm::GlobalVariable(
+        module, pipelineType, true, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantStruct::get(pipelineType, {
+            ir.getInt32(PIE_ABI_VERSION), string(options.file.string()), processPacket,
+            processBurst, ir.getInt32(tables.size()),
+            array(tableInfoType, tableInfos, "pie.tables"),
+        }),
+        "pie.pipeline");
+    auto initialized = new llvm::GlobalVariable(
+        module, ir.getInt1Ty(), false, llvm::GlobalValue::PrivateLinkage, ir.getFalse(),
+        "pie.initialized");
+    auto pipelinePtr = llvm::PointerType::getUnqual(pipelineType);
+
+    auto create = llvm::Function::Create(llvm::FunctionType::get(pipelinePtr, false),
+                                         llvm::Function::ExternalLinkage, PIE_PIPELINE_CREATE,
+                                         &module);
+    auto entry = llvm::BasicBlock::Create(context, "entry", create);
+    auto first = llvm::BasicBlock::Create(context, "init", create);
+    auto done = llvm::BasicBlock::Create(context, "done", create);
+    ir.SetInsertPoint(entry);
+    ir.CreateCondBr(ir.CreateLoad(ir.getInt1Ty(), initialized), done, first);
+    ir.SetInsertPoint(first);
+    ir.CreateCall(init);
+    ir.CreateStore(ir.getTrue(), initialized);
+    ir.CreateBr(done);
+    ir.SetInsertPoint(done);
+    ir.CreateRet(pipeline);
+
+    auto destroy = llvm::Function::Create(
+        llvm::FunctionType::get(ir.getVoidTy(), { pipelinePtr }, false),
+        llvm::Function::ExternalLinkage, "pie_pipeline_destroy", &module);
+    destroy->getArg(0)->setName("pipeline");
+    ir.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", destroy));
+    auto destroyTable = builder.declare_function("pie_table_destroy", ir.getVoidTy(),
+                                                 { bytePtr });
+    for (auto table : tables) {
+        ir.CreateCall(destroyTable, { ir.CreateLoad(bytePtr, table->global) });
+        ir.CreateStore(llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(bytePtr)),
+                       table->global);
+    }
+    externs.emit_destroy();
+    ir.CreateStore(ir.getFalse(), initialized);
+    ir.CreateRetVoid();
+}
+
+void PieBackend::print_stats(std::ostream& out) const
+{
+    auto& module = builder.get_module();
+    std::vector<const llvm::Function*> functions = {
+        parserFunction, verifyFunction, ingressFunction, egressFunction, computeFunction,
+        deparserFunction, module.getFunction(PIE_PROCESS_PACKET),
+        module.getFunction(PIE_PROCESS_BURST),
+    };
+    out << boost::format("%-40s %12s %7s %6s %6s %6s\n") % "function" % "instructions" %
+               "blocks" % "loads" % "stores" % "calls";
+    for (auto function : functions) {
+        if (function == nullptr)
+            continue;
+        unsigned instructions = 0, loads = 0, stores = 0, calls = 0;
+        for (auto& instruction : llvm::instructions(function)) {
+            instructions++;
+            loads += llvm::isa<llvm::LoadInst>(instruction);
+            stores += llvm::isa<llvm::StoreInst>(instruction);
+            calls += llvm::isa<llvm::CallBase>(instruction);
+        }
+        out << boost::format("%-40s %12u %7u %6u %6u %6u\n") % function->getName().str() %
+                   instructions % function->size() % loads % stores % calls;
+    }
+}
+
+void PieBackend::copy_metadata(llvm::Value* meta, llvm::Value* standard,
+                               const IR::Type_Struct* type, bool in)
+{
+    auto& ir = builder.get_builder();
+    auto layout = types.get_layout(type);
+    unsigned metaIndex = 0;
+    for (auto& field : metadataFields) {
+        auto metaAddress = ir.CreateStructGEP(metadataType, meta, metaIndex++);
+        auto p4Field = type->getField(cstring(field.name));
+        if (p4Field == nullptr)
+            continue;
+        auto valueType = types.value_type(p4Field->type);
+        auto storageType = types.storage_type(p4Field->type);
+        auto p4Address = ir.CreateStructGEP(layout->type, standard,
+                                            layout->fieldIndex.at(p4Field->name.name));
+        if (in) {
+            auto value = ir.CreateLoad(ir.getIntNTy(field.width), metaAddress);
+            value = ir.CreateZExtOrTrunc(value, valueType);
+            ir.CreateStore(ir.CreateZExtOrTrunc(value, storageType), p4Address);
+        } else {
+            auto value = ir.CreateLoad(storageType, p4Address);
+            value = ir.CreateZExtOrTrunc(value, valueType);
+            ir.CreateStore(ir.CreateZExtOrTrunc(value, ir.getIntNTy(field.width)), metaAddress);
+        }
+    }
+}
+
+}  // end of namespace pie
@@ -1,42 +1,94 @@
-#ifndef __BACKENDS_PIE_PARSER_H__
-#define __BACKENDS_PIE_PARSER_H__
+#ifndef __BACKENDS_PIE_BACKEND_H__
+#define __BACKENDS_PIE_BACKEND_H__
 
 #include "ir/ir.h"
-#include "lib/json.h"
 #include "frontends/p4/typeMap.h"
 #include "frontends/common/resolveReferences/referenceMap.h"
+#include "dirty.h"
+#include "externs.h"
+#include "llvm-ir.h"
+#include "options.h"
+#include "profile.h"
+#include "table.h"
+#include "type.h"
 
 namespace pie {
 
-class PieParser : public Inspector
+/// Generates the LLVM module for a v1model `V1Switch` program.
+///
+/// Besides one function per P4 block, the module exports the pipeline entry
+///
+///     i32 process_packet(i8* packet, size_t length, pie_metadata* meta)
+///
+/// declared in runtime/pie_runtime.h, its burst variant pie_process_burst(),
+/// pie_init(), which creates the tables and externs, and the stable interface of
+/// pie_runtime.h: pie_pipeline_create() returns a descriptor of the pipeline
+/// and its tables. Packets go through the parser,
+/// checksum verification, ingress, egress, checksum update and deparser; a
+/// packet whose egress_spec is the drop port after ingress or egress is
+/// dropped.
+///
+/// With --profile-generate the pipeline counts what it does (see
+/// PieProfile); with --profile-use the code generators follow such counts.
+class PieBackend
 {
  public:
-    llvm::Function *printfFunction = nullptr;
-    PieParser(llvm::LLVMContext& context,
-        llvm::Module& module,
-        llvm::IRBuilder<>& builder)
-        : context(context)
-        , module(module)
-        , builder(builder) {}
-
-    bool preorder(const IR::ParserState* state) override
-    {
-        auto name = state->name.name.c_str();
-        printf("visit state: %s\n", name);
-        cstring msg("    the parser found a state: ");
-        msg += name;
-        msg += "\n";
-        builder.CreateCall(printfFunction, builder.CreateGlobalStringPtr(msg.c_str()));
-        return false;
-    }
+    PieBackend(const PieOptions& options, PieIrBuilder& builder, P4::ReferenceMap* refMap,
+               P4::TypeMap* typeMap)
+        : options(options)
+        , builder(builder)
+        , refMap(refMap)
+        , typeMap(typeMap)
+        , types(builder, typeMap)
+        , dirty(refMap, typeMap)
+        , profile(builder)
+        , externs(builder, typeMap, types) {}
+
+    bool build(const IR::ToplevelBlock* toplevel);
+
+    /// Prints the size of the code of every P4 block and of the entry points
+    /// as they are now, so after PieIrBuilder::optimize() to see what the
+    /// code generator will get.
+    void print_stats(std::ostream& out) const;
+
  private:
-    llvm::LLVMContext& context;
-    llvm::Module& module;
-    llvm::IRBuilder<>& builder;
-    P4::ReferenceMap*    refMap = nullptr;
-    P4::TypeMap*         typeMap = nullptr;
+    const IR::CompileTimeValue* find_block(const IR::PackageBlock* main, cstring name);
+    const IR::P4Control* find_control(const IR::PackageBlock* main, cstring name);
+    llvm::Function* build_control(const IR::PackageBlock* main, cstring name,
+                                  llvm::BasicBlock* init);
+    llvm::Function* build_process_packet();
+    /// Loops over a burst calling `processPacket`, prefetching the packet
+    /// and metadata `options.prefetchDistance` iterations ahead.
+    llvm::Function* build_process_burst(llvm::Function* processPacket);
+    /// The `struct pie_pipeline` descriptor, pie_pipeline_create() and
+    /// pie_pipeline_destroy().
+    void build_pipeline(llvm::Function* init, llvm::Function* processPacket,
+                        llvm::Function* processBurst);
+    /// Copies the fields of `pie_metadata` from (`in`) or to the v1model
+    /// standard metadata held at `standard`.
+    void copy_metadata(llvm::Value* meta, llvm::Value* standard, const IR::Type_Struct* type,
+                       bool in);
+
+    const PieOptions& options;
+    PieIrBuilder& builder;
+    P4::ReferenceMap* refMap;
+    P4::TypeMap* typeMap;
+    PieTypeFactory types;
+    PieDirtyFields dirty;
+    PieProfile profile;
+    PieExterns externs;
+    llvm::StructType* metadataType = nullptr;
+    const IR::P4Parser* parser = nullptr;
+    llvm::Function* parserFunction = nullptr;
+    llvm::Function* verifyFunction = nullptr;
+    llvm::Function* ingressFunction = nullptr;
+    llvm::Function* egressFunction = nullptr;
+    llvm::Function* computeFunction = nullptr;
+    llvm::Function* deparserFunction = nullptr;
+    /// The tables of all controls, in the order they were created.
+    std::vector<PieTable*> tables;
 };
 
 }  // end of namespace pie
 
-#endif  // end of __BACKENDS_PIE_PARSER_H__
\ No newline at end of file
+#endif  // end of __BACKENDS_PIE_BACKEND_H__
@@ -0,0 +1,163 @@
+/*
+ * Lookup rate of the runtime tables, in millions of packets per second on
+ * one core: an exact table on the IPv4 destination and a DIR-24-8 LPM
+ * table on the same address, for tables that fit in the caches and tables
+ * that do not.
+ *
+ * Keys are read from packet buffers spread over a 32 MiB pool, as a worker
+ * finds them in a ring, which is evicted from the caches before each run. Each table is looked
+ * up packet by packet, then in bursts of 32 where the headers of packet
+ * i + 4 are prefetched while packet i is looked up, as pie_process_burst()
+ * does by default.
+ *
+ * Usage: pie-table-bench [packets per run]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "backends/pie/runtime/pie_runtime.h"
+
+#define POOL_PACKETS 16384
+#define PACKET_SIZE 2048
+#define DST_OFFSET 30   /* IPv4 destination in an untagged Ethernet frame */
+#define BURST 32
+#define DISTANCE 4
+
+struct params
+{
+    uint32_t port;
+};
+
+static uint8_t* pool;
+static uint8_t* burst[BURST];
+static volatile uint32_t sink;
+
+/* xorshift, so that runs use the same keys. */
+static uint32_t next_random(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static uint32_t entry_address(uint32_t i)
+{
+    return 0x0a000000u + i * 0x97u;   /* spread over 10/8 */
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Fills the pool with packets to addresses of the `entries` entries. */
+static void fill_pool(uint32_t entries)
+{
+    uint32_t state = 2463534242u;
+    for (uint32_t i = 0; i < POOL_PACKETS; i++) {
+        uint32_t address = entry_address(next_random(&state) % entries);
+        uint8_t* dst = pool + (size_t)i * PACKET_SIZE + DST_OFFSET;
+        dst[0] = address >> 24;
+        dst[1] = address >> 16;
+        dst[2] = address >> 8;
+        dst[3] = address;
+    }
+}
+
+/* Evicts the pool from the caches between runs. */
+static void flush_pool(void)
+{
+    static uint8_t* scratch;
+    const size_t size = 256u << 20;
+    if (scratch == NULL)
+        scratch = malloc(size);
+    memset(scratch, (int)sink, size);
+    sink += scratch[size / 2];
+}
+
+static double run_single(struct pie_table* table, uint32_t packets)
+{
+    uint32_t sum = 0;
+    double start = now();
+    for (uint32_t i = 0; i < packets; i++) {
+        const uint8_t* packet = pool + (size_t)(i % POOL_PACKETS) * PACKET_SIZE;
+        sum += pie_table_lookup(table, packet + DST_OFFSET)->hit;
+    }
+    double elapsed = now() - start;
+    sink += sum;
+    return packets / elapsed / 1e6;
+}
+
+static double run_burst(struct pie_table* table, uint32_t packets)
+{
+    uint32_t sum = 0;
+    double start = now();
+    for (uint32_t first = 0; first < packets; first += BURST) {
+        for (uint32_t i = 0; i < BURST; i++)
+            burst[i] = pool + (size_t)((first + i) % POOL_PACKETS) * PACKET_SIZE;
+        for (uint32_t i = 0; i < BURST; i++) {
+            uint32_t ahead = i + DISTANCE < BURST ? i + DISTANCE : BURST - 1;
+            __builtin_prefetch(burst[ahead], 0);
+            __builtin_prefetch(burst[ahead] + 64, 0);
+            sum += pie_table_lookup(table, burst[i] + DST_OFFSET)->hit;
+        }
+    }
+    double elapsed = now() - start;
+    sink += sum;
+    return packets / elapsed / 1e6;
+}
+
+static void bench(const char* kind_name, uint32_t kind, uint32_t entries, uint32_t packets)
+{
+    struct pie_table* table = pie_table_create("bench", kind, 4, 0, sizeof(struct params),
+                                               entries);
+    if (table == NULL) {
+        fprintf(stderr, "cannot create a %s table of %u entries\n", kind_name, entries);
+        exit(1);
+    }
+    for (uint32_t i = 0; i < entries; i++) {
+        uint32_t address = entry_address(i);
+        uint8_t key[4] = { address >> 24, address >> 16, address >> 8, address };
+        struct params params = { i };
+        if (pie_table_add(table, key, NULL, 32, 0, 1, &params) != 0) {
+            fprintf(stderr, "cannot add entry %u to the %s table\n", i, kind_name);
+            exit(1);
+        }
+    }
+    pie_table_seal(table);
+    fill_pool(entries);
+
+    flush_pool();
+    double single = run_single(table, packets);
+    flush_pool();
+    double bursts = run_burst(table, packets);
+    printf("%-6s %8u entries: %7.1f Mpps one by one, %7.1f Mpps in bursts of %u\n", kind_name,
+           entries, single, bursts, BURST);
+    pie_table_destroy(table);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t packets = argc > 1 ? (uint32_t)strtoul(argv[1], NULL, 0) : 10000000;
+    packets -= packets % BURST;
+    pool = calloc(POOL_PACKETS, PACKET_SIZE);
+    if (pool == NULL || packets == 0) {
+        fprintf(stderr, "usage: %s [packets per run]\n", argv[0]);
+        return 1;
+    }
+    static const uint32_t sizes[] = { 1024, 65536, 1048576 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        bench("exact", PIE_TABLE_EXACT, sizes[i], packets);
+        bench("lpm", PIE_TABLE_LPM, sizes[i], packets);
+    }
+    return 0;
+}
@@ -0,0 +1,770 @@
+#include "codegen.h"
+
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Intrinsics.h>
+
+#include "lib/error.h"
+
+namespace pie {
+
+llvm::Value* PieCodeGen::emit_expression(const IR::Expression* expression)
+{
+    result = nullptr;
+    visit(expression);
+    auto value = result;
+    result = nullptr;
+    return value;
+}
+
+void PieCodeGen::emit_statement(const IR::StatOrDecl* statement)
+{
+    builder.ensure_open_block();
+    visit(statement);
+}
+
+llvm::Value* PieCodeGen::emit_address(const IR::Expression* expression)
+{
+    if (auto path = expression->to<IR::PathExpression>()) {
+        auto decl = refMap->getDeclaration(path->path, true);
+        auto it = storage.find(decl);
+        if (it == storage.end()) {
+            ::error(ErrorType::ERR_UNSUPPORTED, "%1%: cannot be used as a location", expression);
+            return builder.create_entry_alloca(types.storage_type(type_of(expression)), "bad");
+        }
+        return it->second;
+    }
+    if (auto member = expression->to<IR::Member>()) {
+        auto baseType = type_of(member->expr);
+        auto base = emit_address(member->expr);
+        if (auto stack = baseType->to<IR::Type_Stack>()) {
+            auto next = stack_next_index(base, stack);
+            if (member->member.name == IR::Type_Stack::next)
+                return stack_element(base, stack, next);
+            if (member->member.name == IR::Type_Stack::last)
+                return stack_element(base, stack, ir().CreateSub(next, ir().getInt32(1)));
+        }
+        if (auto st = baseType->to<IR::Type_StructLike>()) {
+            auto layout = types.get_layout(st);
+            auto field = layout->fieldIndex.find(member->member.name);
+            if (field != layout->fieldIndex.end())
+                return ir().CreateStructGEP(layout->type, base, field->second);
+        }
+    }
+    if (auto index = expression->to<IR::ArrayIndex>()) {
+        auto stack = type_of(index->left)->to<IR::Type_Stack>();
+        BUG_CHECK(stack != nullptr, "%1%: expected a header stack", index->left);
+        auto base = emit_address(index->left);
+        auto element = ir().CreateZExtOrTrunc(emit_expression(index->right), ir().getInt32Ty());
+        return stack_element(base, stack, element);
+    }
+    ::error(ErrorType::ERR_UNSUPPORTED, "%1%: cannot be used as a location", expression);
+    return builder.create_entry_alloca(types.storage_type(type_of(expression)), "bad");
+}
+
+llvm::Value* PieCodeGen::stack_next_index(llvm::Value* stack, const IR::Type_Stack* type)
+{
+    auto stackType = types.storage_type(type);
+    return ir().CreateLoad(ir().getInt32Ty(), ir().CreateStructGEP(stackType, stack, 1));
+}
+
+llvm::Value* PieCodeGen::stack_element(llvm::Value* stack, const IR::Type_Stack* type,
+                                       llvm::Value* index)
+{
+    // Out-of-range indices must not escape the stack storage: clamp them.
+    auto last = ir().getInt32(type->getSize() - 1);
+    index = ir().CreateSelect(ir().CreateICmpULE(index, last), index, last);
+    auto stackType = types.storage_type(type);
+    return ir().CreateInBoundsGEP(stackType, stack, {ir().getInt32(0), ir().getInt32(0), index});
+}
+
+llvm::Value* PieCodeGen::valid_address(llvm::Value* header, const IR::Type_Header* type)
+{
+    auto layout = types.get_layout(type);
+    return ir().CreateStructGEP(layout->type, header, layout->validIndex);
+}
+
+llvm::Value* PieCodeGen::origin_address(llvm::Value* header, const IR::Type_Header* type)
+{
+    auto layout = types.get_layout(type);
+    return ir().CreateStructGEP(layout->type, header, layout->originIndex);
+}
+
+llvm::StructType* PieCodeGen::context_type(PieIrBuilder& builder)
+{
+    auto& b = builder.get_builder();
+    return builder.get_struct_type("struct.pie_context", {
+        builder.get_byte_ptr_type(), b.getInt32Ty(), b.getInt32Ty(), b.getInt32Ty(),
+        b.getInt32Ty(), b.getInt32Ty(),
+    });
+}
+
+llvm::Value* PieCodeGen::context_field(llvm::Value* context, unsigned field)
+{
+    return ir().CreateStructGEP(context_type(builder), context, field);
+}
+
+llvm::Value* PieCodeGen::header_bits(llvm::Value* header, const IR::Type_Header* type)
+{
+    auto layout = types.get_layout(type);
+    llvm::Value* bits = nullptr;
+    unsigned width = 0;
+    for (auto field : type->fields) {
+        auto address = ir().CreateStructGEP(layout->type, header,
+                                            layout->fieldIndex.at(field->name.name));
+        auto value = load_value(address, field->type);
+        auto fieldWidth = types.value_width(field->type);
+        width += fieldWidth;
+        auto wide = ir().getIntNTy(width);
+        value = ir().CreateZExt(value, wide);
+        bits = bits ? ir().CreateOr(ir().CreateShl(ir().CreateZExt(bits, wide), fieldWidth),
+                                    value)
+                    : value;
+    }
+    return bits;
+}
+
+llvm::Value* PieCodeGen::load_value(llvm::Value* address, const IR::Type* type)
+{
+    type = types.canonical(type);
+    auto storageType = types.storage_type(type);
+    auto value = ir().CreateLoad(storageType, address);
+    if (type->is<IR::Type_Boolean>())
+        return ir().CreateICmpNE(value, ir().getInt8(0));
+    if (!storageType->isIntegerTy())
+        return value;
+    return ir().CreateTrunc(value, types.value_type(type));
+}
+
+void PieCodeGen::store_value(llvm::Value* address, const IR::Type* type, llvm::Value* value)
+{
+    auto storageType = types.storage_type(type);
+    if (storageType->isIntegerTy())
+        value = ir().CreateZExt(value, storageType);
+    ir().CreateStore(value, address);
+}
+
+void PieCodeGen::assign(llvm::Value* address, const IR::Type* type, const IR::Expression* value)
+{
+    type = types.canonical(type);
+    if (auto st = type->to<IR::Type_StructLike>()) {
+        auto layout = types.get_layout(st);
+        if (auto se = value->to<IR::StructExpression>()) {
+            for (auto component : se->components) {
+                auto field = st->getField(component->name);
+                auto index = layout->fieldIndex.at(component->name.name);
+                assign(ir().CreateStructGEP(layout->type, address, index), field->type,
+                       component->expression);
+            }
+            if (layout->validIndex >= 0) {
+                auto header = st->to<IR::Type_Header>();
+                ir().CreateStore(ir().getInt8(1), valid_address(address, header));
+                ir().CreateStore(ir().getInt32(0), origin_address(address, header));
+            }
+            return;
+        }
+        if (value->is<IR::InvalidHeader>()) {
+            ir().CreateStore(ir().getInt8(0), valid_address(address, st->to<IR::Type_Header>()));
+            return;
+        }
+    }
+    if (type->is<IR::Type_StructLike>() || type->is<IR::Type_Stack>()) {
+        // Whole-aggregate copy, including the validity of headers.
+        auto storageType = types.storage_type(type);
+        auto source = emit_address(value);
+        ir().CreateStore(ir().CreateLoad(storageType, source), address);
+        return;
+    }
+    auto computed = convert(emit_expression(value), type_of(value), type);
+    store_value(address, type, computed);
+}
+
+void PieCodeGen::assign_slice(const IR::Slice* slice, const IR::Expression* value)
+{
+    auto baseType = type_of(slice->e0);
+    auto address = emit_address(slice->e0);
+    auto old = load_value(address, baseType);
+    auto width = old->getType()->getIntegerBitWidth();
+    auto low = slice->getL();
+    auto sliceWidth = slice->getH() - low + 1;
+
+    auto mask = llvm::APInt::getBitsSet(width, low, low + sliceWidth);
+    auto bits = ir().CreateZExtOrTrunc(emit_expression(value), old->getType());
+    bits = ir().CreateAnd(ir().CreateShl(bits, low), ir().getInt(mask));
+    auto cleared = ir().CreateAnd(old, ir().getInt(~mask));
+    store_value(address, baseType, ir().CreateOr(cleared, bits));
+}
+
+llvm::Value* PieCodeGen::convert(llvm::Value* value, const IR::Type* from, const IR::Type* to)
+{
+    from = types.canonical(from);
+    to = types.canonical(to);
+    auto target = types.value_type(to);
+    if (value->getType() == target || !target->isIntegerTy())
+        return value;
+    if (to->is<IR::Type_Boolean>())
+        return ir().CreateICmpNE(value, llvm::ConstantInt::get(value->getType(), 0));
+    return ir().CreateIntCast(value, target, is_signed(from));
+}
+
+llvm::Value* PieCodeGen::constant(const big_int& value, unsigned width)
+{
+    auto type = ir().getIntNTy(width);
+    big_int modulus = big_int(1) << width;
+    big_int v = value % modulus;
+    if (v < 0)
+        v += modulus;
+    if (width <= 64)
+        return llvm::ConstantInt::get(type, static_cast<uint64_t>(v));
+    return ir().getInt(llvm::APInt(width, v.str(), 10));
+}
+
+llvm::Value* PieCodeGen::error_code(cstring name)
+{
+    return ir().getInt32(types.error_code(name));
+}
+
+llvm::Value* PieCodeGen::member_constant(const IR::Member* expression)
+{
+    auto type = type_of(expression);
+    auto name = expression->member.name;
+    if (type->is<IR::Type_Error>())
+        return error_code(name);
+    if (auto enumType = type->to<IR::Type_Enum>()) {
+        unsigned index = 0;
+        for (auto member : enumType->members) {
+            if (member->name.name == name)
+                return ir().getInt32(index);
+            index++;
+        }
+    }
+    if (auto serEnum = type->to<IR::Type_SerEnum>()) {
+        auto member = serEnum->members.getDeclaration<IR::SerEnumMember>(name);
+        if (member != nullptr)
+            return convert(emit_expression(member->value), type_of(member->value), type);
+    }
+    ::error(ErrorType::ERR_UNSUPPORTED, "%1%: unsupported constant", expression);
+    return llvm::UndefValue::get(types.value_type(type));
+}
+
+void PieCodeGen::declare(const IR::Declaration_Variable* decl)
+{
+    auto type = types.canonical(decl->type);
+    auto address = builder.create_entry_alloca(types.storage_type(type), decl->name.name.c_str());
+    bind(decl, address);
+    if (decl->initializer != nullptr)
+        assign(address, type, decl->initializer);
+    else
+        ir().CreateStore(llvm::Constant::getNullValue(types.storage_type(type)), address);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Expressions
+
+bool PieCodeGen::preorder(const IR::Expression* expression)
+{
+    ::error(ErrorType::ERR_UNSUPPORTED, "%1%: expression not supported by the pie backend",
+            expression);
+    result = llvm::UndefValue::get(ir().getInt32Ty());
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::Constant* expression)
+{
+    auto type = type_of(expression);
+    unsigned width = type->is<IR::Type_Bits>() ? type->width_bits() : 64;
+    result = constant(expression->value, width);
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::BoolLiteral* expression)
+{
+    result = ir().getInt1(expression->value);
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::PathExpression* expression)
+{
+    auto decl = refMap->getDeclaration(expression->path, true);
+    if (auto constDecl = decl->to<IR::Declaration_Constant>()) {
+        result = convert(emit_expression(constDecl->initializer),
+                         type_of(constDecl->initializer), type_of(expression));
+        return false;
+    }
+    result = load_value(emit_address(expression), type_of(expression));
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::Member* expression)
+{
+    if (expression->expr->is<IR::TypeNameExpression>()) {
+        result = member_constant(expression);
+        return false;
+    }
+    if (auto stack = type_of(expression->expr)->to<IR::Type_Stack>()) {
+        auto name = expression->member.name;
+        if (name == IR::Type_Stack::arraySize) {
+            result = ir().getInt32(stack->getSize());
+            return false;
+        }
+        if (name == IR::Type_Stack::lastIndex) {
+            auto next = stack_next_index(emit_address(expression->expr), stack);
+            result = ir().CreateSub(next, ir().getInt32(1));
+            return false;
+        }
+    }
+    result = load_value(emit_address(expression), type_of(expression));
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::ArrayIndex* expression)
+{
+    result = load_value(emit_address(expression), type_of(expression));
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::Slice* expression)
+{
+    auto value = emit_expression(expression->e0);
+    auto width = expression->getH() - expression->getL() + 1;
+    if (expression->getL() != 0)
+        value = ir().CreateLShr(value, expression->getL());
+    result = ir().CreateTrunc(value, ir().getIntNTy(width));
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::Concat* expression)
+{
+    auto left = emit_expression(expression->left);
+    auto right = emit_expression(expression->right);
+    auto type = types.value_type(type_of(expression));
+    auto rightWidth = right->getType()->getIntegerBitWidth();
+    auto high = ir().CreateShl(ir().CreateZExt(left, type), rightWidth);
+    result = ir().CreateOr(high, ir().CreateZExt(right, type));
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::Cast* expression)
+{
+    auto value = emit_expression(expression->expr);
+    result = convert(value, type_of(expression->expr), type_of(expression));
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::Mux* expression)
+{
+    auto function = ir().GetInsertBlock()->getParent();
+    auto& context = builder.get_context();
+    auto trueBlock = llvm::BasicBlock::Create(context, "mux.true", function);
+    auto falseBlock = llvm::BasicBlock::Create(context, "mux.false", function);
+    auto endBlock = llvm::BasicBlock::Create(context, "mux.end", function);
+
+    ir().CreateCondBr(emit_expression(expression->e0), trueBlock, falseBlock);
+    ir().SetInsertPoint(trueBlock);
+    auto trueValue = emit_expression(expression->e1);
+    trueBlock = ir().GetInsertBlock();
+    ir().CreateBr(endBlock);
+    ir().SetInsertPoint(falseBlock);
+    auto falseValue = emit_expression(expression->e2);
+    falseBlock = ir().GetInsertBlock();
+    ir().CreateBr(endBlock);
+
+    ir().SetInsertPoint(endBlock);
+    auto phi = ir().CreatePHI(trueValue->getType(), 2);
+    phi->addIncoming(trueValue, trueBlock);
+    phi->addIncoming(falseValue, falseBlock);
+    result = phi;
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::Neg* expression)
+{
+    result = ir().CreateNeg(emit_expression(expression->expr));
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::Cmpl* expression)
+{
+    result = ir().CreateNot(emit_expression(expression->expr));
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::LNot* expression)
+{
+    result = ir().CreateNot(emit_expression(expression->expr));
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::UPlus* expression)
+{
+    result = emit_expression(expression->expr);
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::LAnd* expression)
+{
+    // Short-circuit evaluation: the right operand may have side effects.
+    auto function = ir().GetInsertBlock()->getParent();
+    auto& context = builder.get_context();
+    auto left = emit_expression(expression->left);
+    auto leftBlock = ir().GetInsertBlock();
+    auto rightBlock = llvm::BasicBlock::Create(context, "and.rhs", function);
+    auto endBlock = llvm::BasicBlock::Create(context, "and.end", function);
+    ir().CreateCondBr(left, rightBlock, endBlock);
+    ir().SetInsertPoint(rightBlock);
+    auto right = emit_expression(expression->right);
+    rightBlock = ir().GetInsertBlock();
+    ir().CreateBr(endBlock);
+    ir().SetInsertPoint(endBlock);
+    auto phi = ir().CreatePHI(ir().getInt1Ty(), 2);
+    phi->addIncoming(ir().getFalse(), leftBlock);
+    phi->addIncoming(right, rightBlock);
+    result = phi;
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::LOr* expression)
+{
+    auto function = ir().GetInsertBlock()->getParent();
+    auto& context = builder.get_context();
+    auto left = emit_expression(expression->left);
+    auto leftBlock = ir().GetInsertBlock();
+    auto rightBlock = llvm::BasicBlock::Create(context, "or.rhs", function);
+    auto endBlock = llvm::BasicBlock::Create(context, "or.end", function);
+    ir().CreateCondBr(left, endBlock, rightBlock);
+    ir().SetInsertPoint(rightBlock);
+    auto right = emit_expression(expression->right);
+    rightBlock = ir().GetInsertBlock();
+    ir().CreateBr(endBlock);
+    ir().SetInsertPoint(endBlock);
+    auto phi = ir().CreatePHI(ir().getInt1Ty(), 2);
+    phi->addIncoming(ir().getTrue(), leftBlock);
+    phi->addIncoming(right, rightBlock);
+    result = phi;
+    return false;
+}
+
+llvm::Value* PieCodeGen::shift_out_of_range(llvm::Value* amount, unsigned width)
+{
+    auto amountWidth = amount->getType()->getIntegerBitWidth();
+    if (amountWidth < 32 && width >= (1u << amountWidth))
+        return ir().getFalse();
+    return ir().CreateICmpUGE(amount, llvm::ConstantInt::get(amount->getType(), width));
+}
+
+bool PieCodeGen::preorder(const IR::Shl* expression)
+{
+    // P4 defines shifts by at least the width to produce 0; LLVM does not.
+    auto value = emit_expression(expression->left);
+    auto amount = emit_expression(expression->right);
+    auto width = value->getType()->getIntegerBitWidth();
+    auto tooLarge = shift_out_of_range(amount, width);
+    auto shifted = ir().CreateShl(value, ir().CreateZExtOrTrunc(amount, value->getType()));
+    result = ir().CreateSelect(tooLarge, llvm::ConstantInt::get(value->getType(), 0), shifted);
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::Shr* expression)
+{
+    auto value = emit_expression(expression->left);
+    auto amount = emit_expression(expression->right);
+    auto valueType = value->getType();
+    auto width = valueType->getIntegerBitWidth();
+    auto tooLarge = shift_out_of_range(amount, width);
+    amount = ir().CreateZExtOrTrunc(amount, valueType);
+    if (is_signed(type_of(expression->left))) {
+        auto saturated = ir().CreateSelect(tooLarge, llvm::ConstantInt::get(valueType, width - 1),
+                                           amount);
+        result = ir().CreateAShr(value, saturated);
+    } else {
+        result = ir().CreateSelect(tooLarge, llvm::ConstantInt::get(valueType, 0),
+                                   ir().CreateLShr(value, amount));
+    }
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::Operation_Relation* expression)
+{
+    auto leftType = type_of(expression->left);
+    if (!leftType->is<IR::Type_Bits>() && !leftType->is<IR::Type_Boolean>() &&
+        !leftType->is<IR::Type_InfInt>() && !leftType->is<IR::Type_Error>() &&
+        !leftType->is<IR::Type_Enum>() && !leftType->is<IR::Type_SerEnum>()) {
+        ::error(ErrorType::ERR_UNSUPPORTED, "%1%: comparison of %2% values not supported",
+                expression, leftType);
+        result = ir().getFalse();
+        return false;
+    }
+    auto left = emit_expression(expression->left);
+    auto right = ir().CreateIntCast(emit_expression(expression->right), left->getType(),
+                                    is_signed(type_of(expression->right)));
+    bool isSigned = is_signed(leftType);
+    if (expression->is<IR::Equ>())
+        result = ir().CreateICmpEQ(left, right);
+    else if (expression->is<IR::Neq>())
+        result = ir().CreateICmpNE(left, right);
+    else if (expression->is<IR::Lss>())
+        result = isSigned ? ir().CreateICmpSLT(left, right) : ir().CreateICmpULT(left, right);
+    else if (expression->is<IR::Leq>())
+        result = isSigned ? ir().CreateICmpSLE(left, right) : ir().CreateICmpULE(left, right);
+    else if (expression->is<IR::Grt>())
+        result = isSigned ? ir().CreateICmpSGT(left, right) : ir().CreateICmpUGT(left, right);
+    else if (expression->is<IR::Geq>())
+        result = isSigned ? ir().CreateICmpSGE(left, right) : ir().CreateICmpUGE(left, right);
+    else
+        BUG("%1%: unexpected relation", expression);
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::Operation_Binary* expression)
+{
+    auto left = emit_expression(expression->left);
+    auto right = ir().CreateIntCast(emit_expression(expression->right), left->getType(),
+                                    is_signed(type_of(expression->right)));
+    bool isSigned = is_signed(type_of(expression->left));
+    llvm::Value* value = nullptr;
+    if (expression->is<IR::Add>()) {
+        value = ir().CreateAdd(left, right);
+    } else if (expression->is<IR::Sub>()) {
+        value = ir().CreateSub(left, right);
+    } else if (expression->is<IR::Mul>()) {
+        value = ir().CreateMul(left, right);
+    } else if (expression->is<IR::Div>()) {
+        value = ir().CreateUDiv(left, right);
+    } else if (expression->is<IR::Mod>()) {
+        value = ir().CreateURem(left, right);
+    } else if (expression->is<IR::BAnd>()) {
+        value = ir().CreateAnd(left, right);
+    } else if (expression->is<IR::BOr>()) {
+        value = ir().CreateOr(left, right);
+    } else if (expression->is<IR::BXor>()) {
+        value = ir().CreateXor(left, right);
+    } else if (expression->is<IR::AddSat>()) {
+        auto id = isSigned ? llvm::Intrinsic::sadd_sat : llvm::Intrinsic::uadd_sat;
+        value = ir().CreateBinaryIntrinsic(id, left, right);
+    } else if (expression->is<IR::SubSat>()) {
+        auto id = isSigned ? llvm::Intrinsic::ssub_sat : llvm::Intrinsic::usub_sat;
+        value = ir().CreateBinaryIntrinsic(id, left, right);
+    } else {
+        ::error(ErrorType::ERR_UNSUPPORTED, "%1%: operation not supported by the pie backend",
+                expression);
+        value = left;
+    }
+    result = ir().CreateIntCast(value, types.value_type(type_of(expression)), isSigned);
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::MethodCallExpression* expression)
+{
+    auto instance = P4::MethodInstance::resolve(expression, refMap, typeMap);
+    result = nullptr;
+    emit_method_call(instance);
+    return false;
+}
+
+void PieCodeGen::emit_method_call(const P4::MethodInstance* instance)
+{
+    if (auto builtin = instance->to<P4::BuiltInMethod>()) {
+        emit_builtin(builtin);
+        return;
+    }
+    ::error(ErrorType::ERR_UNSUPPORTED, "%1%: method call not supported by the pie backend",
+            instance->expr);
+}
+
+void PieCodeGen::emit_builtin(const P4::BuiltInMethod* builtin)
+{
+    auto name = builtin->name.name;
+    auto type = type_of(builtin->appliedTo);
+    if (name == IR::Type_Stack::push_front || name == IR::Type_Stack::pop_front) {
+        stack_shift(builtin, name == IR::Type_Stack::push_front);
+        return;
+    }
+    auto address = emit_address(builtin->appliedTo);
+    if (auto header = type->to<IR::Type_Header>()) {
+        auto valid = valid_address(address, header);
+        if (name == IR::Type_Header::isValid)
+            result = ir().CreateICmpNE(ir().CreateLoad(ir().getInt8Ty(), valid), ir().getInt8(0));
+        else if (name == IR::Type_Header::setValid)
+            ir().CreateStore(ir().getInt8(1), valid);
+        else if (name == IR::Type_Header::setInvalid)
+            ir().CreateStore(ir().getInt8(0), valid);
+        else
+            BUG("%1%: unexpected builtin", builtin->expr);
+        return;
+    }
+    if (auto headerUnion = type->to<IR::Type_HeaderUnion>()) {
+        // A union is valid when any of its headers is.
+        auto layout = types.get_layout(headerUnion);
+        llvm::Value* any = ir().getFalse();
+        for (auto field : headerUnion->fields) {
+            auto headerType = types.canonical(field->type)->to<IR::Type_Header>();
+            auto header = ir().CreateStructGEP(layout->type, address,
+                                               layout->fieldIndex.at(field->name.name));
+            auto valid = ir().CreateLoad(ir().getInt8Ty(), valid_address(header, headerType));
+            any = ir().CreateOr(any, ir().CreateICmpNE(valid, ir().getInt8(0)));
+        }
+        result = any;
+        return;
+    }
+    ::error(ErrorType::ERR_UNSUPPORTED, "%1%: method call not supported by the pie backend",
+            builtin->expr);
+}
+
+void PieCodeGen::stack_shift(const P4::BuiltInMethod* builtin, bool push)
+{
+    auto stack = type_of(builtin->appliedTo)->to<IR::Type_Stack>();
+    auto count = builtin->expr->arguments->at(0)->expression->to<IR::Constant>();
+    if (count == nullptr) {
+        ::error(ErrorType::ERR_UNSUPPORTED, "%1%: the shift amount must be a constant",
+                builtin->expr);
+        return;
+    }
+    auto address = emit_address(builtin->appliedTo);
+    auto stackType = types.storage_type(stack);
+    auto headerType = types.canonical(stack->elementType)->to<IR::Type_Header>();
+    auto elementType = types.storage_type(headerType);
+    unsigned size = stack->getSize();
+    unsigned amount = std::min(count->asUnsigned(), size);
+    auto element = [&](unsigned index) {
+        return ir().CreateInBoundsGEP(stackType, address,
+                                      {ir().getInt32(0), ir().getInt32(0), ir().getInt32(index)});
+    };
+
+    if (push) {
+        for (unsigned i = size; i-- > amount;)
+            ir().CreateStore(ir().CreateLoad(elementType, element(i - amount)), element(i));
+        for (unsigned i = 0; i < amount; i++)
+            ir().CreateStore(ir().getInt8(0), valid_address(element(i), headerType));
+    } else {
+        for (unsigned i = 0; i + amount < size; i++)
+            ir().CreateStore(ir().CreateLoad(elementType, element(i + amount)), element(i));
+        for (unsigned i = size - amount; i < size; i++)
+            ir().CreateStore(ir().getInt8(0), valid_address(element(i), headerType));
+    }
+
+    auto nextAddress = ir().CreateStructGEP(stackType, address, 1);
+    auto next = ir().CreateLoad(ir().getInt32Ty(), nextAddress);
+    llvm::Value* updated = nullptr;
+    if (push) {
+        auto sum = ir().CreateAdd(next, ir().getInt32(amount));
+        updated = ir().CreateSelect(ir().CreateICmpULT(sum, ir().getInt32(size)), sum,
+                                    ir().getInt32(size));
+    } else {
+        updated = ir().CreateSelect(ir().CreateICmpUGE(next, ir().getInt32(amount)),
+                                    ir().CreateSub(next, ir().getInt32(amount)),
+                                    ir().getInt32(0));
+    }
+    ir().CreateStore(updated, nextAddress);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Statements
+
+bool PieCodeGen::preorder(const IR::Statement* statement)
+{
+    ::error(ErrorType::ERR_UNSUPPORTED, "%1%: statement not supported by the pie backend",
+            statement);
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::AssignmentStatement* statement)
+{
+    if (auto slice = statement->left->to<IR::Slice>()) {
+        assign_slice(slice, statement->right);
+        return false;
+    }
+    auto address = emit_address(statement->left);
+    assign(address, type_of(statement->left), statement->right);
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::MethodCallStatement* statement)
+{
+    emit_expression(statement->methodCall);
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::IfStatement* statement)
+{
+    auto function = ir().GetInsertBlock()->getParent();
+    auto& context = builder.get_context();
+    auto thenBlock = llvm::BasicBlock::Create(context, "if.then", function);
+    auto endBlock = llvm::BasicBlock::Create(context, "if.end", function);
+    auto elseBlock = endBlock;
+    if (statement->ifFalse != nullptr)
+        elseBlock = llvm::BasicBlock::Create(context, "if.else", function, endBlock);
+
+    ir().CreateCondBr(emit_expression(statement->condition), thenBlock, elseBlock);
+    ir().SetInsertPoint(thenBlock);
+    emit_statement(statement->ifTrue);
+    if (ir().GetInsertBlock()->getTerminator() == nullptr)
+        ir().CreateBr(endBlock);
+    if (statement->ifFalse != nullptr) {
+        ir().SetInsertPoint(elseBlock);
+        emit_statement(statement->ifFalse);
+        if (ir().GetInsertBlock()->getTerminator() == nullptr)
+            ir().CreateBr(endBlock);
+    }
+    ir().SetInsertPoint(endBlock);
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::BlockStatement* statement)
+{
+    for (auto component : statement->components)
+        emit_statement(component);
+    return false;
+}
+
+bool PieCodeGen::preorder(const IR::SwitchStatement* statement)
+{
+    auto function = ir().GetInsertBlock()->getParent();
+    auto& context = builder.get_context();
+    auto value = emit_expression(statement->expression);
+    auto endBlock = llvm::BasicBlock::Create(context, "switch.end", function);
+    auto inst = ir().CreateSwitch(value, endBlock, statement->cases.size());
+
+    std::vector<llvm::BasicBlock*> blocks;
+    for (auto c : statement->cases) {
+        auto block = llvm::BasicBlock::Create(context, "switch.case", function, endBlock);
+        blocks.push_back(block);
+        if (c->label->is<IR::DefaultExpression>()) {
+            inst->setDefaultDest(block);
+            continue;
+        }
+        auto label = llvm::dyn_cast<llvm::ConstantInt>(emit_switch_label(statement, c->label));
+        if (label == nullptr) {
+            ::error(ErrorType::ERR_UNSUPPORTED, "%1%: switch labels must be constants", c->label);
+            continue;
+        }
+        inst->addCase(label, block);
+    }
+    for (size_t i = 0; i < blocks.size(); i++) {
+        ir().SetInsertPoint(blocks[i]);
+        auto statementCase = statement->cases.at(i);
+        // A case without a statement falls through to the next one.
+        auto next = statementCase->statement != nullptr || i + 1 == blocks.size()
+                        ? endBlock : blocks[i + 1];
+        if (statementCase->statement != nullptr)
+            emit_statement(statementCase->statement);
+        if (ir().GetInsertBlock()->getTerminator() == nullptr)
+            ir().CreateBr(next);
+    }
+    ir().SetInsertPoint(endBlock);
+    return false;
+}
+
+llvm::Value* PieCodeGen::emit_switch_label(const IR::SwitchStatement*,
+                                           const IR::Expression* label)
+{
+    return emit_expression(label);
+}
+
+bool PieCodeGen::preorder(const IR::Declaration_Variable* decl)
+{
+    declare(decl);
+    return false;
+}
+
+}  // end of namespace pie
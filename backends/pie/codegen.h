@@ -0,0 +1,163 @@
+#ifndef __BACKENDS_PIE_CODEGEN_H__
+#define __BACKENDS_PIE_CODEGEN_H__
+
+#include <map>
+
+#include "ir/ir.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
+#include "frontends/p4/methodInstance.h"
+#include "frontends/p4/typeMap.h"
+#include "llvm-ir.h"
+#include "type.h"
+
+namespace pie {
+
+/// Lowers P4 expressions and statements into LLVM IR at the current
+/// insertion point of the builder.
+///
+/// Parameters and local variables live in memory (see `bind`); expressions
+/// are evaluated into SSA values. The parser, control and deparser
+/// generators derive from this class and add their own method calls.
+/// Entry points must be invoked from within an `apply` of this visitor.
+class PieCodeGen : public Inspector
+{
+ public:
+    PieCodeGen(PieIrBuilder& builder, P4::ReferenceMap* refMap, P4::TypeMap* typeMap,
+               PieTypeFactory& types)
+        : builder(builder)
+        , refMap(refMap)
+        , typeMap(typeMap)
+        , types(types)
+    {
+        visitDagOnce = false;
+    }
+
+    /// Per-packet state that the pipeline passes to every control and to
+    /// the deparser as a hidden first argument:
+    ///
+    ///     struct pie_context { i8* packet; i32 length; i32 consumed;
+    ///                          i32 checksum_error; i32 meter_color;
+    ///                          i32 checksum_verified; }
+    ///
+    /// meter_color is the color that the direct meter of the last table
+    /// applied gave the packet, for direct_meter.read(). checksum_verified
+    /// has the bits, numbered by PieDirtyFields::verified_bit(), of the
+    /// checksums that passed verification.
+    enum ContextField {
+        CONTEXT_PACKET = 0,
+        CONTEXT_LENGTH = 1,
+        CONTEXT_CONSUMED = 2,
+        CONTEXT_CHECKSUM_ERROR = 3,
+        CONTEXT_METER_COLOR = 4,
+        CONTEXT_CHECKSUM_VERIFIED = 5,
+    };
+    static llvm::StructType* context_type(PieIrBuilder& builder);
+
+    /// Uses `address` as the storage of the parameter or variable `decl`.
+    void bind(const IR::IDeclaration* decl, llvm::Value* address)
+    {
+        storage[decl] = address;
+    }
+
+    llvm::Value* emit_expression(const IR::Expression* expression);
+    llvm::Value* emit_address(const IR::Expression* expression);
+    void emit_statement(const IR::StatOrDecl* statement);
+
+    /// Allocates and initializes the storage of a local variable.
+    void declare(const IR::Declaration_Variable* decl);
+
+    bool preorder(const IR::Expression* expression) override;
+    bool preorder(const IR::Constant* expression) override;
+    bool preorder(const IR::BoolLiteral* expression) override;
+    bool preorder(const IR::PathExpression* expression) override;
+    bool preorder(const IR::Member* expression) override;
+    bool preorder(const IR::ArrayIndex* expression) override;
+    bool preorder(const IR::Slice* expression) override;
+    bool preorder(const IR::Concat* expression) override;
+    bool preorder(const IR::Cast* expression) override;
+    bool preorder(const IR::Mux* expression) override;
+    bool preorder(const IR::Neg* expression) override;
+    bool preorder(const IR::Cmpl* expression) override;
+    bool preorder(const IR::LNot* expression) override;
+    bool preorder(const IR::UPlus* expression) override;
+    bool preorder(const IR::LAnd* expression) override;
+    bool preorder(const IR::LOr* expression) override;
+    bool preorder(const IR::Shl* expression) override;
+    bool preorder(const IR::Shr* expression) override;
+    bool preorder(const IR::Operation_Relation* expression) override;
+    bool preorder(const IR::Operation_Binary* expression) override;
+    bool preorder(const IR::MethodCallExpression* expression) override;
+
+    bool preorder(const IR::Statement* statement) override;
+    bool preorder(const IR::AssignmentStatement* statement) override;
+    bool preorder(const IR::MethodCallStatement* statement) override;
+    bool preorder(const IR::IfStatement* statement) override;
+    bool preorder(const IR::BlockStatement* statement) override;
+    bool preorder(const IR::SwitchStatement* statement) override;
+    bool preorder(const IR::EmptyStatement*) override
+    {
+        return false;
+    }
+    bool preorder(const IR::Declaration_Variable* decl) override;
+    bool preorder(const IR::Declaration_Constant*) override
+    {
+        return false;
+    }
+
+ protected:
+    /// Emits a call; sets `result` to the returned value, if any.
+    virtual void emit_method_call(const P4::MethodInstance* instance);
+    void emit_builtin(const P4::BuiltInMethod* builtin);
+    /// Value of the case `label` of `statement`; must be a constant.
+    virtual llvm::Value* emit_switch_label(const IR::SwitchStatement* statement,
+                                           const IR::Expression* label);
+
+    llvm::Value* load_value(llvm::Value* address, const IR::Type* type);
+    void store_value(llvm::Value* address, const IR::Type* type, llvm::Value* value);
+    void assign(llvm::Value* address, const IR::Type* type, const IR::Expression* value);
+    void assign_slice(const IR::Slice* slice, const IR::Expression* value);
+    llvm::Value* convert(llvm::Value* value, const IR::Type* from, const IR::Type* to);
+    llvm::Value* constant(const big_int& value, unsigned width);
+    llvm::Value* shift_out_of_range(llvm::Value* amount, unsigned width);
+    llvm::Value* member_constant(const IR::Member* expression);
+    llvm::Value* error_code(cstring name);
+
+    llvm::Value* valid_address(llvm::Value* header, const IR::Type_Header* type);
+    llvm::Value* origin_address(llvm::Value* header, const IR::Type_Header* type);
+    /// The fields of `header` concatenated in wire order, first field in
+    /// the most significant bits.
+    llvm::Value* header_bits(llvm::Value* header, const IR::Type_Header* type);
+
+    llvm::Value* stack_element(llvm::Value* stack, const IR::Type_Stack* type,
+                               llvm::Value* index);
+    llvm::Value* stack_next_index(llvm::Value* stack, const IR::Type_Stack* type);
+    void stack_shift(const P4::BuiltInMethod* builtin, bool push);
+
+    llvm::Value* context_field(llvm::Value* context, unsigned field);
+
+    const IR::Type* type_of(const IR::Expression* expression) const
+    {
+        return types.canonical(typeMap->getType(expression, true));
+    }
+    static bool is_signed(const IR::Type* type)
+    {
+        auto bits = type->to<IR::Type_Bits>();
+        return bits != nullptr && bits->isSigned;
+    }
+    llvm::IRDefBuilder& ir()
+    {
+        return builder.get_builder();
+    }
+
+    PieIrBuilder& builder;
+    P4::ReferenceMap* refMap;
+    P4::TypeMap* typeMap;
+    PieTypeFactory& types;
+    std::map<const IR::IDeclaration*, llvm::Value*> storage;
+    /// Value computed by the last visited expression.
+    llvm::Value* result = nullptr;
+};
+
+}  // end of namespace pie
+
+#endif  // end of __BACKENDS_PIE_CODEGEN_H__
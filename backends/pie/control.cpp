@@ -0,0 +1,1364 @@
+#include "control.h"
+
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+#include <algorithm>
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/Module.h>
+
+#include "frontends/p4/coreLibrary.h"
+#include "frontends/p4/fromv1.0/v1model.h"
+#include "lib/error.h"
+#include "runtime/pie_runtime.h"
+
+namespace pie {
+
+namespace {
+
+/// The registers that some code reads and writes.
+class RegisterAccesses : public Inspector
+{
+ public:
+    RegisterAccesses(P4::ReferenceMap* refMap, P4::TypeMap* typeMap)
+        : refMap(refMap)
+        , typeMap(typeMap) {}
+
+    bool preorder(const IR::MethodCallExpression* call) override
+    {
+        auto& registers = P4V1::V1Model::instance.registers;
+        auto instance = P4::MethodInstance::resolve(call, refMap, typeMap);
+        auto method = instance->to<P4::ExternMethod>();
+        if (method != nullptr && method->originalExternType->name.name == registers.name) {
+            if (method->method->name.name == registers.read.name)
+                reads.insert(method->object);
+            else if (method->method->name.name == registers.write.name)
+                writes.insert(method->object);
+        }
+        return true;
+    }
+
+    bool accesses(const IR::IDeclaration* decl) const
+    {
+        return reads.count(decl) != 0 || writes.count(decl) != 0;
+    }
+    bool updates(const IR::IDeclaration* decl) const
+    {
+        return reads.count(decl) != 0 && writes.count(decl) != 0;
+    }
+    std::set<const IR::IDeclaration*> registers() const
+    {
+        auto all = reads;
+        all.insert(writes.begin(), writes.end());
+        return all;
+    }
+
+    std::set<const IR::IDeclaration*> reads;
+    std::set<const IR::IDeclaration*> writes;
+
+ private:
+    P4::ReferenceMap* refMap;
+    P4::TypeMap* typeMap;
+};
+
+/// Whether code that makes `accesses` must hold the lock of `reg`.
+bool needs_lock(const RegisterAccesses& accesses, const PieExterns::Instance* reg,
+                PieTypeFactory& types)
+{
+    return accesses.updates(reg->decl) ||
+           (accesses.accesses(reg->decl) && types.value_width(reg->cellType) > 64);
+}
+
+/// Lock order: by name.
+void sort_registers(std::vector<const PieExterns::Instance*>& registers)
+{
+    std::sort(registers.begin(), registers.end(),
+              [](const PieExterns::Instance* left, const PieExterns::Instance* right) {
+                  return left->name < right->name;
+              });
+}
+
+}  // namespace
+
+llvm::Function* PieControl::build(const IR::P4Control* control, cstring name)
+{
+    functionName = name;
+    control->apply(*this);
+    return function;
+}
+
+bool PieControl::preorder(const IR::P4Control* control)
+{
+    auto& context = builder.get_context();
+    entryType = builder.get_struct_type("struct.pie_entry", {
+        ir().getInt32Ty(), ir().getInt32Ty(), llvm::ArrayType::get(ir().getInt64Ty(), 0),
+    });
+
+    std::vector<llvm::Type*> argTypes = { llvm::PointerType::getUnqual(context_type(builder)) };
+    std::vector<const IR::Parameter*> params;
+    for (auto param : control->getApplyParameters()->parameters) {
+        auto type = types.canonical(param->type);
+        if (type->is<IR::Type_Extern>()) {
+            ::error(ErrorType::ERR_UNSUPPORTED, "%1%: extern parameters are not supported", param);
+            continue;
+        }
+        params.push_back(param);
+        argTypes.push_back(llvm::PointerType::getUnqual(types.storage_type(type)));
+    }
+    auto functionType = llvm::FunctionType::get(ir().getVoidTy(), argTypes, false);
+    function = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage,
+                                      functionName.c_str(), &builder.get_module());
+    ir().SetInsertPoint(llvm::BasicBlock::Create(context, "entry", function));
+
+    auto arg = function->arg_begin();
+    packetContext = &*arg++;
+    packetContext->setName("context");
+    for (auto param : params) {
+        auto address = &*arg++;
+        address->setName(param->name.name.c_str());
+        bind(param, address);
+        frame.push_back(param);
+        if (param->direction == IR::Direction::Out) {
+            auto storageType = types.storage_type(param->type);
+            ir().CreateStore(llvm::Constant::getNullValue(storageType), address);
+        }
+    }
+
+    for (auto decl : control->controlLocals) {
+        if (auto var = decl->to<IR::Declaration_Variable>()) {
+            declare(var);
+            frame.push_back(var);
+        } else if (auto table = decl->to<IR::P4Table>()) {
+            auto pieTable = new PieTable(table, refMap, typeMap, types);
+            if (profile.using_counts())
+                pieTable->use_profile(profile);
+            tableMap.emplace(table, pieTable);
+            tables.push_back(pieTable);
+        } else if (auto instance = decl->to<IR::Declaration_Instance>()) {
+            externs.declare(instance, init);
+        } else if (!decl->is<IR::P4Action>() && !decl->is<IR::Declaration_Constant>()) {
+            ::error(ErrorType::ERR_UNSUPPORTED, "%1%: not supported in pie controls", decl);
+        }
+    }
+    // The control locks the registers that its body accesses and that some
+    // of its code needs locked; then it takes the locks of its actions too.
+    RegisterAccesses everywhere(refMap, typeMap);
+    RegisterAccesses body(refMap, typeMap);
+    control->apply(everywhere);
+    control->body->apply(body);
+    bool locksBody = false;
+    for (auto decl : body.registers()) {
+        auto reg = externs.find(decl);
+        locksBody = locksBody || (reg != nullptr && needs_lock(everywhere, reg, types));
+    }
+    if (locksBody) {
+        for (auto decl : everywhere.registers()) {
+            auto reg = externs.find(decl);
+            if (reg != nullptr && needs_lock(everywhere, reg, types))
+                controlLocks.push_back(reg);
+        }
+    }
+    sort_registers(controlLocks);
+
+    // Actions may use any local, so they are built once all are declared.
+    for (auto decl : control->controlLocals) {
+        if (auto action = decl->to<IR::P4Action>())
+            build_action(action);
+    }
+    for (auto table : tables)
+        emit_table_init(table);
+
+    for (auto reg : controlLocks)
+        externs.lock(reg);
+    emit_statement(control->body);
+    if (ir().GetInsertBlock()->getTerminator() == nullptr)
+        ir().CreateRetVoid();
+    locks = controlLocks;
+    unlock(function);
+    return false;
+}
+
+void PieControl::build_action(const IR::P4Action* action)
+{
+    auto& context = builder.get_context();
+    Action info;
+    std::vector<llvm::Type*> argTypes;
+    std::vector<llvm::Type*> dataFields;
+    std::vector<const IR::Parameter*> directional;
+    argTypes.push_back(packetContext->getType());
+    for (auto decl : frame)
+        argTypes.push_back(storage.at(decl)->getType());
+    for (auto param : action->parameters->parameters) {
+        auto storageType = types.storage_type(param->type);
+        if (param->direction == IR::Direction::None) {
+            info.dataParams.push_back(param);
+            dataFields.push_back(storageType);
+        } else {
+            directional.push_back(param);
+            argTypes.push_back(llvm::PointerType::getUnqual(storageType));
+        }
+    }
+
+    auto name = functionName + "." + action->name.name;
+    info.data = llvm::StructType::create(context, dataFields, ("params." + name).c_str());
+    argTypes.push_back(llvm::PointerType::getUnqual(info.data));
+    auto functionType = llvm::FunctionType::get(ir().getVoidTy(), argTypes, false);
+    info.function = llvm::Function::Create(functionType, llvm::Function::InternalLinkage,
+                                           name.c_str(), &builder.get_module());
+    actions.emplace(action, info);
+
+    llvm::IRBuilderBase::InsertPointGuard guard(ir());
+    auto controlStorage = storage;
+    auto controlContext = packetContext;
+    inAction = true;
+    ir().SetInsertPoint(llvm::BasicBlock::Create(context, "entry", info.function));
+    auto arg = info.function->arg_begin();
+    packetContext = &*arg++;
+    packetContext->setName("context");
+    for (auto decl : frame)
+        bind(decl, &*arg++);
+    for (auto param : directional) {
+        auto address = &*arg++;
+        address->setName(param->name.name.c_str());
+        bind(param, address);
+    }
+    auto data = &*arg;
+    data->setName("data");
+    unsigned index = 0;
+    for (auto param : info.dataParams)
+        bind(param, ir().CreateStructGEP(info.data, data, index++));
+
+    lock(action->body);
+    emit_statement(action->body);
+    if (ir().GetInsertBlock()->getTerminator() == nullptr)
+        ir().CreateRetVoid();
+    unlock(info.function);
+    inAction = false;
+    storage = controlStorage;
+    packetContext = controlContext;
+}
+
+void PieControl::lock(const IR::Node* code)
+{
+    RegisterAccesses accesses(refMap, typeMap);
+    code->apply(accesses);
+    locks.clear();
+    for (auto decl : accesses.registers()) {
+        auto reg = externs.find(decl);
+        if (reg != nullptr && needs_lock(accesses, reg, types) && !holds(reg))
+            locks.push_back(reg);
+    }
+    sort_registers(locks);
+    for (auto reg : locks)
+        externs.lock(reg);
+}
+
+void PieControl::unlock(llvm::Function* function)
+{
+    llvm::IRBuilderBase::InsertPointGuard guard(ir());
+    for (auto& block : *function) {
+        auto ret = llvm::dyn_cast<llvm::ReturnInst>(block.getTerminator());
+        if (ret == nullptr)
+            continue;
+        ir().SetInsertPoint(ret);
+        for (auto it = locks.rbegin(); it != locks.rend(); ++it)
+            externs.unlock(*it);
+    }
+    locks.clear();
+}
+
+bool PieControl::holds(const PieExterns::Instance* reg) const
+{
+    return std::find(locks.begin(), locks.end(), reg) != locks.end() ||
+           std::find(controlLocks.begin(), controlLocks.end(), reg) != controlLocks.end();
+}
+
+void PieControl::emit_action_call(const IR::P4Action* action,
+                                  const IR::Vector<IR::Argument>* arguments, llvm::Value* data)
+{
+    auto it = actions.find(action);
+    if (it == actions.end()) {
+        ::error(ErrorType::ERR_UNSUPPORTED, "%1%: action of another control", action);
+        return;
+    }
+    auto& info = it->second;
+    std::vector<llvm::Value*> args = { packetContext };
+    for (auto decl : frame)
+        args.push_back(storage.at(decl));
+
+    auto& params = action->parameters->parameters;
+    for (size_t i = 0; i < params.size(); i++) {
+        auto param = params.at(i);
+        if (param->direction == IR::Direction::None)
+            continue;
+        if (arguments == nullptr || i >= arguments->size()) {
+            ::error(ErrorType::ERR_EXPECTED, "%1%: missing argument", param);
+            args.push_back(builder.create_entry_alloca(types.storage_type(param->type), "bad"));
+            continue;
+        }
+        auto argument = arguments->at(i)->expression;
+        if (param->direction == IR::Direction::In) {
+            auto copy = builder.create_entry_alloca(types.storage_type(param->type),
+                                                    param->name.name.c_str());
+            assign(copy, param->type, argument);
+            args.push_back(copy);
+        } else {
+            args.push_back(emit_address(argument));
+        }
+    }
+
+    auto dataType = llvm::PointerType::getUnqual(info.data);
+    if (data == nullptr) {
+        data = builder.create_entry_alloca(info.data, "params");
+        fill_action_data(action, arguments, data);
+    }
+    args.push_back(ir().CreateBitCast(data, dataType));
+    ir().CreateCall(info.function, args);
+}
+
+void PieControl::fill_action_data(const IR::P4Action* action,
+                                  const IR::Vector<IR::Argument>* arguments, llvm::Value* data)
+{
+    auto& info = actions.at(action);
+    auto& params = action->parameters->parameters;
+    // Arguments either cover all parameters or only the trailing directionless ones.
+    size_t count = arguments != nullptr ? arguments->size() : 0;
+    size_t skip = params.size() >= count ? params.size() - count : 0;
+    unsigned field = 0;
+    for (size_t i = 0; i < params.size(); i++) {
+        auto param = params.at(i);
+        if (param->direction != IR::Direction::None)
+            continue;
+        auto address = ir().CreateStructGEP(info.data, data, field++);
+        if (i < skip) {
+            ::error(ErrorType::ERR_EXPECTED, "%1%: missing argument", param);
+            continue;
+        }
+        assign(address, param->type, arguments->at(i - skip)->expression);
+    }
+}
+
+const IR::P4Action* PieControl::action_of(const IR::Expression* expression)
+{
+    if (auto call = expression->to<IR::MethodCallExpression>())
+        expression = call->method;
+    auto path = expression->to<IR::PathExpression>();
+    if (path == nullptr)
+        return nullptr;
+    return refMap->getDeclaration(path->path, true)->to<IR::P4Action>();
+}
+
+const PieTable* PieControl::applied_table(const IR::Expression* expression)
+{
+    auto call = expression->to<IR::MethodCallExpression>();
+    if (call == nullptr)
+        return nullptr;
+    auto instance = P4::MethodInstance::resolve(call, refMap, typeMap);
+    auto apply = instance->to<P4::ApplyMethod>();
+    if (apply == nullptr || !apply->isTableApply())
+        return nullptr;
+    auto it = tableMap.find(apply->object->to<IR::P4Table>());
+    return it != tableMap.end() ? it->second : nullptr;
+}
+
+PieControl::Lookup PieControl::emit_table_apply(const PieTable* table)
+{
+    auto& context = builder.get_context();
+    auto it = constTables.find(table);
+    auto lookup = it != constTables.end() ? emit_const_lookup(table, it->second)
+                                          : emit_lookup(table);
+    if (profile.generating()) {
+        profile.count(ir().CreateSelect(ir().CreateICmpNE(lookup.hit, ir().getInt32(0)),
+                                        ir().getInt32(profile.counter(table->counter("hit"_cs))),
+                                        ir().getInt32(profile.counter(table->counter("miss"_cs)))));
+    }
+    if (table->directCounter != nullptr || table->directMeter != nullptr)
+        emit_direct(table, lookup.hit);
+
+    auto current = ir().GetInsertBlock()->getParent();
+    auto endBlock = llvm::BasicBlock::Create(context, "apply.end", current);
+    auto dispatch = ir().CreateSwitch(lookup.action, endBlock, table->actions.size());
+    // The default case runs no action: what the counted actions leave.
+    uint64_t applied = profile.get(table->counter("hit"_cs)) +
+                       profile.get(table->counter("miss"_cs));
+    std::vector<uint64_t> weights = { 0 };
+    for (unsigned id = 0; id < table->actions.size(); id++) {
+        auto element = table->actions.at(id);
+        auto action = action_of(element->expression);
+        auto counter = table->counter("action:" + action->controlPlaneName());
+        weights.push_back(profile.get(counter));
+        applied -= std::min(applied, weights.back());
+        auto block = llvm::BasicBlock::Create(
+            context, ("action." + action->name.name).c_str(), current, endBlock);
+        dispatch->addCase(ir().getInt32(id), block);
+        ir().SetInsertPoint(block);
+        if (profile.generating())
+            profile.count(counter);
+        auto call = element->expression->to<IR::MethodCallExpression>();
+        emit_action_call(action, call != nullptr ? call->arguments : nullptr, lookup.data);
+        ir().CreateBr(endBlock);
+    }
+    weights.front() = applied;
+    if (auto prof = profile.weights(weights))
+        dispatch->setMetadata(llvm::LLVMContext::MD_prof, prof);
+    ir().SetInsertPoint(endBlock);
+    return lookup;
+}
+
+PieControl::Lookup PieControl::emit_lookup(const PieTable* table)
+{
+    auto bytePtr = builder.get_byte_ptr_type();
+    llvm::Value* key = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(bytePtr));
+    if (table->keySize != 0) {
+        auto keyType = llvm::ArrayType::get(ir().getInt8Ty(), table->keySize);
+        key = ir().CreateBitCast(builder.create_entry_alloca(keyType, "key"), bytePtr);
+        for (auto& field : table->keys) {
+            auto value = emit_expression(field.element->expression);
+            builder.store_bytes(key, field.offset, value, field.size);
+        }
+    }
+
+    // Calling the lookup of the table kind directly saves a dispatch per packet.
+    const char* lookup = table->kind == PIE_TABLE_LPM ? "pie_lpm_lookup"
+                       : table->kind == PIE_TABLE_TERNARY ? "pie_ternary_lookup"
+                       : table->kind == PIE_TABLE_LINEAR ? "pie_linear_lookup"
+                       : "pie_exact_lookup";
+    auto entryPtr = llvm::PointerType::getUnqual(entryType);
+    auto lookupFunction = builder.declare_function(lookup, entryPtr, { bytePtr, bytePtr });
+    auto runtimeTable = ir().CreateLoad(bytePtr, table->global);
+    auto entry = ir().CreateCall(lookupFunction, { runtimeTable, key }, "entry");
+    return {
+        ir().CreateLoad(ir().getInt32Ty(), ir().CreateStructGEP(entryType, entry, 0), "action"),
+        ir().CreateLoad(ir().getInt32Ty(), ir().CreateStructGEP(entryType, entry, 1), "hit"),
+        ir().CreateBitCast(ir().CreateStructGEP(entryType, entry, 2), bytePtr),
+    };
+}
+
+PieControl::Lookup PieControl::emit_const_lookup(const PieTable* table,
+                                                 const ConstTable& entries)
+{
+    auto& context = builder.get_context();
+    auto bytePtr = builder.get_byte_ptr_type();
+    auto keyType = ir().getIntNTy(entries.width);
+    llvm::Value* key = llvm::ConstantInt::get(keyType, 0);
+    unsigned shift = entries.width;
+    for (auto& field : table->keys) {
+        shift -= field.width;
+        auto value = ir().CreateZExtOrTrunc(emit_expression(field.element->expression), keyType);
+        key = ir().CreateOr(key, shift != 0 ? ir().CreateShl(value, shift) : value);
+    }
+
+    auto current = ir().GetInsertBlock()->getParent();
+    auto missBlock = llvm::BasicBlock::Create(context, "lookup.miss", current);
+    auto endBlock = llvm::BasicBlock::Create(context, "lookup.end", current);
+    std::vector<std::pair<llvm::BasicBlock*, const ConstEntry*>> found;
+    auto foundBlock = [&](const ConstEntry& entry) {
+        auto block = llvm::BasicBlock::Create(context, "lookup.hit", current, missBlock);
+        found.emplace_back(block, &entry);
+        return block;
+    };
+    // Entries that match every bit have distinct keys, so their order is moot.
+    big_int full = (big_int(1) << entries.width) - 1;
+    bool exact = std::all_of(entries.entries.begin(), entries.entries.end(),
+                             [&](const ConstEntry& entry) { return entry.mask == full; });
+    if (exact && entries.width <= 64) {
+        auto dispatch = ir().CreateSwitch(key, missBlock, entries.entries.size());
+        for (auto& entry : entries.entries) {
+            auto value = llvm::cast<llvm::ConstantInt>(constant(entry.key, entries.width));
+            dispatch->addCase(value, foundBlock(entry));
+        }
+    } else {
+        for (auto& entry : entries.entries) {
+            if (entry.mask == 0) {
+                ir().CreateBr(foundBlock(entry));
+                break;
+            }
+            llvm::Value* masked = key;
+            if (entry.mask != full)
+                masked = ir().CreateAnd(key, constant(entry.mask, entries.width));
+            auto next = llvm::BasicBlock::Create(context, "lookup.next", current, missBlock);
+            ir().CreateCondBr(ir().CreateICmpEQ(masked, constant(entry.key, entries.width)),
+                              foundBlock(entry), next);
+            ir().SetInsertPoint(next);
+        }
+        if (ir().GetInsertBlock()->getTerminator() == nullptr)
+            ir().CreateBr(missBlock);
+    }
+
+    auto i32 = ir().getInt32Ty();
+    auto action = llvm::PHINode::Create(i32, found.size() + 1, "action", endBlock);
+    auto hit = llvm::PHINode::Create(i32, found.size() + 1, "hit", endBlock);
+    auto data = llvm::PHINode::Create(bytePtr, found.size() + 1, "data", endBlock);
+    for (auto& [block, entry] : found) {
+        ir().SetInsertPoint(block);
+        ir().CreateBr(endBlock);
+        action->addIncoming(ir().getInt32(entry->action), block);
+        hit->addIncoming(ir().getInt32(1), block);
+        data->addIncoming(entry->data, block);
+    }
+    ir().SetInsertPoint(missBlock);
+    if (entries.constDefault) {
+        action->addIncoming(ir().getInt32(entries.defaultEntry.action), missBlock);
+        hit->addIncoming(ir().getInt32(0), missBlock);
+        data->addIncoming(entries.defaultEntry.data, missBlock);
+    } else {
+        auto entryPtr = llvm::PointerType::getUnqual(entryType);
+        auto getDefault = builder.declare_function("pie_table_default", entryPtr, { bytePtr });
+        auto entry = ir().CreateCall(getDefault, { ir().CreateLoad(bytePtr, table->global) },
+                                     "entry");
+        action->addIncoming(ir().CreateLoad(i32, ir().CreateStructGEP(entryType, entry, 0)),
+                            missBlock);
+        hit->addIncoming(ir().getInt32(0), missBlock);
+        data->addIncoming(ir().CreateBitCast(ir().CreateStructGEP(entryType, entry, 2), bytePtr),
+                          missBlock);
+    }
+    ir().CreateBr(endBlock);
+    ir().SetInsertPoint(endBlock);
+    return { action, hit, data };
+}
+
+void PieControl::emit_direct(const PieTable* table, llvm::Value* hit)
+{
+    auto& context = builder.get_context();
+    auto color = context_field(packetContext, CONTEXT_METER_COLOR);
+    if (table->directMeter != nullptr)
+        ir().CreateStore(ir().getInt32(PIE_METER_GREEN), color);
+    auto current = ir().GetInsertBlock()->getParent();
+    auto hitBlock = llvm::BasicBlock::Create(context, "direct", current);
+    auto endBlock = llvm::BasicBlock::Create(context, "direct.end", current);
+    ir().CreateCondBr(ir().CreateICmpNE(hit, ir().getInt32(0)), hitBlock, endBlock);
+
+    // The entries of such tables hit with 1 + their cell.
+    ir().SetInsertPoint(hitBlock);
+    auto cell = ir().CreateSub(hit, ir().getInt32(1), "cell");
+    auto length = packet_length();
+    if (table->directCounter != nullptr)
+        externs.count(table->directCounter, cell, length);
+    if (table->directMeter != nullptr)
+        ir().CreateStore(externs.execute(table->directMeter, cell, length), color);
+    ir().CreateBr(endBlock);
+    ir().SetInsertPoint(endBlock);
+}
+
+void PieControl::emit_table_init(PieTable* table)
+{
+    llvm::IRBuilderBase::InsertPointGuard guard(ir());
+    ir().SetInsertPoint(init);
+    auto& module = builder.get_module();
+    auto bytePtr = builder.get_byte_ptr_type();
+    auto i32 = ir().getInt32Ty();
+
+    table->global = new llvm::GlobalVariable(
+        module, bytePtr, false, llvm::GlobalValue::ExternalLinkage,
+        llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(bytePtr)),
+        ("pie.table." + table->name).c_str());
+
+    // The action data of an entry must fit the parameters of every action.
+    llvm::Value* dataSize = ir().getInt32(0);
+    table->dataTypes.clear();
+    for (auto element : table->actions) {
+        auto it = actions.find(action_of(element->expression));
+        table->dataTypes.push_back(it != actions.end() ? it->second.data : nullptr);
+        if (it == actions.end())
+            continue;
+        auto size = ir().CreateTrunc(llvm::ConstantExpr::getSizeOf(it->second.data), i32);
+        dataSize = ir().CreateSelect(ir().CreateICmpUGT(size, dataSize), size, dataSize);
+    }
+    auto create = builder.declare_function("pie_table_create", bytePtr,
+                                           { bytePtr, i32, i32, i32, i32, i32 });
+    auto runtimeTable = ir().CreateCall(create, {
+        ir().CreateGlobalStringPtr(table->name.c_str()), ir().getInt32(table->kind),
+        ir().getInt32(table->keySize), ir().getInt32(table->lpmStart), dataSize,
+        ir().getInt32(table->size),
+    });
+    ir().CreateStore(runtimeTable, table->global);
+
+    auto& attributes = P4V1::V1Model::instance.tableAttributes;
+    auto direct = [&](cstring property, PieExterns::Kind kind) -> PieExterns::Instance* {
+        auto value = table->table->properties->getProperty(property);
+        if (value == nullptr)
+            return nullptr;
+        auto expression = value->value->to<IR::ExpressionValue>();
+        auto path = expression != nullptr ? expression->expression->to<IR::PathExpression>()
+                                          : nullptr;
+        auto instance = path != nullptr ? externs.find(refMap->getDeclaration(path->path, true))
+                                        : nullptr;
+        if (instance == nullptr || instance->kind != kind) {
+            ::error(ErrorType::ERR_INVALID, "%1%: expected a %2% of this control", value,
+                    kind == PieExterns::DIRECT_COUNTER ? "direct_counter" : "direct_meter");
+            return nullptr;
+        }
+        return instance;
+    };
+    auto counter = direct(attributes.counters.name, PieExterns::DIRECT_COUNTER);
+    auto meter = direct(attributes.meters.name, PieExterns::DIRECT_METER);
+    if (counter != nullptr || meter != nullptr) {
+        externs.attach(table->global, counter, meter, table->size, init);
+        table->directCounter = counter;
+        table->directMeter = meter;
+    }
+    if (profile.generating()) {
+        auto record = builder.declare_function(
+            "pie_table_profile", ir().getVoidTy(),
+            { bytePtr, llvm::PointerType::getUnqual(ir().getInt64Ty()) });
+        ir().CreateCall(record, { runtimeTable, profile.address(table->counter("entries"_cs)) });
+    }
+
+    auto setDefault = builder.declare_function("pie_table_set_default", ir().getVoidTy(),
+                                               { bytePtr, i32, bytePtr });
+    auto nullData = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(bytePtr));
+    auto defaultAction = table->table->getDefaultAction();
+    auto action = defaultAction != nullptr ? action_of(defaultAction) : nullptr;
+    int id = action != nullptr ? table->action_id(action) : -1;
+    if (id < 0) {
+        if (defaultAction != nullptr)
+            ::error(ErrorType::ERR_INVALID, "%1%: not an action of the table", defaultAction);
+        ir().CreateCall(setDefault, { runtimeTable, ir().getInt32(PIE_NO_ACTION), nullData });
+    } else {
+        auto call = defaultAction->to<IR::MethodCallExpression>();
+        auto data = builder.create_entry_alloca(actions.at(action).data, "default");
+        fill_action_data(action, call != nullptr ? call->arguments : nullptr, data);
+        ir().CreateCall(setDefault, { runtimeTable, ir().getInt32(id),
+                                      ir().CreateBitCast(data, bytePtr) });
+    }
+
+    if (auto entries = table->table->getEntries()) {
+        auto priorities = entry_priorities(table->table);
+        for (size_t i = 0; i < entries->size(); i++)
+            emit_entry(table, runtimeTable, entries->entries.at(i), priorities.at(i));
+    }
+    auto entriesProperty =
+        table->table->properties->getProperty(IR::TableProperties::entriesPropertyName);
+    if (entriesProperty != nullptr && entriesProperty->isConstant) {
+        auto seal = builder.declare_function("pie_table_seal", ir().getVoidTy(), { bytePtr });
+        ir().CreateCall(seal, { runtimeTable });
+        // The entries of direct resources get their cells at run time.
+        if (counter == nullptr && meter == nullptr)
+            compile_entries(table);
+    }
+}
+
+/// The runtime priorities, where higher wins, of the entries of `table`.
+/// The priorities the frontend gives to the entries of non-const tables
+/// follow `largest_priority_wins`.  Const entries are ordered as bmv2 does:
+/// by their `@priority` annotation, else by their position, smallest first.
+static std::vector<int> entry_priorities(const IR::P4Table* table)
+{
+    std::vector<int> priorities;
+    auto entries = table->getEntries();
+    if (entries == nullptr)
+        return priorities;
+    auto largestWinsProperty = table->getBooleanProperty("largest_priority_wins"_cs);
+    bool largestWins = largestWinsProperty == nullptr || largestWinsProperty->value;
+    for (size_t i = 0; i < entries->size(); i++) {
+        auto entry = entries->entries.at(i);
+        const IR::Constant* value = nullptr;
+        bool smallestWins = true;
+        if (entry->priority != nullptr) {
+            value = entry->priority->to<IR::Constant>();
+            smallestWins = !largestWins;
+        } else if (auto annotation = entry->getAnnotation("priority"_cs)) {
+            if (annotation->expr.size() == 1)
+                value = annotation->expr.front()->to<IR::Constant>();
+            if (value == nullptr)
+                ::error(ErrorType::ERR_INVALID, "%1%: priority must be a constant", annotation);
+        }
+        int priority = i + 1;
+        if (value != nullptr) {
+            if (!value->fitsInt() || value->asInt() < 0)
+                ::error(ErrorType::ERR_UNSUPPORTED, "%1%: priority out of range", value);
+            else
+                priority = value->asInt();
+        }
+        priorities.push_back(smallestWins ? -priority : priority);
+    }
+    return priorities;
+}
+
+/// Number of bits set among the low `width` bits of `value`.
+static unsigned bits_set(const big_int& value, unsigned width)
+{
+    unsigned count = 0;
+    for (unsigned bit = 0; bit < width; bit++)
+        count += boost::multiprecision::bit_test(value, bit) ? 1 : 0;
+    return count;
+}
+
+void PieControl::compile_entries(const PieTable* table)
+{
+    ConstTable compiled;
+    for (auto& field : table->keys)
+        compiled.width += field.width;
+    auto entries = table->table->getEntries();
+    if (compiled.width == 0 || entries == nullptr)
+        return;
+
+    // Like the runtime table, an entry replaces earlier ones with the same
+    // key and mask; so the last of them is kept, where the first was.
+    auto priorities = entry_priorities(table->table);
+    std::set<std::pair<big_int, big_int>> seen;
+    for (size_t i = entries->size(); i-- > 0;) {
+        auto entry = entries->entries.at(i);
+        auto& components = entry->getKeys()->components;
+        if (components.size() != table->keys.size())
+            return;
+        ConstEntry compiledEntry;
+        for (size_t j = 0; j < components.size(); j++) {
+            unsigned width = table->keys.at(j).width;
+            big_int modulus = big_int(1) << width;
+            big_int fieldMask = modulus - 1;
+            const IR::Expression* component = components.at(j);
+            if (component->is<IR::DefaultExpression>()) {
+                component = nullptr;
+                fieldMask = 0;
+            } else if (auto masked = component->to<IR::Mask>()) {
+                auto constant = masked->right->to<IR::Constant>();
+                if (constant == nullptr || constant->value < 0)
+                    return;
+                component = masked->left;
+                fieldMask &= constant->value;
+            }
+            big_int value = 0;
+            if (auto constant = component ? component->to<IR::Constant>() : nullptr)
+                value = constant->value % modulus;
+            else if (auto literal = component ? component->to<IR::BoolLiteral>() : nullptr)
+                value = literal->value ? 1 : 0;
+            else if (component != nullptr)
+                return;
+            if (value < 0)
+                value += modulus;
+            compiledEntry.key = (compiledEntry.key << width) | (value & fieldMask);
+            compiledEntry.mask = (compiledEntry.mask << width) | fieldMask;
+        }
+
+        auto action = action_of(entry->getAction());
+        int id = action != nullptr ? table->action_id(action) : -1;
+        auto call = entry->getAction()->to<IR::MethodCallExpression>();
+        auto arguments = call != nullptr ? call->arguments : nullptr;
+        compiledEntry.data = id >= 0 ? constant_action_data(action, arguments) : nullptr;
+        if (compiledEntry.data == nullptr)
+            return;
+        compiledEntry.action = id;
+        compiledEntry.priority = priorities.at(i);
+        if (seen.emplace(compiledEntry.key, compiledEntry.mask).second)
+            compiled.entries.push_back(compiledEntry);
+    }
+    std::reverse(compiled.entries.begin(), compiled.entries.end());
+    std::stable_sort(compiled.entries.begin(), compiled.entries.end(),
+                     [](const ConstEntry& left, const ConstEntry& right) {
+                         return left.priority > right.priority;
+                     });
+    // The longest prefix matches first, whatever the order of the entries.
+    if (table->kind == PIE_TABLE_LPM) {
+        std::stable_sort(compiled.entries.begin(), compiled.entries.end(),
+                         [&](const ConstEntry& left, const ConstEntry& right) {
+                             return bits_set(left.mask, compiled.width) >
+                                    bits_set(right.mask, compiled.width);
+                         });
+    }
+
+    auto defaultProperty =
+        table->table->properties->getProperty(IR::TableProperties::defaultActionPropertyName);
+    if (defaultProperty != nullptr && defaultProperty->isConstant) {
+        auto defaultAction = table->table->getDefaultAction();
+        auto action = defaultAction != nullptr ? action_of(defaultAction) : nullptr;
+        int id = action != nullptr ? table->action_id(action) : -1;
+        auto call = id >= 0 ? defaultAction->to<IR::MethodCallExpression>() : nullptr;
+        auto arguments = call != nullptr ? call->arguments : nullptr;
+        auto data = id >= 0 ? constant_action_data(action, arguments) : nullptr;
+        if (data != nullptr) {
+            compiled.constDefault = true;
+            compiled.defaultEntry.action = id;
+            compiled.defaultEntry.data = data;
+        }
+    }
+    constTables.emplace(table, std::move(compiled));
+}
+
+llvm::Constant* PieControl::constant_action_data(const IR::P4Action* action,
+                                                 const IR::Vector<IR::Argument>* arguments)
+{
+    auto& info = actions.at(action);
+    auto& params = action->parameters->parameters;
+    // As in fill_action_data().
+    size_t count = arguments != nullptr ? arguments->size() : 0;
+    size_t skip = params.size() >= count ? params.size() - count : 0;
+    std::vector<llvm::Constant*> fields;
+    for (size_t i = 0; i < params.size(); i++) {
+        auto param = params.at(i);
+        if (param->direction != IR::Direction::None)
+            continue;
+        if (i < skip)
+            return nullptr;
+        auto argument = arguments->at(i - skip)->expression;
+        auto storageType = types.storage_type(param->type);
+        if (!storageType->isIntegerTy() ||
+            !(argument->is<IR::Constant>() || argument->is<IR::BoolLiteral>()))
+            return nullptr;
+        auto value = convert(emit_expression(argument), type_of(argument), param->type);
+        auto field = llvm::dyn_cast<llvm::Constant>(ir().CreateZExt(value, storageType));
+        if (field == nullptr)
+            return nullptr;
+        fields.push_back(field);
+    }
+
+    auto global = new llvm::GlobalVariable(
+        builder.get_module(), info.data, true, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantStruct::get(info.data, fields),
+        ("entry." + functionName + "." + action->name.name).c_str());
+    global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+    return llvm::ConstantExpr::getBitCast(global, builder.get_byte_ptr_type());
+}
+
+void PieControl::emit_entry(const PieTable* table, llvm::Value* runtimeTable,
+                            const IR::Entry* entry, int priority)
+{
+    auto& core = P4::P4CoreLibrary::instance();
+    auto bytePtr = builder.get_byte_ptr_type();
+    auto i32 = ir().getInt32Ty();
+    auto nullBytes = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(bytePtr));
+    auto& components = entry->getKeys()->components;
+    if (components.size() != table->keys.size()) {
+        ::error(ErrorType::ERR_INVALID, "%1%: entry does not match the table key", entry);
+        return;
+    }
+
+    llvm::Value* key = nullBytes;
+    llvm::Value* mask = nullBytes;
+    if (table->keySize != 0) {
+        auto keyType = llvm::ArrayType::get(ir().getInt8Ty(), table->keySize);
+        key = ir().CreateBitCast(builder.create_entry_alloca(keyType, "entry.key"), bytePtr);
+        ir().CreateMemSet(key, ir().getInt8(0), table->keySize, llvm::MaybeAlign(1));
+        if (table->kind == PIE_TABLE_TERNARY || table->kind == PIE_TABLE_LINEAR) {
+            mask = ir().CreateBitCast(builder.create_entry_alloca(keyType, "entry.mask"),
+                                      bytePtr);
+        }
+    }
+
+    unsigned prefix = 0;
+    for (size_t i = 0; i < components.size(); i++) {
+        auto& field = table->keys.at(i);
+        auto component = components.at(i);
+        const IR::Expression* value = component;
+        big_int fieldMask = (big_int(1) << field.width) - 1;
+        if (component->is<IR::DefaultExpression>()) {
+            value = nullptr;
+            fieldMask = 0;
+        } else if (auto masked = component->to<IR::Mask>()) {
+            auto constant = masked->right->to<IR::Constant>();
+            if (constant == nullptr) {
+                ::error(ErrorType::ERR_UNSUPPORTED, "%1%: mask must be a constant", masked);
+                continue;
+            }
+            value = masked->left;
+            fieldMask = constant->value & fieldMask;
+        } else if (component->is<IR::Range>()) {
+            ::error(ErrorType::ERR_UNSUPPORTED, "%1%: ranges are not supported", component);
+            continue;
+        }
+
+        if (value != nullptr)
+            builder.store_bytes(key, field.offset, emit_expression(value), field.size);
+        if (table->kind == PIE_TABLE_TERNARY || table->kind == PIE_TABLE_LINEAR)
+            builder.store_bytes(mask, field.offset, constant(fieldMask, field.width), field.size);
+        if (table->kind == PIE_TABLE_LPM && field.matchKind == core.lpmMatch.name) {
+            for (unsigned bit = 0; bit < field.width; bit++)
+                prefix += boost::multiprecision::bit_test(fieldMask, bit) ? 1 : 0;
+        }
+    }
+
+    auto action = action_of(entry->getAction());
+    int id = action != nullptr ? table->action_id(action) : -1;
+    if (id < 0) {
+        ::error(ErrorType::ERR_INVALID, "%1%: not an action of the table", entry->getAction());
+        return;
+    }
+    auto call = entry->getAction()->to<IR::MethodCallExpression>();
+    auto data = builder.create_entry_alloca(actions.at(action).data, "entry.data");
+    fill_action_data(action, call != nullptr ? call->arguments : nullptr, data);
+    auto add = builder.declare_function("pie_table_add", i32,
+                                        { bytePtr, bytePtr, bytePtr, i32, i32, i32, bytePtr });
+    ir().CreateCall(add, {
+        runtimeTable, key, mask, ir().getInt32(prefix), ir().getInt32(priority),
+        ir().getInt32(id), ir().CreateBitCast(data, bytePtr),
+    });
+}
+
+void PieControl::emit_drop(const IR::Expression* standardMetadata)
+{
+    auto type = type_of(standardMetadata)->to<IR::Type_StructLike>();
+    BUG_CHECK(type != nullptr, "%1%: expected standard metadata", standardMetadata);
+    auto address = emit_address(standardMetadata);
+    auto layout = types.get_layout(type);
+    auto set = [&](const char* name, unsigned value) {
+        auto field = type->getField(cstring(name));
+        if (field == nullptr)
+            return;
+        auto fieldAddress =
+            ir().CreateStructGEP(layout->type, address, layout->fieldIndex.at(field->name.name));
+        store_value(fieldAddress, field->type,
+                    constant(value, types.value_width(field->type)));
+    };
+    set("egress_spec", PIE_DROP_PORT);
+    set("mcast_grp", 0);
+}
+
+llvm::Value* PieControl::fold(llvm::Value* sum)
+{
+    // A sum of fewer than 65536 words is at most 0xffff after two rounds.
+    for (int i = 0; i < 2; i++)
+        sum = ir().CreateAdd(ir().CreateAnd(sum, 0xffff), ir().CreateLShr(sum, 16));
+    return sum;
+}
+
+llvm::Value* PieControl::sum_words(llvm::Value* bits, unsigned width, unsigned first,
+                                   unsigned last)
+{
+    llvm::Value* sum = ir().getInt32(0);
+    for (unsigned word = first; word <= last && 16 * (word + 1) <= width; word++) {
+        auto value = ir().CreateTrunc(ir().CreateLShr(bits, width - 16 * (word + 1)),
+                                      ir().getInt16Ty());
+        sum = ir().CreateAdd(sum, ir().CreateZExt(value, ir().getInt32Ty()));
+    }
+    return sum;
+}
+
+static unsigned field_bit_offset(PieTypeFactory& types, const IR::Type_Header* type,
+                                 cstring name)
+{
+    unsigned offset = 0;
+    for (auto field : type->fields) {
+        if (field->name.name == name)
+            break;
+        offset += types.value_width(field->type);
+    }
+    return offset;
+}
+
+void PieControl::emit_checksum(const P4::ExternFunction* function, bool update, bool payload)
+{
+    auto& context = builder.get_context();
+    auto arguments = function->expr->arguments;
+    auto algorithm = arguments->at(3)->expression->to<IR::Member>();
+    if (algorithm == nullptr ||
+        algorithm->member.name != P4V1::V1Model::instance.algorithm.csum16.name) {
+        ::error(ErrorType::ERR_UNSUPPORTED, "%1%: only csum16 checksums are supported",
+                arguments->at(3));
+        return;
+    }
+    if (inAction) {
+        ::error(ErrorType::ERR_UNSUPPORTED, "%1%: checksums cannot be computed inside actions",
+                function->expr);
+        return;
+    }
+    auto data = arguments->at(1)->expression;
+    auto checksum = arguments->at(2)->expression;
+
+    std::vector<const IR::Expression*> components;
+    if (auto list = data->to<IR::ListExpression>()) {
+        for (auto component : list->components)
+            components.push_back(component);
+    } else if (auto se = data->to<IR::StructExpression>()) {
+        for (auto component : se->components)
+            components.push_back(component->expression);
+    } else {
+        components.push_back(data);
+    }
+    std::vector<unsigned> widths;
+    unsigned width = 0;
+    for (auto component : components) {
+        auto type = type_of(component);
+        if (!type->is<IR::Type_Bits>() && !type->is<IR::Type_Boolean>()) {
+            ::error(ErrorType::ERR_UNSUPPORTED, "%1%: checksum data must be a list of fields",
+                    component);
+            return;
+        }
+        widths.push_back(types.value_width(type));
+        width += widths.back();
+    }
+    // The data is summed as 16-bit words, the last one padded with zeros.
+    unsigned padded = (width + 15) / 16 * 16;
+    unsigned words = padded / 16;
+
+    auto current = ir().GetInsertBlock()->getParent();
+    auto body = llvm::BasicBlock::Create(context, "checksum", current);
+    auto end = llvm::BasicBlock::Create(context, "checksum.end", current);
+    ir().CreateCondBr(emit_expression(arguments->at(0)->expression), body, end);
+    ir().SetInsertPoint(body);
+
+    std::vector<llvm::Value*> values;
+    for (auto component : components)
+        values.push_back(emit_expression(component));
+    auto concat = [&](const std::vector<llvm::Value*>& parts) -> llvm::Value* {
+        auto type = ir().getIntNTy(std::max(padded, 16u));
+        llvm::Value* bits = llvm::ConstantInt::get(type, 0);
+        for (size_t i = 0; i < parts.size(); i++) {
+            bits = ir().CreateShl(bits, widths.at(i));
+            bits = ir().CreateOr(bits, ir().CreateZExt(parts.at(i), type));
+        }
+        return ir().CreateShl(bits, padded - width);
+    };
+    auto bits = concat(values);
+    auto complement = [&](llvm::Value* sum) {
+        return ir().CreateXor(fold(sum), 0xffff);
+    };
+    auto packetField = [&](unsigned field) {
+        return ir().CreateLoad(field == CONTEXT_PACKET ? builder.get_byte_ptr_type()
+                                                       : ir().getInt32Ty(),
+                               context_field(packetContext, field));
+    };
+    auto full = [&]() {
+        auto sum = sum_words(bits, padded, 0, words - 1);
+        if (payload) {
+            auto consumed = packetField(CONTEXT_CONSUMED);
+            auto length = ir().CreateSub(packetField(CONTEXT_LENGTH), consumed);
+            auto start = ir().CreateInBoundsGEP(ir().getInt8Ty(), packetField(CONTEXT_PACKET),
+                                                consumed);
+            auto sizeType = builder.get_module().getDataLayout().getIntPtrType(context);
+            auto partial = builder.declare_function(
+                "pie_csum_partial", ir().getInt32Ty(), { builder.get_byte_ptr_type(), sizeType });
+            llvm::Value* payloadSum = ir().CreateCall(
+                partial, { start, ir().CreateZExt(length, sizeType) });
+            // After an odd number of bytes the payload words straddle ours.
+            if ((width + 7) / 8 % 2 != 0) {
+                payloadSum = ir().CreateAnd(ir().CreateOr(ir().CreateShl(payloadSum, 8),
+                                                          ir().CreateLShr(payloadSum, 8)),
+                                            0xffff);
+            }
+            sum = ir().CreateAdd(sum, payloadSum);
+        }
+        return complement(sum);
+    };
+
+    int verifiedBit = dirty.verified_bit(dirty.checksum_key(data, checksum, payload));
+    if (!update) {
+        auto expected = ir().CreateZExtOrTrunc(emit_expression(checksum), ir().getInt32Ty());
+        auto error = context_field(packetContext, CONTEXT_CHECKSUM_ERROR);
+        auto failed = ir().CreateICmpNE(full(), expected);
+        ir().CreateStore(ir().CreateSelect(failed, ir().getInt32(1),
+                                           ir().CreateLoad(ir().getInt32Ty(), error)),
+                         error);
+        if (verifiedBit >= 0) {
+            auto verified = context_field(packetContext, CONTEXT_CHECKSUM_VERIFIED);
+            auto passed = ir().CreateShl(
+                ir().CreateZExt(ir().CreateNot(failed), ir().getInt32Ty()), verifiedBit);
+            ir().CreateStore(ir().CreateOr(ir().CreateLoad(ir().getInt32Ty(), verified), passed),
+                             verified);
+        }
+        ir().CreateBr(end);
+        ir().SetInsertPoint(end);
+        return;
+    }
+
+    auto checksumType = type_of(checksum);
+    auto checksumAddress = emit_address(checksum);
+    auto store = [&](llvm::Value* value) {
+        store_value(checksumAddress, checksumType,
+                    ir().CreateZExtOrTrunc(value, types.value_type(checksumType)));
+    };
+
+    // RFC 1624 needs the old bytes of every header involved, and the
+    // checksum must not cover itself. It also carries an error in the old
+    // checksum over to the new one, so the old checksum must have been
+    // verified in this packet.
+    auto headerOf = [&](const IR::Expression* expression) -> const IR::Type_Header* {
+        auto member = expression->to<IR::Member>();
+        return member != nullptr ? type_of(member->expr)->to<IR::Type_Header>() : nullptr;
+    };
+    auto checksumHeader = headerOf(checksum);
+    bool incremental = checksumHeader != nullptr && types.value_width(checksumType) == 16 &&
+                       verifiedBit >= 0;
+    for (auto component : components) {
+        if (!incremental)
+            break;
+        if (component->is<IR::Constant>() || component->is<IR::BoolLiteral>())
+            continue;
+        auto header = headerOf(component);
+        incremental = header != nullptr &&
+            !(header->name == checksumHeader->name &&
+              component->to<IR::Member>()->member.name ==
+                  checksum->to<IR::Member>()->member.name);
+    }
+    if (!incremental) {
+        store(full());
+        ir().CreateBr(end);
+        ir().SetInsertPoint(end);
+        return;
+    }
+
+    // Origin of the bytes a header field was extracted from, plus one.
+    auto originOf = [&](const IR::Expression* expression) {
+        auto member = expression->to<IR::Member>();
+        auto header = type_of(member->expr)->to<IR::Type_Header>();
+        return ir().CreateLoad(ir().getInt32Ty(),
+                               origin_address(emit_address(member->expr), header));
+    };
+    auto oldField = [&](const IR::Expression* expression, llvm::Value* origin, unsigned bits) {
+        auto member = expression->to<IR::Member>();
+        auto header = type_of(member->expr)->to<IR::Type_Header>();
+        auto base = ir().CreateInBoundsGEP(ir().getInt8Ty(), packetField(CONTEXT_PACKET),
+                                           ir().CreateSub(origin, ir().getInt32(1)));
+        return builder.load_bits(base, field_bit_offset(types, header, member->member.name),
+                                 bits);
+    };
+    auto checksumOrigin = originOf(checksum);
+    llvm::Value* extracted = ir().CreateICmpNE(checksumOrigin, ir().getInt32(0));
+    std::vector<llvm::Value*> origins;
+    for (auto component : components) {
+        llvm::Value* origin = nullptr;
+        if (component->is<IR::Member>()) {
+            origin = originOf(component);
+            extracted = ir().CreateAnd(extracted, ir().CreateICmpNE(origin, ir().getInt32(0)));
+        }
+        origins.push_back(origin);
+    }
+    auto verified = ir().CreateLoad(ir().getInt32Ty(),
+                                    context_field(packetContext, CONTEXT_CHECKSUM_VERIFIED));
+    auto error = ir().CreateLoad(ir().getInt32Ty(),
+                                 context_field(packetContext, CONTEXT_CHECKSUM_ERROR));
+    extracted = ir().CreateAnd(extracted,
+                               ir().CreateICmpNE(ir().CreateAnd(verified, 1u << verifiedBit),
+                                                 ir().getInt32(0)));
+    extracted = ir().CreateAnd(extracted, ir().CreateICmpEQ(error, ir().getInt32(0)));
+    auto incrementalBlock = llvm::BasicBlock::Create(context, "checksum.incremental", current,
+                                                     end);
+    auto fullBlock = llvm::BasicBlock::Create(context, "checksum.full", current, end);
+    ir().CreateCondBr(extracted, incrementalBlock, fullBlock);
+
+    ir().SetInsertPoint(fullBlock);
+    store(full());
+    ir().CreateBr(end);
+
+    // HC' = ~(~HC + ~m + m') over the words holding fields that may have
+    // changed; the others cancel out.
+    ir().SetInsertPoint(incrementalBlock);
+    auto oldChecksum = ir().CreateZExt(oldField(checksum, checksumOrigin, 16), ir().getInt32Ty());
+    std::vector<llvm::Value*> oldValues = values;
+    std::set<unsigned> changed;
+    unsigned position = 0;
+    for (size_t i = 0; i < components.size(); i++) {
+        auto member = components.at(i)->to<IR::Member>();
+        if (member != nullptr && widths.at(i) != 0 &&
+            dirty.is_dirty(headerOf(member), member->member.name)) {
+            oldValues.at(i) = oldField(member, origins.at(i), widths.at(i));
+            for (unsigned word = position / 16; word <= (position + widths.at(i) - 1) / 16; word++)
+                changed.insert(word);
+        }
+        position += widths.at(i);
+    }
+    auto oldBits = concat(oldValues);
+    llvm::Value* sum = ir().CreateXor(oldChecksum, 0xffff);
+    for (auto word : changed) {
+        sum = ir().CreateAdd(sum, ir().CreateXor(sum_words(oldBits, padded, word, word), 0xffff));
+        sum = ir().CreateAdd(sum, sum_words(bits, padded, word, word));
+    }
+    store(complement(sum));
+    ir().CreateBr(end);
+    ir().SetInsertPoint(end);
+}
+
+llvm::Value* PieControl::packet_length()
+{
+    return ir().CreateLoad(ir().getInt32Ty(), context_field(packetContext, CONTEXT_LENGTH),
+                           "length");
+}
+
+llvm::Value* PieControl::extern_index(const IR::Expression* index)
+{
+    return ir().CreateZExtOrTrunc(emit_expression(index), ir().getInt32Ty(), "index");
+}
+
+void PieControl::emit_extern_method(const PieExterns::Instance* instance,
+                                    const P4::ExternMethod* method)
+{
+    auto& v1model = P4V1::V1Model::instance;
+    auto arguments = method->expr->arguments;
+    auto argument = [&](size_t i) {
+        return arguments->at(i)->expression;
+    };
+    const IR::Expression* out = nullptr;
+    llvm::Value* color = nullptr;
+    switch (instance->kind) {
+    case PieExterns::COUNTER:
+        externs.count(instance, extern_index(argument(0)), packet_length());
+        return;
+    case PieExterns::DIRECT_COUNTER:
+        // Tables count the hits of their entries themselves.
+        return;
+    case PieExterns::METER:
+        color = externs.execute(instance, extern_index(argument(0)), packet_length());
+        out = argument(1);
+        break;
+    case PieExterns::DIRECT_METER:
+        color = ir().CreateLoad(ir().getInt32Ty(),
+                                context_field(packetContext, CONTEXT_METER_COLOR), "color");
+        out = argument(0);
+        break;
+    case PieExterns::REGISTER:
+        emit_register_access(instance, arguments,
+                             method->method->name.name == v1model.registers.write.name);
+        return;
+    }
+    auto type = type_of(out);
+    store_value(emit_address(out), type,
+                ir().CreateZExtOrTrunc(color, types.value_type(type)));
+}
+
+void PieControl::emit_register_access(const PieExterns::Instance* reg,
+                                      const IR::Vector<IR::Argument>* arguments, bool write)
+{
+    // read(out T result, in I index) and write(in I index, in T value).
+    auto& context = builder.get_context();
+    auto type = reg->cellType;
+    auto index = extern_index(arguments->at(write ? 0 : 1)->expression);
+    llvm::Value* value = nullptr;
+    llvm::Value* resultAddress = nullptr;
+    if (write)
+        value = emit_expression(arguments->at(1)->expression);
+    else
+        resultAddress = emit_address(arguments->at(0)->expression);
+
+    // Reads out of range return 0; writes out of range do nothing.
+    auto current = ir().GetInsertBlock()->getParent();
+    auto before = ir().GetInsertBlock();
+    auto access = llvm::BasicBlock::Create(context, write ? "register.write" : "register.read",
+                                           current);
+    auto end = llvm::BasicBlock::Create(context, "register.end", current);
+    ir().CreateCondBr(ir().CreateICmpULT(index, ir().getInt32(reg->size)), access, end);
+    ir().SetInsertPoint(access);
+    bool wide = types.value_width(type) > 64;
+    BUG_CHECK(!wide || holds(reg), "%1%: register accessed without its lock", reg->decl);
+    auto cell = externs.cell(reg, index);
+    llvm::Value* loaded = nullptr;
+    if (write) {
+        store_value(cell, type, value);
+        if (!wide) {
+            llvm::cast<llvm::StoreInst>(&ir().GetInsertBlock()->back())
+                ->setAtomic(llvm::AtomicOrdering::Monotonic);
+        }
+    } else {
+        loaded = load_value(cell, type);
+        auto load = llvm::cast<llvm::Instruction>(loaded);
+        while (!llvm::isa<llvm::LoadInst>(load))
+            load = llvm::cast<llvm::Instruction>(load->getOperand(0));
+        if (!wide)
+            llvm::cast<llvm::LoadInst>(load)->setAtomic(llvm::AtomicOrdering::Monotonic);
+    }
+    auto accessEnd = ir().GetInsertBlock();
+    ir().CreateBr(end);
+    ir().SetInsertPoint(end);
+    if (!write) {
+        auto phi = ir().CreatePHI(loaded->getType(), 2);
+        phi->addIncoming(llvm::Constant::getNullValue(loaded->getType()), before);
+        phi->addIncoming(loaded, accessEnd);
+        store_value(resultAddress, type, phi);
+    }
+}
+
+void PieControl::emit_method_call(const P4::MethodInstance* instance)
+{
+    if (auto apply = instance->to<P4::ApplyMethod>()) {
+        if (auto table = applied_table(instance->expr)) {
+            emit_table_apply(table);
+            return;
+        }
+        ::error(ErrorType::ERR_UNSUPPORTED, "%1%: only tables can be applied in pie controls",
+                instance->expr);
+        return;
+    }
+    if (auto call = instance->to<P4::ActionCall>()) {
+        emit_action_call(call->action, instance->expr->arguments, nullptr);
+        return;
+    }
+    if (auto method = instance->to<P4::ExternMethod>()) {
+        if (auto object = externs.find(method->object)) {
+            emit_extern_method(object, method);
+            return;
+        }
+    }
+    if (auto function = instance->to<P4::ExternFunction>()) {
+        auto& v1model = P4V1::V1Model::instance;
+        auto name = function->method->name.name;
+        if (name == v1model.drop.name) {
+            emit_drop(instance->expr->arguments->at(0)->expression);
+            return;
+        }
+        if (name == v1model.verify_checksum.name || name == v1model.update_checksum.name ||
+            name == v1model.verify_checksum_with_payload.name ||
+            name == v1model.update_checksum_with_payload.name) {
+            bool update = name == v1model.update_checksum.name ||
+                          name == v1model.update_checksum_with_payload.name;
+            bool payload = name == v1model.verify_checksum_with_payload.name ||
+                           name == v1model.update_checksum_with_payload.name;
+            emit_checksum(function, update, payload);
+            return;
+        }
+    }
+    PieCodeGen::emit_method_call(instance);
+}
+
+llvm::Value* PieControl::emit_switch_label(const IR::SwitchStatement* statement,
+                                           const IR::Expression* label)
+{
+    auto member = statement->expression->to<IR::Member>();
+    if (member != nullptr && member->member.name == IR::Type_Table::action_run.name) {
+        if (auto table = applied_table(member->expr)) {
+            auto action = action_of(label);
+            int id = action != nullptr ? table->action_id(action) : -1;
+            if (id < 0) {
+                ::error(ErrorType::ERR_INVALID, "%1%: not an action of the table", label);
+                return ir().getInt32(PIE_NO_ACTION);
+            }
+            return ir().getInt32(id);
+        }
+    }
+    return PieCodeGen::emit_switch_label(statement, label);
+}
+
+bool PieControl::preorder(const IR::Member* expression)
+{
+    auto table = applied_table(expression->expr);
+    if (table == nullptr)
+        return PieCodeGen::preorder(expression);
+
+    auto lookup = emit_table_apply(table);
+    auto name = expression->member.name;
+    if (name == IR::Type_Table::action_run.name) {
+        result = lookup.action;
+        return false;
+    }
+    if (name == IR::Type_Table::hit.name)
+        result = ir().CreateICmpNE(lookup.hit, ir().getInt32(0));
+    else
+        result = ir().CreateICmpEQ(lookup.hit, ir().getInt32(0));
+
+    // Lets LLVM lay out the usual outcome as the fall-through path.
+    uint64_t hits = profile.get(table->counter("hit"_cs));
+    uint64_t misses = profile.get(table->counter("miss"_cs));
+    if (hits + misses != 0 && (hits >= 9 * misses || misses >= 9 * hits)) {
+        bool expected = (hits > misses) == (name == IR::Type_Table::hit.name);
+        result = ir().CreateIntrinsic(llvm::Intrinsic::expect, { ir().getInt1Ty() },
+                                      { result, ir().getInt1(expected) });
+    }
+    return false;
+}
+
+bool PieControl::preorder(const IR::ExitStatement* statement)
+{
+    if (inAction) {
+        ::error(ErrorType::ERR_UNSUPPORTED, "%1%: exit is not supported inside actions",
+                statement);
+        return false;
+    }
+    ir().CreateRetVoid();
+    return false;
+}
+
+bool PieControl::preorder(const IR::ReturnStatement* statement)
+{
+    ir().CreateRetVoid();
+    return false;
+}
+
+}  // end of namespace pie
@@ -0,0 +1,200 @@
+#ifndef __BACKENDS_PIE_CONTROL_H__
+#define __BACKENDS_PIE_CONTROL_H__
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "ir/ir.h"
+#include "frontends/p4/typeMap.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
+#include "codegen.h"
+#include "dirty.h"
+#include "externs.h"
+#include "profile.h"
+#include "table.h"
+
+namespace pie {
+
+/// Compiles a P4 control into an LLVM function
+///
+///     void control(pie_context* context, <params>...)
+///
+/// whose parameters point to the storage of the control parameters.
+///
+/// Every action becomes an internal function that receives the context, the
+/// control parameters and locals it may touch, its directional parameters,
+/// and a pointer to its other parameters laid out as a struct: that struct
+/// is the action data stored in table entries. Applying a table packs the
+/// key, calls the lookup of the table kind and dispatches on the action id
+/// with a switch, which LLVM turns into a jump table of direct calls. On a
+/// hit, the direct counter and meter of the table count and meter the
+/// packet before the action runs.
+///
+/// The lookup of a table with `const entries` and no direct resources is
+/// compiled as well: the key fields are concatenated into one integer that
+/// an exact table of up to 64 bits matches with a switch, which LLVM lowers
+/// to jump tables and binary searches, and other tables compare under the
+/// mask of every entry in turn, in the order the entries match. The action
+/// data of the entries are constants; only a miss reads the runtime table,
+/// for its default action, unless that is `const` too. The runtime table
+/// still holds the entries for the control plane, which can no longer
+/// change them.
+///
+/// Code creating the tables and externs is appended to `init`, the body of
+/// pie_init().
+/// With a profile, the dispatch is weighted by how often every action ran,
+/// and `hit` and `miss` are expected to take their usual value.
+///
+/// update_checksum() is computed incrementally (RFC 1624) from the bytes
+/// the headers were extracted from, over the 16-bit words holding fields
+/// that the program may modify (see PieDirtyFields); it falls back to a
+/// full computation for headers that were not extracted. Like an IP router,
+/// the incremental update keeps a wrong incoming checksum wrong.
+///
+/// Register cells of up to 64 bits are read and written with relaxed
+/// atomics, which are plain moves, so that no core sees a torn value. Code
+/// that both reads and writes a register, or accesses one with wider cells,
+/// holds its lock, so that concurrent read-modify-writes do not lose
+/// updates: the whole control holds it when its body accesses the register,
+/// else every action that does. A function takes all its locks on entry, in
+/// name order, and never while holding others; so when the control holds
+/// some, it holds those of its actions as well. Registers may be shared
+/// between controls, which run one after the other and so cannot deadlock.
+class PieControl : public PieCodeGen
+{
+ public:
+    PieControl(PieIrBuilder& builder, P4::ReferenceMap* refMap, P4::TypeMap* typeMap,
+               PieTypeFactory& types, const PieDirtyFields& dirty, llvm::BasicBlock* init,
+               PieProfile& profile, PieExterns& externs)
+        : PieCodeGen(builder, refMap, typeMap, types)
+        , dirty(dirty)
+        , init(init)
+        , profile(profile)
+        , externs(externs) {}
+
+    llvm::Function* build(const IR::P4Control* control, cstring name);
+
+    bool preorder(const IR::P4Control* control) override;
+    bool preorder(const IR::Member* expression) override;
+    bool preorder(const IR::ExitStatement* statement) override;
+    bool preorder(const IR::ReturnStatement* statement) override;
+
+    const std::vector<PieTable*>& get_tables() const
+    {
+        return tables;
+    }
+
+ protected:
+    void emit_method_call(const P4::MethodInstance* instance) override;
+    llvm::Value* emit_switch_label(const IR::SwitchStatement* statement,
+                                   const IR::Expression* label) override;
+
+ private:
+    struct Action
+    {
+        llvm::Function* function;
+        /// Directionless parameters, in order.
+        llvm::StructType* data;
+        std::vector<const IR::Parameter*> dataParams;
+    };
+
+    /// What a lookup found: the i32 action id and hit of the entry (as in
+    /// `struct pie_entry`) and a pointer to its action data.
+    struct Lookup
+    {
+        llvm::Value* action;
+        llvm::Value* hit;
+        llvm::Value* data;
+    };
+    /// An entry of a table compiled into code, with its key and mask over
+    /// the concatenated key fields.
+    struct ConstEntry
+    {
+        big_int key;
+        big_int mask;
+        unsigned action = 0;
+        /// As given to the runtime table: higher wins.
+        int priority = 0;
+        llvm::Constant* data = nullptr;
+    };
+    struct ConstTable
+    {
+        unsigned width = 0;
+        /// In the order they match.
+        std::vector<ConstEntry> entries;
+        /// The default action, when it is `const`.
+        bool constDefault = false;
+        ConstEntry defaultEntry;
+    };
+
+    void build_action(const IR::P4Action* action);
+    /// Calls `action`. Directional parameters are bound to the leading
+    /// `arguments`; the others come from `data` when it is not null, and
+    /// from the remaining arguments otherwise.
+    void emit_action_call(const IR::P4Action* action,
+                          const IR::Vector<IR::Argument>* arguments, llvm::Value* data);
+    /// Stores the directionless arguments of a call to `action` in `data`.
+    void fill_action_data(const IR::P4Action* action,
+                          const IR::Vector<IR::Argument>* arguments, llvm::Value* data);
+    /// Looks the key up and runs the action.
+    Lookup emit_table_apply(const PieTable* table);
+    Lookup emit_lookup(const PieTable* table);
+    Lookup emit_const_lookup(const PieTable* table, const ConstTable& entries);
+    /// Counts and meters a hit with the direct resources of `table`.
+    void emit_direct(const PieTable* table, llvm::Value* hit);
+    void emit_table_init(PieTable* table);
+    /// Compiles the entries of `table` into constTables, unless some key or
+    /// action argument is not a constant.
+    void compile_entries(const PieTable* table);
+    /// The action data of a call to `action`, as a constant byte pointer, or
+    /// nullptr.
+    llvm::Constant* constant_action_data(const IR::P4Action* action,
+                                         const IR::Vector<IR::Argument>* arguments);
+    void emit_entry(const PieTable* table, llvm::Value* runtimeTable, const IR::Entry* entry,
+                    int priority);
+    const PieTable* applied_table(const IR::Expression* expression);
+    const IR::P4Action* action_of(const IR::Expression* expression);
+    void emit_drop(const IR::Expression* standardMetadata);
+    void emit_extern_method(const PieExterns::Instance* instance,
+                            const P4::ExternMethod* method);
+    void emit_register_access(const PieExterns::Instance* reg,
+                              const IR::Vector<IR::Argument>* arguments, bool write);
+    /// Takes the locks that `code` needs and the control does not hold, in
+    /// name order; unlock() releases them.
+    void lock(const IR::Node* code);
+    void unlock(llvm::Function* function);
+    bool holds(const PieExterns::Instance* reg) const;
+    llvm::Value* extern_index(const IR::Expression* index);
+    llvm::Value* packet_length();
+    /// verify_checksum() and update_checksum(), with or without payload.
+    void emit_checksum(const P4::ExternFunction* function, bool update, bool payload);
+    /// Ones' complement sum (unfolded, in an i32) of the 16-bit words
+    /// `first` to `last` of the `width`-bit value `bits`.
+    llvm::Value* sum_words(llvm::Value* bits, unsigned width, unsigned first, unsigned last);
+    llvm::Value* fold(llvm::Value* sum);
+
+    const PieDirtyFields& dirty;
+    llvm::BasicBlock* init;
+    PieProfile& profile;
+    PieExterns& externs;
+    cstring functionName;
+    llvm::Function* function = nullptr;
+    llvm::Value* packetContext = nullptr;
+    /// Control parameters and locals, passed by pointer to every action.
+    std::vector<const IR::IDeclaration*> frame;
+    std::map<const IR::P4Action*, Action> actions;
+    std::map<const IR::P4Table*, PieTable*> tableMap;
+    std::vector<PieTable*> tables;
+    std::map<const PieTable*, ConstTable> constTables;
+    llvm::StructType* entryType = nullptr;
+    bool inAction = false;
+    /// Registers locked by the control function, and by the function being
+    /// generated.
+    std::vector<const PieExterns::Instance*> controlLocks;
+    std::vector<const PieExterns::Instance*> locks;
+};
+
+}  // end of namespace pie
+
+#endif  // end of __BACKENDS_PIE_CONTROL_H__
@@ -0,0 +1,220 @@
+#include "deparser.h"
+
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+
+#include "frontends/p4/coreLibrary.h"
+#include "lib/error.h"
+#include "runtime/pie_runtime.h"
+
+namespace pie {
+
+llvm::Function* PieDeparser::build(const IR::P4Control* control, cstring name)
+{
+    functionName = name;
+    control->apply(*this);
+    return function;
+}
+
+bool PieDeparser::preorder(const IR::P4Control* control)
+{
+    auto& context = builder.get_context();
+    std::vector<llvm::Type*> argTypes = { llvm::PointerType::getUnqual(context_type(builder)) };
+    std::vector<const IR::Parameter*> params;
+    for (auto param : control->getApplyParameters()->parameters) {
+        auto type = types.canonical(param->type);
+        if (type->is<IR::Type_Extern>())
+            continue;
+        params.push_back(param);
+        argTypes.push_back(llvm::PointerType::getUnqual(types.storage_type(type)));
+    }
+    auto functionType = llvm::FunctionType::get(ir().getInt32Ty(), argTypes, false);
+    function = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage,
+                                      functionName.c_str(), &builder.get_module());
+    ir().SetInsertPoint(llvm::BasicBlock::Create(context, "entry", function));
+
+    auto arg = function->arg_begin();
+    packetContext = &*arg++;
+    packetContext->setName("context");
+    for (auto param : params) {
+        auto address = &*arg++;
+        address->setName(param->name.name.c_str());
+        bind(param, address);
+    }
+    for (auto decl : control->controlLocals) {
+        if (!decl->is<IR::Declaration_Constant>())
+            ::error(ErrorType::ERR_UNSUPPORTED, "%1%: not supported in pie deparsers", decl);
+    }
+
+    cursor = builder.create_entry_alloca(ir().getInt32Ty(), "cursor");
+    ir().CreateStore(ir().getInt32(0), cursor);
+    sizing = true;
+    emit_statement(control->body);
+    builder.ensure_open_block();
+
+    auto consumed = ir().CreateLoad(ir().getInt32Ty(),
+                                    context_field(packetContext, CONTEXT_CONSUMED));
+    auto start = ir().CreateSub(consumed, ir().CreateLoad(ir().getInt32Ty(), cursor), "start");
+    auto write = llvm::BasicBlock::Create(context, "write", function);
+    auto done = llvm::BasicBlock::Create(context, "done", function);
+    ir().CreateCondBr(ir().CreateICmpSGE(start, ir().getInt32(-PIE_HEADROOM)), write, done);
+
+    ir().SetInsertPoint(write);
+    ir().CreateStore(start, cursor);
+    sizing = false;
+    emit_statement(control->body);
+    builder.ensure_open_block();
+    ir().CreateBr(done);
+
+    ir().SetInsertPoint(done);
+    ir().CreateRet(start);
+    return false;
+}
+
+bool PieDeparser::preorder(const IR::AssignmentStatement* statement)
+{
+    ::error(ErrorType::ERR_UNSUPPORTED,
+            "%1%: pie deparsers may only contain emit calls and conditions", statement);
+    return false;
+}
+
+bool PieDeparser::preorder(const IR::SwitchStatement* statement)
+{
+    ::error(ErrorType::ERR_UNSUPPORTED,
+            "%1%: pie deparsers may only contain emit calls and conditions", statement);
+    return false;
+}
+
+bool PieDeparser::preorder(const IR::Declaration_Variable* decl)
+{
+    ::error(ErrorType::ERR_UNSUPPORTED,
+            "%1%: pie deparsers may only contain emit calls and conditions", decl);
+    return false;
+}
+
+void PieDeparser::emit_method_call(const P4::MethodInstance* instance)
+{
+    auto method = instance->to<P4::ExternMethod>();
+    if (method != nullptr &&
+        method->method->name.name == P4::P4CoreLibrary::instance().packetOut.emit.name) {
+        auto argument = instance->expr->arguments->at(0)->expression;
+        emit(emit_address(argument), type_of(argument), argument);
+        return;
+    }
+    PieCodeGen::emit_method_call(instance);
+}
+
+void PieDeparser::emit(llvm::Value* address, const IR::Type* type, const IR::Node* node)
+{
+    type = types.canonical(type);
+    if (auto header = type->to<IR::Type_Header>()) {
+        emit_header(address, header, node);
+        return;
+    }
+    if (auto stack = type->to<IR::Type_Stack>()) {
+        auto stackType = types.storage_type(stack);
+        for (unsigned i = 0; i < stack->getSize(); i++) {
+            auto element = ir().CreateInBoundsGEP(
+                stackType, address, { ir().getInt32(0), ir().getInt32(0), ir().getInt32(i) });
+            emit(element, stack->elementType, node);
+        }
+        return;
+    }
+    if (auto st = type->to<IR::Type_StructLike>()) {
+        // Structs emit their fields in order; at most one header of a union is valid.
+        auto layout = types.get_layout(st);
+        for (auto field : st->fields) {
+            auto fieldAddress = ir().CreateStructGEP(layout->type, address,
+                                                     layout->fieldIndex.at(field->name.name));
+            emit(fieldAddress, field->type, node);
+        }
+        return;
+    }
+    ::error(ErrorType::ERR_UNSUPPORTED, "%1%: only headers can be emitted", node);
+}
+
+void PieDeparser::emit_header(llvm::Value* header, const IR::Type_Header* type,
+                              const IR::Node* node)
+{
+    auto& context = builder.get_context();
+    unsigned width = 0;
+    for (auto field : type->fields)
+        width += types.value_width(field->type);
+    if (width % 8 != 0) {
+        ::error(ErrorType::ERR_UNSUPPORTED, "%1%: header size is not a whole number of bytes",
+                type);
+        return;
+    }
+    if (width == 0)
+        return;
+    unsigned size = width / 8;
+    auto valid = ir().CreateICmpNE(ir().CreateLoad(ir().getInt8Ty(), valid_address(header, type)),
+                                   ir().getInt8(0));
+    auto position = ir().CreateLoad(ir().getInt32Ty(), cursor);
+    auto emitted = ir().CreateSelect(valid, ir().getInt32(size), ir().getInt32(0));
+    ir().CreateStore(ir().CreateAdd(position, emitted), cursor);
+    if (sizing)
+        return;
+
+    bool hasDirty = false;
+    for (auto field : type->fields)
+        hasDirty |= dirty.is_dirty(type, field->name.name);
+
+    auto current = ir().GetInsertBlock()->getParent();
+    auto check = llvm::BasicBlock::Create(context, "emit.valid", current);
+    auto full = llvm::BasicBlock::Create(context, "emit.full", current);
+    auto next = llvm::BasicBlock::Create(context, "emit.next", current);
+    ir().CreateCondBr(valid, check, next);
+
+    ir().SetInsertPoint(check);
+    auto packet = ir().CreateLoad(builder.get_byte_ptr_type(),
+                                  context_field(packetContext, CONTEXT_PACKET));
+    auto base = ir().CreateInBoundsGEP(ir().getInt8Ty(), packet, position);
+    auto origin = ir().CreateLoad(ir().getInt32Ty(), origin_address(header, type));
+    auto unmoved = ir().CreateICmpEQ(origin, ir().CreateAdd(position, ir().getInt32(1)));
+    if (hasDirty) {
+        auto inPlace = llvm::BasicBlock::Create(context, "emit.inplace", current, full);
+        ir().CreateCondBr(unmoved, inPlace, full);
+        ir().SetInsertPoint(inPlace);
+        write_dirty(base, header_bits(header, type), type, size);
+        ir().CreateBr(next);
+    } else {
+        ir().CreateCondBr(unmoved, next, full);
+    }
+
+    ir().SetInsertPoint(full);
+    builder.store_bytes(base, 0, header_bits(header, type), size);
+    ir().CreateBr(next);
+
+    ir().SetInsertPoint(next);
+}
+
+void PieDeparser::write_dirty(llvm::Value* base, llvm::Value* bits, const IR::Type_Header* type,
+                              unsigned size)
+{
+    // Byte ranges covering dirty fields; neighbouring fields in those bytes
+    // are clean, so their stored values are the bytes already in the packet.
+    std::vector<std::pair<unsigned, unsigned>> ranges;
+    unsigned offset = 0;
+    for (auto field : type->fields) {
+        auto width = types.value_width(field->type);
+        if (dirty.is_dirty(type, field->name.name)) {
+            unsigned first = offset / 8;
+            unsigned last = (offset + width + 7) / 8;
+            if (!ranges.empty() && ranges.back().second >= first)
+                ranges.back().second = std::max(ranges.back().second, last);
+            else
+                ranges.emplace_back(first, last);
+        }
+        offset += width;
+    }
+    for (auto& range : ranges) {
+        unsigned bytes = range.second - range.first;
+        auto value = ir().CreateLShr(bits, 8 * (size - range.second));
+        builder.store_bytes(base, range.first, value, bytes);
+    }
+}
+
+}  // end of namespace pie
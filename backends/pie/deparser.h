@@ -0,0 +1,65 @@
+#ifndef __BACKENDS_PIE_DEPARSER_H__
+#define __BACKENDS_PIE_DEPARSER_H__
+
+#include "ir/ir.h"
+#include "frontends/p4/typeMap.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
+#include "codegen.h"
+#include "dirty.h"
+
+namespace pie {
+
+/// Compiles a P4 deparser into an LLVM function
+///
+///     i32 deparser(pie_context* context, <params>...)
+///
+/// that writes the emitted headers back into the packet buffer in place.
+/// The payload, which starts `consumed` bytes into the packet, never moves:
+/// the headers are written right before it, so the outgoing packet starts
+/// at the offset returned by the function, which is negative when headers
+/// were added. No byte is written when that offset is below -PIE_HEADROOM.
+///
+/// A header that ends up where it was extracted from (see the origin in
+/// PieStructLayout) only has the bytes of its dirty fields written;
+/// unmodified headers in place are not touched at all.
+///
+/// The body runs twice, once to size the headers and once to write them,
+/// so it may only contain emit calls and conditions.
+class PieDeparser : public PieCodeGen
+{
+ public:
+    PieDeparser(PieIrBuilder& builder, P4::ReferenceMap* refMap, P4::TypeMap* typeMap,
+                PieTypeFactory& types, const PieDirtyFields& dirty)
+        : PieCodeGen(builder, refMap, typeMap, types)
+        , dirty(dirty) {}
+
+    llvm::Function* build(const IR::P4Control* control, cstring name);
+
+    bool preorder(const IR::P4Control* control) override;
+    bool preorder(const IR::AssignmentStatement* statement) override;
+    bool preorder(const IR::SwitchStatement* statement) override;
+    bool preorder(const IR::Declaration_Variable* decl) override;
+
+ protected:
+    void emit_method_call(const P4::MethodInstance* instance) override;
+
+ private:
+    void emit(llvm::Value* address, const IR::Type* type, const IR::Node* node);
+    void emit_header(llvm::Value* header, const IR::Type_Header* type, const IR::Node* node);
+    /// Writes the bytes of `bits` (a header of `size` bytes) that hold dirty
+    /// fields of `type` at `base`.
+    void write_dirty(llvm::Value* base, llvm::Value* bits, const IR::Type_Header* type,
+                     unsigned size);
+
+    const PieDirtyFields& dirty;
+    cstring functionName;
+    llvm::Function* function = nullptr;
+    llvm::Value* packetContext = nullptr;
+    /// Bytes emitted so far while sizing; the next write position while writing.
+    llvm::Value* cursor = nullptr;
+    bool sizing = false;
+};
+
+}  // end of namespace pie
+
+#endif  // end of __BACKENDS_PIE_DEPARSER_H__
@@ -0,0 +1,86 @@
+#include "dirty.h"
+
+#include "frontends/p4/fromv1.0/v1model.h"
+#include "frontends/p4/methodInstance.h"
+
+namespace pie {
+
+bool PieDirtyFields::is_dirty(const IR::Type_Header* type, cstring field) const
+{
+    auto it = fields.find(type->name.name);
+    return it != fields.end() && it->second.count(field) != 0;
+}
+
+std::string PieDirtyFields::checksum_key(const IR::Expression* data,
+                                         const IR::Expression* checksum, bool payload) const
+{
+    auto describe = [&](const IR::Expression* expression) {
+        if (auto member = expression->to<IR::Member>()) {
+            auto type = typeMap->getType(member->expr, true);
+            if (auto header = type->to<IR::Type_Header>())
+                return header->name.name + "." + member->member.name;
+        }
+        return std::string(expression->toString());
+    };
+    std::string key = payload ? "payload" : "header";
+    if (auto list = data->to<IR::ListExpression>()) {
+        for (auto component : list->components)
+            key += " " + describe(component);
+    } else if (auto se = data->to<IR::StructExpression>()) {
+        for (auto component : se->components)
+            key += " " + describe(component->expression);
+    } else {
+        key += " " + describe(data);
+    }
+    return key + " -> " + describe(checksum);
+}
+
+int PieDirtyFields::verified_bit(const std::string& key) const
+{
+    auto it = verified.find(key);
+    return it != verified.end() ? it->second : -1;
+}
+
+void PieDirtyFields::mark(const IR::Expression* expression)
+{
+    while (auto slice = expression->to<IR::Slice>())
+        expression = slice->e0;
+    auto member = expression->to<IR::Member>();
+    if (member == nullptr)
+        return;
+    auto type = typeMap->getType(member->expr, true);
+    if (auto header = type->to<IR::Type_Header>())
+        fields[header->name.name].insert(member->member.name);
+}
+
+bool PieDirtyFields::preorder(const IR::AssignmentStatement* statement)
+{
+    mark(statement->left);
+    return true;
+}
+
+bool PieDirtyFields::preorder(const IR::MethodCallExpression* expression)
+{
+    auto instance = P4::MethodInstance::resolve(expression, refMap, typeMap);
+    for (auto param : *instance->substitution.getParametersInArgumentOrder()) {
+        if (param->direction != IR::Direction::Out && param->direction != IR::Direction::InOut)
+            continue;
+        if (auto argument = instance->substitution.lookup(param))
+            mark(argument->expression);
+    }
+    // A packet has 32 bits for the checksums it verified.
+    auto& v1model = P4V1::V1Model::instance;
+    if (auto function = instance->to<P4::ExternFunction>()) {
+        auto name = function->method->name.name;
+        bool payload = name == v1model.verify_checksum_with_payload.name;
+        if ((payload || name == v1model.verify_checksum.name) && verified.size() < 32) {
+            auto arguments = expression->arguments;
+            auto key = checksum_key(arguments->at(1)->expression, arguments->at(2)->expression,
+                                    payload);
+            verified.emplace(key, verified.size());
+        }
+    }
+    return true;
+}
+
+}  // end of namespace pie
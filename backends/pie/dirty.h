@@ -0,0 +1,55 @@
+#ifndef __BACKENDS_PIE_DIRTY_H__
+#define __BACKENDS_PIE_DIRTY_H__
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "ir/ir.h"
+#include "frontends/p4/typeMap.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
+
+namespace pie {
+
+/// Finds the header fields that a program may modify: targets of
+/// assignments and arguments bound to out and inout parameters, including
+/// those of actions and externs such as update_checksum().
+///
+/// Fields are tracked per header type, not per instance. Whole-header
+/// assignments are not recorded because they also copy the origin of the
+/// header (see PieStructLayout), so the deparser can still tell whether the
+/// bytes it would write are already in the packet.
+///
+/// Also numbers the checksums that the program verifies, so that a packet
+/// can record those that passed: only they can be updated incrementally.
+class PieDirtyFields : public Inspector
+{
+ public:
+    PieDirtyFields(P4::ReferenceMap* refMap, P4::TypeMap* typeMap)
+        : refMap(refMap)
+        , typeMap(typeMap) {}
+
+    bool is_dirty(const IR::Type_Header* type, cstring field) const;
+    /// Identifies a checksum by the header fields of its data and result,
+    /// whatever the names of the headers in the control that computes it.
+    std::string checksum_key(const IR::Expression* data, const IR::Expression* checksum,
+                             bool payload) const;
+    /// The bit of the checksum `key` in the verified checksums of a packet,
+    /// or -1 if the program does not verify it.
+    int verified_bit(const std::string& key) const;
+
+    bool preorder(const IR::AssignmentStatement* statement) override;
+    bool preorder(const IR::MethodCallExpression* expression) override;
+
+ private:
+    void mark(const IR::Expression* expression);
+
+    P4::ReferenceMap* refMap;
+    P4::TypeMap* typeMap;
+    std::map<cstring, std::set<cstring>> fields;
+    std::map<std::string, int> verified;
+};
+
+}  // end of namespace pie
+
+#endif  // end of __BACKENDS_PIE_DIRTY_H__
@@ -0,0 +1,241 @@
+#include "externs.h"
+
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+
+#include "frontends/p4/fromv1.0/v1model.h"
+#include "lib/error.h"
+#include "runtime/pie_runtime.h"
+
+namespace pie {
+
+namespace {
+
+/// The `i`-th constructor argument of `decl` as a constant, or nullptr.
+const IR::Constant* constant_argument(const IR::Declaration_Instance* decl, size_t i)
+{
+    if (decl->arguments->size() <= i)
+        return nullptr;
+    return decl->arguments->at(i)->expression->to<IR::Constant>();
+}
+
+}  // namespace
+
+PieExterns::Instance* PieExterns::declare(const IR::Declaration_Instance* decl,
+                                          llvm::BasicBlock* init)
+{
+    auto& v1model = P4V1::V1Model::instance;
+    auto type = typeMap->getType(decl, true);
+    if (auto specialized = type->to<IR::Type_SpecializedCanonical>())
+        type = specialized->baseType;
+    auto externType = type->to<IR::Type_Extern>();
+    auto externName = externType != nullptr ? externType->name.name : cstring::empty;
+
+    auto instance = new Instance();
+    instance->decl = decl;
+    instance->name = decl->controlPlaneName();
+    size_t typeArgument = 1;
+    if (externName == v1model.counter.name) {
+        instance->kind = COUNTER;
+    } else if (externName == v1model.directCounter.name) {
+        instance->kind = DIRECT_COUNTER;
+        typeArgument = 0;
+    } else if (externName == v1model.meter.name) {
+        instance->kind = METER;
+    } else if (externName == v1model.directMeter.name) {
+        instance->kind = DIRECT_METER;
+        typeArgument = 0;
+    } else if (externName == v1model.registers.name) {
+        instance->kind = REGISTER;
+        auto specialized = decl->type->to<IR::Type_Specialized>();
+        if (specialized != nullptr && !specialized->arguments->empty())
+            instance->cellType = types.canonical(
+                typeMap->getTypeType(specialized->arguments->at(0), true));
+        if (instance->cellType == nullptr || !(instance->cellType->is<IR::Type_Bits>() ||
+                                               instance->cellType->is<IR::Type_Boolean>())) {
+            ::error(ErrorType::ERR_UNSUPPORTED, "%1%: register cells must be bit<W> or bool",
+                    decl);
+            return nullptr;
+        }
+    } else {
+        ::error(ErrorType::ERR_UNSUPPORTED, "%1%: extern not supported by the pie backend",
+                decl);
+        return nullptr;
+    }
+
+    if (instance->kind == METER || instance->kind == DIRECT_METER) {
+        auto member = decl->arguments->size() > typeArgument
+                          ? decl->arguments->at(typeArgument)->expression->to<IR::Member>()
+                          : nullptr;
+        if (member != nullptr && member->member.name == v1model.meter.meterType.bytes.name)
+            instance->meterType = PIE_METER_BYTES;
+        else
+            instance->meterType = PIE_METER_PACKETS;
+    }
+    if (instance->kind != DIRECT_COUNTER && instance->kind != DIRECT_METER) {
+        auto size = constant_argument(decl, 0);
+        if (size == nullptr || !size->fitsUint()) {
+            ::error(ErrorType::ERR_UNSUPPORTED, "%1%: size must be a 32-bit constant", decl);
+            return nullptr;
+        }
+        instance->size = size->asUnsigned();
+    }
+    instances.emplace(decl, instance);
+    if (instance->kind != DIRECT_COUNTER && instance->kind != DIRECT_METER)
+        create(instance, init);
+    return instance;
+}
+
+PieExterns::Instance* PieExterns::find(const IR::IDeclaration* decl) const
+{
+    auto it = instances.find(decl);
+    return it != instances.end() ? it->second : nullptr;
+}
+
+void PieExterns::create(Instance* instance, llvm::BasicBlock* init)
+{
+    auto& ir = builder.get_builder();
+    auto& module = builder.get_module();
+    llvm::IRBuilderBase::InsertPointGuard guard(ir);
+    ir.SetInsertPoint(init);
+    auto bytePtr = builder.get_byte_ptr_type();
+    auto i32 = ir.getInt32Ty();
+    auto name = ir.CreateGlobalStringPtr(instance->name.c_str());
+    auto size = ir.getInt32(instance->size);
+
+    instance->global = new llvm::GlobalVariable(
+        module, bytePtr, false, llvm::GlobalValue::InternalLinkage,
+        llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(bytePtr)),
+        ("pie.extern." + instance->name).c_str());
+    llvm::Value* object = nullptr;
+    switch (instance->kind) {
+    case COUNTER:
+    case DIRECT_COUNTER: {
+        auto create = builder.declare_function("pie_counter_create", bytePtr, { bytePtr, i32 });
+        object = ir.CreateCall(create, { name, size });
+        break;
+    }
+    case METER:
+    case DIRECT_METER: {
+        auto create = builder.declare_function("pie_meter_create", bytePtr,
+                                               { bytePtr, i32, i32 });
+        object = ir.CreateCall(create, { name, ir.getInt32(instance->meterType), size });
+        break;
+    }
+    case REGISTER: {
+        auto storageType = types.storage_type(instance->cellType);
+        auto cellsType = llvm::ArrayType::get(storageType, instance->size);
+        instance->cells = new llvm::GlobalVariable(
+            module, cellsType, false, llvm::GlobalValue::InternalLinkage,
+            llvm::ConstantAggregateZero::get(cellsType),
+            ("pie.register." + instance->name).c_str());
+        // A pipeline created again starts from zero, like its tables.
+        auto cells = ir.CreateBitCast(instance->cells, bytePtr);
+        ir.CreateMemSet(cells, ir.getInt8(0),
+                        llvm::ConstantExpr::getSizeOf(cellsType), llvm::MaybeAlign());
+        auto create = builder.declare_function("pie_register_create", bytePtr,
+                                               { bytePtr, bytePtr, i32, i32 });
+        auto cellSize = llvm::ConstantExpr::getTrunc(llvm::ConstantExpr::getSizeOf(storageType),
+                                                     i32);
+        object = ir.CreateCall(create, { name, cells, cellSize, size });
+        break;
+    }
+    }
+    ir.CreateStore(object, instance->global);
+    created.push_back(instance);
+}
+
+void PieExterns::attach(llvm::GlobalVariable* table, Instance* counter, Instance* meter,
+                        unsigned size, llvm::BasicBlock* init)
+{
+    auto& ir = builder.get_builder();
+    auto bytePtr = builder.get_byte_ptr_type();
+    auto null = llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(bytePtr));
+    for (auto instance : { counter, meter }) {
+        if (instance == nullptr)
+            continue;
+        if (instance->global != nullptr) {
+            ::error(ErrorType::ERR_INVALID, "%1%: attached to more than one table",
+                    instance->decl);
+            return;
+        }
+        instance->size = size;
+        create(instance, init);
+    }
+
+    llvm::IRBuilderBase::InsertPointGuard guard(ir);
+    ir.SetInsertPoint(init);
+    auto setDirect = builder.declare_function("pie_table_set_direct", ir.getInt32Ty(),
+                                              { bytePtr, bytePtr, bytePtr });
+    ir.CreateCall(setDirect, {
+        ir.CreateLoad(bytePtr, table),
+        counter != nullptr ? ir.CreateLoad(bytePtr, counter->global) : null,
+        meter != nullptr ? ir.CreateLoad(bytePtr, meter->global) : null,
+    });
+}
+
+llvm::Value* PieExterns::object(const Instance* instance)
+{
+    return builder.get_builder().CreateLoad(builder.get_byte_ptr_type(), instance->global);
+}
+
+void PieExterns::count(const Instance* counter, llvm::Value* index, llvm::Value* length)
+{
+    auto& ir = builder.get_builder();
+    auto i32 = ir.getInt32Ty();
+    auto function = builder.declare_function("pie_counter_count", ir.getVoidTy(),
+                                             { builder.get_byte_ptr_type(), i32, i32 });
+    ir.CreateCall(function, { object(counter), index, length });
+}
+
+llvm::Value* PieExterns::execute(const Instance* meter, llvm::Value* index, llvm::Value* length)
+{
+    auto& ir = builder.get_builder();
+    auto i32 = ir.getInt32Ty();
+    auto function = builder.declare_function("pie_meter_execute", i32,
+                                             { builder.get_byte_ptr_type(), i32, i32 });
+    return ir.CreateCall(function, { object(meter), index, length }, "color");
+}
+
+llvm::Value* PieExterns::cell(const Instance* reg, llvm::Value* index)
+{
+    auto& ir = builder.get_builder();
+    return ir.CreateInBoundsGEP(reg->cells->getValueType(), reg->cells,
+                                { ir.getInt32(0), index });
+}
+
+void PieExterns::lock(const Instance* reg)
+{
+    auto& ir = builder.get_builder();
+    auto function = builder.declare_function("pie_register_lock", ir.getVoidTy(),
+                                             { builder.get_byte_ptr_type() });
+    ir.CreateCall(function, { object(reg) });
+}
+
+void PieExterns::unlock(const Instance* reg)
+{
+    auto& ir = builder.get_builder();
+    auto function = builder.declare_function("pie_register_unlock", ir.getVoidTy(),
+                                             { builder.get_byte_ptr_type() });
+    ir.CreateCall(function, { object(reg) });
+}
+
+void PieExterns::emit_destroy()
+{
+    auto& ir = builder.get_builder();
+    auto bytePtr = builder.get_byte_ptr_type();
+    for (auto instance : created) {
+        const char* destroy = instance->kind == COUNTER || instance->kind == DIRECT_COUNTER
+                                  ? "pie_counter_destroy"
+                              : instance->kind == REGISTER ? "pie_register_destroy"
+                                                           : "pie_meter_destroy";
+        auto function = builder.declare_function(destroy, ir.getVoidTy(), { bytePtr });
+        ir.CreateCall(function, { object(instance) });
+        ir.CreateStore(llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(bytePtr)),
+                       instance->global);
+    }
+}
+
+}  // end of namespace pie
@@ -0,0 +1,92 @@
+#ifndef __BACKENDS_PIE_EXTERNS_H__
+#define __BACKENDS_PIE_EXTERNS_H__
+
+#include <map>
+#include <vector>
+
+#include "ir/ir.h"
+#include "frontends/p4/typeMap.h"
+#include "llvm-ir.h"
+#include "type.h"
+
+namespace llvm {
+class GlobalVariable;
+}
+
+namespace pie {
+
+/// The stateful externs of a program, v1model `counter`, `direct_counter`,
+/// `meter`, `direct_meter` and `register`, and their runtime objects
+/// (runtime/pie_counter.c, pie_meter.c and pie_register.c).
+///
+/// Every instance holds its runtime object in a global that pie_init()
+/// fills in and pie_pipeline_destroy() clears. Counters are sharded per
+/// core by the runtime; meters run a token bucket per cell. The cells of a
+/// register are an array of the generated module, which the code accesses
+/// directly; PieControl decides where those accesses need its lock.
+class PieExterns
+{
+ public:
+    enum Kind { COUNTER, DIRECT_COUNTER, METER, DIRECT_METER, REGISTER };
+
+    struct Instance
+    {
+        const IR::Declaration_Instance* decl;
+        Kind kind;
+        /// Name used by the control plane (pie_counter_find() and others).
+        cstring name;
+        /// Number of cells; for direct instances, that of their table.
+        unsigned size = 0;
+        /// PIE_METER_PACKETS or PIE_METER_BYTES.
+        unsigned meterType = 0;
+        /// Registers: the type of the cells and their storage.
+        const IR::Type* cellType = nullptr;
+        llvm::GlobalVariable* cells = nullptr;
+        /// Holds the runtime object once pie_init() has run.
+        llvm::GlobalVariable* global = nullptr;
+    };
+
+    PieExterns(PieIrBuilder& builder, P4::TypeMap* typeMap, PieTypeFactory& types)
+        : builder(builder)
+        , typeMap(typeMap)
+        , types(types) {}
+
+    /// Records the instance `decl` and appends its creation to `init`, the
+    /// body of pie_init(); direct instances are created by attach(). Reports
+    /// an error and returns nullptr for externs the backend does not lower.
+    Instance* declare(const IR::Declaration_Instance* decl, llvm::BasicBlock* init);
+    /// The instance declared by `decl`, or nullptr.
+    Instance* find(const IR::IDeclaration* decl) const;
+    /// Creates the direct counter and meter (either may be null) of the
+    /// table held by `table`, with `size` cells, and attaches them to it.
+    void attach(llvm::GlobalVariable* table, Instance* counter, Instance* meter,
+                unsigned size, llvm::BasicBlock* init);
+
+    /// The runtime object of `instance`, loaded at the insertion point.
+    llvm::Value* object(const Instance* instance);
+    void count(const Instance* counter, llvm::Value* index, llvm::Value* length);
+    /// The i32 color (PIE_METER_*) of a packet of `length` bytes.
+    llvm::Value* execute(const Instance* meter, llvm::Value* index, llvm::Value* length);
+    /// Address of the register cell `index`, which must be in range.
+    llvm::Value* cell(const Instance* reg, llvm::Value* index);
+    void lock(const Instance* reg);
+    void unlock(const Instance* reg);
+
+    /// Destroys the runtime objects at the insertion point, for
+    /// pie_pipeline_destroy().
+    void emit_destroy();
+
+ private:
+    void create(Instance* instance, llvm::BasicBlock* init);
+
+    PieIrBuilder& builder;
+    P4::TypeMap* typeMap;
+    PieTypeFactory& types;
+    std::map<const IR::IDeclaration*, Instance*> instances;
+    /// In the order they were created.
+    std::vector<Instance*> created;
+};
+
+}  // end of namespace pie
+
+#endif  // end of __BACKENDS_PIE_EXTERNS_H__
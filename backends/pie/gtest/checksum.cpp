@@ -0,0 +1,23 @@
+#include <gtest/gtest.h>
+
+#include "backends/pie/runtime/pie_runtime.h"
+
+namespace Test {
+
+TEST(PieChecksum, Partial) {
+    // An IPv4 header with its checksum field zeroed.
+    const uint8_t header[20] = {0x45, 0x00, 0x00, 0x73, 0x00, 0x00, 0x40, 0x00, 0x40, 0x11,
+                                0x00, 0x00, 0xc0, 0xa8, 0x00, 0x01, 0xc0, 0xa8, 0x00, 0xc7};
+    EXPECT_EQ(~pie_csum_partial(header, sizeof(header)) & 0xffff, 0xb861u);
+
+    // An odd length is padded with a zero byte.
+    const uint8_t odd[3] = {0x12, 0x34, 0x56};
+    EXPECT_EQ(pie_csum_partial(odd, 3), 0x6834u);
+    EXPECT_EQ(pie_csum_partial(odd, 0), 0u);
+
+    // Carries wrap around.
+    const uint8_t ones[6] = {0xff, 0xff, 0xff, 0xff, 0x00, 0x02};
+    EXPECT_EQ(pie_csum_partial(ones, 6), 0x0002u);
+}
+
+}  // namespace Test
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+
+#include <errno.h>
+
+#include <thread>
+#include <vector>
+
+#include "backends/pie/runtime/pie_runtime.h"
+
+namespace Test {
+
+TEST(PieCounter, Readout) {
+    auto counter = pie_counter_create("packets", 4);
+    ASSERT_NE(counter, nullptr);
+    EXPECT_EQ(pie_counter_find("packets"), counter);
+    EXPECT_EQ(pie_counter_size(counter), 4u);
+
+    pie_counter_count(counter, 1, 64);
+    pie_counter_count(counter, 1, 1500);
+    pie_counter_count(counter, 4, 64);   // out of range, ignored
+    pie_counter_value value;
+    ASSERT_EQ(pie_counter_read(counter, 1, &value), 0);
+    EXPECT_EQ(value.packets, 2u);
+    EXPECT_EQ(value.bytes, 1564u);
+    ASSERT_EQ(pie_counter_read(counter, 0, &value), 0);
+    EXPECT_EQ(value.packets, 0u);
+    EXPECT_EQ(pie_counter_read(counter, 4, &value), -EINVAL);
+
+    ASSERT_EQ(pie_counter_clear(counter, 1), 0);
+    ASSERT_EQ(pie_counter_read(counter, 1, &value), 0);
+    EXPECT_EQ(value.packets, 0u);
+    EXPECT_EQ(value.bytes, 0u);
+
+    pie_counter_destroy(counter);
+    EXPECT_EQ(pie_counter_find("packets"), nullptr);
+}
+
+TEST(PieCounter, SharedByThreads) {
+    auto counter = pie_counter_create("shared", 1);
+    ASSERT_NE(counter, nullptr);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([counter] {
+            for (int j = 0; j < 10000; j++)
+                pie_counter_count(counter, 0, 100);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    pie_counter_value value;
+    ASSERT_EQ(pie_counter_read(counter, 0, &value), 0);
+    EXPECT_EQ(value.packets, 40000u);
+    EXPECT_EQ(value.bytes, 4000000u);
+    pie_counter_destroy(counter);
+}
+
+TEST(PieCounter, MoreThreadsThanCores) {
+    // Threads beyond one per CPU share a shard; none of their counts is lost.
+    auto counter = pie_counter_create("crowded", 2);
+    ASSERT_NE(counter, nullptr);
+    unsigned count = 2 * std::thread::hardware_concurrency() + 2;
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < count; i++) {
+        threads.emplace_back([counter, i] {
+            for (int j = 0; j < 1000; j++)
+                pie_counter_count(counter, i % 2, 10);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    pie_counter_value value;
+    ASSERT_EQ(pie_counter_read(counter, 0, &value), 0);
+    EXPECT_EQ(value.packets, 1000u * ((count + 1) / 2));
+    ASSERT_EQ(pie_counter_read(counter, 1, &value), 0);
+    EXPECT_EQ(value.bytes, 10000u * (count / 2));
+
+    // Counts after a clear add up from zero.
+    ASSERT_EQ(pie_counter_clear(counter, 1), 0);
+    pie_counter_count(counter, 1, 10);
+    ASSERT_EQ(pie_counter_read(counter, 1, &value), 0);
+    EXPECT_EQ(value.packets, 1u);
+    EXPECT_EQ(value.bytes, 10u);
+    pie_counter_destroy(counter);
+}
+
+}  // namespace Test
@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "backends/pie/runtime/pie_harness.h"
+
+namespace Test {
+
+namespace {
+
+// An Ethernet/IPv4/TCP frame from 66.9.149.187:2794 to 161.142.100.80:1766,
+// the first verification case of the Microsoft RSS specification.
+std::vector<uint8_t> tcp_frame(uint8_t flow = 0) {
+    std::vector<uint8_t> frame(54, 0);
+    frame[12] = 0x08;
+    frame[14] = 0x45;
+    frame[23] = 6;
+    const uint8_t addresses[8] = {66, 9, 149, 187, 161, 142, 100, 80};
+    memcpy(&frame[26], addresses, 8);
+    frame[34] = 2794 >> 8;
+    frame[35] = 2794 & 0xff;
+    frame[36] = 1766 >> 8;
+    frame[37] = 1766 & 0xff;
+    frame[53] = flow;
+    frame[29] ^= flow;
+    return frame;
+}
+
+std::mutex flowsLock;
+std::map<uint8_t, std::set<std::thread::id>> flowThreads;
+
+// Drops packets of odd flows, forwards the others unchanged.
+uint32_t fake_burst(uint8_t* const* packets, const size_t* lengths, pie_metadata* meta,
+                    int32_t* results, uint32_t count) {
+    uint32_t forwarded = 0;
+    std::lock_guard<std::mutex> guard(flowsLock);
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t flow = packets[i][53];
+        flowThreads[flow].insert(std::this_thread::get_id());
+        EXPECT_EQ(meta[i].packet_length, lengths[i]);
+        results[i] = flow % 2 != 0 ? PIE_DROPPED : int32_t(lengths[i]);
+        forwarded += flow % 2 == 0;
+    }
+    return forwarded;
+}
+
+}  // namespace
+
+TEST(PieHarness, Toeplitz) {
+    const uint8_t ipv4[12] = {66, 9, 149, 187, 161, 142, 100, 80, 0x0a, 0xea, 0x06, 0xe6};
+    EXPECT_EQ(pie_toeplitz(pie_rss_default_key, ipv4, 12), 0x51ccc178u);
+    EXPECT_EQ(pie_toeplitz(pie_rss_default_key, ipv4, 8), 0x323e8fc2u);
+
+    // 3ffe:2501:200:1fff::7 -> 3ffe:2501:200:3::1
+    uint8_t ipv6[36] = {0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x1f, 0xff};
+    ipv6[15] = 7;
+    const uint8_t destination[8] = {0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x00, 0x03};
+    memcpy(ipv6 + 16, destination, 8);
+    ipv6[31] = 1;
+    const uint8_t ports[4] = {0x0a, 0xea, 0x06, 0xe6};
+    memcpy(ipv6 + 32, ports, 4);
+    EXPECT_EQ(pie_toeplitz(pie_rss_default_key, ipv6, 36), 0x40207d3du);
+    EXPECT_EQ(pie_toeplitz(pie_rss_default_key, ipv6, 32), 0x2cc18cd5u);
+}
+
+TEST(PieHarness, RssHash) {
+    auto frame = tcp_frame();
+    EXPECT_EQ(pie_rss_hash(pie_rss_default_key, frame.data(), frame.size()), 0x51ccc178u);
+
+    // Fragments hash on the addresses only.
+    frame[20] = 0x20;
+    EXPECT_EQ(pie_rss_hash(pie_rss_default_key, frame.data(), frame.size()), 0x323e8fc2u);
+
+    // A VLAN tag moves the IP header but does not change the hash.
+    frame = tcp_frame();
+    frame.insert(frame.begin() + 12, {0x81, 0x00, 0x00, 0x05});
+    EXPECT_EQ(pie_rss_hash(pie_rss_default_key, frame.data(), frame.size()), 0x51ccc178u);
+
+    const uint8_t arp[14] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x08, 0x06};
+    EXPECT_EQ(pie_rss_hash(pie_rss_default_key, arp, sizeof(arp)), 0u);
+    EXPECT_EQ(pie_rss_hash(pie_rss_default_key, arp, 10), 0u);
+}
+
+TEST(PieHarness, Ring) {
+    auto ring = pie_ring_create(5);
+    ASSERT_NE(ring, nullptr);
+    pie_packet in[8] = {};
+    pie_packet out[8] = {};
+    for (uint32_t i = 0; i < 8; i++)
+        in[i].length = i;
+
+    // Rounded up to 8 slots; go around a few times.
+    for (int round = 0; round < 3; round++) {
+        EXPECT_EQ(pie_ring_enqueue(ring, in, 5), 5u);
+        EXPECT_EQ(pie_ring_enqueue(ring, in + 5, 5), 3u);
+        EXPECT_EQ(pie_ring_dequeue(ring, out, 3), 3u);
+        EXPECT_EQ(pie_ring_dequeue(ring, out + 3, 8), 5u);
+        EXPECT_EQ(pie_ring_dequeue(ring, out, 1), 0u);
+        for (uint32_t i = 0; i < 8; i++)
+            EXPECT_EQ(out[i].length, i);
+    }
+    pie_ring_destroy(ring);
+}
+
+TEST(PieHarness, Pcap) {
+    char path[] = "/tmp/pie-harness-XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    FILE* file = fdopen(fd, "wb");
+    const uint32_t header[6] = {0xa1b2c3d4, 0x00040002, 0, 0, 65535, 1};
+    fwrite(header, sizeof(header), 1, file);
+    for (uint32_t length = 1; length <= 2; length++) {
+        const uint32_t record[4] = {0, 0, length, length};
+        fwrite(record, sizeof(record), 1, file);
+        const uint8_t data[2] = {0xaa, 0xbb};
+        fwrite(data, length, 1, file);
+    }
+    // A truncated record is ignored.
+    const uint32_t truncated[4] = {0, 0, 100, 100};
+    fwrite(truncated, sizeof(truncated), 1, file);
+    fclose(file);
+
+    pie_pcap pcap;
+    ASSERT_EQ(pie_pcap_load(path, &pcap), 0);
+    ASSERT_EQ(pcap.count, 2u);
+    EXPECT_EQ(pcap.packets[0].length, 1u);
+    EXPECT_EQ(pcap.packets[1].length, 2u);
+    EXPECT_EQ(pcap.packets[1].data[1], 0xbb);
+    pie_pcap_free(&pcap);
+
+    EXPECT_EQ(pie_pcap_load("/nonexistent/pie.pcap", &pcap), -ENOENT);
+    remove(path);
+}
+
+TEST(PieHarness, Workers) {
+    std::vector<std::vector<uint8_t>> frames;
+    for (uint8_t flow = 0; flow < 64; flow++)
+        frames.push_back(tcp_frame(flow));
+    std::vector<pie_packet> packets;
+    for (auto& frame : frames)
+        packets.push_back({frame.data(), uint32_t(frame.size()), 0});
+
+    pie_harness_config config = {};
+    config.process_burst = fake_burst;
+    config.workers = 4;
+    config.burst = 8;
+    config.ring_size = 16;
+    auto harness = pie_harness_create(&config);
+    ASSERT_NE(harness, nullptr);
+    ASSERT_EQ(pie_harness_run(harness, packets.data(), packets.size(), 100), 0);
+
+    pie_worker_stats totals;
+    pie_harness_totals(harness, &totals);
+    EXPECT_EQ(totals.packets, 6400u);
+    EXPECT_EQ(totals.forwarded, 3200u);
+    EXPECT_EQ(totals.dropped, 3200u);
+    EXPECT_EQ(totals.bytes, 3200u * 54);
+    uint64_t packetsPerWorker = 0;
+    for (uint32_t i = 0; i < config.workers; i++)
+        packetsPerWorker += pie_harness_stats(harness, i)->packets;
+    EXPECT_EQ(packetsPerWorker, totals.packets);
+
+    // Every flow stays on one worker, and the flows are spread.
+    std::set<std::thread::id> threads;
+    for (auto& flow : flowThreads) {
+        EXPECT_EQ(flow.second.size(), 1u);
+        threads.insert(flow.second.begin(), flow.second.end());
+    }
+    EXPECT_GT(threads.size(), 1u);
+    pie_harness_destroy(harness);
+}
+
+}  // namespace Test
@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+
+#include <errno.h>
+
+#include <chrono>
+#include <thread>
+
+#include "backends/pie/runtime/pie_runtime.h"
+
+namespace Test {
+
+TEST(PieMeter, Colors) {
+    auto meter = pie_meter_create("policer", PIE_METER_BYTES, 2);
+    ASSERT_NE(meter, nullptr);
+    EXPECT_EQ(pie_meter_find("policer"), meter);
+    EXPECT_EQ(pie_meter_size(meter), 2u);
+    // Unconfigured cells and indexes out of range mark everything green.
+    EXPECT_EQ(pie_meter_execute(meter, 0, 1500), uint32_t(PIE_METER_GREEN));
+    EXPECT_EQ(pie_meter_execute(meter, 2, 1500), uint32_t(PIE_METER_GREEN));
+
+    EXPECT_EQ(pie_meter_set(meter, 0, 2000, 1000, 1000, 1000), -EINVAL);
+    EXPECT_EQ(pie_meter_set(meter, 2, 1000, 1000, 2000, 1000), -EINVAL);
+    // Slow enough that the buckets barely refill during the test.
+    ASSERT_EQ(pie_meter_set(meter, 0, 1, 1000, 2, 2000), 0);
+    EXPECT_EQ(pie_meter_execute(meter, 0, 1000), uint32_t(PIE_METER_GREEN));
+    EXPECT_EQ(pie_meter_execute(meter, 0, 600), uint32_t(PIE_METER_YELLOW));
+    EXPECT_EQ(pie_meter_execute(meter, 0, 600), uint32_t(PIE_METER_RED));
+    EXPECT_EQ(pie_meter_execute(meter, 0, 400), uint32_t(PIE_METER_YELLOW));
+    EXPECT_EQ(pie_meter_execute(meter, 1, 600), uint32_t(PIE_METER_GREEN));
+
+    ASSERT_EQ(pie_meter_clear(meter, 0), 0);
+    EXPECT_EQ(pie_meter_execute(meter, 0, 1500), uint32_t(PIE_METER_GREEN));
+    pie_meter_destroy(meter);
+    EXPECT_EQ(pie_meter_find("policer"), nullptr);
+}
+
+TEST(PieMeter, Refill) {
+    auto meter = pie_meter_create("refill", PIE_METER_PACKETS, 1);
+    ASSERT_NE(meter, nullptr);
+    // 1000 packets per second, a burst of one.
+    ASSERT_EQ(pie_meter_set(meter, 0, 1000, 1, 1000, 1), 0);
+    EXPECT_EQ(pie_meter_execute(meter, 0, 64), uint32_t(PIE_METER_GREEN));
+    EXPECT_EQ(pie_meter_execute(meter, 0, 64), uint32_t(PIE_METER_RED));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(pie_meter_execute(meter, 0, 64), uint32_t(PIE_METER_GREEN));
+    pie_meter_destroy(meter);
+}
+
+}  // namespace Test
@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "backends/pie/runtime/pie_runtime.h"
+
+namespace Test {
+
+TEST(PieProfile, MapAndLoad) {
+    std::string path = testing::TempDir() + "pie-profile-" + std::to_string(getpid());
+    const char* names[] = {"table:t:hit", "table:t:miss"};
+    uint64_t fallback[2] = {0, 0};
+    uint64_t* counters = pie_profile_map(path.c_str(), names, 2, fallback);
+    ASSERT_NE(counters, fallback);
+    counters[0] += 5;
+    counters[1] += 1;
+
+    // The same counters go on counting.
+    counters = pie_profile_map(path.c_str(), names, 2, fallback);
+    counters[0] += 2;
+
+    pie_profile profile;
+    ASSERT_EQ(pie_profile_load(path.c_str(), &profile), 0);
+    ASSERT_EQ(profile.count, 2u);
+    EXPECT_STREQ(profile.names[1], "table:t:miss");
+    EXPECT_EQ(profile.counters[0], 7u);
+    EXPECT_EQ(profile.counters[1], 1u);
+    pie_profile_free(&profile);
+
+    // Other counters start over.
+    const char* other[] = {"table:u:hit"};
+    counters = pie_profile_map(path.c_str(), other, 1, fallback);
+    EXPECT_EQ(counters[0], 0u);
+    ASSERT_EQ(pie_profile_load(path.c_str(), &profile), 0);
+    EXPECT_EQ(profile.count, 1u);
+    EXPECT_STREQ(profile.names[0], "table:u:hit");
+    pie_profile_free(&profile);
+    unlink(path.c_str());
+
+    EXPECT_EQ(pie_profile_map("/nonexistent/profile", names, 2, fallback), fallback);
+    EXPECT_EQ(pie_profile_load("/nonexistent/profile", &profile), -ENOENT);
+}
+
+}  // namespace Test
@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include "backends/pie/runtime/pie_runtime.h"
+
+namespace Test {
+
+TEST(PieRegister, ReadWrite) {
+    uint32_t cells[4] = {1, 2, 3, 4};
+    auto reg = pie_register_create("flows", cells, sizeof(cells[0]), 4);
+    ASSERT_NE(reg, nullptr);
+    EXPECT_EQ(pie_register_find("flows"), reg);
+    EXPECT_EQ(pie_register_size(reg), 4u);
+
+    uint32_t value = 0;
+    ASSERT_EQ(pie_register_read(reg, 2, &value), 0);
+    EXPECT_EQ(value, 3u);
+    value = 42;
+    ASSERT_EQ(pie_register_write(reg, 1, &value), 0);
+    EXPECT_EQ(cells[1], 42u);
+    EXPECT_EQ(pie_register_read(reg, 4, &value), -EINVAL);
+    EXPECT_EQ(pie_register_write(reg, 4, &value), -EINVAL);
+
+    pie_register_destroy(reg);
+    EXPECT_EQ(pie_register_find("flows"), nullptr);
+}
+
+TEST(PieRegister, WideCells) {
+    // Cells wider than 8 bytes are copied under the lock.
+    uint8_t cells[2][16] = {};
+    auto reg = pie_register_create("wide", cells, 16, 2);
+    ASSERT_NE(reg, nullptr);
+    uint8_t value[16];
+    memset(value, 0xab, sizeof(value));
+    ASSERT_EQ(pie_register_write(reg, 1, value), 0);
+    uint8_t copy[16] = {};
+    ASSERT_EQ(pie_register_read(reg, 1, copy), 0);
+    EXPECT_EQ(memcmp(copy, value, sizeof(value)), 0);
+    EXPECT_EQ(cells[0][0], 0);
+    pie_register_destroy(reg);
+}
+
+}  // namespace Test
@@ -0,0 +1,295 @@
+#include <gtest/gtest.h>
+
+#include <errno.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "backends/pie/runtime/pie_runtime.h"
+
+namespace Test {
+
+namespace {
+
+struct Params {
+    uint32_t port;
+};
+
+uint32_t port_of(const pie_entry* entry) {
+    return reinterpret_cast<const Params*>(entry->data)->port;
+}
+
+}  // namespace
+
+TEST(PieTable, Exact) {
+    auto table = pie_table_create("exact", PIE_TABLE_EXACT, 6, 0, sizeof(Params), 4);
+    ASSERT_NE(table, nullptr);
+    Params miss = {99};
+    pie_table_set_default(table, 0, &miss);
+
+    // Enough entries to rehash a few times.
+    for (uint32_t i = 0; i < 1000; i++) {
+        uint8_t key[6] = {0, 0, 0, 0, uint8_t(i >> 8), uint8_t(i)};
+        Params params = {i};
+        ASSERT_EQ(pie_table_add(table, key, nullptr, 0, 0, 1, &params), 0);
+    }
+    for (uint32_t i = 0; i < 1000; i++) {
+        uint8_t key[6] = {0, 0, 0, 0, uint8_t(i >> 8), uint8_t(i)};
+        auto entry = pie_exact_lookup(table, key);
+        EXPECT_EQ(entry->hit, 1u);
+        EXPECT_EQ(entry->action, 1u);
+        EXPECT_EQ(port_of(entry), i);
+    }
+
+    uint8_t key[6] = {0, 0, 0, 0, 0, 7};
+    EXPECT_EQ(pie_table_delete(table, key, nullptr, 0), 0);
+    EXPECT_EQ(pie_table_delete(table, key, nullptr, 0), -ENOENT);
+    auto entry = pie_table_lookup(table, key);
+    EXPECT_EQ(entry->hit, 0u);
+    EXPECT_EQ(port_of(entry), 99u);
+
+    EXPECT_EQ(pie_table_find("exact"), table);
+    pie_table_destroy(table);
+    EXPECT_EQ(pie_table_find("exact"), nullptr);
+}
+
+TEST(PieTable, Dir24) {
+    auto table = pie_table_create("dir24", PIE_TABLE_LPM, 4, 0, sizeof(Params), 16);
+    ASSERT_NE(table, nullptr);
+    uint8_t net8[4] = {10, 0, 0, 0};
+    uint8_t net24[4] = {10, 1, 2, 0};
+    uint8_t host[4] = {10, 1, 2, 3};
+    Params p8 = {8}, p24 = {24}, p32 = {32}, p0 = {0};
+    ASSERT_EQ(pie_table_add(table, net8, nullptr, 8, 0, 1, &p8), 0);
+    ASSERT_EQ(pie_table_add(table, host, nullptr, 32, 0, 1, &p32), 0);
+    ASSERT_EQ(pie_table_add(table, net24, nullptr, 24, 0, 1, &p24), 0);
+
+    uint8_t a[4] = {10, 1, 2, 3}, b[4] = {10, 1, 2, 4}, c[4] = {10, 9, 9, 9}, d[4] = {11, 0, 0, 1};
+    EXPECT_EQ(port_of(pie_lpm_lookup(table, a)), 32u);
+    EXPECT_EQ(port_of(pie_lpm_lookup(table, b)), 24u);
+    EXPECT_EQ(port_of(pie_lpm_lookup(table, c)), 8u);
+    EXPECT_EQ(pie_lpm_lookup(table, d)->hit, 0u);
+
+    ASSERT_EQ(pie_table_delete(table, net24, nullptr, 24), 0);
+    EXPECT_EQ(port_of(pie_lpm_lookup(table, a)), 32u);
+    EXPECT_EQ(port_of(pie_lpm_lookup(table, b)), 8u);
+
+    ASSERT_EQ(pie_table_add(table, d, nullptr, 0, 0, 1, &p0), 0);
+    EXPECT_EQ(pie_lpm_lookup(table, d)->hit, 1u);
+    ASSERT_EQ(pie_table_delete(table, host, nullptr, 32), 0);
+    ASSERT_EQ(pie_table_delete(table, net8, nullptr, 8), 0);
+    EXPECT_EQ(port_of(pie_lpm_lookup(table, a)), 0u);
+    pie_table_destroy(table);
+}
+
+TEST(PieTable, Trie) {
+    // A 16-bit exact field followed by a 48-bit LPM field.
+    auto table = pie_table_create("trie", PIE_TABLE_LPM, 8, 16, sizeof(Params), 16);
+    ASSERT_NE(table, nullptr);
+    uint8_t wide[8] = {0, 1, 0xaa, 0xbb, 0, 0, 0, 0};
+    uint8_t narrow[8] = {0, 1, 0xaa, 0xbb, 0xcc, 0, 0, 0};
+    Params p16 = {16}, p20 = {20};
+    ASSERT_EQ(pie_table_add(table, wide, nullptr, 16, 0, 1, &p16), 0);
+    ASSERT_EQ(pie_table_add(table, narrow, nullptr, 20, 0, 2, &p20), 0);
+
+    uint8_t a[8] = {0, 1, 0xaa, 0xbb, 0xcf, 1, 2, 3};
+    uint8_t b[8] = {0, 1, 0xaa, 0xbb, 0x10, 1, 2, 3};
+    uint8_t c[8] = {0, 2, 0xaa, 0xbb, 0xcc, 1, 2, 3};
+    EXPECT_EQ(pie_lpm_lookup(table, a)->action, 2u);
+    EXPECT_EQ(pie_lpm_lookup(table, b)->action, 1u);
+    EXPECT_EQ(pie_lpm_lookup(table, c)->hit, 0u);
+
+    ASSERT_EQ(pie_table_delete(table, narrow, nullptr, 20), 0);
+    EXPECT_EQ(pie_lpm_lookup(table, a)->action, 1u);
+    pie_table_destroy(table);
+}
+
+TEST(PieTable, Ternary) {
+    auto table = pie_table_create("ternary", PIE_TABLE_TERNARY, 2, 0, 0, 16);
+    ASSERT_NE(table, nullptr);
+    uint8_t any[2] = {0, 0}, high[2] = {0xff, 0}, all[2] = {0xff, 0xff};
+    uint8_t key1[2] = {0x12, 0}, key2[2] = {0x12, 0x34};
+    ASSERT_EQ(pie_table_add(table, key1, any, 0, 1, 1, nullptr), 0);
+    ASSERT_EQ(pie_table_add(table, key1, high, 0, 10, 2, nullptr), 0);
+    ASSERT_EQ(pie_table_add(table, key2, all, 0, 5, 3, nullptr), 0);
+
+    uint8_t a[2] = {0x12, 0x34}, b[2] = {0x13, 0x34};
+    EXPECT_EQ(pie_ternary_lookup(table, a)->action, 2u);
+    EXPECT_EQ(pie_ternary_lookup(table, b)->action, 1u);
+
+    ASSERT_EQ(pie_table_delete(table, key1, high, 0), 0);
+    EXPECT_EQ(pie_ternary_lookup(table, a)->action, 3u);
+    ASSERT_EQ(pie_table_delete(table, key1, any, 0), 0);
+    EXPECT_EQ(pie_ternary_lookup(table, b)->hit, 0u);
+    pie_table_destroy(table);
+}
+
+TEST(PieTable, Linear) {
+    auto table = pie_table_create("linear", PIE_TABLE_LINEAR, 2, 0, sizeof(Params), 4);
+    ASSERT_NE(table, nullptr);
+    uint8_t high[2] = {0xff, 0};
+    uint8_t key1[2] = {0x12, 0}, key2[2] = {0x12, 0x34};
+    Params one = {1}, two = {2};
+    ASSERT_EQ(pie_table_add(table, key1, high, 0, 1, 1, &one), 0);
+    ASSERT_EQ(pie_table_add(table, key2, nullptr, 0, 5, 2, &two), 0);
+
+    uint8_t a[2] = {0x12, 0x34}, b[2] = {0x12, 0x35}, c[2] = {0x13, 0x34};
+    EXPECT_EQ(port_of(pie_linear_lookup(table, a)), 2u);
+    EXPECT_EQ(pie_linear_lookup(table, b)->action, 1u);
+    EXPECT_EQ(pie_table_lookup(table, c)->hit, 0u);
+
+    // Replacing a rule moves it to its new priority.
+    ASSERT_EQ(pie_table_add(table, key1, high, 0, 10, 3, &one), 0);
+    EXPECT_EQ(pie_linear_lookup(table, a)->action, 3u);
+    ASSERT_EQ(pie_table_delete(table, key1, high, 0), 0);
+    EXPECT_EQ(pie_table_delete(table, key1, high, 0), -ENOENT);
+    EXPECT_EQ(pie_linear_lookup(table, a)->action, 2u);
+    EXPECT_EQ(pie_linear_lookup(table, b)->hit, 0u);
+    pie_table_destroy(table);
+}
+
+TEST(PieTable, Profile) {
+    auto table = pie_table_create("profiled", PIE_TABLE_EXACT, 1, 0, 0, 4);
+    ASSERT_NE(table, nullptr);
+    uint64_t maxEntries = 0;
+    pie_table_profile(table, &maxEntries);
+    for (uint8_t i = 0; i < 3; i++)
+        ASSERT_EQ(pie_table_add(table, &i, nullptr, 0, 0, 0, nullptr), 0);
+    uint8_t key = 0;
+    ASSERT_EQ(pie_table_delete(table, &key, nullptr, 0), 0);
+    ASSERT_EQ(pie_table_add(table, &key, nullptr, 0, 0, 0, nullptr), 0);
+    EXPECT_EQ(maxEntries, 3u);
+    pie_table_destroy(table);
+}
+
+TEST(PieTable, Direct) {
+    auto table = pie_table_create("direct", PIE_TABLE_TERNARY, 1, 0, 0, 4);
+    auto counter = pie_counter_create("direct-counter", 2);
+    auto meter = pie_meter_create("direct-meter", PIE_METER_PACKETS, 4);
+    ASSERT_NE(table, nullptr);
+    ASSERT_EQ(pie_table_set_direct(table, counter, meter), 0);
+    EXPECT_EQ(pie_table_set_direct(table, counter, nullptr), -EBUSY);
+
+    uint8_t key = 0x10, high = 0xf0, low = 0x0f;
+    ASSERT_EQ(pie_table_add(table, &key, &high, 0, 1, 0, nullptr), 0);
+    ASSERT_EQ(pie_table_add(table, &key, &low, 0, 2, 0, nullptr), 0);
+    // Two cells: the counter is the smaller resource.
+    uint8_t full = 0xff;
+    EXPECT_EQ(pie_table_add(table, &key, &full, 0, 3, 0, nullptr), -ENOSPC);
+    auto entry = pie_ternary_lookup(table, &key);
+    ASSERT_NE(entry->hit, 0u);
+    uint32_t cell = entry->hit - 1;
+    pie_counter_count(counter, cell, 100);
+
+    // Replacing an entry keeps its cell and its counts.
+    ASSERT_EQ(pie_table_add(table, &key, &low, 0, 2, 1, nullptr), 0);
+    EXPECT_EQ(pie_ternary_lookup(table, &key)->hit, cell + 1);
+    pie_counter_value value;
+    ASSERT_EQ(pie_counter_read(counter, cell, &value), 0);
+    EXPECT_EQ(value.packets, 1u);
+
+    // A deleted entry gives its cell back, cleared for the next one.
+    ASSERT_EQ(pie_table_delete(table, &key, &low, 0), 0);
+    ASSERT_EQ(pie_table_add(table, &key, &full, 0, 3, 0, nullptr), 0);
+    EXPECT_EQ(pie_ternary_lookup(table, &key)->hit, cell + 1);
+    ASSERT_EQ(pie_counter_read(counter, cell, &value), 0);
+    EXPECT_EQ(value.packets, 0u);
+
+    pie_table_destroy(table);
+    pie_meter_destroy(meter);
+    pie_counter_destroy(counter);
+}
+
+TEST(PieTable, Sealed) {
+    auto table = pie_table_create("sealed", PIE_TABLE_EXACT, 1, 0, sizeof(Params), 4);
+    ASSERT_NE(table, nullptr);
+    uint8_t key = 1;
+    Params params = {7};
+    ASSERT_EQ(pie_table_add(table, &key, nullptr, 0, 0, 1, &params), 0);
+    pie_table_seal(table);
+    EXPECT_EQ(pie_table_add(table, &key, nullptr, 0, 0, 2, &params), -EPERM);
+    EXPECT_EQ(pie_table_delete(table, &key, nullptr, 0), -EPERM);
+    EXPECT_EQ(pie_exact_lookup(table, &key)->action, 1u);
+
+    // The default action may still change.
+    Params miss = {99};
+    pie_table_set_default(table, 0, &miss);
+    auto entry = pie_table_default(table);
+    EXPECT_EQ(entry->hit, 0u);
+    EXPECT_EQ(port_of(entry), 99u);
+    pie_table_destroy(table);
+}
+
+TEST(PieTable, ConcurrentUpdates) {
+    // Readers check that every entry they find belongs to the key they looked
+    // up while a writer adds, modifies and deletes entries and forces
+    // rehashes, tbl8 and next hop growth.
+    auto exact = pie_table_create("churn-exact", PIE_TABLE_EXACT, 4, 0, sizeof(Params), 4);
+    auto lpm = pie_table_create("churn-lpm", PIE_TABLE_LPM, 4, 0, sizeof(Params), 4);
+    auto ternary = pie_table_create("churn-ternary", PIE_TABLE_TERNARY, 4, 0, sizeof(Params), 4);
+    ASSERT_NE(exact, nullptr);
+    ASSERT_NE(lpm, nullptr);
+    ASSERT_NE(ternary, nullptr);
+    const uint32_t keys = 512;
+    auto key_of = [](uint32_t i, uint8_t* key) {
+        key[0] = 10;
+        key[1] = uint8_t(i >> 8);
+        key[2] = uint8_t(i);
+        key[3] = uint8_t(i * 7);
+    };
+    uint8_t full[4] = {0xff, 0xff, 0xff, 0xff};
+
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> errors(0), hits(0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 2; r++) {
+        readers.emplace_back([&]() {
+            pie_rcu_register();
+            while (!stop.load()) {
+                for (uint32_t i = 0; i < keys; i++) {
+                    uint8_t key[4];
+                    key_of(i, key);
+                    for (auto table : {exact, lpm, ternary}) {
+                        auto entry = pie_table_lookup(table, key);
+                        if (entry->hit == 0)
+                            continue;
+                        hits++;
+                        if (entry->action != 1 || port_of(entry) % keys != i)
+                            errors++;
+                    }
+                }
+                pie_rcu_quiescent();
+            }
+            pie_rcu_unregister();
+        });
+    }
+
+    for (uint32_t round = 0; round < 20; round++) {
+        for (uint32_t i = 0; i < keys; i++) {
+            uint8_t key[4];
+            key_of(i, key);
+            Params params = {round * keys + i};
+            if ((i + round) % 3 == 0) {
+                pie_table_delete(exact, key, nullptr, 0);
+                pie_table_delete(lpm, key, nullptr, 32);
+                pie_table_delete(ternary, key, full, 0);
+            } else {
+                ASSERT_EQ(pie_table_add(exact, key, nullptr, 0, 0, 1, &params), 0);
+                ASSERT_EQ(pie_table_add(lpm, key, nullptr, 32, 0, 1, &params), 0);
+                ASSERT_EQ(pie_table_add(ternary, key, full, 0, int32_t(i), 1, &params), 0);
+            }
+        }
+    }
+    stop = true;
+    for (auto& reader : readers)
+        reader.join();
+    EXPECT_EQ(errors.load(), 0u);
+    EXPECT_GT(hits.load(), 0u);
+
+    pie_table_destroy(exact);
+    pie_table_destroy(lpm);
+    pie_table_destroy(ternary);
+}
+
+}  // namespace Test
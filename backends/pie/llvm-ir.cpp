@@ -6,12 +6,26 @@
 #pragma GCC diagnostic ignored "-Wunused-label" 
 #pragma GCC diagnostic ignored "-Wunused-but-set-variable"
 
+#include <algorithm>
+
+#include <llvm/ADT/Triple.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ExecutionUtils.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Module.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/MC/SubtargetFeature.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/Host.h>
 #include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/FileSystem.h"
 
@@ -22,31 +36,204 @@ PieIrBuilder::PieIrBuilder()
     , module(*new llvm::Module("pie-module", context))
     , builder(*new llvm::IRBuilder<>(context))
 {
-    // һΪvoid
-    llvm::FunctionType *functionType = llvm::FunctionType::get(llvm::Type::getVoidTy(context), false);
-    llvm::Function *helloFunction = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage, "main", &module);
- 
-    // 
-    llvm::BasicBlock *entryBlock = llvm::BasicBlock::Create(context, "entry", helloFunction);
-    builder.SetInsertPoint(entryBlock);
- 
-    // ӡ"Hello World!"
-    functionType = llvm::FunctionType::get(llvm::Type::getInt32Ty(context), false);
-    printfFunction = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage, "printf", &module);
-    builder.CreateCall(printfFunction, builder.CreateGlobalStringPtr("Hello pie!\n"));
 }
 
 void PieIrBuilder::finish()
 {
-    // 
     finished = true;
-    builder.CreateRetVoid();
 }
 
-void PieIrBuilder::add_print(const char* msg)
+int PieIrBuilder::set_target(const std::string& arch, const std::string& cpu,
+                             unsigned level)
+{
+    llvm::InitializeAllTargetInfos();
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmPrinters();
+
+    // As with llc -march, the architecture replaces the one of the host.
+    llvm::Triple triple(llvm::sys::getDefaultTargetTriple());
+    std::string error;
+    auto target = llvm::TargetRegistry::lookupTarget(arch, triple, error);
+    if (target == nullptr) {
+        llvm::errs() << "pie: cannot generate code for " << (arch.empty() ? triple.str() : arch)
+                     << ": " << error << "\n";
+        return -1;
+    }
+
+    std::string cpuName = cpu.empty() ? "generic" : cpu;
+    llvm::SubtargetFeatures features;
+    if (cpu == "native") {
+        cpuName = llvm::sys::getHostCPUName().str();
+        llvm::StringMap<bool> hostFeatures;
+        if (llvm::sys::getHostCPUFeatures(hostFeatures)) {
+            for (auto& feature : hostFeatures)
+                features.AddFeature(feature.first(), feature.second);
+        }
+    }
+    // LLVM would only warn about a CPU the target does not know.
+    std::unique_ptr<llvm::MCSubtargetInfo> subtarget(
+        target->createMCSubtargetInfo(triple.str(), "", ""));
+    if (!cpu.empty() && subtarget != nullptr && !subtarget->isCPUStringValid(cpuName)) {
+        llvm::errs() << "pie: unknown CPU '" << cpuName << "' for " << triple.getArchName()
+                     << "\n";
+        return -1;
+    }
+    static const llvm::CodeGenOpt::Level levels[] = {
+        llvm::CodeGenOpt::None, llvm::CodeGenOpt::Less, llvm::CodeGenOpt::Default,
+        llvm::CodeGenOpt::Aggressive,
+    };
+    // Shared objects need position-independent code.
+    targetMachine = target->createTargetMachine(
+        triple.str(), cpuName, features.getString(), llvm::TargetOptions(), llvm::Reloc::PIC_,
+        llvm::None, levels[std::min(level, 3u)]);
+    if (targetMachine == nullptr) {
+        llvm::errs() << "pie: cannot create a target machine for " << triple.str() << "\n";
+        return -1;
+    }
+    module.setTargetTriple(triple.str());
+    module.setDataLayout(targetMachine->createDataLayout());
+    return 0;
+}
+
+void PieIrBuilder::optimize(unsigned level, bool size)
+{
+    assert(finished && targetMachine != nullptr);
+    llvm::LoopAnalysisManager loops;
+    llvm::FunctionAnalysisManager functions;
+    llvm::CGSCCAnalysisManager sccs;
+    llvm::ModuleAnalysisManager modules;
+    llvm::PassBuilder passBuilder(targetMachine);
+    passBuilder.registerModuleAnalyses(modules);
+    passBuilder.registerCGSCCAnalyses(sccs);
+    passBuilder.registerFunctionAnalyses(functions);
+    passBuilder.registerLoopAnalyses(loops);
+    passBuilder.crossRegisterProxies(loops, functions, sccs, modules);
+
+    llvm::ModulePassManager passes;
+    if (size) {
+        passes = passBuilder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::Oz);
+    } else if (level == 0) {
+        passes = passBuilder.buildO0DefaultPipeline(llvm::OptimizationLevel::O0);
+    } else {
+        static const llvm::OptimizationLevel levels[] = {
+            llvm::OptimizationLevel::O1, llvm::OptimizationLevel::O2,
+            llvm::OptimizationLevel::O3,
+        };
+        passes = passBuilder.buildPerModuleDefaultPipeline(levels[std::min(level, 3u) - 1]);
+    }
+    passes.run(module, modules);
+}
+
+llvm::Type* PieIrBuilder::get_byte_ptr_type()
+{
+    return llvm::PointerType::getUnqual(builder.getInt8Ty());
+}
+
+llvm::Value* PieIrBuilder::create_entry_alloca(llvm::Type* type, const char* name)
 {
-    assert(!finished);
-    builder.CreateCall(printfFunction, builder.CreateGlobalStringPtr(msg));
+    auto function = builder.GetInsertBlock()->getParent();
+    auto& entry = function->getEntryBlock();
+    llvm::IRBuilder<> entryBuilder(&entry, entry.begin());
+    return entryBuilder.CreateAlloca(type, nullptr, name);
+}
+
+llvm::Value* PieIrBuilder::load_bytes(llvm::Value* base, unsigned byte_offset, unsigned bytes)
+{
+    assert(bytes > 0);
+    auto wordType = builder.getIntNTy(bytes * 8);
+    auto ptr = base;
+    if (byte_offset != 0)
+        ptr = builder.CreateConstInBoundsGEP1_32(builder.getInt8Ty(), base, byte_offset);
+    auto load = builder.CreateLoad(
+        wordType, builder.CreateBitCast(ptr, llvm::PointerType::getUnqual(wordType)), "wire");
+    load->setAlignment(llvm::Align(1));
+    if (bytes == 1 || !module.getDataLayout().isLittleEndian())
+        return load;
+    if (bytes % 2 == 0)
+        return builder.CreateUnaryIntrinsic(llvm::Intrinsic::bswap, load);
+
+    // bswap needs a whole number of 16-bit words: widen by a byte, swap,
+    // and drop the byte that moved to the bottom.
+    auto wideType = builder.getIntNTy(bytes * 8 + 8);
+    auto swapped = builder.CreateUnaryIntrinsic(llvm::Intrinsic::bswap,
+                                                builder.CreateZExt(load, wideType));
+    return builder.CreateTrunc(builder.CreateLShr(swapped, 8), wordType);
+}
+
+llvm::Value* PieIrBuilder::load_bits(llvm::Value* base, unsigned bit_offset, unsigned width)
+{
+    assert(width > 0);
+    unsigned shift = bit_offset % 8;
+    unsigned bytes = (shift + width + 7) / 8;
+    auto word = load_bytes(base, bit_offset / 8, bytes);
+
+    unsigned trailing = bytes * 8 - shift - width;
+    if (trailing != 0)
+        word = builder.CreateLShr(word, trailing);
+    return builder.CreateTrunc(word, builder.getIntNTy(width));
+}
+
+void PieIrBuilder::store_bytes(llvm::Value* base, unsigned byte_offset, llvm::Value* value,
+                               unsigned bytes)
+{
+    assert(bytes > 0);
+    auto byteType = builder.getInt8Ty();
+    auto wordType = builder.getIntNTy(bytes * 8);
+    value = builder.CreateZExtOrTrunc(value, wordType);
+    auto ptr = builder.CreateConstInBoundsGEP1_32(byteType, base, byte_offset);
+    if (bytes == 1) {
+        builder.CreateStore(value, ptr);
+        return;
+    }
+    if (bytes % 2 != 0) {
+        // A store cannot be widened like a load without clobbering the byte
+        // after it: write the leading bytes with one swapped store and the
+        // last byte on its own.
+        store_bytes(base, byte_offset, builder.CreateLShr(value, 8), bytes - 1);
+        builder.CreateStore(builder.CreateTrunc(value, byteType),
+                            builder.CreateConstInBoundsGEP1_32(byteType, ptr, bytes - 1));
+        return;
+    }
+    auto swapped = value;
+    if (module.getDataLayout().isLittleEndian())
+        swapped = builder.CreateUnaryIntrinsic(llvm::Intrinsic::bswap, value);
+    auto store = builder.CreateStore(
+        swapped, builder.CreateBitCast(ptr, llvm::PointerType::getUnqual(wordType)));
+    store->setAlignment(llvm::Align(1));
+}
+
+void PieIrBuilder::prefetch(llvm::Value* address, bool write)
+{
+    auto function = llvm::Intrinsic::getDeclaration(&module, llvm::Intrinsic::prefetch,
+                                                    { address->getType() });
+    // Arguments: read/write, locality (3 = keep in all levels), data cache.
+    builder.CreateCall(function, { address, builder.getInt32(write ? 1 : 0),
+                                   builder.getInt32(3), builder.getInt32(1) });
+}
+
+llvm::Function* PieIrBuilder::declare_function(const char* name, llvm::Type* result,
+                                               const std::vector<llvm::Type*>& args)
+{
+    auto type = llvm::FunctionType::get(result, args, false);
+    return llvm::cast<llvm::Function>(module.getOrInsertFunction(name, type).getCallee());
+}
+
+llvm::StructType* PieIrBuilder::get_struct_type(const char* name,
+                                                const std::vector<llvm::Type*>& fields)
+{
+    if (auto type = llvm::StructType::getTypeByName(context, name))
+        return type;
+    return llvm::StructType::create(context, fields, name);
+}
+
+void PieIrBuilder::ensure_open_block()
+{
+    auto block = builder.GetInsertBlock();
+    if (block->getTerminator() == nullptr)
+        return;
+    auto dead = llvm::BasicBlock::Create(context, "dead", block->getParent());
+    builder.SetInsertPoint(dead);
 }
 
 int PieIrBuilder::output(const char* filename)
@@ -64,4 +251,89 @@ int PieIrBuilder::output(const char* filename)
     return 0;
 }
 
+int PieIrBuilder::output_bitcode(const char* filename)
+{
+    assert(finished);
+    std::error_code error;
+    llvm::raw_fd_ostream out(filename, error, llvm::sys::fs::OF_None);
+    if (error)
+        return -1;
+    llvm::WriteBitcodeToFile(module, out);
+    out.close();
+    return out.has_error() ? -1 : 0;
+}
+
+int PieIrBuilder::output_object(const char* filename)
+{
+    assert(finished && targetMachine != nullptr);
+    std::error_code error;
+    llvm::raw_fd_ostream out(filename, error, llvm::sys::fs::OF_None);
+    if (error)
+        return -1;
+    llvm::legacy::PassManager passes;
+    if (targetMachine->addPassesToEmitFile(passes, out, nullptr, llvm::CGFT_ObjectFile)) {
+        llvm::errs() << "pie: the target cannot emit object files\n";
+        return -1;
+    }
+    passes.run(module);
+    out.close();
+    return out.has_error() ? -1 : 0;
+}
+
+void* PieIrBuilder::jit_lookup(const char* symbol)
+{
+    assert(finished);
+    if (jit == nullptr) {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+
+        llvm::orc::LLJITBuilder jitBuilder;
+        if (targetMachine != nullptr) {
+            // Compile for the CPU and level given to set_target().
+            llvm::orc::JITTargetMachineBuilder machine(targetMachine->getTargetTriple());
+            machine.setCPU(targetMachine->getTargetCPU().str());
+            machine.getFeatures() =
+                llvm::SubtargetFeatures(targetMachine->getTargetFeatureString());
+            machine.setCodeGenOptLevel(targetMachine->getOptLevel());
+            jitBuilder.setJITTargetMachineBuilder(std::move(machine));
+        }
+        auto created = jitBuilder.create();
+        if (!created) {
+            llvm::errs() << "pie: cannot create the JIT: " << created.takeError() << "\n";
+            return nullptr;
+        }
+        auto& lljit = **created;
+        auto& dylib = lljit.getMainJITDylib();
+        auto host = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+            lljit.getDataLayout().getGlobalPrefix());
+        if (!host) {
+            llvm::errs() << "pie: cannot search the host process: " << host.takeError() << "\n";
+            return nullptr;
+        }
+        dylib.addGenerator(std::move(*host));
+
+        // The JIT owns the module from now on; context and module were
+        // allocated by the constructor and are never freed otherwise.
+        std::unique_ptr<llvm::Module> ownedModule(&module);
+        std::unique_ptr<llvm::LLVMContext> ownedContext(&context);
+        llvm::orc::ThreadSafeModule tsm(std::move(ownedModule), std::move(ownedContext));
+        if (auto err = lljit.addIRModule(std::move(tsm))) {
+            llvm::errs() << "pie: cannot add the module to the JIT: " << err << "\n";
+            return nullptr;
+        }
+        jit = created->release();
+    }
+
+    auto address = jit->lookup(symbol);
+    if (!address) {
+        llvm::errs() << "pie: " << address.takeError() << "\n";
+        return nullptr;
+    }
+#if LLVM_VERSION_MAJOR >= 15
+    return address->toPtr<void*>();
+#else
+    return reinterpret_cast<void*>(address->getAddress());
+#endif
+}
+
 }  // end of namespace pie
@@ -1,6 +1,9 @@
 #ifndef __BACKENDS_PIE_LLVM_IR_H__
 #define __BACKENDS_PIE_LLVM_IR_H__
 
+#include <string>
+#include <vector>
+
 namespace llvm {
 
 class ConstantFolder;
@@ -8,9 +11,18 @@ class IRBuilderDefaultInserter;
 class LLVMContext;
 class Module;
 class Function;
+class BasicBlock;
+class Type;
+class Value;
+class StructType;
+class TargetMachine;
 template <typename FolderTy, typename InserterTy> class IRBuilder;
 typedef IRBuilder<ConstantFolder, IRBuilderDefaultInserter> IRDefBuilder;
 
+namespace orc {
+class LLJIT;
+}
+
 }
 
 namespace pie {
@@ -23,9 +35,70 @@ class PieIrBuilder
 
     void finish();
 
-    void add_print(const char* msg);
+    /// Creates the target machine and gives the module its triple and data
+    /// layout; must be called before any code is built. `arch` is an LLVM
+    /// architecture name such as x86-64 or aarch64, empty for the host; `cpu`
+    /// a CPU name such as skylake-avx512, "native" for the host CPU and its
+    /// features, or empty for a generic one. `level` (0 to 3) sets the code
+    /// generator optimization level. Returns 0, or -1 when LLVM cannot
+    /// generate code for the target.
+    int set_target(const std::string& arch, const std::string& cpu, unsigned level);
+
+    /// Runs the standard LLVM pipeline of optimization level `level` (0 to 3)
+    /// over the finished module, tuned for the target, or the -Oz one when
+    /// `size` is set. Level 0 still inlines always_inline functions.
+    void optimize(unsigned level, bool size);
 
+    /// Writes the finished module as LLVM IR text, as bitcode (for hosts that
+    /// link-time optimize the pipeline with their own code), or as a
+    /// position-independent object file generated in-process. All return 0
+    /// or -1.
     int output(const char* filename);
+    int output_bitcode(const char* filename);
+    int output_object(const char* filename);
+
+    /// Hands the finished module to an ORC LLJIT living in this process and
+    /// returns the address of `symbol`, or nullptr if it cannot be compiled
+    /// or found. Symbols of the host process (libc, the pie runtime) are
+    /// visible to the generated code. The module must not be changed after
+    /// the first call.
+    void* jit_lookup(const char* symbol);
+
+    /// Type of the pointers used to address packet bytes.
+    llvm::Type* get_byte_ptr_type();
+
+    /// Allocates a local variable at the start of the function being generated,
+    /// so that LLVM can promote it to registers.
+    llvm::Value* create_entry_alloca(llvm::Type* type, const char* name);
+
+    /// Reads `bytes` bytes in network byte order at `byte_offset` bytes after
+    /// the byte pointer `base`, with one unaligned load and a byte swap.
+    llvm::Value* load_bytes(llvm::Value* base, unsigned byte_offset, unsigned bytes);
+
+    /// Reads the network-order bit field of `width` bits that starts
+    /// `bit_offset` bits after the byte pointer `base`.
+    llvm::Value* load_bits(llvm::Value* base, unsigned bit_offset, unsigned width);
+
+    /// Writes the low `bytes` bytes of `value` in network byte order at
+    /// `byte_offset` bytes after the byte pointer `base`, with one unaligned
+    /// store and a byte swap (plus a one-byte store for odd sizes).
+    void store_bytes(llvm::Value* base, unsigned byte_offset, llvm::Value* value,
+                     unsigned bytes);
+
+    /// Prefetches the cache line holding `address` into all cache levels.
+    void prefetch(llvm::Value* address, bool write);
+
+    /// Declares (once) a function implemented by the pie runtime.
+    llvm::Function* declare_function(const char* name, llvm::Type* result,
+                                     const std::vector<llvm::Type*>& args);
+
+    /// Returns the named struct type, creating it with `fields` if needed.
+    llvm::StructType* get_struct_type(const char* name, const std::vector<llvm::Type*>& fields);
+
+    /// Starts a new basic block in the current function if the current one
+    /// already ends with a terminator, so that code emitted after a branch
+    /// still has a (dead) place to go.
+    void ensure_open_block();
 
     llvm::LLVMContext& get_context()
     {
@@ -44,10 +117,11 @@ class PieIrBuilder
     llvm::LLVMContext& context;
     llvm::Module& module;
     llvm::IRDefBuilder& builder;
-    llvm::Function *printfFunction = nullptr;
     bool finished = false;
+    llvm::TargetMachine* targetMachine = nullptr;
+    llvm::orc::LLJIT* jit = nullptr;
 };
 
 }  // end of namespace pie
 
-#endif  // end of __BACKENDS_PIE_LLVM_IR_H__
\ No newline at end of file
+#endif  // end of __BACKENDS_PIE_LLVM_IR_H__
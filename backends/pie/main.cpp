@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <string.h>
 #include <string>
 #include <iostream>
 
@@ -18,58 +19,146 @@
 #include "midend/convertEnums.h"
 
 #include "frontends/common/options.h"
-#include "frontends/p4/evaluator/evaluator.h"
-#include "midend/convertEnums.h"
+#include "midend.h"
+#include "options.h"
+#include "runtime/pie_harness.h"
+#include "runtime/pie_runtime.h"
+#include "stf.h"
 
-namespace pie {
-
-class MidEnd : public PassManager {
- public:
-    // These will be accurate when the mid-end completes evaluation
-    P4::ReferenceMap    refMap;
-    P4::TypeMap         typeMap;
-    const IR::ToplevelBlock   *toplevel = nullptr;
-    P4::ConvertEnums::EnumMapping enumMap;
-
-    // explicit MidEnd(BMV2Options& options);
-    explicit MidEnd()
-    {
-        bool isv1 = true; //options.isv1();
-        setName("MidEnd");
-        refMap.setIsV1(isv1);  // must be done BEFORE creating passes
-        auto evaluator = new P4::EvaluatorPass(&refMap, &typeMap);
-        addPasses({
-            evaluator,
-            new VisitFunctor([this, evaluator]() { toplevel = evaluator->getToplevelBlock(); }),
-        });
-    }
-    const IR::ToplevelBlock* process(const IR::P4Program *&program) {
-        program = program->apply(*this);
-        return toplevel; }
-};
+#include "backend.h"
 
+#pragma GCC diagnostic ignored "-Wunused-parameter"
 
-class BMV2Options : public CompilerOptions {
- public:
-};
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/FileUtilities.h>
+#include <llvm/Support/Program.h>
 
-using BMV2Context = P4CContextWithOptions<BMV2Options>;
+/// Runs the packets of --pcap through `burst` on --workers threads and
+/// prints the packet rate of every worker.
+static int run_pcap(const pie::PieOptions& options, pie_process_burst_fn burst)
+{
+    auto path = options.inputPcap.string();
+    pie_pcap pcap;
+    int ret = pie_pcap_load(path.c_str(), &pcap);
+    if (ret != 0) {
+        fprintf(stderr, "failed to read '%s': %s\n", path.c_str(), strerror(-ret));
+        return -1;
+    }
 
-}  // end of namespace pie
+    pie_harness_config config = {};
+    config.process_burst = burst;
+    config.workers = options.workers;
+    config.pin = 1;
+    auto harness = pie_harness_create(&config);
+    if (harness == nullptr) {
+        fprintf(stderr, "failed to create %u workers\n", options.workers);
+        pie_pcap_free(&pcap);
+        return -1;
+    }
+    ret = pie_harness_run(harness, pcap.packets, pcap.count, options.repeat);
+    if (ret != 0) {
+        fprintf(stderr, "failed to run the workers: %s\n", strerror(-ret));
+    } else {
+        for (unsigned i = 0; i < options.workers; i++) {
+            auto stats = pie_harness_stats(harness, i);
+            printf("worker %u: %llu packets, %llu forwarded, %.3f Mpps\n", i,
+                   (unsigned long long)stats->packets, (unsigned long long)stats->forwarded,
+                   stats->seconds > 0 ? stats->packets / stats->seconds / 1e6 : 0.0);
+        }
+        pie_worker_stats totals;
+        pie_harness_totals(harness, &totals);
+        printf("total: %llu packets, %llu forwarded, %llu dropped, %.3f Mpps\n",
+               (unsigned long long)totals.packets, (unsigned long long)totals.forwarded,
+               (unsigned long long)totals.dropped,
+               totals.seconds > 0 ? totals.packets / totals.seconds / 1e6 : 0.0);
+    }
+    pie_harness_destroy(harness);
+    pie_pcap_free(&pcap);
+    return ret == 0 ? 0 : -1;
+}
 
-#include "parser.h"
+/// Runs the STF test of --stf through the pipeline and, when it passes, its
+/// packets --repeat times to measure the packet rate. Returns 2 for tests
+/// that need features the pipeline lacks, so that drivers can skip them.
+static int run_stf(const pie::PieOptions& options, const pie_pipeline* pipeline)
+{
+    auto path = options.inputStf.string();
+    pie::PieStf stf(pipeline);
+    switch (stf.run(options.inputStf, std::cerr)) {
+    case pie::PieStf::Result::FAILED:
+        fprintf(stderr, "%s: the pipeline does not do what the test expects\n", path.c_str());
+        return 1;
+    case pie::PieStf::Result::UNSUPPORTED:
+        fprintf(stderr, "%s: skipped\n", path.c_str());
+        return 2;
+    case pie::PieStf::Result::PASSED:
+        break;
+    }
+    printf("%s: passed, %.0f pps\n", path.c_str(), stf.measure(options.repeat));
+    return 0;
+}
 
+/// Generates an object for the pipeline and links it with the runtime into
+/// the shared object `output`, with the system C compiler as linker: LLVM
+/// cannot link in-process without lld, which is not part of its libraries.
+static int emit_shared(const pie::PieOptions& options, pie::PieIrBuilder& builder,
+                       const std::string& output)
+{
+    llvm::SmallString<128> object;
+    if (llvm::sys::fs::createTemporaryFile("pie", "o", object)) {
+        fprintf(stderr, "failed to create a temporary file\n");
+        return -1;
+    }
+    llvm::FileRemover remover(object);
+    if (builder.output_object(object.c_str()) != 0)
+        return -1;
+
+    auto linker = llvm::sys::findProgramByName("cc");
+    if (!linker) {
+        fprintf(stderr,
+                "cannot link '%s': --emit shared links with the C compiler 'cc', which is not "
+                "in PATH; use --emit obj and link the object with '%s' instead\n",
+                output.c_str(), options.runtimeLibrary.string().c_str());
+        return -1;
+    }
+    auto runtime = options.runtimeLibrary.string();
+    // --whole-archive keeps every runtime function, so that the control
+    // plane finds them all in the shared object.
+    llvm::StringRef args[] = {
+        *linker, "-shared", "-o", output, object, "-Wl,--whole-archive", runtime,
+        "-Wl,--no-whole-archive", "-lpthread",
+    };
+    std::string error;
+    int status = llvm::sys::ExecuteAndWait(*linker, args, llvm::None, {}, 0, 0, &error);
+    if (status != 0) {
+        fprintf(stderr, "failed to link '%s' with '%s'%s%s\n", output.c_str(), runtime.c_str(),
+                error.empty() ? "" : ": ", error.c_str());
+        return -1;
+    }
+    return 0;
+}
 
 int main(int argc, char** argv) {
     setup_gc_logging();
 
     pie::PieIrBuilder builder;
 
-    AutoCompileContext autoBMV2Context(new pie::BMV2Context);
-    auto& options = pie::BMV2Context::get().options();
+    AutoCompileContext autoPieContext(new pie::PieContext);
+    auto& options = pie::PieContext::get().options();
 
     if (options.process(argc, argv) != nullptr)
         options.setInputFile();
+    if (!options.inputPcap.empty() && !options.jit)
+        ::error(ErrorType::ERR_INVALID, "--pcap requires --jit");
+    if (!options.inputStf.empty() && !options.jit)
+        ::error(ErrorType::ERR_INVALID, "--stf requires --jit");
+    if (!options.inputStf.empty() && !options.inputPcap.empty())
+        ::error(ErrorType::ERR_INVALID, "--stf and --pcap cannot be combined");
+    if (!options.targetArch.empty() && options.jit)
+        ::error(ErrorType::ERR_INVALID, "--march cannot be used with --jit");
+    if (!options.profileGenerate.empty() && !options.profileUse.empty())
+        ::error(ErrorType::ERR_INVALID, "--profile-generate and --profile-use cannot be combined");
     if (::errorCount() > 0)
         return 1;
 
@@ -92,7 +181,12 @@ int main(int argc, char** argv) {
         return 1;
 
     const IR::ToplevelBlock* toplevel = nullptr;
-    pie::MidEnd midEnd;
+    pie::MidEnd midEnd(options);
+    if (options.listMidendPasses) {
+        midEnd.listPasses(std::cout, cstring::newline);
+        std::cout << std::endl;
+        return 0;
+    }
     try {
         toplevel = midEnd.process(program);
         if (::errorCount() > 1 || toplevel == nullptr ||
@@ -105,34 +199,60 @@ int main(int argc, char** argv) {
     if (::errorCount() > 0)
         return 1;
     
-    pie::PieParser parser(builder);
-    toplevel->getProgram()->apply(parser);
+    // The JIT runs the pipeline right here, so it may use every feature
+    // of the host CPU.
+    auto cpu = options.targetCpu;
+    if (cpu.empty() && options.jit)
+        cpu = "native";
+    if (builder.set_target(options.targetArch, cpu, options.optimizationLevel) != 0)
+        return 1;
+    pie::PieBackend backend(options, builder, &midEnd.refMap, &midEnd.typeMap);
+    if (!backend.build(toplevel))
+        return 1;
     builder.finish();
+    builder.optimize(options.optimizationLevel, options.optimizeSize);
+    if (options.llvmStats)
+        backend.print_stats(std::cout);
   
-    // delete engine;
-    auto ret = builder.output("hello.ll");
-    if (ret != 0) {
-        fprintf(stderr, "failed to output to '%s'\n", "hello.ll");
-        return -1;
+    if (options.jit) {
+        auto create = reinterpret_cast<pie_pipeline_create_fn>(
+            builder.jit_lookup(PIE_PIPELINE_CREATE));
+        if (create == nullptr) {
+            fprintf(stderr, "failed to compile the pipeline in-process\n");
+            return -1;
+        }
+        auto pipeline = create();
+        if (!options.inputStf.empty())
+            return run_stf(options, pipeline);
+        if (!options.inputPcap.empty())
+            return run_pcap(options, pipeline->process_burst);
+        return 0;
     }
 
-    auto cmd = "llc -filetype=obj --relocation-model=pic -o hello.o hello.ll";
-    ret = system(cmd);
-    if (ret != 0) {
-        fprintf(stderr, "failed to exec '%s'\n", cmd);
-        return -1;
+    if (options.outputFile.empty()) {
+        static const char* const extensions[] = { ".ll", ".bc", ".o", ".so" };
+        options.outputFile = options.file.filename();
+        options.outputFile.replace_extension(extensions[int(options.emit)]);
+    }
+    auto output = options.outputFile.string();
+    int ret = 0;
+    switch (options.emit) {
+    case pie::PieOptions::Emit::IR:
+        ret = builder.output(output.c_str());
+        break;
+    case pie::PieOptions::Emit::BITCODE:
+        ret = builder.output_bitcode(output.c_str());
+        break;
+    case pie::PieOptions::Emit::OBJECT:
+        ret = builder.output_object(output.c_str());
+        break;
+    case pie::PieOptions::Emit::SHARED:
+        ret = emit_shared(options, builder, output);
+        break;
     }
-
-    cmd = "gcc hello.o -o hello";
-    ret = system(cmd);
     if (ret != 0) {
-        fprintf(stderr, "failed to exec '%s'\n", cmd);
+        fprintf(stderr, "failed to output to '%s'\n", output.c_str());
         return -1;
     }
-
-    cmd = "./hello";
-    printf("exec the cmd: %s\n", cmd);
-    system(cmd);
-
     return 0;
 }
@@ -0,0 +1,123 @@
+#include "midend.h"
+
+#include "frontends/common/constantFolding.h"
+#include "frontends/p4/evaluator/evaluator.h"
+#include "frontends/p4/moveDeclarations.h"
+#include "frontends/p4/simplify.h"
+#include "frontends/p4/simplifyParsers.h"
+#include "frontends/p4/strengthReduction.h"
+#include "frontends/p4/typeChecking/typeChecker.h"
+#include "midend/compileTimeOps.h"
+#include "midend/complexComparison.h"
+#include "midend/copyStructures.h"
+#include "midend/eliminateInvalidHeaders.h"
+#include "midend/eliminateNewtype.h"
+#include "midend/eliminateSerEnums.h"
+#include "midend/eliminateTuples.h"
+#include "midend/eliminateTypedefs.h"
+#include "midend/expandEmit.h"
+#include "midend/expandLookahead.h"
+#include "midend/flattenHeaders.h"
+#include "midend/flattenInterfaceStructs.h"
+#include "midend/local_copyprop.h"
+#include "midend/midEndLast.h"
+#include "midend/nestedStructs.h"
+#include "midend/orderArguments.h"
+#include "midend/parserUnroll.h"
+#include "midend/predication.h"
+#include "midend/removeAssertAssume.h"
+#include "midend/removeLeftSlices.h"
+#include "midend/removeMiss.h"
+#include "midend/removeSelectBooleans.h"
+#include "midend/simplifyKey.h"
+#include "midend/simplifySelectCases.h"
+#include "midend/simplifySelectList.h"
+#include "midend/tableHit.h"
+
+namespace pie {
+
+namespace {
+
+/// User enums become bit<32>; the v1model ones (HashAlgorithm, ...) stay
+/// enums, which the backend recognizes as extern arguments.
+class EnumOn32Bits : public P4::ChooseEnumRepresentation
+{
+    bool convert(const IR::Type_Enum* type) const override
+    {
+        if (type->srcInfo.isValid()) {
+            auto sourceFile = type->srcInfo.getSourceFile();
+            if (sourceFile.endsWith("v1model.p4"))
+                return false;
+        }
+        return true;
+    }
+    unsigned enumSize(unsigned) const override
+    {
+        return 32;
+    }
+};
+
+}  // namespace
+
+MidEnd::MidEnd(const CompilerOptions& options)
+{
+    setName("MidEnd");
+    refMap.setIsV1(true);  // must be done BEFORE creating passes
+    auto evaluator = new P4::EvaluatorPass(&refMap, &typeMap);
+    auto convertEnums = new P4::ConvertEnums(&refMap, &typeMap, new EnumOn32Bits());
+    // Keys that pack as they are; the others are computed into locals first.
+    auto simpleKey = [this]() {
+        return new P4::OrPolicy(new P4::IsValid(&refMap, &typeMap), new P4::IsMask());
+    };
+    addPasses({
+        options.ndebug ? new P4::RemoveAssertAssume(&refMap, &typeMap) : nullptr,
+        new P4::RemoveMiss(&refMap, &typeMap),
+        new P4::EliminateNewtype(&refMap, &typeMap),
+        new P4::EliminateInvalidHeaders(&refMap, &typeMap),
+        new P4::EliminateSerEnums(&refMap, &typeMap),
+        convertEnums,
+        new VisitFunctor([this, convertEnums]() { enumMap = convertEnums->getEnumMapping(); }),
+        new P4::OrderArguments(&refMap, &typeMap),
+        new P4::TypeChecking(&refMap, &typeMap),
+        new P4::SimplifyKey(&refMap, &typeMap, simpleKey()),
+        new P4::ConstantFolding(&refMap, &typeMap),
+        new P4::StrengthReduction(&typeMap),
+        new P4::SimplifySelectCases(&refMap, &typeMap, true),  // require constant keysets
+        new P4::ExpandLookahead(&refMap, &typeMap),
+        new P4::ExpandEmit(&refMap, &typeMap),
+        new P4::SimplifyParsers(&refMap),
+        new P4::StrengthReduction(&typeMap),
+        new P4::EliminateTuples(&refMap, &typeMap),
+        new P4::SimplifyComparisons(&refMap, &typeMap),
+        new P4::CopyStructures(&refMap, &typeMap),
+        new P4::NestedStructs(&refMap, &typeMap),
+        new P4::SimplifySelectList(&refMap, &typeMap),
+        new P4::RemoveSelectBooleans(&refMap, &typeMap),
+        new P4::FlattenHeaders(&refMap, &typeMap),
+        new P4::FlattenInterfaceStructs(&refMap, &typeMap),
+        new P4::Predication(&refMap),
+        new P4::MoveDeclarations(),  // more may have been introduced
+        new P4::ConstantFolding(&refMap, &typeMap),
+        new P4::LocalCopyPropagation(&refMap, &typeMap),
+        new PassRepeated({
+            new P4::ConstantFolding(&refMap, &typeMap),
+            new P4::StrengthReduction(&typeMap),
+        }),
+        new P4::SimplifyKey(&refMap, &typeMap, simpleKey()),
+        new P4::MoveDeclarations(),
+        new P4::SimplifyControlFlow(&typeMap),
+        new P4::EliminateTypedef(&refMap, &typeMap),
+        new P4::CompileTimeOperations(),
+        new P4::TableHit(&refMap, &typeMap),
+        new P4::RemoveLeftSlices(&refMap, &typeMap),
+        new P4::TypeChecking(&refMap, &typeMap),
+        options.loopsUnrolling ? new P4::ParsersUnroll(true, &refMap, &typeMap) : nullptr,
+        evaluator,
+        new VisitFunctor([this, evaluator]() { toplevel = evaluator->getToplevelBlock(); }),
+        new P4::MidEndLast(),
+    });
+    if (options.excludeMidendPasses)
+        removePasses(options.passesToExcludeMidend);
+}
+
+}  // end of namespace pie
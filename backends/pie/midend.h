@@ -0,0 +1,40 @@
+#ifndef __BACKENDS_PIE_MIDEND_H__
+#define __BACKENDS_PIE_MIDEND_H__
+
+#include "ir/ir.h"
+#include "frontends/common/options.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
+#include "frontends/p4/typeMap.h"
+#include "midend/convertEnums.h"
+
+namespace pie {
+
+/// Lowers a v1model program into the subset PieBackend compiles best: no
+/// tuples, nested structs, structs inside headers, enums, typedefs or
+/// conditionals in actions (which become selects), with locals copy
+/// propagated. The backend then lays out flat scalar state that LLVM can
+/// keep in registers instead of whole structs it has to spill.
+///
+/// Unlike bmv2, ranges in select cases and switch statements are kept:
+/// the parser matches ranges directly and switches become LLVM switches.
+class MidEnd : public PassManager
+{
+ public:
+    // These will be accurate when the mid-end completes evaluation
+    P4::ReferenceMap refMap;
+    P4::TypeMap typeMap;
+    const IR::ToplevelBlock* toplevel = nullptr;
+    P4::ConvertEnums::EnumMapping enumMap;
+
+    explicit MidEnd(const CompilerOptions& options);
+
+    const IR::ToplevelBlock* process(const IR::P4Program*& program)
+    {
+        program = program->apply(*this);
+        return toplevel;
+    }
+};
+
+}  // end of namespace pie
+
+#endif  // end of __BACKENDS_PIE_MIDEND_H__
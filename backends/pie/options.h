@@ -0,0 +1,200 @@
+#ifndef __BACKENDS_PIE_OPTIONS_H__
+#define __BACKENDS_PIE_OPTIONS_H__
+
+#include <map>
+
+#include "frontends/common/options.h"
+
+#ifndef PIE_RUNTIME_LIBRARY
+#define PIE_RUNTIME_LIBRARY "libpie_runtime.a"
+#endif
+
+namespace pie {
+
+class PieOptions : public CompilerOptions
+{
+ public:
+    /// What p4c-pie writes to outputFile.
+    enum class Emit { IR, BITCODE, OBJECT, SHARED };
+    Emit emit = Emit::IR;
+    /// Defaults to the input file with the extension of `emit`.
+    std::filesystem::path outputFile;
+    /// Linked into shared objects so that they need no other library.
+    std::filesystem::path runtimeLibrary = PIE_RUNTIME_LIBRARY;
+    /// Target of the generated code; see PieIrBuilder::set_target(). The
+    /// optimization level is CompilerOptions::optimizationLevel (-O0 to -O3).
+    std::string targetArch;
+    std::string targetCpu;
+    /// Print the size of the code generated for every P4 block.
+    bool llvmStats = false;
+    /// Compile and run the pipeline in-process instead of writing it out.
+    bool jit = false;
+    /// How many packets ahead pie_process_burst() prefetches.
+    unsigned prefetchDistance = 4;
+    /// With --jit: packets to run through the pipeline, and how.
+    std::filesystem::path inputPcap;
+    unsigned workers = 1;
+    unsigned repeat = 1;
+    /// With --jit: an STF test to check the pipeline against.
+    std::filesystem::path inputStf;
+    /// The counter file of an instrumented pipeline, and one to compile with.
+    std::filesystem::path profileGenerate;
+    std::filesystem::path profileUse;
+
+    PieOptions()
+    {
+        registerOption(
+            "-o", "outfile",
+            [this](const char* arg) {
+                outputFile = arg;
+                return true;
+            },
+            "Write the compiled pipeline to outfile (default: the input file\n"
+            "with the extension of --emit)");
+        registerOption(
+            "--emit", "kind",
+            [this](const char* arg) {
+                static const std::map<cstring, Emit> kinds = {
+                    { "ll"_cs, Emit::IR }, { "bc"_cs, Emit::BITCODE },
+                    { "obj"_cs, Emit::OBJECT }, { "shared"_cs, Emit::SHARED },
+                };
+                auto kind = kinds.find(cstring(arg));
+                if (kind == kinds.end()) {
+                    ::error(ErrorType::ERR_INVALID, "%1%: expected ll, bc, obj or shared", arg);
+                    return false;
+                }
+                emit = kind->second;
+                return true;
+            },
+            "[PIE back-end] Output format: LLVM IR text (ll, the default), bitcode\n"
+            "(bc), a position-independent object to link with libpie_runtime.a\n"
+            "(obj), or a shared object exporting the pipeline and the runtime\n"
+            "(shared). Objects are generated in-process; shared objects are\n"
+            "linked by the system C compiler.");
+        registerOption(
+            "--runtime-lib", "file",
+            [this](const char* arg) {
+                runtimeLibrary = arg;
+                return true;
+            },
+            "[PIE back-end] The libpie_runtime.a linked into --emit shared objects.");
+        registerOption(
+            "--march", "arch",
+            [this](const char* arg) {
+                targetArch = arg;
+                return true;
+            },
+            "[PIE back-end] Generate code for the LLVM architecture arch (x86-64,\n"
+            "aarch64, ...) instead of the host one; not with --jit.");
+        registerOption(
+            "--mcpu", "cpu",
+            [this](const char* arg) {
+                targetCpu = arg;
+                return true;
+            },
+            "[PIE back-end] Use the instructions of cpu and tune for it (e.g.\n"
+            "skylake-avx512), or 'native' for the host CPU. Defaults to a generic\n"
+            "CPU, or with --jit to the host one. -O0 to -O3 and -Oz select the\n"
+            "LLVM optimization pipeline.");
+        registerOption(
+            "--emit-llvm-stats", nullptr,
+            [this](const char*) {
+                llvmStats = true;
+                return true;
+            },
+            "[PIE back-end] Print the instruction counts of the optimized code of\n"
+            "every P4 parser, control and deparser.");
+        registerOption(
+            "--jit", nullptr,
+            [this](const char*) {
+                jit = true;
+                return true;
+            },
+            "[PIE back-end] Compile the pipeline in-process with the LLVM ORC JIT\n"
+            "and run it instead of writing it out.");
+        registerOption(
+            "--prefetch-distance", "n",
+            [this](const char* arg) {
+                char* end = nullptr;
+                auto distance = strtoul(arg, &end, 10);
+                if (end == arg || *end != 0 || distance > 64) {
+                    ::error(ErrorType::ERR_INVALID, "%1%: invalid prefetch distance", arg);
+                    return false;
+                }
+                prefetchDistance = distance;
+                return true;
+            },
+            "[PIE back-end] Number of packets ahead of the current one whose headers\n"
+            "pie_process_burst() prefetches (default 4, 0 disables prefetching).");
+        registerOption(
+            "--pcap", "file",
+            [this](const char* arg) {
+                inputPcap = arg;
+                return true;
+            },
+            "[PIE back-end] With --jit, run the packets of a pcap file through the\n"
+            "pipeline on --workers threads and report the packet rate.");
+        registerOption(
+            "--stf", "file",
+            [this](const char* arg) {
+                inputStf = arg;
+                return true;
+            },
+            "[PIE back-end] With --jit, run the STF test in file (as written for\n"
+            "run-bmv2-test.py) through the pipeline, then report the packet rate of\n"
+            "its packets, run --repeat times. Fails if any output differs.");
+        registerOption(
+            "--profile-generate", "file",
+            [this](const char* arg) {
+                profileGenerate = arg;
+                return true;
+            },
+            "[PIE back-end] Make the pipeline count its parser transitions, table\n"
+            "hits, misses and actions, and the entries of its tables, in file; the\n"
+            "counts of runs of the same program add up.");
+        registerOption(
+            "--profile-use", "file",
+            [this](const char* arg) {
+                profileUse = arg;
+                return true;
+            },
+            "[PIE back-end] Optimize with the counts in file, written by a pipeline\n"
+            "compiled with --profile-generate: order select cases and weigh branches\n"
+            "by how often they were taken, scan tables that held a few entries\n"
+            "linearly and size the hash tables by the entries they held.");
+        registerOption(
+            "--workers", "n",
+            [this](const char* arg) {
+                char* end = nullptr;
+                auto count = strtoul(arg, &end, 10);
+                if (end == arg || *end != 0 || count == 0 || count > 1024) {
+                    ::error(ErrorType::ERR_INVALID, "%1%: invalid number of workers", arg);
+                    return false;
+                }
+                workers = count;
+                return true;
+            },
+            "[PIE back-end] Worker threads for --pcap, between which packets are\n"
+            "distributed by their RSS hash (default 1).");
+        registerOption(
+            "--repeat", "n",
+            [this](const char* arg) {
+                char* end = nullptr;
+                auto count = strtoul(arg, &end, 10);
+                if (end == arg || *end != 0 || count == 0 || count > UINT32_MAX) {
+                    ::error(ErrorType::ERR_INVALID, "%1%: invalid repeat count", arg);
+                    return false;
+                }
+                repeat = count;
+                return true;
+            },
+            "[PIE back-end] How many times --pcap and --stf run their packets\n"
+            "(default 1).");
+    }
+};
+
+using PieContext = P4CContextWithOptions<PieOptions>;
+
+}  // end of namespace pie
+
+#endif  // end of __BACKENDS_PIE_OPTIONS_H__
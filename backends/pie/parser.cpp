@@ -0,0 +1,513 @@
+#include "parser.h"
+
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+#include <algorithm>
+#include <set>
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/MDBuilder.h>
+
+#include "frontends/p4/coreLibrary.h"
+#include "lib/error.h"
+
+namespace pie {
+
+llvm::Function* PieParser::build(const IR::P4Parser* parser, cstring name)
+{
+    functionName = name;
+    parserName = parser->name.name;
+    parser->apply(*this);
+    return function;
+}
+
+bool PieParser::preorder(const IR::P4Parser* parser)
+{
+    auto& context = builder.get_context();
+    std::vector<llvm::Type*> argTypes = {
+        builder.get_byte_ptr_type(),
+        ir().getInt32Ty(),
+        llvm::PointerType::getUnqual(ir().getInt32Ty()),
+    };
+    std::vector<const IR::Parameter*> params;
+    for (auto param : parser->getApplyParameters()->parameters) {
+        auto type = types.canonical(param->type);
+        if (type->is<IR::Type_Extern>()) {
+            packetParam = param;
+            continue;
+        }
+        params.push_back(param);
+        argTypes.push_back(llvm::PointerType::getUnqual(types.storage_type(type)));
+    }
+    auto functionType = llvm::FunctionType::get(ir().getInt32Ty(), argTypes, false);
+    function = llvm::Function::Create(functionType, llvm::Function::ExternalLinkage,
+                                      functionName.c_str(), &builder.get_module());
+    ir().SetInsertPoint(llvm::BasicBlock::Create(context, "entry", function));
+
+    auto arg = function->arg_begin();
+    packet = &*arg++;
+    packet->setName("packet");
+    length = &*arg++;
+    length->setName("length");
+    consumed = &*arg++;
+    consumed->setName("offset");
+    for (auto param : params) {
+        auto address = &*arg++;
+        address->setName(param->name.name.c_str());
+        bind(param, address);
+        // Headers in out parameters start invalid.
+        if (param->direction == IR::Direction::Out) {
+            auto storageType = types.storage_type(param->type);
+            ir().CreateStore(llvm::Constant::getNullValue(storageType), address);
+        }
+    }
+
+    offset = builder.create_entry_alloca(ir().getInt32Ty(), "cursor");
+    error = builder.create_entry_alloca(ir().getInt32Ty(), "error");
+    ir().CreateStore(ir().getInt32(0), offset);
+    ir().CreateStore(error_code(P4::P4CoreLibrary::instance().noError.name), error);
+
+    for (auto decl : parser->parserLocals) {
+        if (auto var = decl->to<IR::Declaration_Variable>())
+            declare(var);
+        else if (!decl->is<IR::Declaration_Constant>())
+            ::error(ErrorType::ERR_UNSUPPORTED, "%1%: not supported in pie parsers", decl);
+    }
+
+    states.clear();
+    for (auto state : parser->states) {
+        auto block = llvm::BasicBlock::Create(context, state->name.name.c_str(), function);
+        states.emplace(state->name.name, block);
+    }
+    ir().CreateBr(states.at(IR::ParserState::start));
+    for (auto state : parser->states)
+        visit(state);
+    return false;
+}
+
+bool PieParser::preorder(const IR::ParserState* state)
+{
+    currentState = state;
+    ir().SetInsertPoint(states.at(state->name.name));
+    if (state->name.name == IR::ParserState::accept ||
+        state->name.name == IR::ParserState::reject) {
+        ir().CreateStore(ir().CreateLoad(ir().getInt32Ty(), offset), consumed);
+        ir().CreateRet(ir().CreateLoad(ir().getInt32Ty(), error));
+        return false;
+    }
+    for (auto component : state->components)
+        emit_statement(component);
+    builder.ensure_open_block();
+    emit_transition(state->selectExpression);
+    return false;
+}
+
+llvm::BasicBlock* PieParser::state_block(const IR::Expression* state)
+{
+    auto path = state->to<IR::PathExpression>();
+    BUG_CHECK(path != nullptr, "%1%: expected a state name", state);
+    return states.at(path->path->name.name);
+}
+
+void PieParser::emit_transition(const IR::Expression* transition)
+{
+    if (transition == nullptr) {
+        ir().CreateBr(states.at(IR::ParserState::reject));
+        return;
+    }
+    if (auto select = transition->to<IR::SelectExpression>()) {
+        emit_select(select);
+        return;
+    }
+    ir().CreateBr(state_block(transition));
+}
+
+static const IR::Expression* single_keyset(const IR::Expression* keyset)
+{
+    if (auto list = keyset->to<IR::ListExpression>()) {
+        if (list->components.size() == 1)
+            return list->components.at(0);
+    }
+    return keyset;
+}
+
+cstring PieParser::transition_counter(cstring what) const
+{
+    return "parser:" + parserName + "." + currentState->name.name + ":" + what;
+}
+
+llvm::BasicBlock* PieParser::counted_target(llvm::BasicBlock* target, cstring counter)
+{
+    if (!profile.generating())
+        return target;
+    llvm::IRBuilderBase::InsertPointGuard guard(ir());
+    auto block = llvm::BasicBlock::Create(builder.get_context(), "select.count", function,
+                                          target);
+    ir().SetInsertPoint(block);
+    profile.count(counter);
+    ir().CreateBr(target);
+    return block;
+}
+
+namespace {
+
+/// The keys a keyset component matches when it is constant: those equal to
+/// `value` on the bits of `mask`.
+struct KeysetBits
+{
+    bool known;
+    llvm::APInt value;
+    llvm::APInt mask;
+};
+
+/// Whether no key matches both `left` and `right`.
+bool disjoint(const std::vector<KeysetBits>& left, const std::vector<KeysetBits>& right)
+{
+    for (size_t i = 0; i < left.size(); i++) {
+        auto& l = left.at(i);
+        auto& r = right.at(i);
+        if (l.known && r.known && !((l.value ^ r.value) & l.mask & r.mask).isZero())
+            return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+std::vector<size_t> PieParser::order_cases(const IR::SelectExpression* select,
+                                           const std::vector<const IR::Type*>& keyTypes,
+                                           const std::vector<uint64_t>& taken)
+{
+    auto& cases = select->selectCases;
+    std::vector<size_t> order;
+    for (size_t i = 0; i < cases.size(); i++)
+        order.push_back(i);
+    if (!profile.using_counts())
+        return order;
+
+    auto bitsOf = [&](const IR::Expression* element, const IR::Type* keyType) -> KeysetBits {
+        auto width = std::max(types.value_width(keyType), 1u);
+        auto constantBits = [&](const IR::Expression* expression) {
+            if (auto c = expression->to<IR::Constant>())
+                return llvm::cast<llvm::ConstantInt>(constant(c->value, width))->getValue();
+            return llvm::APInt(width, expression->to<IR::BoolLiteral>()->value ? 1 : 0);
+        };
+        auto isConstant = [](const IR::Expression* expression) {
+            return expression->is<IR::Constant>() || expression->is<IR::BoolLiteral>();
+        };
+        if (element->is<IR::DefaultExpression>())
+            return { true, llvm::APInt(width, 0), llvm::APInt(width, 0) };
+        if (isConstant(element))
+            return { true, constantBits(element), llvm::APInt::getAllOnes(width) };
+        auto mask = element->to<IR::Mask>();
+        if (mask != nullptr && isConstant(mask->left) && isConstant(mask->right)) {
+            auto bits = constantBits(mask->right);
+            return { true, constantBits(mask->left) & bits, bits };
+        }
+        return { false, llvm::APInt(width, 0), llvm::APInt(width, 0) };
+    };
+    std::vector<std::vector<KeysetBits>> keysets;
+    for (auto c : cases) {
+        std::vector<KeysetBits> bits;
+        auto list = c->keyset->to<IR::ListExpression>();
+        for (size_t i = 0; i < keyTypes.size(); i++) {
+            auto element = keyTypes.size() == 1 ? single_keyset(c->keyset)
+                         : list != nullptr ? list->components.at(i) : c->keyset;
+            bits.push_back(bitsOf(element, keyTypes.at(i)));
+        }
+        keysets.push_back(bits);
+    }
+
+    // A case only passes cases it is disjoint from, so the first case that
+    // matches a key stays the same.
+    for (size_t i = 1; i < order.size(); i++) {
+        for (size_t j = i; j > 0; j--) {
+            auto before = order.at(j - 1), after = order.at(j);
+            if (taken.at(after) <= taken.at(before) ||
+                !disjoint(keysets.at(before), keysets.at(after)))
+                break;
+            std::swap(order.at(j - 1), order.at(j));
+        }
+    }
+    return order;
+}
+
+void PieParser::emit_select(const IR::SelectExpression* select)
+{
+    auto& context = builder.get_context();
+    std::vector<llvm::Value*> keys;
+    std::vector<const IR::Type*> keyTypes;
+    for (auto key : select->select->components) {
+        keys.push_back(emit_expression(key));
+        keyTypes.push_back(type_of(key));
+    }
+    auto noMatch = llvm::BasicBlock::Create(context, "select.nomatch", function);
+
+    // How often every case was taken, and no case.
+    auto& cases = select->selectCases;
+    std::vector<cstring> counters;
+    std::vector<uint64_t> taken;
+    for (size_t i = 0; i < cases.size(); i++) {
+        counters.push_back(transition_counter(cstring::to_cstring(i)));
+        taken.push_back(profile.get(counters.back()));
+    }
+    auto noMatchCounter = transition_counter("nomatch"_cs);
+    uint64_t noMatchTaken = profile.get(noMatchCounter);
+
+    // A single key compared against constants becomes a switch instruction.
+    bool constantCases = keys.size() == 1;
+    for (auto c : cases) {
+        auto keyset = single_keyset(c->keyset);
+        if (!keyset->is<IR::DefaultExpression>() && !keyset->is<IR::Constant>() &&
+            !keyset->is<IR::BoolLiteral>() && !keyset->is<IR::Member>())
+            constantCases = false;
+    }
+
+    if (constantCases) {
+        auto inst = ir().CreateSwitch(keys[0], noMatch, cases.size());
+        std::vector<uint64_t> weights = { noMatchTaken };
+        std::set<llvm::ConstantInt*> seen;
+        for (size_t i = 0; i < cases.size(); i++) {
+            auto c = cases.at(i);
+            auto keyset = single_keyset(c->keyset);
+            if (keyset->is<IR::DefaultExpression>()) {
+                inst->setDefaultDest(counted_target(state_block(c->state), counters.at(i)));
+                weights.front() = taken.at(i);
+                break;
+            }
+            auto value = convert(emit_expression(keyset), type_of(keyset), keyTypes[0]);
+            auto label = llvm::dyn_cast<llvm::ConstantInt>(value);
+            if (label == nullptr) {
+                ::error(ErrorType::ERR_UNSUPPORTED, "%1%: keyset must be a constant", keyset);
+                continue;
+            }
+            // Only the first of several identical cases is reachable.
+            if (seen.insert(label).second) {
+                inst->addCase(label, counted_target(state_block(c->state), counters.at(i)));
+                weights.push_back(taken.at(i));
+            }
+        }
+        if (auto prof = profile.weights(weights))
+            inst->setMetadata(llvm::LLVMContext::MD_prof, prof);
+    } else {
+        uint64_t later = noMatchTaken;
+        for (auto count : taken)
+            later += count;
+        for (auto index : order_cases(select, keyTypes, taken)) {
+            auto c = cases.at(index);
+            llvm::Value* matches = ir().getTrue();
+            auto keyset = c->keyset->to<IR::ListExpression>();
+            if (keyset != nullptr && keys.size() > 1) {
+                for (size_t i = 0; i < keys.size(); i++) {
+                    auto element = keyset->components.at(i);
+                    auto match = emit_keyset_match(element, keys[i], keyTypes[i]);
+                    matches = ir().CreateAnd(matches, match);
+                }
+            } else {
+                matches = emit_keyset_match(single_keyset(c->keyset), keys[0], keyTypes[0]);
+            }
+            later -= taken.at(index);
+            auto next = llvm::BasicBlock::Create(context, "select.next", function, noMatch);
+            ir().CreateCondBr(matches, counted_target(state_block(c->state), counters.at(index)),
+                              next, profile.weights({ taken.at(index), later }));
+            ir().SetInsertPoint(next);
+        }
+        ir().CreateBr(noMatch);
+    }
+
+    ir().SetInsertPoint(noMatch);
+    if (profile.generating())
+        profile.count(noMatchCounter);
+    ir().CreateStore(error_code(P4::P4CoreLibrary::instance().noMatch.name), error);
+    ir().CreateBr(states.at(IR::ParserState::reject));
+}
+
+llvm::Value* PieParser::emit_keyset_match(const IR::Expression* keyset, llvm::Value* key,
+                                          const IR::Type* keyType)
+{
+    if (keyset->is<IR::DefaultExpression>())
+        return ir().getTrue();
+    if (auto mask = keyset->to<IR::Mask>()) {
+        auto value = convert(emit_expression(mask->left), type_of(mask->left), keyType);
+        auto bits = convert(emit_expression(mask->right), type_of(mask->right), keyType);
+        return ir().CreateICmpEQ(ir().CreateAnd(key, bits), ir().CreateAnd(value, bits));
+    }
+    if (auto range = keyset->to<IR::Range>()) {
+        auto low = convert(emit_expression(range->left), type_of(range->left), keyType);
+        auto high = convert(emit_expression(range->right), type_of(range->right), keyType);
+        if (is_signed(keyType))
+            return ir().CreateAnd(ir().CreateICmpSLE(low, key), ir().CreateICmpSLE(key, high));
+        return ir().CreateAnd(ir().CreateICmpULE(low, key), ir().CreateICmpULE(key, high));
+    }
+    if (auto path = keyset->to<IR::PathExpression>()) {
+        if (refMap->getDeclaration(path->path, true)->is<IR::P4ValueSet>()) {
+            ::error(ErrorType::ERR_UNSUPPORTED, "%1%: value sets are not supported", keyset);
+            return ir().getFalse();
+        }
+    }
+    auto value = convert(emit_expression(keyset), type_of(keyset), keyType);
+    return ir().CreateICmpEQ(key, value);
+}
+
+void PieParser::emit_method_call(const P4::MethodInstance* instance)
+{
+    auto& corelib = P4::P4CoreLibrary::instance();
+    auto arguments = instance->expr->arguments;
+    if (auto method = instance->to<P4::ExternMethod>()) {
+        auto name = method->method->name.name;
+        if (method->originalExternType->name.name == corelib.packetIn.name) {
+            if (name == corelib.packetIn.extract.name && arguments->size() == 1) {
+                emit_extract(arguments->at(0)->expression);
+                return;
+            }
+            if (name == corelib.packetIn.lookahead.name) {
+                emit_lookahead(type_of(instance->expr));
+                return;
+            }
+            if (name == corelib.packetIn.advance.name) {
+                emit_advance(arguments->at(0)->expression);
+                return;
+            }
+            if (name == corelib.packetIn.length.name) {
+                result = length;
+                return;
+            }
+        }
+    }
+    if (auto function = instance->to<P4::ExternFunction>()) {
+        if (function->method->name.name == IR::ParserState::verify) {
+            emit_verify(arguments->at(0)->expression, arguments->at(1)->expression);
+            return;
+        }
+    }
+    PieCodeGen::emit_method_call(instance);
+}
+
+llvm::Value* PieParser::has_bytes(llvm::Value* current, llvm::Value* bytes)
+{
+    return ir().CreateICmpULE(ir().CreateAdd(current, bytes), length);
+}
+
+void PieParser::reject_unless(llvm::Value* condition, llvm::Value* code)
+{
+    auto& context = builder.get_context();
+    auto ok = llvm::BasicBlock::Create(context, "ok", function);
+    auto fail = llvm::BasicBlock::Create(context, "fail", function);
+    auto weights = llvm::MDBuilder(context).createBranchWeights(2000, 1);
+    ir().CreateCondBr(condition, ok, fail, weights);
+    ir().SetInsertPoint(fail);
+    ir().CreateStore(code, error);
+    ir().CreateBr(states.at(IR::ParserState::reject));
+    ir().SetInsertPoint(ok);
+}
+
+void PieParser::emit_extract(const IR::Expression* destination)
+{
+    auto& corelib = P4::P4CoreLibrary::instance();
+    auto type = type_of(destination)->to<IR::Type_Header>();
+    if (type == nullptr) {
+        ::error(ErrorType::ERR_UNSUPPORTED, "%1%: only headers can be extracted", destination);
+        return;
+    }
+    unsigned width = 0;
+    for (auto field : type->fields)
+        width += types.value_width(field->type);
+    if (width % 8 != 0) {
+        ::error(ErrorType::ERR_UNSUPPORTED, "%1%: header size must be a multiple of 8 bits",
+                destination);
+        return;
+    }
+
+    llvm::Value* header = nullptr;
+    llvm::Value* nextAddress = nullptr;
+    llvm::Value* next = nullptr;
+    auto member = destination->to<IR::Member>();
+    if (member != nullptr && member->member.name == IR::Type_Stack::next) {
+        auto stack = type_of(member->expr)->to<IR::Type_Stack>();
+        auto stackAddress = emit_address(member->expr);
+        nextAddress = ir().CreateStructGEP(types.storage_type(stack), stackAddress, 1);
+        next = ir().CreateLoad(ir().getInt32Ty(), nextAddress);
+        reject_unless(ir().CreateICmpULT(next, ir().getInt32(stack->getSize())),
+                      error_code(corelib.stackOutOfBounds.name));
+        header = stack_element(stackAddress, stack, next);
+    } else {
+        header = emit_address(destination);
+    }
+
+    auto current = ir().CreateLoad(ir().getInt32Ty(), offset);
+    auto bytes = ir().getInt32(width / 8);
+    reject_unless(has_bytes(current, bytes), error_code(corelib.packetTooShort.name));
+    auto base = ir().CreateInBoundsGEP(ir().getInt8Ty(), packet, current);
+
+    // One wide load of the whole header; every field is then a shift and a
+    // truncation of it. LLVM splits loads wider than a register into
+    // register-sized ones.
+    auto layout = types.get_layout(type);
+    auto wire = width != 0 ? builder.load_bytes(base, 0, width / 8) : nullptr;
+    unsigned bitOffset = 0;
+    for (auto field : type->fields) {
+        auto fieldWidth = types.value_width(field->type);
+        if (fieldWidth == 0)
+            continue;
+        auto value = wire;
+        if (width - bitOffset - fieldWidth != 0)
+            value = ir().CreateLShr(value, width - bitOffset - fieldWidth);
+        value = ir().CreateTrunc(value, ir().getIntNTy(fieldWidth),
+                                 field->name.name.c_str());
+        auto address = ir().CreateStructGEP(layout->type, header,
+                                            layout->fieldIndex.at(field->name.name));
+        store_value(address, field->type, value);
+        bitOffset += fieldWidth;
+    }
+    ir().CreateStore(ir().getInt8(1), valid_address(header, type));
+    ir().CreateStore(ir().CreateAdd(current, ir().getInt32(1)), origin_address(header, type));
+    ir().CreateStore(ir().CreateAdd(current, bytes), offset);
+    if (nextAddress != nullptr)
+        ir().CreateStore(ir().CreateAdd(next, ir().getInt32(1)), nextAddress);
+}
+
+void PieParser::emit_lookahead(const IR::Type* type)
+{
+    if (!type->is<IR::Type_Bits>() && !type->is<IR::Type_Boolean>()) {
+        ::error(ErrorType::ERR_UNSUPPORTED, "%1%: lookahead is only supported for bit types",
+                type);
+        result = llvm::UndefValue::get(types.value_type(type));
+        return;
+    }
+    auto width = types.value_width(type);
+    auto current = ir().CreateLoad(ir().getInt32Ty(), offset);
+    reject_unless(has_bytes(current, ir().getInt32((width + 7) / 8)),
+                  error_code(P4::P4CoreLibrary::instance().packetTooShort.name));
+    auto base = ir().CreateInBoundsGEP(ir().getInt8Ty(), packet, current);
+    result = builder.load_bits(base, 0, width);
+}
+
+void PieParser::emit_advance(const IR::Expression* bits)
+{
+    // The cursor counts bytes, so only whole bytes can be skipped: a constant
+    // amount is checked here, any other one when the packet is parsed.
+    if (auto constant = bits->to<IR::Constant>()) {
+        if (constant->value % 8 != 0) {
+            ::error(ErrorType::ERR_UNSUPPORTED,
+                    "%1%: advance must skip a multiple of 8 bits", bits);
+            return;
+        }
+    }
+    auto amount = ir().CreateZExtOrTrunc(emit_expression(bits), ir().getInt32Ty());
+    if (!bits->is<IR::Constant>())
+        reject_unless(ir().CreateICmpEQ(ir().CreateAnd(amount, 7), ir().getInt32(0)),
+                      error_code("ParserInvalidArgument"_cs));
+    auto bytes = ir().CreateLShr(amount, 3);
+    auto current = ir().CreateLoad(ir().getInt32Ty(), offset);
+    reject_unless(has_bytes(current, bytes),
+                  error_code(P4::P4CoreLibrary::instance().packetTooShort.name));
+    ir().CreateStore(ir().CreateAdd(current, bytes), offset);
+}
+
+void PieParser::emit_verify(const IR::Expression* condition, const IR::Expression* code)
+{
+    auto holds = emit_expression(condition);
+    reject_unless(holds, emit_expression(code));
+}
+
+}  // end of namespace pie
@@ -1,36 +1,83 @@
 #ifndef __BACKENDS_PIE_PARSER_H__
 #define __BACKENDS_PIE_PARSER_H__
 
+#include <map>
+
 #include "ir/ir.h"
-#include "lib/json.h"
 #include "frontends/p4/typeMap.h"
 #include "frontends/common/resolveReferences/referenceMap.h"
-#include "llvm-ir.h"
+#include "codegen.h"
+#include "profile.h"
 
 namespace pie {
 
-class PieParser : public Inspector
+/// Compiles a P4 parser into an LLVM function
+///
+///     i32 parser(i8* packet, i32 length, i32* offset, <params>...)
+///
+/// Every parser state becomes a basic block that extracts headers from the
+/// packet and branches to the next state. `offset` receives the number of
+/// bytes consumed; the result is the parser error code (0 is NoError).
+/// Non-packet parameters are passed by pointer to their storage.
+///
+/// Selects on a single key compared with constants become switches, the
+/// others chains of comparisons in case order. With a profile, the
+/// transitions get branch weights, and a case of the chain moves before the
+/// less frequent cases that no key can match together with it.
+class PieParser : public PieCodeGen
 {
  public:
-    PieParser(PieIrBuilder& builder)
-        : builder(builder) {}
-
-    bool preorder(const IR::ParserState* state) override
-    {
-        auto name = state->name.name.c_str();
-        printf("visit state: %s\n", name);
-        cstring msg("    the parser found a state: ");
-        msg += name;
-        msg += "\n";
-        builder.add_print(msg.c_str());
-        return false;
-    }
+    PieParser(PieIrBuilder& builder, P4::ReferenceMap* refMap, P4::TypeMap* typeMap,
+              PieTypeFactory& types, PieProfile& profile)
+        : PieCodeGen(builder, refMap, typeMap, types)
+        , profile(profile) {}
+
+    llvm::Function* build(const IR::P4Parser* parser, cstring name);
+
+    bool preorder(const IR::P4Parser* parser) override;
+    bool preorder(const IR::ParserState* state) override;
+
+ protected:
+    void emit_method_call(const P4::MethodInstance* instance) override;
+
  private:
-    pie::PieIrBuilder& builder;
-    P4::ReferenceMap*    refMap = nullptr;
-    P4::TypeMap*         typeMap = nullptr;
+    void emit_transition(const IR::Expression* transition);
+    void emit_select(const IR::SelectExpression* select);
+    /// Order of the cases of a comparison chain, given how often each was taken.
+    std::vector<size_t> order_cases(const IR::SelectExpression* select,
+                                    const std::vector<const IR::Type*>& keyTypes,
+                                    const std::vector<uint64_t>& taken);
+    /// Profile counter of the transition `what` of the current state.
+    cstring transition_counter(cstring what) const;
+    /// Branches to `target`, through a block counting `counter` when profiling.
+    llvm::BasicBlock* counted_target(llvm::BasicBlock* target, cstring counter);
+    llvm::Value* emit_keyset_match(const IR::Expression* keyset, llvm::Value* key,
+                                   const IR::Type* keyType);
+    void emit_extract(const IR::Expression* destination);
+    void emit_lookahead(const IR::Type* type);
+    void emit_advance(const IR::Expression* bits);
+    void emit_verify(const IR::Expression* condition, const IR::Expression* code);
+    /// Continues only when `condition` holds; otherwise sets the error and rejects.
+    void reject_unless(llvm::Value* condition, llvm::Value* code);
+    /// Checks that `bytes` more bytes are available after `current`.
+    llvm::Value* has_bytes(llvm::Value* current, llvm::Value* bytes);
+    llvm::BasicBlock* state_block(const IR::Expression* state);
+
+    PieProfile& profile;
+    cstring functionName;
+    cstring parserName;
+    const IR::ParserState* currentState = nullptr;
+    llvm::Function* function = nullptr;
+    const IR::Parameter* packetParam = nullptr;
+    llvm::Value* packet = nullptr;
+    llvm::Value* length = nullptr;
+    llvm::Value* consumed = nullptr;
+    /// Parser-local storage for the cursor (in bytes) and the error code.
+    llvm::Value* offset = nullptr;
+    llvm::Value* error = nullptr;
+    std::map<cstring, llvm::BasicBlock*> states;
 };
 
 }  // end of namespace pie
 
-#endif  // end of __BACKENDS_PIE_PARSER_H__
\ No newline at end of file
+#endif  // end of __BACKENDS_PIE_PARSER_H__
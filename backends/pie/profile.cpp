@@ -0,0 +1,151 @@
+#include "profile.h"
+
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Module.h>
+
+#include "lib/error.h"
+#include "runtime/pie_runtime.h"
+
+namespace pie {
+
+bool PieProfile::use(const std::filesystem::path& path)
+{
+    pie_profile profile;
+    int ret = pie_profile_load(path.c_str(), &profile);
+    if (ret != 0) {
+        ::error(ErrorType::ERR_IO, "%1%: cannot read profile: %2%", path.string(),
+                ret == -EINVAL ? "not a pie profile" : strerror(-ret));
+        return false;
+    }
+    for (uint32_t i = 0; i < profile.count; i++)
+        counts.emplace(cstring(profile.names[i]), profile.counters[i]);
+    pie_profile_free(&profile);
+    return true;
+}
+
+unsigned PieProfile::counter(cstring name)
+{
+    auto it = indexes.emplace(name, names.size());
+    if (it.second)
+        names.push_back(name);
+    return it.first->second;
+}
+
+llvm::GlobalVariable* PieProfile::get_global()
+{
+    if (global == nullptr) {
+        auto i64Ptr = llvm::PointerType::getUnqual(builder.get_builder().getInt64Ty());
+        global = new llvm::GlobalVariable(builder.get_module(), i64Ptr, false,
+                                          llvm::GlobalValue::PrivateLinkage,
+                                          llvm::ConstantPointerNull::get(i64Ptr), "pie.profile");
+    }
+    return global;
+}
+
+llvm::Value* PieProfile::counters()
+{
+    auto& ir = builder.get_builder();
+    return ir.CreateLoad(llvm::PointerType::getUnqual(ir.getInt64Ty()), get_global());
+}
+
+llvm::Value* PieProfile::address(cstring name)
+{
+    auto& ir = builder.get_builder();
+    return ir.CreateConstInBoundsGEP1_32(ir.getInt64Ty(), counters(), counter(name));
+}
+
+void PieProfile::count(cstring name)
+{
+    count(builder.get_builder().getInt32(counter(name)));
+}
+
+void PieProfile::count(llvm::Value* index)
+{
+    // Workers, and the processes sharing the file, count into the same
+    // cells: relaxed atomic adds lose no counts and order nothing else.
+    auto& ir = builder.get_builder();
+    auto address = ir.CreateInBoundsGEP(ir.getInt64Ty(), counters(), index);
+    ir.CreateAtomicRMW(llvm::AtomicRMWInst::Add, address, ir.getInt64(1), llvm::MaybeAlign(8),
+                       llvm::AtomicOrdering::Monotonic);
+}
+
+bool PieProfile::has(cstring name) const
+{
+    return counts.count(name) != 0;
+}
+
+uint64_t PieProfile::get(cstring name) const
+{
+    auto it = counts.find(name);
+    asked++;
+    if (it == counts.end())
+        return 0;
+    found++;
+    return it->second;
+}
+
+llvm::MDNode* PieProfile::weights(const std::vector<uint64_t>& branches) const
+{
+    uint64_t most = 0;
+    for (auto count : branches)
+        most = std::max(most, count);
+    if (most == 0)
+        return nullptr;
+    // Weights are 32-bit; only their ratios matter.
+    uint64_t scale = most / UINT32_MAX + 1;
+    std::vector<uint32_t> scaled;
+    for (auto count : branches)
+        scaled.push_back(static_cast<uint32_t>(count / scale));
+    return llvm::MDBuilder(builder.get_context()).createBranchWeights(scaled);
+}
+
+void PieProfile::finish(llvm::BasicBlock* init)
+{
+    if (using_counts() && asked != 0 && found == 0) {
+        ::warning(ErrorType::WARN_MISMATCH,
+                  "the profile has no counts for this program; it is not used");
+    }
+    if (!generating())
+        return;
+    auto& ir = builder.get_builder();
+    auto& module = builder.get_module();
+    llvm::IRBuilderBase::InsertPointGuard guard(ir);
+    ir.SetInsertPoint(init, init->getFirstInsertionPt());
+
+    auto bytePtr = builder.get_byte_ptr_type();
+    auto i64Ptr = llvm::PointerType::getUnqual(ir.getInt64Ty());
+    std::vector<llvm::Constant*> strings;
+    for (auto name : names) {
+        strings.push_back(llvm::cast<llvm::Constant>(
+            ir.CreateGlobalStringPtr(name.c_str(), "pie.counter", 0, &module)));
+    }
+    auto namesType = llvm::ArrayType::get(bytePtr, names.size());
+    auto namesArray = new llvm::GlobalVariable(
+        module, namesType, true, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantArray::get(namesType, strings), "pie.counters");
+    // Counts go here when the file cannot be mapped.
+    auto fallbackType = llvm::ArrayType::get(ir.getInt64Ty(), std::max<size_t>(names.size(), 1));
+    auto fallback = new llvm::GlobalVariable(
+        module, fallbackType, false, llvm::GlobalValue::PrivateLinkage,
+        llvm::ConstantAggregateZero::get(fallbackType), "pie.profile.fallback");
+
+    auto map = builder.declare_function(
+        "pie_profile_map", i64Ptr,
+        { bytePtr, llvm::PointerType::getUnqual(bytePtr), ir.getInt32Ty(), i64Ptr });
+    auto mapped = ir.CreateCall(map, {
+        ir.CreateGlobalStringPtr(output.string(), "pie.profile.path", 0, &module),
+        ir.CreateBitCast(namesArray, llvm::PointerType::getUnqual(bytePtr)),
+        ir.getInt32(names.size()), ir.CreateBitCast(fallback, i64Ptr),
+    });
+    ir.CreateStore(mapped, get_global());
+}
+
+}  // end of namespace pie
@@ -0,0 +1,90 @@
+#ifndef __BACKENDS_PIE_PROFILE_H__
+#define __BACKENDS_PIE_PROFILE_H__
+
+#include <filesystem>
+#include <map>
+#include <vector>
+
+#include "lib/cstring.h"
+#include "llvm-ir.h"
+
+namespace llvm {
+class GlobalVariable;
+class MDNode;
+}
+
+namespace pie {
+
+/// Execution profile of a pipeline, for profile-guided compilation.
+///
+/// With --profile-generate, the generated code counts named events in the
+/// shared counter file of runtime/pie_profile.c: parser transitions
+/// (`parser:<parser>.<state>:<case>`, or `:nomatch`), table hits and misses
+/// (`table:<table>:hit`, `:miss`), the actions tables run
+/// (`table:<table>:action:<action>`) and the most entries every table held
+/// (`table:<table>:entries`). With --profile-use, the counts of such a file
+/// drive the code generators: branch weights of selects and action
+/// dispatches, the order of select cases and the kind of every table.
+class PieProfile
+{
+ public:
+    explicit PieProfile(PieIrBuilder& builder)
+        : builder(builder) {}
+
+    /// Counts events into the file at `path` once pie_init() has run.
+    void generate(const std::filesystem::path& path)
+    {
+        output = path;
+    }
+    /// Reads the counts in `path`; reports an error and returns false when
+    /// it is not a profile.
+    bool use(const std::filesystem::path& path);
+
+    bool generating() const
+    {
+        return !output.empty();
+    }
+    bool using_counts() const
+    {
+        return !counts.empty();
+    }
+
+    /// Increments the counter `name` at the insertion point.
+    void count(cstring name);
+    /// Increments the counter whose index (see counter()) is the i32 `index`.
+    void count(llvm::Value* index);
+    /// Index of the counter `name`, allocated on first use.
+    unsigned counter(cstring name);
+    /// Address of the i64 counter `name`; valid once pie_init() has run.
+    llvm::Value* address(cstring name);
+
+    /// Whether the profile in use counted `name`, and how many times.
+    bool has(cstring name) const;
+    uint64_t get(cstring name) const;
+    /// Branch weights for the successors of a terminator, in order, or
+    /// nullptr when nothing was counted.
+    llvm::MDNode* weights(const std::vector<uint64_t>& counts) const;
+
+    /// Maps the counters at the start of `init`, the entry block of
+    /// pie_init(), once every counter has been allocated. Warns when the
+    /// profile in use has none of the counts the code generators asked for.
+    void finish(llvm::BasicBlock* init);
+
+ private:
+    llvm::GlobalVariable* get_global();
+    llvm::Value* counters();
+
+    PieIrBuilder& builder;
+    std::filesystem::path output;
+    std::vector<cstring> names;
+    std::map<cstring, unsigned> indexes;
+    /// Holds the `uint64_t*` returned by pie_profile_map().
+    llvm::GlobalVariable* global = nullptr;
+    std::map<cstring, uint64_t> counts;
+    mutable unsigned asked = 0;
+    mutable unsigned found = 0;
+};
+
+}  // end of namespace pie
+
+#endif  // end of __BACKENDS_PIE_PROFILE_H__
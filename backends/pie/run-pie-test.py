@@ -0,0 +1,326 @@
+#!/usr/bin/env python3
+# Compiles a sample P4 program with p4c-pie and checks the LLVM IR emitted
+# for its parser and deparser: headers must be read and written with wide
+# loads and stores and byte swaps, not one byte at a time. Then builds it as a shared object and checks that a
+# host can load it and find its tables through the C interface. Finally, if
+# the program has an STF test, runs it with --jit --stf: the pipeline must
+# send the packets that bmv2 is expected to, and its packet rate is logged.
+
+import argparse
+import ctypes
+import logging
+import re
+import shutil
+import sys
+import tempfile
+from pathlib import Path
+
+FILE_DIR = Path(__file__).resolve().parent
+sys.path.append(str(FILE_DIR.joinpath("../../tools")))
+import testutils
+
+PARSER = argparse.ArgumentParser()
+PARSER.add_argument("rootdir", help="the root directory of the compiler source tree")
+PARSER.add_argument("p4filename", help="the p4 file to process")
+PARSER.add_argument(
+    "-c", "--compiler", dest="compiler", default="p4c-pie", help="the p4c-pie binary"
+)
+PARSER.add_argument(
+    "-b",
+    "--nocleanup",
+    action="store_false",
+    help="do not remove temporary results for failing tests",
+)
+PARSER.add_argument(
+    "-l",
+    "--log_level",
+    dest="log_level",
+    default="WARNING",
+    choices=["CRITICAL", "ERROR", "WARNING", "INFO", "DEBUG", "NOTSET"],
+    help="the log level of the test",
+)
+PARSER.add_argument(
+    "--repeat",
+    dest="repeat",
+    type=int,
+    default=100000,
+    help="how many times the packets of the STF test are run to measure the packet rate",
+)
+PARSER.add_argument(
+    "--pps-log",
+    dest="pps_log",
+    help="append the program and the packet rate of its STF test to this file",
+)
+
+FUNCTION = re.compile(r"^define .*@(pie_(?:parser|deparser)_\w+)\(")
+# A byte at a constant offset from another pointer into the packet.
+BYTE_GEP = re.compile(
+    r"^\s*(%[\w.]+) = getelementptr inbounds i8, i8\* (%[\w.]+), i(?:32|64) \d+$"
+)
+BYTE_LOAD = re.compile(r"= load i8, i8\* (%[\w.]+)")
+WIDE_LOAD = re.compile(r"%wire[\w.]* = load i(\d+), ")
+BYTE_STORE = re.compile(r"^\s*store i8 [^,]+, i8\* (%[\w.]+)")
+WIDE_STORE = re.compile(r"^\s*store i(\d+) [^,]+, i\d+\* %[\w.]+, align 1$")
+
+
+def pipeline_functions(ir: str) -> dict:
+    """Returns the body of every parser and deparser function in ir, by name."""
+    functions = {}
+    name = None
+    for line in ir.splitlines():
+        match = FUNCTION.match(line)
+        if match:
+            name = match.group(1)
+            functions[name] = []
+        elif name is not None:
+            if line == "}":
+                name = None
+            else:
+                functions[name].append(line)
+    return functions
+
+
+def check_parser(name: str, body: list) -> int:
+    """Fails if a parser reads packet bytes one at a time."""
+    byte_pointers = set()
+    wide_loads = 0
+    for line in body:
+        match = BYTE_GEP.match(line)
+        if match:
+            byte_pointers.add(match.group(1))
+            continue
+        match = BYTE_LOAD.search(line)
+        if match and match.group(1) in byte_pointers:
+            logging.error("%s reads a byte at a time: %s", name, line.strip())
+            return testutils.FAILURE
+        match = WIDE_LOAD.search(line)
+        if match and int(match.group(1)) > 8:
+            wide_loads += 1
+    if wide_loads == 0:
+        logging.error("%s extracts no header with a wide load", name)
+        return testutils.FAILURE
+    if not any("@llvm.bswap." in line for line in body):
+        logging.error("%s does not byte-swap the headers it extracts", name)
+        return testutils.FAILURE
+    return testutils.SUCCESS
+
+
+def check_deparser(name: str, body: list) -> int:
+    """Fails if a deparser writes packet bytes one at a time."""
+    # Byte pointers by the pointer they are an offset from. An odd-sized
+    # header ends with a single byte store, but never more than one off the
+    # same pointer.
+    byte_bases = {}
+    byte_stores = {}
+    wide_stores = 0
+    for line in body:
+        match = BYTE_GEP.match(line)
+        if match:
+            byte_bases[match.group(1)] = match.group(2)
+            continue
+        match = BYTE_STORE.match(line)
+        if match and match.group(1) in byte_bases:
+            base = byte_bases[match.group(1)]
+            byte_stores[base] = byte_stores.get(base, 0) + 1
+            if byte_stores[base] > 1:
+                logging.error("%s writes a byte at a time: %s", name, line.strip())
+                return testutils.FAILURE
+            continue
+        match = WIDE_STORE.match(line)
+        if match and int(match.group(1)) > 8:
+            wide_stores += 1
+    if wide_stores == 0:
+        logging.error("%s emits no header with a wide store", name)
+        return testutils.FAILURE
+    if not any("@llvm.bswap." in line for line in body):
+        logging.error("%s does not byte-swap the headers it emits", name)
+        return testutils.FAILURE
+    return testutils.SUCCESS
+
+
+# runtime/pie_runtime.h
+PIE_ABI_VERSION = 2
+
+
+class FieldInfo(ctypes.Structure):
+    _fields_ = [
+        ("name", ctypes.c_char_p),
+        ("match", ctypes.c_uint32),
+        ("width", ctypes.c_uint32),
+        ("offset", ctypes.c_uint32),
+        ("size", ctypes.c_uint32),
+    ]
+
+
+class ActionInfo(ctypes.Structure):
+    _fields_ = [
+        ("name", ctypes.c_char_p),
+        ("data_size", ctypes.c_uint32),
+        ("param_count", ctypes.c_uint32),
+        ("params", ctypes.POINTER(FieldInfo)),
+    ]
+
+
+class TableInfo(ctypes.Structure):
+    _fields_ = [
+        ("name", ctypes.c_char_p),
+        ("kind", ctypes.c_uint32),
+        ("key_size", ctypes.c_uint32),
+        ("lpm_start", ctypes.c_uint32),
+        ("key_count", ctypes.c_uint32),
+        ("keys", ctypes.POINTER(FieldInfo)),
+        ("action_count", ctypes.c_uint32),
+        ("actions", ctypes.POINTER(ActionInfo)),
+    ]
+
+
+class Pipeline(ctypes.Structure):
+    _fields_ = [
+        ("abi_version", ctypes.c_uint32),
+        ("program", ctypes.c_char_p),
+        ("process_packet", ctypes.c_void_p),
+        ("process_burst", ctypes.c_void_p),
+        ("table_count", ctypes.c_uint32),
+        ("tables", ctypes.POINTER(TableInfo)),
+    ]
+
+
+def check_shared(args, argv, tmpdir: Path) -> int:
+    """Fails if the pipeline cannot be loaded and set up as a shared object."""
+    output = tmpdir.joinpath("pipeline.so")
+    result = testutils.exec_process(
+        f"{args.compiler} -O3 --emit-llvm-stats --emit shared -o {output} {' '.join(argv)} "
+        f"{args.p4filename}",
+        cwd=tmpdir,
+    )
+    if result.returncode != testutils.SUCCESS:
+        # p4c-pie links with cc and explains if it is missing.
+        logging.error("%s failed to build a shared object for %s", args.compiler, args.p4filename)
+        logging.error("%s", result.output)
+        return testutils.FAILURE
+    if "pie_parser_" not in result.output:
+        logging.error("--emit-llvm-stats does not report the parser")
+        return testutils.FAILURE
+
+    library = ctypes.CDLL(str(output))
+    library.pie_pipeline_create.restype = ctypes.POINTER(Pipeline)
+    library.pie_table_find.restype = ctypes.c_void_p
+    library.pie_table_find.argtypes = [ctypes.c_char_p]
+    pipeline = library.pie_pipeline_create().contents
+    if pipeline.abi_version != PIE_ABI_VERSION:
+        logging.error("%s has ABI version %d", output, pipeline.abi_version)
+        return testutils.FAILURE
+    if not pipeline.process_packet or not pipeline.process_burst:
+        logging.error("%s does not export its entry points", output)
+        return testutils.FAILURE
+    for i in range(pipeline.table_count):
+        table = pipeline.tables[i]
+        if not library.pie_table_find(table.name):
+            logging.error("%s: table %s was not created", output, table.name.decode())
+            return testutils.FAILURE
+        for j in range(table.key_count):
+            key = table.keys[j]
+            if key.offset + key.size > table.key_size or key.width > 8 * key.size:
+                logging.error("%s: key %s is outside the key", output, key.name.decode())
+                return testutils.FAILURE
+    return testutils.SUCCESS
+
+
+# Exit status of p4c-pie for STF tests that need what pie does not support.
+STF_UNSUPPORTED = 2
+STF_PASSED = re.compile(r": passed, (\d+) pps$", re.MULTILINE)
+
+
+def check_stf(args, argv, tmpdir: Path) -> int:
+    """Fails if the pipeline does not pass the STF test that bmv2 passes."""
+    stf = Path(args.p4filename).resolve().with_suffix(".stf")
+    if not stf.is_file():
+        return testutils.SUCCESS
+    result = testutils.exec_process(
+        f"{args.compiler} --jit --stf {stf} --repeat {args.repeat} {' '.join(argv)} "
+        f"{args.p4filename}",
+        cwd=tmpdir,
+    )
+    if result.returncode == STF_UNSUPPORTED:
+        logging.warning("%s needs features the pie backend does not support", stf)
+        return testutils.SUCCESS
+    match = STF_PASSED.search(result.output or "")
+    if result.returncode != testutils.SUCCESS or match is None:
+        logging.error("%s does not pass %s", args.p4filename, stf)
+        return testutils.FAILURE
+    logging.info("%s: %s packets/s", args.p4filename, match.group(1))
+    if args.pps_log:
+        with open(args.pps_log, "a") as log:
+            log.write(f"{Path(args.p4filename).name}\t{match.group(1)}\n")
+    return testutils.SUCCESS
+
+
+def is_error(p4filename: str) -> bool:
+    """True if the program is one that p4c-pie must reject."""
+    return "_errors" in p4filename
+
+
+def check_error(args, argv) -> int:
+    """Fails if p4c-pie compiles the program, or crashes instead of rejecting it."""
+    result = testutils.exec_process(
+        f"{args.compiler} -o /dev/null {' '.join(argv)} {args.p4filename}"
+    )
+    if result.returncode == testutils.SUCCESS:
+        logging.error("%s compiled %s, which it must reject", args.compiler, args.p4filename)
+        return testutils.FAILURE
+    if "Compiler Bug" in (result.output or ""):
+        logging.error("%s crashed on %s", args.compiler, args.p4filename)
+        return testutils.FAILURE
+    return testutils.SUCCESS
+
+
+def run_test(args, argv) -> int:
+    if is_error(args.p4filename):
+        return check_error(args, argv)
+    tmpdir = Path(tempfile.mkdtemp(dir=Path(".").absolute()))
+    output = tmpdir.joinpath("pipeline.ll")
+    # Unoptimized, to see the code of the backend rather than what LLVM makes of it.
+    result = testutils.exec_process(
+        f"{args.compiler} -O0 -o {output} {' '.join(argv)} {args.p4filename}", cwd=tmpdir
+    )
+    if result.returncode != testutils.SUCCESS:
+        logging.error("%s failed to compile %s", args.compiler, args.p4filename)
+        return testutils.FAILURE
+
+    ir = output.read_text()
+    if shutil.which("llvm-as"):
+        result = testutils.exec_process(f"llvm-as {output} -o /dev/null")
+        if result.returncode != testutils.SUCCESS:
+            logging.error("%s is not valid LLVM IR", output)
+            return testutils.FAILURE
+
+    functions = pipeline_functions(ir)
+    if not any(name.startswith("pie_parser_") for name in functions):
+        logging.error("no parser function in %s", output)
+        return testutils.FAILURE
+    if not any(name.startswith("pie_deparser_") for name in functions):
+        logging.error("no deparser function in %s", output)
+        return testutils.FAILURE
+    for name, body in functions.items():
+        check = check_parser if name.startswith("pie_parser_") else check_deparser
+        if check(name, body) != testutils.SUCCESS:
+            return testutils.FAILURE
+
+    if check_shared(args, argv, tmpdir) != testutils.SUCCESS:
+        return testutils.FAILURE
+    if check_stf(args, argv, tmpdir) != testutils.SUCCESS:
+        return testutils.FAILURE
+
+    if args.nocleanup:
+        testutils.del_dir(tmpdir)
+    return testutils.SUCCESS
+
+
+if __name__ == "__main__":
+    args, argv = PARSER.parse_known_args()
+    logging.basicConfig(format="%(levelname)s:%(message)s", level=getattr(logging, args.log_level))
+    if testutils.check_if_file(args.compiler) is None and shutil.which(args.compiler) is None:
+        sys.exit(testutils.FAILURE)
+    if testutils.check_if_file(args.p4filename) is None:
+        sys.exit(testutils.FAILURE)
+    sys.exit(run_test(args, argv))
@@ -0,0 +1,37 @@
+/*
+ * Internet checksum helpers used by pipelines generated by p4c-pie.
+ *
+ * Header checksums are computed by the generated code itself, usually
+ * incrementally (RFC 1624); only payloads, whose length is not known at
+ * compile time, go through here.
+ */
+
+#include <string.h>
+
+#include "pie_runtime.h"
+
+uint32_t pie_csum_partial(const uint8_t* data, size_t length)
+{
+    /* Sum 32-bit big-endian words into 64 bits; the carries are folded at
+     * the end, which gives the same result as 16-bit ones' complement
+     * additions (RFC 1071). */
+    uint64_t sum = 0;
+    while (length >= 4) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        sum += __builtin_bswap32(word);
+        data += 4;
+        length -= 4;
+    }
+    if (length >= 2) {
+        sum += (uint32_t)data[0] << 8 | data[1];
+        data += 2;
+        length -= 2;
+    }
+    if (length != 0)
+        sum += (uint32_t)data[0] << 8;
+
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return (uint32_t)sum;
+}
@@ -0,0 +1,216 @@
+/*
+ * Packet and byte counters of pipelines generated by p4c-pie.
+ *
+ * A counter holds one shard of cells per CPU and one shared shard. The
+ * first time a thread counts, it claims a shard of its own, which it gives
+ * back when it exits; a thread that finds none left counts into the shared
+ * shard. Only its owner writes an own shard, with plain additions stored
+ * atomically so that readouts never see a torn 64-bit value; the shared
+ * shard takes relaxed atomic adds. Shards start on a cache line and span
+ * whole lines, so cores counting into the same cell never write the same
+ * line.
+ *
+ * Readouts add the shards up and subtract the base that pie_counter_clear()
+ * recorded, so clearing never races with counting. The packet and byte
+ * count of a cell are not read as a pair: a readout may include a packet in
+ * one and not yet in the other.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pie_runtime.h"
+
+#define CACHE_LINE 64
+#define MAX_SHARDS 1024
+
+struct pie_counter {
+    char* name;
+    uint32_t size;
+    uint32_t stride;        /* cells from one shard to the next */
+    struct pie_counter_value* base;    /* guarded by lock */
+    pthread_mutex_t lock;
+    struct pie_counter* next;
+    struct pie_counter_value* cells;   /* shard_count + 1 shards */
+};
+
+static struct pie_counter* registry;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ---------------------------------------------------------------- shards */
+
+static uint32_t shard_count;
+static uint8_t shard_taken[MAX_SHARDS];   /* guarded by shard_lock */
+static pthread_mutex_t shard_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t shard_once = PTHREAD_ONCE_INIT;
+static pthread_key_t shard_key;
+
+/* 1 + the shard of this thread, or 0 before it first counts. */
+static _Thread_local uint32_t thread_shard;
+
+static void shard_release(void* value)
+{
+    pthread_mutex_lock(&shard_lock);
+    shard_taken[(uintptr_t)value - 1] = 0;
+    pthread_mutex_unlock(&shard_lock);
+}
+
+static void shard_init(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    shard_count = cpus < 1 ? 1 : cpus > MAX_SHARDS ? MAX_SHARDS : (uint32_t)cpus;
+    pthread_key_create(&shard_key, shard_release);
+}
+
+static uint32_t shard_claim(void)
+{
+    uint32_t shard = shard_count;
+    pthread_mutex_lock(&shard_lock);
+    for (uint32_t i = 0; i < shard_count; i++) {
+        if (!shard_taken[i]) {
+            shard_taken[i] = 1;
+            shard = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&shard_lock);
+    if (shard != shard_count)
+        pthread_setspecific(shard_key, (void*)(uintptr_t)(shard + 1));
+    thread_shard = shard + 1;
+    return thread_shard;
+}
+
+/* -------------------------------------------------------------- counters */
+
+struct pie_counter* pie_counter_create(const char* name, uint32_t size)
+{
+    pthread_once(&shard_once, shard_init);
+    struct pie_counter* counter = calloc(1, sizeof(*counter));
+    if (counter == NULL)
+        return NULL;
+    uint32_t per_line = CACHE_LINE / sizeof(struct pie_counter_value);
+    counter->stride = (size + per_line - 1) / per_line * per_line;
+    size_t bytes =
+        (size_t)(shard_count + 1) * counter->stride * sizeof(struct pie_counter_value);
+    counter->cells = aligned_alloc(CACHE_LINE, bytes ? bytes : CACHE_LINE);
+    counter->base = calloc(size ? size : 1, sizeof(struct pie_counter_value));
+    name = name ? name : "";
+    counter->name = malloc(strlen(name) + 1);
+    if (counter->cells == NULL || counter->base == NULL || counter->name == NULL) {
+        free(counter->cells);
+        free(counter->base);
+        free(counter->name);
+        free(counter);
+        return NULL;
+    }
+    memset(counter->cells, 0, bytes);
+    strcpy(counter->name, name);
+    counter->size = size;
+    pthread_mutex_init(&counter->lock, NULL);
+
+    pthread_mutex_lock(&registry_lock);
+    counter->next = registry;
+    registry = counter;
+    pthread_mutex_unlock(&registry_lock);
+    return counter;
+}
+
+void pie_counter_destroy(struct pie_counter* counter)
+{
+    if (counter == NULL)
+        return;
+    pthread_mutex_lock(&registry_lock);
+    for (struct pie_counter** link = &registry; *link != NULL; link = &(*link)->next) {
+        if (*link == counter) {
+            *link = counter->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    pthread_mutex_destroy(&counter->lock);
+    free(counter->cells);
+    free(counter->base);
+    free(counter->name);
+    free(counter);
+}
+
+struct pie_counter* pie_counter_find(const char* name)
+{
+    struct pie_counter* found = NULL;
+    pthread_mutex_lock(&registry_lock);
+    for (struct pie_counter* counter = registry; counter != NULL; counter = counter->next) {
+        if (strcmp(counter->name, name) == 0) {
+            found = counter;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return found;
+}
+
+uint32_t pie_counter_size(const struct pie_counter* counter)
+{
+    return counter->size;
+}
+
+void pie_counter_count(struct pie_counter* counter, uint32_t index, uint32_t bytes)
+{
+    if (index >= counter->size)
+        return;
+    uint32_t shard = thread_shard;
+    if (shard == 0)
+        shard = shard_claim();
+    struct pie_counter_value* cell =
+        &counter->cells[(size_t)(shard - 1) * counter->stride + index];
+    if (shard - 1 == shard_count) {
+        __atomic_fetch_add(&cell->packets, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&cell->bytes, bytes, __ATOMIC_RELAXED);
+        return;
+    }
+    /* Relaxed loads and stores are plain moves: no lock prefix. */
+    uint64_t packets = __atomic_load_n(&cell->packets, __ATOMIC_RELAXED);
+    uint64_t total = __atomic_load_n(&cell->bytes, __ATOMIC_RELAXED);
+    __atomic_store_n(&cell->packets, packets + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&cell->bytes, total + bytes, __ATOMIC_RELAXED);
+}
+
+/* Sum of the shards of a cell. */
+static void counter_total(const struct pie_counter* counter, uint32_t index,
+                          struct pie_counter_value* value)
+{
+    value->packets = 0;
+    value->bytes = 0;
+    for (uint32_t shard = 0; shard <= shard_count; shard++) {
+        const struct pie_counter_value* cell =
+            &counter->cells[(size_t)shard * counter->stride + index];
+        value->packets += __atomic_load_n(&cell->packets, __ATOMIC_RELAXED);
+        value->bytes += __atomic_load_n(&cell->bytes, __ATOMIC_RELAXED);
+    }
+}
+
+int pie_counter_read(const struct pie_counter* counter, uint32_t index,
+                     struct pie_counter_value* value)
+{
+    if (index >= counter->size)
+        return -EINVAL;
+    struct pie_counter* locked = (struct pie_counter*)counter;
+    pthread_mutex_lock(&locked->lock);
+    counter_total(counter, index, value);
+    value->packets -= counter->base[index].packets;
+    value->bytes -= counter->base[index].bytes;
+    pthread_mutex_unlock(&locked->lock);
+    return 0;
+}
+
+int pie_counter_clear(struct pie_counter* counter, uint32_t index)
+{
+    if (index >= counter->size)
+        return -EINVAL;
+    pthread_mutex_lock(&counter->lock);
+    counter_total(counter, index, &counter->base[index]);
+    pthread_mutex_unlock(&counter->lock);
+    return 0;
+}
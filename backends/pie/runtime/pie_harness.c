@@ -0,0 +1,326 @@
+/*
+ * Worker threads, their rings and the RSS distributor of the multi-core
+ * harness (see pie_harness.h).
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pie_harness.h"
+
+#define CACHE_LINE 64
+/* Entries of the RSS indirection table, as on most NICs. */
+#define RETA_SIZE 128
+
+/* ------------------------------------------------------------------ ring */
+
+struct pie_ring {
+    _Alignas(CACHE_LINE) _Atomic uint32_t head;   /* written by the producer */
+    _Alignas(CACHE_LINE) _Atomic uint32_t tail;   /* written by the consumer */
+    _Alignas(CACHE_LINE) uint32_t mask;
+    struct pie_packet slots[];
+};
+
+struct pie_ring* pie_ring_create(uint32_t capacity)
+{
+    uint32_t size = 2;
+    while (size < capacity && size < (1u << 30))
+        size <<= 1;
+    size_t bytes = sizeof(struct pie_ring) + (size_t)size * sizeof(struct pie_packet);
+    bytes = (bytes + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+    struct pie_ring* ring = aligned_alloc(CACHE_LINE, bytes);
+    if (ring == NULL)
+        return NULL;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->mask = size - 1;
+    return ring;
+}
+
+void pie_ring_destroy(struct pie_ring* ring)
+{
+    free(ring);
+}
+
+uint32_t pie_ring_enqueue(struct pie_ring* ring, const struct pie_packet* packets,
+                          uint32_t count)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t space = ring->mask + 1 - (head - tail);
+    if (count > space)
+        count = space;
+    for (uint32_t i = 0; i < count; i++)
+        ring->slots[(head + i) & ring->mask] = packets[i];
+    atomic_store_explicit(&ring->head, head + count, memory_order_release);
+    return count;
+}
+
+uint32_t pie_ring_dequeue(struct pie_ring* ring, struct pie_packet* packets, uint32_t count)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (count > head - tail)
+        count = head - tail;
+    for (uint32_t i = 0; i < count; i++)
+        packets[i] = ring->slots[(tail + i) & ring->mask];
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+    return count;
+}
+
+/* --------------------------------------------------------------- workers */
+
+struct pie_worker {
+    struct pie_harness* harness;
+    uint32_t index;
+    pthread_t thread;
+    struct pie_ring* ring;
+    /* PIE_HEADROOM bytes, then room for the largest packet, per burst slot */
+    uint8_t* buffers;
+    struct pie_worker_stats stats;
+};
+
+struct pie_harness {
+    struct pie_harness_config config;
+    struct pie_worker* workers;
+    uint32_t reta[RETA_SIZE];
+    _Atomic int done;
+    double seconds;
+};
+
+#define BUFFER_SIZE (PIE_HEADROOM + PIE_MAX_PACKET)
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void run_burst(struct pie_worker* worker, const struct pie_packet* packets,
+                      uint32_t count)
+{
+    uint8_t* data[PIE_MAX_BURST];
+    size_t lengths[PIE_MAX_BURST];
+    struct pie_metadata meta[PIE_MAX_BURST];
+    int32_t results[PIE_MAX_BURST];
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (packets[i].length > PIE_MAX_PACKET) {
+            worker->stats.packets++;
+            worker->stats.dropped++;
+            continue;
+        }
+        /* Like a NIC writing into an mbuf: the pipeline may rewrite it. */
+        data[n] = worker->buffers + (size_t)n * BUFFER_SIZE + PIE_HEADROOM;
+        memcpy(data[n], packets[i].data, packets[i].length);
+        lengths[n] = packets[i].length;
+        memset(&meta[n], 0, sizeof(meta[n]));
+        meta[n].ingress_port = packets[i].ingress_port;
+        meta[n].packet_length = packets[i].length;
+        n++;
+    }
+    if (n == 0)
+        return;
+
+    uint32_t forwarded = worker->harness->config.process_burst(data, lengths, meta, results, n);
+    worker->stats.packets += n;
+    worker->stats.forwarded += forwarded;
+    worker->stats.dropped += n - forwarded;
+    worker->stats.bursts++;
+    for (uint32_t i = 0; i < n; i++) {
+        if (results[i] != PIE_DROPPED)
+            worker->stats.bytes += (uint32_t)results[i];
+    }
+}
+
+static void* worker_main(void* arg)
+{
+    struct pie_worker* worker = arg;
+    struct pie_harness* harness = worker->harness;
+    struct pie_packet packets[PIE_MAX_BURST];
+    double start = 0;
+    double end = 0;
+
+    /* Between bursts the worker holds no table entry: the control plane
+     * may update the tables while the workers run. */
+    pie_rcu_register();
+    for (;;) {
+        pie_rcu_quiescent();
+        uint32_t count = pie_ring_dequeue(worker->ring, packets, harness->config.burst);
+        if (count == 0) {
+            if (!atomic_load_explicit(&harness->done, memory_order_acquire)) {
+                sched_yield();
+                continue;
+            }
+            /* The distributor sets `done` after its last enqueue: look at
+             * the ring once more so that nothing is left behind. */
+            count = pie_ring_dequeue(worker->ring, packets, harness->config.burst);
+            if (count == 0)
+                break;
+        }
+        if (start == 0)
+            start = now();
+        run_burst(worker, packets, count);
+        end = now();
+    }
+    pie_rcu_unregister();
+    if (start != 0)
+        worker->stats.seconds += end - start;
+    return NULL;
+}
+
+struct pie_harness* pie_harness_create(const struct pie_harness_config* config)
+{
+    if (config->process_burst == NULL || config->workers == 0 ||
+        config->burst > PIE_MAX_BURST)
+        return NULL;
+    struct pie_harness* harness = calloc(1, sizeof(*harness));
+    if (harness == NULL)
+        return NULL;
+    harness->config = *config;
+    if (harness->config.burst == 0)
+        harness->config.burst = 32;
+    if (harness->config.ring_size == 0)
+        harness->config.ring_size = 1024;
+    if (harness->config.rss_key == NULL)
+        harness->config.rss_key = pie_rss_default_key;
+    for (uint32_t i = 0; i < RETA_SIZE; i++)
+        harness->reta[i] = i % config->workers;
+
+    harness->workers = calloc(config->workers, sizeof(*harness->workers));
+    if (harness->workers == NULL) {
+        free(harness);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < config->workers; i++) {
+        struct pie_worker* worker = &harness->workers[i];
+        worker->harness = harness;
+        worker->index = i;
+        worker->ring = pie_ring_create(harness->config.ring_size);
+        worker->buffers = aligned_alloc(CACHE_LINE,
+                                        (size_t)harness->config.burst * BUFFER_SIZE);
+        if (worker->ring == NULL || worker->buffers == NULL) {
+            pie_harness_destroy(harness);
+            return NULL;
+        }
+    }
+    return harness;
+}
+
+void pie_harness_destroy(struct pie_harness* harness)
+{
+    if (harness == NULL)
+        return;
+    for (uint32_t i = 0; i < harness->config.workers; i++) {
+        pie_ring_destroy(harness->workers[i].ring);
+        free(harness->workers[i].buffers);
+    }
+    free(harness->workers);
+    free(harness);
+}
+
+static void pin_thread(pthread_t thread, uint32_t cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    /* Best effort: run unpinned on machines with fewer CPUs. */
+    pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+int pie_harness_run(struct pie_harness* harness, const struct pie_packet* packets,
+                    size_t count, uint32_t repeat)
+{
+    uint32_t workers = harness->config.workers;
+    /* The NIC computes RSS in hardware, so the queue of every packet is
+     * chosen before the clock starts. */
+    uint32_t* queues = malloc((count != 0 ? count : 1) * sizeof(*queues));
+    if (queues == NULL)
+        return -ENOMEM;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t hash = pie_rss_hash(harness->config.rss_key, packets[i].data,
+                                     packets[i].length);
+        queues[i] = harness->reta[hash % RETA_SIZE];
+    }
+
+    atomic_store(&harness->done, 0);
+    uint32_t started = 0;
+    int error = 0;
+    for (; started < workers; started++) {
+        struct pie_worker* worker = &harness->workers[started];
+        error = -pthread_create(&worker->thread, NULL, worker_main, worker);
+        if (error != 0)
+            break;
+        if (harness->config.pin)
+            pin_thread(worker->thread, started);
+    }
+
+    double start = now();
+    if (error == 0) {
+        /* Stage packets per worker and hand them over a burst at a time. */
+        struct pie_packet* staged = malloc((size_t)workers * PIE_MAX_BURST * sizeof(*staged));
+        uint32_t* pending = calloc(workers, sizeof(*pending));
+        if (staged == NULL || pending == NULL)
+            error = -ENOMEM;
+        for (uint32_t round = 0; error == 0 && round < repeat; round++) {
+            for (size_t i = 0; i < count; i++) {
+                uint32_t queue = queues[i];
+                struct pie_packet* batch = staged + (size_t)queue * PIE_MAX_BURST;
+                batch[pending[queue]++] = packets[i];
+                if (pending[queue] < harness->config.burst)
+                    continue;
+                struct pie_ring* ring = harness->workers[queue].ring;
+                for (uint32_t sent = 0; sent < pending[queue];) {
+                    sent += pie_ring_enqueue(ring, batch + sent, pending[queue] - sent);
+                    if (sent < pending[queue])
+                        sched_yield();
+                }
+                pending[queue] = 0;
+            }
+        }
+        for (uint32_t queue = 0; error == 0 && queue < workers; queue++) {
+            struct pie_packet* batch = staged + (size_t)queue * PIE_MAX_BURST;
+            for (uint32_t sent = 0; sent < pending[queue];)
+                sent += pie_ring_enqueue(harness->workers[queue].ring, batch + sent,
+                                         pending[queue] - sent);
+        }
+        free(staged);
+        free(pending);
+    }
+
+    atomic_store_explicit(&harness->done, 1, memory_order_release);
+    for (uint32_t i = 0; i < started; i++)
+        pthread_join(harness->workers[i].thread, NULL);
+    harness->seconds += now() - start;
+    free(queues);
+    return error;
+}
+
+const struct pie_worker_stats* pie_harness_stats(const struct pie_harness* harness,
+                                                 uint32_t worker)
+{
+    return &harness->workers[worker].stats;
+}
+
+void pie_harness_totals(const struct pie_harness* harness, struct pie_worker_stats* totals)
+{
+    memset(totals, 0, sizeof(*totals));
+    for (uint32_t i = 0; i < harness->config.workers; i++) {
+        const struct pie_worker_stats* stats = &harness->workers[i].stats;
+        totals->packets += stats->packets;
+        totals->forwarded += stats->forwarded;
+        totals->dropped += stats->dropped;
+        totals->bytes += stats->bytes;
+        totals->bursts += stats->bursts;
+    }
+    totals->seconds = harness->seconds;
+}
@@ -0,0 +1,127 @@
+#ifndef __BACKENDS_PIE_RUNTIME_PIE_HARNESS_H__
+#define __BACKENDS_PIE_RUNTIME_PIE_HARNESS_H__
+
+/*
+ * Multi-core harness for pipelines generated by p4c-pie: runs a pipeline on
+ * N worker threads without a NIC or DPDK, to measure how it scales.
+ *
+ * A distributor thread (the caller of pie_harness_run) spreads the input
+ * packets over the workers with the same Toeplitz hash and indirection
+ * table that NICs use for RSS, so all packets of a flow go to one worker.
+ * Each worker has a single-producer single-consumer ring, its own packet
+ * buffers and metadata, and calls pie_process_burst() on what it dequeues.
+ * The tables of the pipeline are shared. Workers report a quiescent state
+ * between bursts, so the control plane can update tables while they run.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pie_runtime.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A packet to run through the pipeline. The harness copies the data into a
+ * worker buffer before processing, so it is never modified. */
+struct pie_packet {
+    const uint8_t* data;
+    uint32_t length;
+    uint32_t ingress_port;
+};
+
+/* ------------------------------------------------------------------- rss */
+
+#define PIE_RSS_KEY_SIZE 40
+
+/* The key that most NIC drivers program by default. */
+extern const uint8_t pie_rss_default_key[PIE_RSS_KEY_SIZE];
+
+/* Toeplitz hash of `length` bytes; `length` is at most PIE_RSS_KEY_SIZE - 4. */
+uint32_t pie_toeplitz(const uint8_t* key, const uint8_t* data, size_t length);
+
+/*
+ * RSS hash of an Ethernet frame (up to two VLAN tags): the Toeplitz hash of
+ * the addresses and, for unfragmented TCP, UDP and SCTP, the ports, in the
+ * order of the Microsoft RSS specification. Frames that are not IP hash to 0.
+ */
+uint32_t pie_rss_hash(const uint8_t* key, const uint8_t* packet, size_t length);
+
+/* ------------------------------------------------------------------ pcap */
+
+struct pie_pcap {
+    struct pie_packet* packets;
+    size_t count;
+    uint8_t* buffer;   /* file contents, the packets point into it */
+};
+
+/*
+ * Reads a classic pcap file (either byte order, micro or nanosecond
+ * timestamps). Packets get ingress port 0. Returns 0 or a negative errno
+ * value; -EINVAL for files that are not pcap.
+ */
+int pie_pcap_load(const char* path, struct pie_pcap* pcap);
+void pie_pcap_free(struct pie_pcap* pcap);
+
+/* ------------------------------------------------------------------ ring */
+
+/* Lock-free ring for one producer thread and one consumer thread. */
+struct pie_ring;
+
+/* `capacity` is rounded up to a power of two. */
+struct pie_ring* pie_ring_create(uint32_t capacity);
+void pie_ring_destroy(struct pie_ring* ring);
+/* Both return the number of packets moved, which may be less than count. */
+uint32_t pie_ring_enqueue(struct pie_ring* ring, const struct pie_packet* packets,
+                          uint32_t count);
+uint32_t pie_ring_dequeue(struct pie_ring* ring, struct pie_packet* packets, uint32_t count);
+
+/* --------------------------------------------------------------- harness */
+
+#define PIE_MAX_BURST 64
+/* Largest packet a worker buffer holds; longer packets are dropped. */
+#define PIE_MAX_PACKET 9216
+
+struct pie_harness_config {
+    pie_process_burst_fn process_burst;
+    uint32_t workers;
+    uint32_t burst;           /* packets per call, at most PIE_MAX_BURST; 0 for 32 */
+    uint32_t ring_size;       /* per worker; 0 for 1024 */
+    int pin;                  /* pin worker i to CPU i */
+    const uint8_t* rss_key;   /* NULL for pie_rss_default_key */
+};
+
+struct pie_worker_stats {
+    uint64_t packets;
+    uint64_t forwarded;
+    uint64_t dropped;
+    uint64_t bytes;           /* of the forwarded packets, as sent */
+    uint64_t bursts;
+    double seconds;           /* from the first packet to the end of the last burst */
+};
+
+struct pie_harness;
+
+struct pie_harness* pie_harness_create(const struct pie_harness_config* config);
+void pie_harness_destroy(struct pie_harness* harness);
+
+/*
+ * Runs `count` packets through the pipeline `repeat` times and waits until
+ * every worker is done. Statistics accumulate over runs. Returns 0 or a
+ * negative errno value when the worker threads cannot be started.
+ */
+int pie_harness_run(struct pie_harness* harness, const struct pie_packet* packets,
+                    size_t count, uint32_t repeat);
+
+/* Statistics of one worker, and of all of them with the wall-clock time
+ * of the runs. */
+const struct pie_worker_stats* pie_harness_stats(const struct pie_harness* harness,
+                                                 uint32_t worker);
+void pie_harness_totals(const struct pie_harness* harness, struct pie_worker_stats* totals);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BACKENDS_PIE_RUNTIME_PIE_HARNESS_H__ */
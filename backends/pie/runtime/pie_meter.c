@@ -0,0 +1,249 @@
+/*
+ * Meters of pipelines generated by p4c-pie: two-rate three-color markers
+ * (RFC 2698, color-blind), one pair of token buckets per cell.
+ *
+ * Time is read from the CPU timestamp counter, which costs a few cycles
+ * where a system call would cost a hundred, and calibrated once against
+ * CLOCK_MONOTONIC. Tokens are kept in 32.32 fixed point, so that buckets
+ * refill by a fraction of a token per cycle. Every cell fills a cache line
+ * and has a spin lock, held while its buckets are updated.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pie_runtime.h"
+
+#define CACHE_LINE 64
+#define TOKEN_SHIFT 32
+
+struct meter_cell {
+    uint32_t lock;
+    uint32_t configured;
+    uint64_t last;          /* timestamp of the last update */
+    uint64_t committed;     /* tokens of both buckets */
+    uint64_t peak;
+    uint64_t cir;           /* tokens per tick */
+    uint64_t pir;
+    uint64_t cburst;        /* bucket sizes */
+    uint64_t pburst;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct pie_meter {
+    char* name;
+    uint32_t type;
+    uint32_t size;
+    struct pie_meter* next;
+    struct meter_cell* cells;
+};
+
+static struct pie_meter* registry;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------------------------------------------------------ time */
+
+static uint64_t ticks_per_second;
+static pthread_once_t calibrate_once = PTHREAD_ONCE_INIT;
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static inline uint64_t ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return monotonic_ns();
+#endif
+}
+
+static void calibrate(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    /* Modern CPUs have an invariant TSC, which ticks at a constant rate. */
+    struct timespec pause = { 0, 10000000 };
+    uint64_t start_ns = monotonic_ns();
+    uint64_t start = ticks();
+    nanosleep(&pause, NULL);
+    uint64_t elapsed_ns = monotonic_ns() - start_ns;
+    uint64_t elapsed = ticks() - start;
+    ticks_per_second = (uint64_t)((unsigned __int128)elapsed * 1000000000u / elapsed_ns);
+#elif defined(__aarch64__)
+    __asm__ volatile("mrs %0, cntfrq_el0" : "=r"(ticks_per_second));
+#else
+    ticks_per_second = 1000000000u;
+#endif
+    if (ticks_per_second == 0)
+        ticks_per_second = 1;
+}
+
+/* ---------------------------------------------------------------- meters */
+
+static void cell_lock(struct meter_cell* cell)
+{
+    while (__atomic_exchange_n(&cell->lock, 1, __ATOMIC_ACQUIRE) != 0) {
+        while (__atomic_load_n(&cell->lock, __ATOMIC_RELAXED) != 0) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#else
+            sched_yield();
+#endif
+        }
+    }
+}
+
+static void cell_unlock(struct meter_cell* cell)
+{
+    __atomic_store_n(&cell->lock, 0, __ATOMIC_RELEASE);
+}
+
+struct pie_meter* pie_meter_create(const char* name, uint32_t type, uint32_t size)
+{
+    pthread_once(&calibrate_once, calibrate);
+    if (type > PIE_METER_BYTES)
+        return NULL;
+    struct pie_meter* meter = calloc(1, sizeof(*meter));
+    if (meter == NULL)
+        return NULL;
+    size_t bytes = (size_t)(size ? size : 1) * sizeof(struct meter_cell);
+    meter->cells = aligned_alloc(CACHE_LINE, bytes);
+    name = name ? name : "";
+    meter->name = malloc(strlen(name) + 1);
+    if (meter->cells == NULL || meter->name == NULL) {
+        free(meter->cells);
+        free(meter->name);
+        free(meter);
+        return NULL;
+    }
+    memset(meter->cells, 0, bytes);
+    strcpy(meter->name, name);
+    meter->type = type;
+    meter->size = size;
+
+    pthread_mutex_lock(&registry_lock);
+    meter->next = registry;
+    registry = meter;
+    pthread_mutex_unlock(&registry_lock);
+    return meter;
+}
+
+void pie_meter_destroy(struct pie_meter* meter)
+{
+    if (meter == NULL)
+        return;
+    pthread_mutex_lock(&registry_lock);
+    for (struct pie_meter** link = &registry; *link != NULL; link = &(*link)->next) {
+        if (*link == meter) {
+            *link = meter->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    free(meter->cells);
+    free(meter->name);
+    free(meter);
+}
+
+struct pie_meter* pie_meter_find(const char* name)
+{
+    struct pie_meter* found = NULL;
+    pthread_mutex_lock(&registry_lock);
+    for (struct pie_meter* meter = registry; meter != NULL; meter = meter->next) {
+        if (strcmp(meter->name, name) == 0) {
+            found = meter;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return found;
+}
+
+uint32_t pie_meter_size(const struct pie_meter* meter)
+{
+    return meter->size;
+}
+
+/* A rate per second as tokens per tick. */
+static uint64_t tokens_per_tick(uint64_t rate)
+{
+    unsigned __int128 tokens = ((unsigned __int128)rate << TOKEN_SHIFT) / ticks_per_second;
+    return tokens > UINT64_MAX ? UINT64_MAX : (uint64_t)tokens;
+}
+
+int pie_meter_set(struct pie_meter* meter, uint32_t index, uint64_t cir, uint64_t cburst,
+                  uint64_t pir, uint64_t pburst)
+{
+    if (index >= meter->size || pir < cir || cburst > UINT32_MAX || pburst > UINT32_MAX)
+        return -EINVAL;
+    struct meter_cell* cell = &meter->cells[index];
+    cell_lock(cell);
+    cell->cir = tokens_per_tick(cir);
+    cell->pir = tokens_per_tick(pir);
+    cell->cburst = cburst << TOKEN_SHIFT;
+    cell->pburst = pburst << TOKEN_SHIFT;
+    cell->committed = cell->cburst;
+    cell->peak = cell->pburst;
+    cell->last = ticks();
+    cell->configured = 1;
+    cell_unlock(cell);
+    return 0;
+}
+
+int pie_meter_clear(struct pie_meter* meter, uint32_t index)
+{
+    if (index >= meter->size)
+        return -EINVAL;
+    struct meter_cell* cell = &meter->cells[index];
+    cell_lock(cell);
+    cell->configured = 0;
+    cell_unlock(cell);
+    return 0;
+}
+
+/* Adds the tokens of `elapsed` ticks to a bucket, up to its size. */
+static uint64_t refill(uint64_t tokens, uint64_t rate, uint64_t elapsed, uint64_t size)
+{
+    unsigned __int128 added = (unsigned __int128)rate * elapsed + tokens;
+    return added > size ? size : (uint64_t)added;
+}
+
+uint32_t pie_meter_execute(struct pie_meter* meter, uint32_t index, uint32_t length)
+{
+    if (index >= meter->size)
+        return PIE_METER_GREEN;
+    struct meter_cell* cell = &meter->cells[index];
+    uint64_t need = (uint64_t)(meter->type == PIE_METER_BYTES ? length : 1) << TOKEN_SHIFT;
+    uint64_t now = ticks();
+    uint32_t color = PIE_METER_GREEN;
+    cell_lock(cell);
+    if (cell->configured) {
+        /* Another core may have read a later timestamp first. */
+        uint64_t elapsed = now > cell->last ? now - cell->last : 0;
+        cell->last += elapsed;
+        cell->committed = refill(cell->committed, cell->cir, elapsed, cell->cburst);
+        cell->peak = refill(cell->peak, cell->pir, elapsed, cell->pburst);
+        if (cell->peak < need) {
+            color = PIE_METER_RED;
+        } else if (cell->committed < need) {
+            cell->peak -= need;
+            color = PIE_METER_YELLOW;
+        } else {
+            cell->peak -= need;
+            cell->committed -= need;
+        }
+    }
+    cell_unlock(cell);
+    return color;
+}
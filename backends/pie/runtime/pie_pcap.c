@@ -0,0 +1,97 @@
+/*
+ * Minimal reader of classic pcap files, so that the harness does not need
+ * libpcap. The whole file is read into memory and the packets point into it.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pie_harness.h"
+
+#define PCAP_MAGIC_USEC 0xa1b2c3d4u
+#define PCAP_MAGIC_NSEC 0xa1b23c4du
+#define PCAP_FILE_HEADER 24
+#define PCAP_RECORD_HEADER 16
+
+static uint32_t read32(const uint8_t* p, int swap)
+{
+    uint32_t value;
+    memcpy(&value, p, 4);
+    return swap ? __builtin_bswap32(value) : value;
+}
+
+int pie_pcap_load(const char* path, struct pie_pcap* pcap)
+{
+    memset(pcap, 0, sizeof(*pcap));
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return -errno;
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        size = ftell(file);
+    if (size < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        int error = -errno;
+        fclose(file);
+        return error;
+    }
+    uint8_t* buffer = malloc(size != 0 ? (size_t)size : 1);
+    if (buffer == NULL) {
+        fclose(file);
+        return -ENOMEM;
+    }
+    size_t got = fread(buffer, 1, (size_t)size, file);
+    fclose(file);
+    if (got != (size_t)size || size < PCAP_FILE_HEADER) {
+        free(buffer);
+        return -EINVAL;
+    }
+
+    uint32_t magic = read32(buffer, 0);
+    int swap = 0;
+    if (magic != PCAP_MAGIC_USEC && magic != PCAP_MAGIC_NSEC) {
+        magic = read32(buffer, 1);
+        swap = 1;
+    }
+    if (magic != PCAP_MAGIC_USEC && magic != PCAP_MAGIC_NSEC) {
+        free(buffer);
+        return -EINVAL;
+    }
+
+    /* Count the records first, then point at them. */
+    size_t count = 0;
+    size_t offset = PCAP_FILE_HEADER;
+    while (offset + PCAP_RECORD_HEADER <= (size_t)size) {
+        uint32_t captured = read32(buffer + offset + 8, swap);
+        if (captured > (size_t)size - offset - PCAP_RECORD_HEADER)
+            break;
+        offset += PCAP_RECORD_HEADER + captured;
+        count++;
+    }
+    struct pie_packet* packets = calloc(count != 0 ? count : 1, sizeof(*packets));
+    if (packets == NULL) {
+        free(buffer);
+        return -ENOMEM;
+    }
+    offset = PCAP_FILE_HEADER;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t captured = read32(buffer + offset + 8, swap);
+        packets[i].data = buffer + offset + PCAP_RECORD_HEADER;
+        packets[i].length = captured;
+        packets[i].ingress_port = 0;
+        offset += PCAP_RECORD_HEADER + captured;
+    }
+
+    pcap->packets = packets;
+    pcap->count = count;
+    pcap->buffer = buffer;
+    return 0;
+}
+
+void pie_pcap_free(struct pie_pcap* pcap)
+{
+    free(pcap->packets);
+    free(pcap->buffer);
+    memset(pcap, 0, sizeof(*pcap));
+}
@@ -0,0 +1,148 @@
+/*
+ * Execution profiles of pipelines compiled with p4c-pie --profile-generate.
+ *
+ * The counters live in a file mapped shared, which p4c-pie --profile-use
+ * reads back. A file whose counter names match those of the pipeline is
+ * reused, so that the counts of several runs add up; any other file is
+ * overwritten.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "pie_runtime.h"
+
+static uint64_t names_size(const char* const* names, uint32_t count)
+{
+    uint64_t size = 0;
+    for (uint32_t i = 0; i < count; i++)
+        size += strlen(names[i]) + 1;
+    return size;
+}
+
+/* Whether the file at `base` of `size` bytes holds exactly these counters. */
+static int profile_matches(const uint8_t* base, size_t size, const char* const* names,
+                           uint32_t count)
+{
+    const struct pie_profile_header* header = (const struct pie_profile_header*)base;
+    if (size < sizeof(*header) || memcmp(header->magic, PIE_PROFILE_MAGIC, 8) != 0 ||
+        header->version != PIE_PROFILE_VERSION || header->count != count)
+        return 0;
+    const char* name = (const char*)(base + sizeof(*header) + (size_t)count * 8);
+    for (uint32_t i = 0; i < count; i++) {
+        size_t length = strlen(names[i]) + 1;
+        if (memcmp(name, names[i], length) != 0)
+            return 0;
+        name += length;
+    }
+    return 1;
+}
+
+uint64_t* pie_profile_map(const char* path, const char* const* names, uint32_t count,
+                          uint64_t* fallback)
+{
+    uint64_t names_bytes = names_size(names, count);
+    size_t size = sizeof(struct pie_profile_header) + (size_t)count * 8 + names_bytes;
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "pie: cannot open profile %s: %s\n", path, strerror(errno));
+        return fallback;
+    }
+    off_t old = lseek(fd, 0, SEEK_END);
+    if (old != (off_t)size && ftruncate(fd, (off_t)size) != 0) {
+        fprintf(stderr, "pie: cannot resize profile %s: %s\n", path, strerror(errno));
+        close(fd);
+        return fallback;
+    }
+    uint8_t* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "pie: cannot map profile %s: %s\n", path, strerror(errno));
+        return fallback;
+    }
+
+    uint64_t* counters = (uint64_t*)(base + sizeof(struct pie_profile_header));
+    if (old != (off_t)size || !profile_matches(base, size, names, count)) {
+        struct pie_profile_header* header = (struct pie_profile_header*)base;
+        memset(base, 0, size);
+        memcpy(header->magic, PIE_PROFILE_MAGIC, 8);
+        header->version = PIE_PROFILE_VERSION;
+        header->count = count;
+        header->names_size = names_bytes;
+        char* name = (char*)(counters + count);
+        for (uint32_t i = 0; i < count; i++) {
+            size_t length = strlen(names[i]) + 1;
+            memcpy(name, names[i], length);
+            name += length;
+        }
+    }
+    return counters;
+}
+
+int pie_profile_load(const char* path, struct pie_profile* profile)
+{
+    memset(profile, 0, sizeof(*profile));
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return -errno;
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        size = ftell(file);
+    if (size < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        int error = -errno;
+        fclose(file);
+        return error;
+    }
+    /* One more byte terminates the last name of a truncated file. */
+    uint8_t* buffer = malloc((size_t)size + 1);
+    if (buffer == NULL) {
+        fclose(file);
+        return -ENOMEM;
+    }
+    size_t got = fread(buffer, 1, (size_t)size, file);
+    fclose(file);
+    buffer[size] = 0;
+
+    const struct pie_profile_header* header = (const struct pie_profile_header*)buffer;
+    if (got != (size_t)size || (size_t)size < sizeof(*header) ||
+        memcmp(header->magic, PIE_PROFILE_MAGIC, 8) != 0 ||
+        header->version != PIE_PROFILE_VERSION ||
+        (size_t)size - sizeof(*header) < (uint64_t)header->count * 8 + header->names_size) {
+        free(buffer);
+        return -EINVAL;
+    }
+    uint32_t count = header->count;
+    const char** names = calloc(count != 0 ? count : 1, sizeof(*names));
+    if (names == NULL) {
+        free(buffer);
+        return -ENOMEM;
+    }
+    const char* name = (const char*)(buffer + sizeof(*header) + (size_t)count * 8);
+    const char* end = (const char*)buffer + size;
+    for (uint32_t i = 0; i < count; i++) {
+        if (name >= end) {
+            free(names);
+            free(buffer);
+            return -EINVAL;
+        }
+        names[i] = name;
+        name += strlen(name) + 1;
+    }
+    profile->count = count;
+    profile->names = names;
+    profile->counters = (const uint64_t*)(buffer + sizeof(*header));
+    profile->buffer = buffer;
+    return 0;
+}
+
+void pie_profile_free(struct pie_profile* profile)
+{
+    free(profile->names);
+    free(profile->buffer);
+    memset(profile, 0, sizeof(*profile));
+}
@@ -0,0 +1,161 @@
+/*
+ * Quiescent-state-based reclamation for the runtime (see pie_runtime.h).
+ *
+ * A global epoch counts grace periods. Retiring memory advances it; every
+ * registered reader copies it into its own record at each quiescent state.
+ * Memory retired at epoch E can be freed once every reader has seen E:
+ * the reader then went through a quiescent state after the memory was
+ * unpublished, so it holds no pointer to it.
+ *
+ * Readers only touch their own record. Registration and the list of
+ * deferred frees are protected by a mutex taken by writers alone.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+#include "pie_runtime.h"
+
+struct reader {
+    uint64_t seen;      /* accessed atomically */
+    struct reader* next;
+};
+
+struct deferred {
+    uint64_t cookie;
+    void (*free_fn)(void* object, uintptr_t arg);
+    void* object;
+    uintptr_t arg;
+    struct deferred* next;
+};
+
+static uint64_t epoch = 1;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct reader* readers;
+/* Oldest first, so cookies increase along the list. */
+static struct deferred* pending;
+static struct deferred** pending_tail = &pending;
+static _Thread_local struct reader* self;
+
+void pie_rcu_register(void)
+{
+    if (self != NULL)
+        return;
+    struct reader* reader = malloc(sizeof(*reader));
+    if (reader == NULL)
+        abort();
+    __atomic_store_n(&reader->seen, __atomic_load_n(&epoch, __ATOMIC_SEQ_CST),
+                     __ATOMIC_RELEASE);
+    pthread_mutex_lock(&lock);
+    reader->next = readers;
+    readers = reader;
+    pthread_mutex_unlock(&lock);
+    self = reader;
+}
+
+void pie_rcu_unregister(void)
+{
+    if (self == NULL)
+        return;
+    pthread_mutex_lock(&lock);
+    for (struct reader** link = &readers; *link != NULL; link = &(*link)->next) {
+        if (*link == self) {
+            *link = self->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    free(self);
+    self = NULL;
+}
+
+void pie_rcu_quiescent(void)
+{
+    if (self != NULL)
+        __atomic_store_n(&self->seen, __atomic_load_n(&epoch, __ATOMIC_SEQ_CST),
+                         __ATOMIC_RELEASE);
+}
+
+/* Grace periods with cookies up to the result have elapsed. */
+static uint64_t completed_locked(void)
+{
+    uint64_t completed = UINT64_MAX;
+    for (struct reader* reader = readers; reader != NULL; reader = reader->next) {
+        uint64_t seen = __atomic_load_n(&reader->seen, __ATOMIC_ACQUIRE);
+        if (seen < completed)
+            completed = seen;
+    }
+    return completed;
+}
+
+uint64_t pie_rcu_retire(void)
+{
+    return __atomic_add_fetch(&epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+int pie_rcu_expired(uint64_t cookie)
+{
+    pthread_mutex_lock(&lock);
+    uint64_t completed = completed_locked();
+    pthread_mutex_unlock(&lock);
+    return cookie <= completed;
+}
+
+/* Frees the deferred memory whose grace period has elapsed. */
+static void reclaim(void)
+{
+    pthread_mutex_lock(&lock);
+    uint64_t completed = completed_locked();
+    struct deferred* ready = NULL;
+    struct deferred** link = &pending;
+    while (*link != NULL && (*link)->cookie <= completed)
+        link = &(*link)->next;
+    if (link != &pending) {
+        struct deferred* rest = *link;
+        *link = NULL;
+        ready = pending;
+        pending = rest;
+        if (rest == NULL)
+            pending_tail = &pending;
+    }
+    pthread_mutex_unlock(&lock);
+
+    /* Outside the lock: free functions may retire more memory. */
+    while (ready != NULL) {
+        struct deferred* next = ready->next;
+        ready->free_fn(ready->object, ready->arg);
+        free(ready);
+        ready = next;
+    }
+}
+
+void pie_rcu_defer(void (*free_fn)(void* object, uintptr_t arg), void* object, uintptr_t arg)
+{
+    struct deferred* deferred = malloc(sizeof(*deferred));
+    if (deferred == NULL) {
+        pie_rcu_synchronize();
+        free_fn(object, arg);
+        return;
+    }
+    deferred->free_fn = free_fn;
+    deferred->object = object;
+    deferred->arg = arg;
+    deferred->next = NULL;
+    pthread_mutex_lock(&lock);
+    deferred->cookie = pie_rcu_retire();
+    *pending_tail = deferred;
+    pending_tail = &deferred->next;
+    pthread_mutex_unlock(&lock);
+    reclaim();
+}
+
+void pie_rcu_synchronize(void)
+{
+    uint64_t cookie = pie_rcu_retire();
+    /* A reader waiting here holds no table pointer. */
+    pie_rcu_quiescent();
+    while (!pie_rcu_expired(cookie))
+        sched_yield();
+    reclaim();
+}
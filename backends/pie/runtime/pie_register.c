@@ -0,0 +1,179 @@
+/*
+ * Registers of pipelines generated by p4c-pie.
+ *
+ * The cells belong to the generated code, which reads and writes them
+ * directly: cells of up to 8 bytes with atomic loads and stores, wider
+ * cells and read-modify-write actions under the lock of the register. The
+ * control plane accesses them the same way, through this wrapper.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pie_runtime.h"
+
+struct pie_register {
+    char* name;
+    uint8_t* cells;
+    uint32_t cell_size;
+    uint32_t size;
+    uint32_t lock;
+    struct pie_register* next;
+};
+
+static struct pie_register* registry;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct pie_register* pie_register_create(const char* name, void* cells, uint32_t cell_size,
+                                         uint32_t size)
+{
+    struct pie_register* reg = calloc(1, sizeof(*reg));
+    if (reg == NULL)
+        return NULL;
+    name = name ? name : "";
+    reg->name = malloc(strlen(name) + 1);
+    if (reg->name == NULL) {
+        free(reg);
+        return NULL;
+    }
+    strcpy(reg->name, name);
+    reg->cells = cells;
+    reg->cell_size = cell_size;
+    reg->size = size;
+
+    pthread_mutex_lock(&registry_lock);
+    reg->next = registry;
+    registry = reg;
+    pthread_mutex_unlock(&registry_lock);
+    return reg;
+}
+
+void pie_register_destroy(struct pie_register* reg)
+{
+    if (reg == NULL)
+        return;
+    pthread_mutex_lock(&registry_lock);
+    for (struct pie_register** link = &registry; *link != NULL; link = &(*link)->next) {
+        if (*link == reg) {
+            *link = reg->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    free(reg->name);
+    free(reg);
+}
+
+struct pie_register* pie_register_find(const char* name)
+{
+    struct pie_register* found = NULL;
+    pthread_mutex_lock(&registry_lock);
+    for (struct pie_register* reg = registry; reg != NULL; reg = reg->next) {
+        if (strcmp(reg->name, name) == 0) {
+            found = reg;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return found;
+}
+
+uint32_t pie_register_size(const struct pie_register* reg)
+{
+    return reg->size;
+}
+
+void pie_register_lock(struct pie_register* reg)
+{
+    while (__atomic_exchange_n(&reg->lock, 1, __ATOMIC_ACQUIRE) != 0) {
+        while (__atomic_load_n(&reg->lock, __ATOMIC_RELAXED) != 0) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#else
+            sched_yield();
+#endif
+        }
+    }
+}
+
+void pie_register_unlock(struct pie_register* reg)
+{
+    __atomic_store_n(&reg->lock, 0, __ATOMIC_RELEASE);
+}
+
+int pie_register_read(struct pie_register* reg, uint32_t index, void* value)
+{
+    if (index >= reg->size)
+        return -EINVAL;
+    void* cell = reg->cells + (size_t)index * reg->cell_size;
+    switch (reg->cell_size) {
+    case 1: {
+        uint8_t word = __atomic_load_n((uint8_t*)cell, __ATOMIC_RELAXED);
+        memcpy(value, &word, sizeof(word));
+        break;
+    }
+    case 2: {
+        uint16_t word = __atomic_load_n((uint16_t*)cell, __ATOMIC_RELAXED);
+        memcpy(value, &word, sizeof(word));
+        break;
+    }
+    case 4: {
+        uint32_t word = __atomic_load_n((uint32_t*)cell, __ATOMIC_RELAXED);
+        memcpy(value, &word, sizeof(word));
+        break;
+    }
+    case 8: {
+        uint64_t word = __atomic_load_n((uint64_t*)cell, __ATOMIC_RELAXED);
+        memcpy(value, &word, sizeof(word));
+        break;
+    }
+    default:
+        pie_register_lock(reg);
+        memcpy(value, cell, reg->cell_size);
+        pie_register_unlock(reg);
+        break;
+    }
+    return 0;
+}
+
+int pie_register_write(struct pie_register* reg, uint32_t index, const void* value)
+{
+    if (index >= reg->size)
+        return -EINVAL;
+    void* cell = reg->cells + (size_t)index * reg->cell_size;
+    switch (reg->cell_size) {
+    case 1: {
+        uint8_t word;
+        memcpy(&word, value, sizeof(word));
+        __atomic_store_n((uint8_t*)cell, word, __ATOMIC_RELAXED);
+        break;
+    }
+    case 2: {
+        uint16_t word;
+        memcpy(&word, value, sizeof(word));
+        __atomic_store_n((uint16_t*)cell, word, __ATOMIC_RELAXED);
+        break;
+    }
+    case 4: {
+        uint32_t word;
+        memcpy(&word, value, sizeof(word));
+        __atomic_store_n((uint32_t*)cell, word, __ATOMIC_RELAXED);
+        break;
+    }
+    case 8: {
+        uint64_t word;
+        memcpy(&word, value, sizeof(word));
+        __atomic_store_n((uint64_t*)cell, word, __ATOMIC_RELAXED);
+        break;
+    }
+    default:
+        pie_register_lock(reg);
+        memcpy(cell, value, reg->cell_size);
+        pie_register_unlock(reg);
+        break;
+    }
+    return 0;
+}
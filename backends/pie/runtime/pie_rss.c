@@ -0,0 +1,93 @@
+/*
+ * Receive-side scaling: the Toeplitz hash over the IP addresses and ports,
+ * computed the way NICs do it so that the harness spreads flows over the
+ * workers like a real multi-queue card would.
+ */
+
+#include <string.h>
+
+#include "pie_harness.h"
+
+const uint8_t pie_rss_default_key[PIE_RSS_KEY_SIZE] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67,
+    0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb,
+    0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30,
+    0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+uint32_t pie_toeplitz(const uint8_t* key, const uint8_t* data, size_t length)
+{
+    /* `window` holds the 32 key bits aligned with the current input bit,
+     * followed by the next 32 so that it can slide a byte at a time. */
+    uint64_t window = 0;
+    for (int i = 0; i < 8; i++)
+        window = (window << 8) | key[i];
+    uint32_t hash = 0;
+    for (size_t i = 0; i < length; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            if (data[i] & (1u << bit))
+                hash ^= (uint32_t)(window >> (25 + bit));
+        }
+        window = (window << 8) | (i + 8 < PIE_RSS_KEY_SIZE ? key[i + 8] : 0);
+    }
+    return hash;
+}
+
+#define ETH_HEADER 14
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_IPV6 0x86dd
+#define ETHERTYPE_VLAN 0x8100
+#define ETHERTYPE_QINQ 0x88a8
+
+static int has_ports(uint8_t protocol)
+{
+    return protocol == 6 || protocol == 17 || protocol == 132;
+}
+
+uint32_t pie_rss_hash(const uint8_t* key, const uint8_t* packet, size_t length)
+{
+    if (length < ETH_HEADER)
+        return 0;
+    size_t offset = 12;
+    uint16_t ethertype = (uint16_t)(packet[offset] << 8 | packet[offset + 1]);
+    for (int tags = 0; tags < 2 && (ethertype == ETHERTYPE_VLAN ||
+                                    ethertype == ETHERTYPE_QINQ); tags++) {
+        offset += 4;
+        if (offset + 2 > length)
+            return 0;
+        ethertype = (uint16_t)(packet[offset] << 8 | packet[offset + 1]);
+    }
+    offset += 2;
+
+    /* addresses, then ports: at most 16 + 16 + 2 + 2 bytes */
+    uint8_t input[36];
+    size_t size = 0;
+    uint8_t protocol = 0;
+    size_t transport = 0;
+    int fragment = 0;
+    if (ethertype == ETHERTYPE_IPV4) {
+        if (offset + 20 > length)
+            return 0;
+        const uint8_t* ip = packet + offset;
+        memcpy(input, ip + 12, 8);
+        size = 8;
+        protocol = ip[9];
+        fragment = ((ip[6] & 0x3f) | ip[7]) != 0;   /* MF flag or offset */
+        transport = offset + (size_t)(ip[0] & 0x0f) * 4;
+    } else if (ethertype == ETHERTYPE_IPV6) {
+        if (offset + 40 > length)
+            return 0;
+        const uint8_t* ip = packet + offset;
+        memcpy(input, ip + 8, 32);
+        size = 32;
+        protocol = ip[6];
+        transport = offset + 40;
+    } else {
+        return 0;
+    }
+    if (!fragment && has_ports(protocol) && transport + 4 <= length) {
+        memcpy(input + size, packet + transport, 4);
+        size += 4;
+    }
+    return pie_toeplitz(key, input, size);
+}
@@ -0,0 +1,431 @@
+#ifndef __BACKENDS_PIE_RUNTIME_PIE_RUNTIME_H__
+#define __BACKENDS_PIE_RUNTIME_PIE_RUNTIME_H__
+
+/*
+ * C interface between pipelines generated by p4c-pie and the programs that
+ * run them. Everything here is plain C so that the generated code, the JIT
+ * host and hand-written harnesses agree on the layout.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Per-packet metadata exchanged with the pipeline. Fields are copied by
+ * name into and out of the v1model standard_metadata_t; fields that are
+ * narrower in P4 are truncated on the way in.
+ *
+ * The generated code relies on this exact layout (see PieBackend).
+ */
+struct pie_metadata {
+    uint32_t ingress_port;
+    uint32_t egress_spec;
+    uint32_t egress_port;
+    uint32_t instance_type;
+    uint32_t packet_length;
+    uint32_t mcast_grp;
+    uint32_t egress_rid;
+    uint32_t checksum_error;
+    uint32_t parser_error;
+    uint32_t priority;
+    uint64_t ingress_global_timestamp;
+    /* Set by the pipeline: where the outgoing packet starts, relative to
+     * the packet pointer passed in (negative when headers were added). */
+    int32_t packet_offset;
+};
+
+/* egress_spec value that v1model's mark_to_drop() assigns */
+#define PIE_DROP_PORT 511
+
+/*
+ * Runs one packet through the pipeline. The packet buffer is rewritten in
+ * place; the result is the length of the outgoing packet in bytes, or
+ * PIE_DROPPED when the pipeline dropped it. The outgoing packet starts at
+ * packet + meta->packet_offset: the payload never moves and the deparser
+ * writes the headers right before it, only touching bytes that changed.
+ *
+ * Buffers must have PIE_HEADROOM writable bytes before the packet so that
+ * headers can be added (DPDK mbufs have 128); packets that would grow
+ * further are dropped.
+ */
+#define PIE_DROPPED (-1)
+#define PIE_HEADROOM 128
+
+typedef int32_t (*pie_process_packet_fn)(uint8_t* packet, size_t length,
+                                         struct pie_metadata* meta);
+
+#define PIE_PROCESS_PACKET "process_packet"
+
+/*
+ * Runs `count` packets through the pipeline, as process_packet() would one
+ * after the other, and stores the result of packet i in results[i]. While
+ * packet i is processed the headers and metadata of packet
+ * i + prefetch distance (see --prefetch-distance) are prefetched, so bursts
+ * of 32 or 64 packets, as received from a NIC, hide most cache misses.
+ * Returns the number of packets that were not dropped.
+ */
+typedef uint32_t (*pie_process_burst_fn)(uint8_t* const* packets, const size_t* lengths,
+                                         struct pie_metadata* meta, int32_t* results,
+                                         uint32_t count);
+
+#define PIE_PROCESS_BURST "pie_process_burst"
+
+/*
+ * Creates the tables of the pipeline and installs their default actions and
+ * const entries. Must be called once before the first packet.
+ */
+typedef void (*pie_init_fn)(void);
+
+#define PIE_INIT "pie_init"
+
+/* ------------------------------------------------------------- pipelines */
+
+/*
+ * Stable interface of compiled pipelines. `p4c-pie --emit shared` produces a
+ * shared object that contains the pipeline and the runtime and exports the
+ * functions of this header; `--emit obj` an object to link with
+ * libpie_runtime.a. A host loads it (or links it), calls
+ * pie_pipeline_create() and then runs packets through the functions of the
+ * descriptor, and manages tables and reads counters by name with the
+ * pie_table_* and pie_counter_* calls below.
+ *
+ * PIE_ABI_VERSION changes whenever a structure or function of this header
+ * changes incompatibly.
+ */
+#define PIE_ABI_VERSION 2
+
+/* How a key field is matched (optional fields match like ternary ones). */
+enum pie_match_kind {
+    PIE_MATCH_EXACT = 0,
+    PIE_MATCH_LPM = 1,
+    PIE_MATCH_TERNARY = 2,
+    PIE_MATCH_OPTIONAL = 3,
+};
+
+/*
+ * A key field or an action parameter of `width` bits, stored in `size` bytes
+ * at `offset`. Key fields are laid out as described under "tables" below;
+ * action parameters are C integers (bool is a byte) in the action data.
+ */
+struct pie_field_info {
+    const char* name;              /* the @name of a key field, or its P4 expression */
+    uint32_t match;                /* enum pie_match_kind; 0 for parameters */
+    uint32_t width;                /* in bits */
+    uint32_t offset;               /* in bytes */
+    uint32_t size;                 /* in bytes */
+};
+
+struct pie_action_info {
+    const char* name;              /* P4 control-plane name */
+    /* Size of the action data. pie_table_add() reads as many bytes as the
+     * largest action of the table has. */
+    uint32_t data_size;
+    uint32_t param_count;
+    const struct pie_field_info* params;
+};
+
+struct pie_table_info {
+    const char* name;              /* for pie_table_find() */
+    uint32_t kind;                 /* enum pie_table_kind */
+    uint32_t key_size;             /* in bytes */
+    uint32_t lpm_start;            /* as passed to pie_table_create() */
+    uint32_t key_count;
+    const struct pie_field_info* keys;
+    uint32_t action_count;
+    const struct pie_action_info* actions;    /* by id */
+};
+
+struct pie_pipeline {
+    uint32_t abi_version;          /* PIE_ABI_VERSION of the compiler */
+    const char* program;           /* the P4 source file */
+    pie_process_packet_fn process_packet;
+    pie_process_burst_fn process_burst;
+    uint32_t table_count;
+    const struct pie_table_info* tables;
+};
+
+/*
+ * Runs pie_init() the first time it is called and returns the descriptor of
+ * the pipeline; later calls return the same descriptor. Not thread-safe.
+ */
+const struct pie_pipeline* pie_pipeline_create(void);
+/* Destroys the tables. No thread may be running the pipeline. */
+void pie_pipeline_destroy(const struct pie_pipeline* pipeline);
+
+typedef const struct pie_pipeline* (*pie_pipeline_create_fn)(void);
+
+#define PIE_PIPELINE_CREATE "pie_pipeline_create"
+
+/* ----------------------------------------------------------- concurrency */
+
+/*
+ * Tables can be updated while other threads run the pipeline. Lookups take
+ * no lock: an update publishes its change with one atomic store and frees
+ * what it replaced only after a grace period, once every reader has gone
+ * through a quiescent state, a point where it holds no pointer returned by
+ * a lookup (quiescent-state-based reclamation, as in DPDK's rte_rcu_qsbr).
+ *
+ * Threads that run the pipeline while tables may change register
+ * themselves and report a quiescent state between bursts. Threads that
+ * never register must not look tables up during updates. Updates to one
+ * table are serialized by a lock that readers never take.
+ */
+void pie_rcu_register(void);
+void pie_rcu_unregister(void);
+void pie_rcu_quiescent(void);
+
+/* Waits for a grace period and frees everything deferred before it. */
+void pie_rcu_synchronize(void);
+
+/* Calls free_fn(object, arg) once no reader can hold a pointer to object. */
+void pie_rcu_defer(void (*free_fn)(void* object, uintptr_t arg), void* object, uintptr_t arg);
+
+/*
+ * For memory that its owner recycles itself: returns a cookie for the
+ * memory unpublished so far, which can be reused once pie_rcu_expired()
+ * of the cookie is true.
+ */
+uint64_t pie_rcu_retire(void);
+int pie_rcu_expired(uint64_t cookie);
+
+/* ------------------------------------------------------------- checksums */
+
+/*
+ * Ones' complement sum of `length` bytes taken as big-endian 16-bit words,
+ * the last byte padded with zero, folded to 16 bits but not complemented.
+ * Used by the generated code for the payload of *_checksum_with_payload().
+ */
+uint32_t pie_csum_partial(const uint8_t* data, size_t length);
+
+/* ---------------------------------------------------------------- tables */
+
+/*
+ * Match-action tables. Keys are byte strings of a fixed size: every key
+ * field takes the smallest number of bytes that holds it and is stored in
+ * network byte order, right-aligned. In LPM tables the LPM field comes last.
+ * Action ids follow the order of the table's `actions` list, starting at 0.
+ */
+enum pie_table_kind {
+    PIE_TABLE_EXACT = 0,   /* open-addressing hash table */
+    PIE_TABLE_LPM = 1,     /* DIR-24-8 for 32-bit keys, multibit trie otherwise */
+    PIE_TABLE_TERNARY = 2, /* tuple space search */
+    PIE_TABLE_LINEAR = 3,  /* array scanned in priority order, for a few entries */
+};
+
+/* Action id of a default entry that runs nothing. */
+#define PIE_NO_ACTION 0xffffffffu
+
+/* Result of a lookup: the action to run and its parameters. */
+struct pie_entry {
+    uint32_t action;
+    uint32_t hit;       /* 0 for the default action, else 1 + the cell of the entry */
+    uint64_t data[];    /* parameters, laid out as a C struct */
+};
+
+struct pie_table;
+
+/*
+ * `lpm_start` is the bit of the key where the LPM field starts (prefix
+ * lengths are counted from there); `data_size` bounds the action parameters
+ * of every action; `size` is the expected number of entries.
+ */
+struct pie_table* pie_table_create(const char* name, uint32_t kind, uint32_t key_size,
+                                   uint32_t lpm_start, uint32_t data_size, uint32_t size);
+/* The table must no longer be reachable by readers. */
+void pie_table_destroy(struct pie_table* table);
+/* Tables created by pie_init() can be found by their P4 name. */
+struct pie_table* pie_table_find(const char* name);
+
+/*
+ * Adds an entry, replacing any entry with the same key. `mask` and
+ * `priority` (higher wins) are used by ternary and linear tables (where a
+ * NULL mask matches every bit), `prefix_len` by LPM tables. Returns 0 or a
+ * negative errno value.
+ */
+int pie_table_add(struct pie_table* table, const uint8_t* key, const uint8_t* mask,
+                  uint32_t prefix_len, int32_t priority, uint32_t action, const void* data);
+int pie_table_delete(struct pie_table* table, const uint8_t* key, const uint8_t* mask,
+                     uint32_t prefix_len);
+void pie_table_set_default(struct pie_table* table, uint32_t action, const void* data);
+/*
+ * Makes the entries of a table constant: from now on, adding or deleting
+ * entries fails with -EPERM. The pipeline may then look the entries up in
+ * code of its own, calling pie_table_default() only on a miss.
+ */
+void pie_table_seal(struct pie_table* table);
+/* The default entry, which stays valid like the result of a lookup. */
+const struct pie_entry* pie_table_default(struct pie_table* table);
+
+/*
+ * Lookups never fail: on a miss they return the default entry. The entry
+ * stays valid until the caller's next quiescent state, even if it is
+ * modified or deleted meanwhile.
+ */
+const struct pie_entry* pie_table_lookup(struct pie_table* table, const uint8_t* key);
+const struct pie_entry* pie_exact_lookup(struct pie_table* table, const uint8_t* key);
+const struct pie_entry* pie_lpm_lookup(struct pie_table* table, const uint8_t* key);
+const struct pie_entry* pie_ternary_lookup(struct pie_table* table, const uint8_t* key);
+const struct pie_entry* pie_linear_lookup(struct pie_table* table, const uint8_t* key);
+
+/* From now on, keeps in *max_entries the most entries the table has held. */
+void pie_table_profile(struct pie_table* table, uint64_t* max_entries);
+
+struct pie_counter;
+struct pie_meter;
+
+/*
+ * Attaches a direct counter and a direct meter (either may be NULL) to an
+ * empty table. Every entry added from then on owns one cell of both, cleared
+ * when the entry is added and given back when it is deleted; `hit` of the
+ * entry is 1 + that cell. Adding more entries than the counter or meter has
+ * cells fails with -ENOSPC. Returns 0 or a negative errno value.
+ */
+int pie_table_set_direct(struct pie_table* table, struct pie_counter* counter,
+                         struct pie_meter* meter);
+
+/* -------------------------------------------------------------- counters */
+
+/*
+ * Every thread that counts gets a shard of its own, a copy of the cells
+ * padded to whole cache lines, so that cores never write the same line and
+ * need no atomic read-modify-write; readouts add the shards up. Threads
+ * beyond one per CPU share one more shard, with atomic adds.
+ */
+
+/* Packet and byte count of one counter cell. */
+struct pie_counter_value {
+    uint64_t packets;
+    uint64_t bytes;
+};
+
+struct pie_counter;
+
+/* An array of `size` cells, all zero. */
+struct pie_counter* pie_counter_create(const char* name, uint32_t size);
+void pie_counter_destroy(struct pie_counter* counter);
+/* Counters created by pie_init() can be found by their P4 name. */
+struct pie_counter* pie_counter_find(const char* name);
+uint32_t pie_counter_size(const struct pie_counter* counter);
+
+/* Counts a packet of `bytes` bytes; indexes out of range are ignored. */
+void pie_counter_count(struct pie_counter* counter, uint32_t index, uint32_t bytes);
+
+/*
+ * Readout for the control plane, which may run while packets are counted.
+ * Both return 0, or -EINVAL for an index out of range.
+ */
+int pie_counter_read(const struct pie_counter* counter, uint32_t index,
+                     struct pie_counter_value* value);
+int pie_counter_clear(struct pie_counter* counter, uint32_t index);
+
+/* ---------------------------------------------------------------- meters */
+
+/* Two-rate three-color markers (RFC 2698), timed with the CPU timestamp counter. */
+enum pie_meter_type {
+    PIE_METER_PACKETS = 0,
+    PIE_METER_BYTES = 1,
+};
+
+enum pie_meter_color {
+    PIE_METER_GREEN = 0,
+    PIE_METER_YELLOW = 1,
+    PIE_METER_RED = 2,
+};
+
+struct pie_meter;
+
+/* An array of `size` cells, which mark every packet green until set. */
+struct pie_meter* pie_meter_create(const char* name, uint32_t type, uint32_t size);
+void pie_meter_destroy(struct pie_meter* meter);
+struct pie_meter* pie_meter_find(const char* name);
+uint32_t pie_meter_size(const struct pie_meter* meter);
+
+/*
+ * Rates are in packets or bytes per second, burst sizes in packets or bytes
+ * (at most 2^32 - 1); the buckets start full. Both return 0, or -EINVAL for
+ * an index out of range or a peak rate below the committed rate.
+ */
+int pie_meter_set(struct pie_meter* meter, uint32_t index, uint64_t cir, uint64_t cburst,
+                  uint64_t pir, uint64_t pburst);
+int pie_meter_clear(struct pie_meter* meter, uint32_t index);
+
+/* Marks a packet of `length` bytes; indexes out of range mark it green. */
+uint32_t pie_meter_execute(struct pie_meter* meter, uint32_t index, uint32_t length);
+
+/* ------------------------------------------------------------- registers */
+
+/*
+ * Registers wrap the cells of the generated code, `size` cells of
+ * `cell_size` bytes in host byte order. Cells of up to 8 bytes are read and
+ * written atomically; wider cells, and actions that read and write a
+ * register, take the lock of the register.
+ */
+struct pie_register;
+
+struct pie_register* pie_register_create(const char* name, void* cells, uint32_t cell_size,
+                                         uint32_t size);
+void pie_register_destroy(struct pie_register* reg);
+struct pie_register* pie_register_find(const char* name);
+uint32_t pie_register_size(const struct pie_register* reg);
+
+/* Both copy `cell_size` bytes and return 0, or -EINVAL for an index out of range. */
+int pie_register_read(struct pie_register* reg, uint32_t index, void* value);
+int pie_register_write(struct pie_register* reg, uint32_t index, const void* value);
+
+/* A spin lock, held only for a few instructions. */
+void pie_register_lock(struct pie_register* reg);
+void pie_register_unlock(struct pie_register* reg);
+
+/* -------------------------------------------------------------- profiles */
+
+/*
+ * Pipelines compiled with --profile-generate count how often every parser
+ * transition is taken, every table hits and misses and every action runs,
+ * and the most entries every table held; p4c-pie --profile-use reads the
+ * counts back. The counters are 64-bit words in a file mapped shared, so
+ * they outlive the process and can be read while packets flow. They are
+ * incremented without atomics: threads sharing the pipeline may lose a few
+ * counts, which a profile can afford.
+ *
+ * The file holds the header, `count` counters, then their names, each
+ * terminated by a NUL.
+ */
+#define PIE_PROFILE_MAGIC "PIEPROF"
+#define PIE_PROFILE_VERSION 1
+
+struct pie_profile_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t names_size;   /* in bytes, NULs included */
+};
+
+/*
+ * Maps the counters `names` from `path`, for the lifetime of the process.
+ * Counts in a file with the same names go on; other files are overwritten.
+ * When the file cannot be mapped, returns `fallback`, `count` words that
+ * the caller has zeroed.
+ */
+uint64_t* pie_profile_map(const char* path, const char* const* names, uint32_t count,
+                          uint64_t* fallback);
+
+struct pie_profile {
+    uint32_t count;
+    const char** names;
+    const uint64_t* counters;
+    void* buffer;          /* file contents, names and counters point into it */
+};
+
+/* Returns 0 or a negative errno value; -EINVAL for files that are not profiles. */
+int pie_profile_load(const char* path, struct pie_profile* profile);
+void pie_profile_free(struct pie_profile* profile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BACKENDS_PIE_RUNTIME_PIE_RUNTIME_H__ */
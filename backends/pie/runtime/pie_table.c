@@ -0,0 +1,1412 @@
+/*
+ * Match-action tables used by pipelines generated by p4c-pie.
+ *
+ *  - exact:   open-addressing hash table with linear probing;
+ *  - lpm:     DIR-24-8 when the key is a single 32-bit LPM field, otherwise
+ *             a multibit trie with 8-bit strides and prefix expansion;
+ *  - ternary: tuple space search, one hash table per distinct mask, with
+ *             the tuples visited in decreasing order of their best priority;
+ *  - linear:  an array of masked keys scanned in decreasing order of
+ *             priority, cheaper than hashing for a handful of entries.
+ *
+ * Lookups are on the packet path and never allocate. Updates come from the
+ * control plane and may allocate and rehash.
+ *
+ * Updates may run while other threads look entries up (see pie_runtime.h):
+ *
+ *  - hash slots are never reused in place. A new or modified entry is
+ *    written into an empty slot, published by setting its state, and the
+ *    slot it replaces is marked deleted. Deleted slots go away when the
+ *    table is rehashed into a new slot array;
+ *  - LPM next hops are written before the DIR-24-8 or trie slots pointing
+ *    to them, which are single 32-bit words; a modified route gets a new
+ *    next hop, and old ones are recycled after a grace period;
+ *  - arrays that grow (tbl8 groups, next hops, the ternary group list) are
+ *    copied, and the copy is published, as is every new linear rule array.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pie_runtime.h"
+
+#define ALIGN8(x) (((x) + 7u) & ~7u)
+
+/* Loads and stores of words shared with concurrent lookups. */
+#define LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static uint64_t pie_hash(const uint8_t* key, uint32_t size)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ size;
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, key, 8);
+        h = (h ^ word) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+        key += 8;
+        size -= 8;
+    }
+    if (size != 0) {
+        uint64_t word = 0;
+        memcpy(&word, key, size);
+        h = (h ^ word) * 0xc4ceb9fe1a85ec53ull;
+    }
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 32;
+    return h;
+}
+
+static void free_object(void* object, uintptr_t unused)
+{
+    (void)unused;
+    free(object);
+}
+
+/* ------------------------------------------------------------ hash table */
+
+enum { SLOT_EMPTY = 0, SLOT_FULL = 1, SLOT_DELETED = 2 };
+
+/* A slot is this header, the entry (entry_size bytes) and the key. */
+struct slot_header {
+    uint32_t tag;
+    int32_t priority;
+    uint32_t state;
+    uint32_t reserved;
+};
+
+/* The slots of a hash table, replaced as a whole by a rehash. */
+struct slot_array {
+    uint32_t mask;      /* capacity - 1; the capacity is a power of two */
+    uint32_t reserved;
+    uint8_t slots[];
+};
+
+struct pie_hash {
+    struct slot_array* array;
+    uint32_t key_size;
+    uint32_t entry_size;
+    uint32_t slot_size;
+    uint32_t count;     /* full slots */
+    uint32_t used;      /* full and deleted slots */
+};
+
+static struct slot_header* slot_at(const struct pie_hash* h, const struct slot_array* array,
+                                   uint32_t index)
+{
+    return (struct slot_header*)(array->slots + (size_t)index * h->slot_size);
+}
+
+static struct pie_entry* slot_entry(struct slot_header* slot)
+{
+    return (struct pie_entry*)(slot + 1);
+}
+
+static uint8_t* slot_key(const struct pie_hash* h, struct slot_header* slot)
+{
+    return (uint8_t*)(slot + 1) + h->entry_size;
+}
+
+static struct slot_array* slots_alloc(const struct pie_hash* h, uint32_t capacity)
+{
+    struct slot_array* array = calloc(1, sizeof(*array) + (size_t)capacity * h->slot_size);
+    if (array != NULL)
+        array->mask = capacity - 1;
+    return array;
+}
+
+static int hash_init(struct pie_hash* h, uint32_t key_size, uint32_t entry_size, uint32_t size)
+{
+    uint32_t capacity = 16;
+    while (capacity < 2 * size && capacity < (1u << 30))
+        capacity <<= 1;
+    h->key_size = key_size;
+    h->entry_size = entry_size;
+    h->slot_size = sizeof(struct slot_header) + entry_size + ALIGN8(key_size);
+    h->count = 0;
+    h->used = 0;
+    h->array = slots_alloc(h, capacity);
+    return h->array ? 0 : -ENOMEM;
+}
+
+static void hash_free(struct pie_hash* h)
+{
+    free(h->array);
+    h->array = NULL;
+}
+
+static struct slot_header* hash_find(const struct pie_hash* h, const uint8_t* key, uint64_t hash)
+{
+    const struct slot_array* array = LOAD_ACQUIRE(&h->array);
+    uint32_t mask = array->mask;
+    uint32_t tag = (uint32_t)(hash >> 32);
+    for (uint32_t i = (uint32_t)hash & mask;; i = (i + 1) & mask) {
+        struct slot_header* slot = slot_at(h, array, i);
+        uint32_t state = LOAD_ACQUIRE(&slot->state);
+        if (state == SLOT_EMPTY)
+            return NULL;
+        if (state == SLOT_FULL && slot->tag == tag &&
+            memcmp(slot_key(h, slot), key, h->key_size) == 0)
+            return slot;
+    }
+}
+
+/*
+ * Takes the first empty slot on the probe sequence of `hash` and writes
+ * the key into it. The slot stays invisible to lookups until
+ * hash_publish(); since it comes after every slot of the sequence already
+ * in use, lookups keep finding an older slot with the same key until then.
+ */
+static struct slot_header* hash_claim(struct pie_hash* h, struct slot_array* array,
+                                      const uint8_t* key, uint64_t hash)
+{
+    uint32_t mask = array->mask;
+    uint32_t i = (uint32_t)hash & mask;
+    struct slot_header* slot = slot_at(h, array, i);
+    while (slot->state != SLOT_EMPTY) {
+        i = (i + 1) & mask;
+        slot = slot_at(h, array, i);
+    }
+    slot->tag = (uint32_t)(hash >> 32);
+    memcpy(slot_key(h, slot), key, h->key_size);
+    return slot;
+}
+
+/*
+ * Keeps the load factor, deleted slots included, at most 1/2 after one more
+ * slot is used. A rehash copies the full slots into a new array, publishes
+ * it and frees the old one after a grace period.
+ */
+static int hash_reserve(struct pie_hash* h)
+{
+    struct slot_array* old = h->array;
+    uint32_t capacity = old->mask + 1;
+    if (2 * (h->used + 1) <= capacity)
+        return 0;
+    if (2 * (h->count + 1) > capacity / 2)
+        capacity *= 2;
+    struct slot_array* array = slots_alloc(h, capacity);
+    if (array == NULL)
+        return -ENOMEM;
+    for (uint32_t i = 0; i <= old->mask; i++) {
+        struct slot_header* from = slot_at(h, old, i);
+        if (from->state != SLOT_FULL)
+            continue;
+        const uint8_t* key = slot_key(h, from);
+        struct slot_header* to = hash_claim(h, array, key, pie_hash(key, h->key_size));
+        memcpy(to, from, h->slot_size);
+    }
+    h->used = h->count;
+    STORE_RELEASE(&h->array, array);
+    pie_rcu_defer(free_object, old, 0);
+    return 0;
+}
+
+/*
+ * Claims a slot for `key`, to be filled by the caller and made visible by
+ * hash_publish(). `*replaced` is set to the slot now holding the key, if any.
+ */
+static struct slot_header* hash_prepare(struct pie_hash* h, const uint8_t* key,
+                                        struct slot_header** replaced)
+{
+    if (hash_reserve(h) != 0)
+        return NULL;
+    uint64_t hash = pie_hash(key, h->key_size);
+    *replaced = hash_find(h, key, hash);
+    h->used++;
+    return hash_claim(h, h->array, key, hash);
+}
+
+static void hash_publish(struct pie_hash* h, struct slot_header* slot,
+                         struct slot_header* replaced)
+{
+    STORE_RELEASE(&slot->state, SLOT_FULL);
+    h->count++;
+    if (replaced != NULL) {
+        STORE_RELEASE(&replaced->state, SLOT_DELETED);
+        h->count--;
+    }
+}
+
+static int hash_remove(struct pie_hash* h, const uint8_t* key)
+{
+    struct slot_header* slot = hash_find(h, key, pie_hash(key, h->key_size));
+    if (slot == NULL)
+        return -ENOENT;
+    STORE_RELEASE(&slot->state, SLOT_DELETED);
+    h->count--;
+    return 0;
+}
+
+/* ------------------------------------------------------------ LPM tables */
+
+#define DIR_EXT 0x80000000u
+#define DIR_DEPTH_SHIFT 24
+#define DIR_INDEX_MASK 0x00ffffffu
+
+struct trie_node {
+    /* dir_value() of the prefix bits used in this node and the next hop */
+    uint32_t nh[256];
+    struct trie_node* child[256];
+};
+
+struct retired_hop {
+    uint32_t hop;
+    uint64_t cookie;
+};
+
+struct pie_lpm {
+    int dir24;              /* DIR-24-8 rather than the trie */
+    uint32_t root;          /* next hop of the zero-length prefix */
+    uint32_t* tbl24;
+    uint32_t* tbl8;
+    uint32_t groups;        /* tbl8 groups in use */
+    uint32_t groups_capacity;
+    struct trie_node* trie;
+    /* Next hops are entries numbered from 1; 0 means no route. */
+    uint8_t* hops;
+    uint32_t hops_count;
+    uint32_t hops_capacity;
+    uint32_t free_hop;      /* head of the free list, threaded through `action` */
+    /* Next hops no longer installed, oldest first, that readers may still use. */
+    struct retired_hop* retired;
+    uint32_t retired_count;
+    uint32_t retired_capacity;
+    /* Installed prefixes: masked key followed by the total prefix length. */
+    struct pie_hash rules;
+};
+
+/* ---------------------------------------------------------- ternary tables */
+
+struct tss_group {
+    uint8_t* mask;
+    int32_t max_priority;   /* accessed atomically */
+    struct pie_hash hash;
+};
+
+/* The groups in decreasing order of max_priority, replaced as a whole. */
+struct tss_list {
+    uint32_t count;
+    struct tss_group* groups[];
+};
+
+struct pie_tss {
+    struct tss_list* list;
+};
+
+/* ----------------------------------------------------------- linear tables */
+
+/* A rule is this header, the entry, the masked key and the mask. */
+struct linear_header {
+    int32_t priority;
+    uint32_t reserved;
+};
+
+/* The rules in decreasing order of priority, replaced as a whole. */
+struct linear_list {
+    uint32_t count;
+    uint32_t reserved;
+    uint8_t rules[];
+};
+
+struct pie_linear {
+    struct linear_list* list;
+    uint32_t rule_size;
+};
+
+/* ------------------------------------------------------ direct resources */
+
+/* A cell given back, reusable once readers are done with its old entry. */
+struct free_cell {
+    uint32_t cell;
+    uint32_t reserved;
+    uint64_t cookie;    /* from pie_rcu_retire() */
+};
+
+/*
+ * The cells of the direct counter and meter of a table. Entries are known
+ * by their identity, the masked key, the mask and the prefix length they
+ * were added with, which maps to their cell in `owners`. Free cells are
+ * reused in the order they were given back.
+ */
+struct pie_cells {
+    struct pie_counter* counter;
+    struct pie_meter* meter;
+    struct pie_hash owners;     /* the cell is the action of the entry */
+    struct free_cell* free;     /* a ring of `size` cells */
+    uint32_t size;
+    uint32_t first;
+    uint32_t free_count;
+    uint32_t reserved;
+};
+
+static void cells_free(struct pie_cells* cells)
+{
+    if (cells == NULL)
+        return;
+    hash_free(&cells->owners);
+    free(cells->free);
+    free(cells);
+}
+
+/* ------------------------------------------------------------------ tables */
+
+struct pie_table {
+    char* name;
+    uint32_t kind;
+    uint32_t key_size;
+    uint32_t lpm_start;
+    uint32_t data_size;
+    uint32_t entry_size;
+    struct pie_entry* default_entry;
+    struct pie_hash exact;
+    struct pie_lpm lpm;
+    struct pie_tss ternary;
+    struct pie_linear linear;
+    uint64_t* max_entries;  /* see pie_table_profile() */
+    struct pie_cells* cells;    /* see pie_table_set_direct() */
+    int sealed;             /* see pie_table_seal() */
+    pthread_mutex_t lock;   /* serializes updates */
+    struct pie_table* next;
+};
+
+static struct pie_table* registry;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_entry(struct pie_table* table, struct pie_entry* entry, uint32_t action,
+                      uint32_t hit, const void* data)
+{
+    entry->action = action;
+    entry->hit = hit;
+    if (data != NULL)
+        memcpy(entry->data, data, table->data_size);
+    else
+        memset(entry->data, 0, table->data_size);
+}
+
+static struct pie_entry* hop_at(const struct pie_lpm* lpm, uint32_t entry_size, uint32_t hop)
+{
+    return (struct pie_entry*)(LOAD_ACQUIRE(&lpm->hops) + (size_t)(hop - 1) * entry_size);
+}
+
+static void hop_free(struct pie_table* table, uint32_t hop)
+{
+    struct pie_lpm* lpm = &table->lpm;
+    hop_at(lpm, table->entry_size, hop)->action = lpm->free_hop;
+    lpm->free_hop = hop;
+}
+
+/* Frees the retired next hops that no reader can use any more. */
+static void hop_reclaim(struct pie_table* table)
+{
+    struct pie_lpm* lpm = &table->lpm;
+    uint32_t done = 0;
+    while (done < lpm->retired_count && pie_rcu_expired(lpm->retired[done].cookie))
+        hop_free(table, lpm->retired[done++].hop);
+    if (done != 0) {
+        lpm->retired_count -= done;
+        memmove(lpm->retired, lpm->retired + done, lpm->retired_count * sizeof(*lpm->retired));
+    }
+}
+
+static void hop_retire(struct pie_table* table, uint32_t hop)
+{
+    struct pie_lpm* lpm = &table->lpm;
+    if (lpm->retired_count == lpm->retired_capacity) {
+        uint32_t capacity = lpm->retired_capacity ? 2 * lpm->retired_capacity : 64;
+        struct retired_hop* retired = realloc(lpm->retired, capacity * sizeof(*retired));
+        if (retired == NULL) {
+            pie_rcu_synchronize();
+            hop_free(table, hop);
+            return;
+        }
+        lpm->retired = retired;
+        lpm->retired_capacity = capacity;
+    }
+    lpm->retired[lpm->retired_count].hop = hop;
+    lpm->retired[lpm->retired_count].cookie = pie_rcu_retire();
+    lpm->retired_count++;
+}
+
+static uint32_t hop_alloc(struct pie_table* table)
+{
+    struct pie_lpm* lpm = &table->lpm;
+    hop_reclaim(table);
+    if (lpm->free_hop != 0) {
+        uint32_t hop = lpm->free_hop;
+        lpm->free_hop = hop_at(lpm, table->entry_size, hop)->action;
+        return hop;
+    }
+    if (lpm->hops_count == lpm->hops_capacity) {
+        uint32_t capacity = lpm->hops_capacity ? 2 * lpm->hops_capacity : 64;
+        if (capacity > DIR_INDEX_MASK)
+            return 0;
+        uint8_t* hops = malloc((size_t)capacity * table->entry_size);
+        if (hops == NULL)
+            return 0;
+        uint8_t* old = lpm->hops;
+        if (old != NULL)
+            memcpy(hops, old, (size_t)lpm->hops_count * table->entry_size);
+        STORE_RELEASE(&lpm->hops, hops);
+        if (old != NULL)
+            pie_rcu_defer(free_object, old, 0);
+        lpm->hops_capacity = capacity;
+    }
+    return ++lpm->hops_count;
+}
+
+/* Copies the first `bits` bits of `key` into `out` and clears the rest. */
+static void mask_prefix(uint8_t* out, const uint8_t* key, uint32_t size, uint32_t bits)
+{
+    for (uint32_t i = 0; i < size; i++) {
+        uint8_t mask = bits >= 8 * (i + 1) ? 0xff :
+                       bits <= 8 * i ? 0 : (uint8_t)(0xff00 >> (bits - 8 * i));
+        out[i] = key[i] & mask;
+    }
+}
+
+/* The rule of the installed prefix of `len` bits of `key`, or NULL. */
+static struct slot_header* rule_slot(struct pie_table* table, const uint8_t* key, uint32_t len)
+{
+    uint8_t rule[table->key_size + 4];
+    mask_prefix(rule, key, table->key_size, len);
+    memcpy(rule + table->key_size, &len, 4);
+    struct pie_hash* rules = &table->lpm.rules;
+    return hash_find(rules, rule, pie_hash(rule, rules->key_size));
+}
+
+/* Next hop of the installed prefix of `len` bits of `key`, or 0. */
+static uint32_t rule_find(struct pie_table* table, const uint8_t* key, uint32_t len)
+{
+    struct slot_header* slot = rule_slot(table, key, len);
+    return slot ? slot_entry(slot)->action : 0;
+}
+
+/* Longest installed prefix of `key` shorter than `len` bits but at least `min` bits. */
+static uint32_t rule_cover(struct pie_table* table, const uint8_t* key, uint32_t len,
+                           uint32_t min, uint32_t* depth)
+{
+    for (uint32_t l = len; l-- > min;) {
+        uint32_t hop = rule_find(table, key, l);
+        if (hop != 0) {
+            *depth = l;
+            return hop;
+        }
+    }
+    *depth = 0;
+    return 0;
+}
+
+static uint32_t dir_value(uint32_t depth, uint32_t hop)
+{
+    return hop ? (depth << DIR_DEPTH_SHIFT) | hop : 0;
+}
+
+static uint32_t dir_depth(uint32_t value)
+{
+    return (value & ~DIR_EXT) >> DIR_DEPTH_SHIFT;
+}
+
+/* Adds a tbl8 group filled with `fill`; lookups cannot reach it until a
+ * tbl24 slot points to it. */
+static int dir_group(struct pie_lpm* lpm, uint32_t fill)
+{
+    if (lpm->groups == lpm->groups_capacity) {
+        uint32_t capacity = lpm->groups_capacity ? 2 * lpm->groups_capacity : 256;
+        uint32_t* tbl8 = malloc((size_t)capacity * 256 * sizeof(uint32_t));
+        if (tbl8 == NULL)
+            return -1;
+        uint32_t* old = lpm->tbl8;
+        if (old != NULL)
+            memcpy(tbl8, old, (size_t)lpm->groups * 256 * sizeof(uint32_t));
+        STORE_RELEASE(&lpm->tbl8, tbl8);
+        if (old != NULL)
+            pie_rcu_defer(free_object, old, 0);
+        lpm->groups_capacity = capacity;
+    }
+    uint32_t* group = lpm->tbl8 + (size_t)lpm->groups * 256;
+    for (unsigned i = 0; i < 256; i++)
+        group[i] = fill;
+    return (int)lpm->groups++;
+}
+
+/*
+ * Writes `value` into every slot covered by the prefix (`address`, `len`)
+ * whose depth satisfies the update: below or at `len` when adding, equal
+ * to `len` when removing.
+ */
+static int dir_update(struct pie_lpm* lpm, uint32_t address, uint32_t len, uint32_t value,
+                      int removing)
+{
+#define DIR_MATCHES(v) (removing ? dir_depth(v) == len : dir_depth(v) <= len)
+    if (len <= 24) {
+        uint32_t first = len ? (address >> 8) & (0xffffffu << (24 - len)) : 0;
+        uint32_t count = 1u << (24 - len);
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t v = lpm->tbl24[i];
+            if (v & DIR_EXT) {
+                uint32_t* group = lpm->tbl8 + (size_t)(v & DIR_INDEX_MASK) * 256;
+                for (unsigned j = 0; j < 256; j++) {
+                    if (DIR_MATCHES(group[j]))
+                        STORE_RELEASE(&group[j], value);
+                }
+            } else if (DIR_MATCHES(v)) {
+                STORE_RELEASE(&lpm->tbl24[i], value);
+            }
+        }
+        return 0;
+    }
+
+    uint32_t index = address >> 8;
+    uint32_t v = lpm->tbl24[index];
+    if (!(v & DIR_EXT)) {
+        if (removing)
+            return 0;
+        int group = dir_group(lpm, v);
+        if (group < 0)
+            return -ENOMEM;
+        v = DIR_EXT | (uint32_t)group;
+        STORE_RELEASE(&lpm->tbl24[index], v);
+    }
+    uint32_t* group = lpm->tbl8 + (size_t)(v & DIR_INDEX_MASK) * 256;
+    uint32_t first = address & 0xff & (0xffu << (32 - len));
+    uint32_t count = 1u << (32 - len);
+    for (uint32_t j = first; j < first + count; j++) {
+        if (DIR_MATCHES(group[j]))
+            STORE_RELEASE(&group[j], value);
+    }
+    return 0;
+#undef DIR_MATCHES
+}
+
+static struct trie_node* trie_child(struct trie_node** link)
+{
+    if (*link == NULL) {
+        struct trie_node* node = calloc(1, sizeof(struct trie_node));
+        if (node == NULL)
+            return NULL;
+        STORE_RELEASE(link, node);
+    }
+    return *link;
+}
+
+static int trie_update(struct pie_table* table, const uint8_t* key, uint32_t len, uint32_t hop,
+                       uint32_t depth, int removing)
+{
+    struct pie_lpm* lpm = &table->lpm;
+    uint32_t level = (len - 1) / 8;
+    uint32_t bits = len - 8 * level;
+    if (removing && lpm->trie == NULL)
+        return 0;
+    struct trie_node* node = trie_child(&lpm->trie);
+    for (uint32_t i = 0; node != NULL && i < level; i++) {
+        if (removing && node->child[key[i]] == NULL)
+            return 0;
+        node = trie_child(&node->child[key[i]]);
+    }
+    if (node == NULL)
+        return -ENOMEM;
+
+    uint32_t span = 1u << (8 - bits);
+    uint32_t first = key[level] & ~(span - 1);
+    uint32_t value = dir_value(depth ? depth - 8 * level : 0, hop);
+    for (uint32_t j = first; j < first + span; j++) {
+        uint32_t v = node->nh[j];
+        if (removing ? dir_depth(v) == bits : dir_depth(v) <= bits)
+            STORE_RELEASE(&node->nh[j], value);
+    }
+    return 0;
+}
+
+/* Points the slots of the prefix (`masked`, `len`) to `hop`. */
+static int lpm_install(struct pie_table* table, const uint8_t* masked, uint32_t len,
+                       uint32_t hop)
+{
+    struct pie_lpm* lpm = &table->lpm;
+    if (len == 0) {
+        STORE_RELEASE(&lpm->root, hop);
+        return 0;
+    }
+    if (lpm->dir24) {
+        uint32_t address = ((uint32_t)masked[0] << 24) | ((uint32_t)masked[1] << 16) |
+                           ((uint32_t)masked[2] << 8) | masked[3];
+        return dir_update(lpm, address, len, dir_value(len, hop), 0);
+    }
+    return trie_update(table, masked, len, hop, len, 0);
+}
+
+static int lpm_add(struct pie_table* table, const uint8_t* key, uint32_t prefix_len,
+                   uint32_t action, uint32_t hit, const void* data)
+{
+    struct pie_lpm* lpm = &table->lpm;
+    uint32_t len = table->lpm_start + prefix_len;
+    if (len > 8 * table->key_size)
+        return -EINVAL;
+    uint8_t masked[table->key_size + 4];
+    mask_prefix(masked, key, table->key_size, len);
+    memcpy(masked + table->key_size, &len, 4);
+
+    /* A modified route gets a new next hop, so that lookups see either
+     * the old entry or the new one, never a mix. */
+    uint32_t hop = hop_alloc(table);
+    if (hop == 0)
+        return -ENOMEM;
+    set_entry(table, hop_at(lpm, table->entry_size, hop), action, hit, data);
+    struct slot_header* rule = rule_slot(table, masked, len);
+    uint32_t old = 0;
+    if (rule != NULL) {
+        old = slot_entry(rule)->action;
+        slot_entry(rule)->action = hop;
+    } else {
+        struct slot_header* replaced;
+        rule = hash_prepare(&lpm->rules, masked, &replaced);
+        if (rule == NULL) {
+            hop_free(table, hop);
+            return -ENOMEM;
+        }
+        slot_entry(rule)->action = hop;
+        hash_publish(&lpm->rules, rule, replaced);
+    }
+
+    int result = lpm_install(table, masked, len, hop);
+    if (old != 0)
+        hop_retire(table, old);
+    return result;
+}
+
+static int lpm_delete(struct pie_table* table, const uint8_t* key, uint32_t prefix_len)
+{
+    struct pie_lpm* lpm = &table->lpm;
+    uint32_t len = table->lpm_start + prefix_len;
+    if (len > 8 * table->key_size)
+        return -EINVAL;
+    uint8_t masked[table->key_size + 4];
+    mask_prefix(masked, key, table->key_size, len);
+    memcpy(masked + table->key_size, &len, 4);
+    uint32_t hop = rule_find(table, masked, len);
+    if (hop == 0)
+        return -ENOENT;
+    hash_remove(&lpm->rules, masked);
+
+    if (len == 0) {
+        STORE_RELEASE(&lpm->root, 0);
+    } else if (lpm->dir24) {
+        uint32_t depth;
+        uint32_t cover = rule_cover(table, masked, len, 1, &depth);
+        uint32_t address = ((uint32_t)masked[0] << 24) | ((uint32_t)masked[1] << 16) |
+                           ((uint32_t)masked[2] << 8) | masked[3];
+        dir_update(lpm, address, len, dir_value(depth, cover), 1);
+    } else {
+        /* Shorter prefixes ending in an upper trie node are found on the way down. */
+        uint32_t depth;
+        uint32_t cover = rule_cover(table, masked, len, 8 * ((len - 1) / 8) + 1, &depth);
+        trie_update(table, masked, len, cover, depth, 1);
+    }
+    hop_retire(table, hop);
+    return 0;
+}
+
+static void trie_free(struct trie_node* node)
+{
+    if (node == NULL)
+        return;
+    for (unsigned i = 0; i < 256; i++)
+        trie_free(node->child[i]);
+    free(node);
+}
+
+const struct pie_entry* pie_lpm_lookup(struct pie_table* table, const uint8_t* key)
+{
+    const struct pie_lpm* lpm = &table->lpm;
+    uint32_t hop = LOAD_ACQUIRE(&lpm->root);
+    if (lpm->dir24) {
+        uint32_t address = ((uint32_t)key[0] << 24) | ((uint32_t)key[1] << 16) |
+                           ((uint32_t)key[2] << 8) | key[3];
+        uint32_t v = LOAD_ACQUIRE(&lpm->tbl24[address >> 8]);
+        if (v & DIR_EXT) {
+            const uint32_t* tbl8 = LOAD_ACQUIRE(&lpm->tbl8);
+            v = LOAD_ACQUIRE(&tbl8[((size_t)(v & DIR_INDEX_MASK) << 8) | (address & 0xff)]);
+        }
+        if (v != 0)
+            hop = v & DIR_INDEX_MASK;
+    } else {
+        const struct trie_node* node = LOAD_ACQUIRE(&lpm->trie);
+        for (uint32_t i = 0; node != NULL && i < table->key_size; i++) {
+            uint8_t byte = key[i];
+            uint32_t v = LOAD_ACQUIRE(&node->nh[byte]);
+            if (v != 0)
+                hop = v & DIR_INDEX_MASK;
+            node = LOAD_ACQUIRE(&node->child[byte]);
+        }
+    }
+    return hop ? hop_at(lpm, table->entry_size, hop) : LOAD_ACQUIRE(&table->default_entry);
+}
+
+/* ---------------------------------------------------------- ternary tables */
+
+static int32_t group_priority(const struct tss_group* group)
+{
+    return __atomic_load_n(&group->max_priority, __ATOMIC_RELAXED);
+}
+
+static int group_order(const void* left, const void* right)
+{
+    int32_t l = group_priority(*(const struct tss_group* const*)left);
+    int32_t r = group_priority(*(const struct tss_group* const*)right);
+    return l < r ? 1 : l > r ? -1 : 0;
+}
+
+static void group_free(void* object, uintptr_t unused)
+{
+    struct tss_group* group = object;
+    (void)unused;
+    hash_free(&group->hash);
+    free(group->mask);
+    free(group);
+}
+
+static struct tss_group* tss_find(struct pie_table* table, const uint8_t* mask)
+{
+    const struct tss_list* list = table->ternary.list;
+    for (uint32_t i = 0; list != NULL && i < list->count; i++) {
+        if (memcmp(list->groups[i]->mask, mask, table->key_size) == 0)
+            return list->groups[i];
+    }
+    return NULL;
+}
+
+/*
+ * Publishes the group list with `added` and without `removed` (either may
+ * be NULL), sorted; does nothing when it would not change.
+ */
+static int tss_update(struct pie_table* table, struct tss_group* added,
+                      struct tss_group* removed)
+{
+    struct pie_tss* tss = &table->ternary;
+    struct tss_list* old = tss->list;
+    uint32_t count = old ? old->count : 0;
+    if (added == NULL && removed == NULL) {
+        int sorted = 1;
+        for (uint32_t i = 1; i < count; i++)
+            sorted &= group_order(&old->groups[i - 1], &old->groups[i]) <= 0;
+        if (sorted)
+            return 0;
+    }
+    struct tss_list* list = malloc(sizeof(*list) + (count + 1) * sizeof(list->groups[0]));
+    if (list == NULL)
+        return -ENOMEM;
+    list->count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (old->groups[i] != removed)
+            list->groups[list->count++] = old->groups[i];
+    }
+    if (added != NULL)
+        list->groups[list->count++] = added;
+    qsort(list->groups, list->count, sizeof(list->groups[0]), group_order);
+    STORE_RELEASE(&tss->list, list);
+    if (old != NULL)
+        pie_rcu_defer(free_object, old, 0);
+    return 0;
+}
+
+/* Recomputes the best priority of a group after a removal or a change. */
+static void tss_rescan(struct tss_group* group)
+{
+    const struct slot_array* array = group->hash.array;
+    int first = 1;
+    int32_t best = 0;
+    for (uint32_t i = 0; i <= array->mask; i++) {
+        struct slot_header* slot = slot_at(&group->hash, array, i);
+        if (slot->state == SLOT_FULL && (first || slot->priority > best)) {
+            best = slot->priority;
+            first = 0;
+        }
+    }
+    if (!first)
+        __atomic_store_n(&group->max_priority, best, __ATOMIC_RELAXED);
+}
+
+static int tss_add(struct pie_table* table, const uint8_t* key, const uint8_t* mask,
+                   int32_t priority, uint32_t action, uint32_t hit, const void* data)
+{
+    struct tss_group* group = tss_find(table, mask);
+    int created = group == NULL;
+    if (created) {
+        group = calloc(1, sizeof(*group));
+        if (group == NULL)
+            return -ENOMEM;
+        group->mask = malloc(table->key_size ? table->key_size : 1);
+        if (group->mask == NULL || hash_init(&group->hash, table->key_size,
+                                             table->entry_size, 16) != 0) {
+            free(group->mask);
+            free(group);
+            return -ENOMEM;
+        }
+        memcpy(group->mask, mask, table->key_size);
+        group->max_priority = priority;
+    }
+
+    uint8_t masked[table->key_size];
+    for (uint32_t i = 0; i < table->key_size; i++)
+        masked[i] = key[i] & mask[i];
+    struct slot_header* replaced;
+    struct slot_header* slot = hash_prepare(&group->hash, masked, &replaced);
+    if (slot == NULL) {
+        if (created)
+            group_free(group, 0);
+        return -ENOMEM;
+    }
+    slot->priority = priority;
+    set_entry(table, slot_entry(slot), action, hit, data);
+    /* Raise the priority before the entry shows, so that lookups that
+     * stop early still reach it. */
+    if (priority > group_priority(group))
+        __atomic_store_n(&group->max_priority, priority, __ATOMIC_RELAXED);
+    hash_publish(&group->hash, slot, replaced);
+    if (replaced != NULL)
+        tss_rescan(group);
+
+    if (created && tss_update(table, group, NULL) != 0) {
+        group_free(group, 0);
+        return -ENOMEM;
+    }
+    return tss_update(table, NULL, NULL);
+}
+
+static int tss_delete(struct pie_table* table, const uint8_t* key, const uint8_t* mask)
+{
+    struct tss_group* group = tss_find(table, mask);
+    if (group == NULL)
+        return -ENOENT;
+    uint8_t masked[table->key_size];
+    for (uint32_t i = 0; i < table->key_size; i++)
+        masked[i] = key[i] & mask[i];
+    if (hash_remove(&group->hash, masked) != 0)
+        return -ENOENT;
+
+    if (group->hash.count == 0) {
+        /* Without memory, an empty group just stays in the list. */
+        if (tss_update(table, NULL, group) == 0)
+            pie_rcu_defer(group_free, group, 0);
+        return 0;
+    }
+    tss_rescan(group);
+    tss_update(table, NULL, NULL);
+    return 0;
+}
+
+const struct pie_entry* pie_ternary_lookup(struct pie_table* table, const uint8_t* key)
+{
+    const struct tss_list* list = LOAD_ACQUIRE(&table->ternary.list);
+    struct slot_header* best = NULL;
+    uint8_t masked[table->key_size ? table->key_size : 1];
+    for (uint32_t g = 0; list != NULL && g < list->count; g++) {
+        const struct tss_group* group = list->groups[g];
+        if (best != NULL && group_priority(group) <= best->priority)
+            break;
+        for (uint32_t i = 0; i < table->key_size; i++)
+            masked[i] = key[i] & group->mask[i];
+        struct slot_header* slot =
+            hash_find(&group->hash, masked, pie_hash(masked, table->key_size));
+        if (slot != NULL && (best == NULL || slot->priority > best->priority))
+            best = slot;
+    }
+    return best ? slot_entry(best) : LOAD_ACQUIRE(&table->default_entry);
+}
+
+/* ----------------------------------------------------------- linear tables */
+
+static struct linear_header* linear_at(const struct pie_table* table,
+                                       const struct linear_list* list, uint32_t index)
+{
+    return (struct linear_header*)(list->rules + (size_t)index * table->linear.rule_size);
+}
+
+static struct pie_entry* linear_entry(struct linear_header* rule)
+{
+    return (struct pie_entry*)(rule + 1);
+}
+
+static uint8_t* linear_key(const struct pie_table* table, struct linear_header* rule)
+{
+    return (uint8_t*)(rule + 1) + table->entry_size;
+}
+
+static uint8_t* linear_mask(const struct pie_table* table, struct linear_header* rule)
+{
+    return linear_key(table, rule) + ALIGN8(table->key_size);
+}
+
+/* Writes the key and mask of a rule; a NULL mask matches every bit. */
+static void linear_set(const struct pie_table* table, struct linear_header* rule,
+                       const uint8_t* key, const uint8_t* mask)
+{
+    uint8_t* masked = linear_key(table, rule);
+    uint8_t* bits = linear_mask(table, rule);
+    for (uint32_t i = 0; i < table->key_size; i++) {
+        bits[i] = mask ? mask[i] : 0xff;
+        masked[i] = key[i] & bits[i];
+    }
+}
+
+/* Index of the rule with the key and mask of `probe`, or the rule count. */
+static uint32_t linear_find(const struct pie_table* table, const struct linear_list* list,
+                            struct linear_header* probe)
+{
+    uint32_t count = list ? list->count : 0;
+    for (uint32_t i = 0; i < count; i++) {
+        struct linear_header* rule = linear_at(table, list, i);
+        if (memcmp(linear_key(table, rule), linear_key(table, probe),
+                   2 * ALIGN8(table->key_size)) == 0)
+            return i;
+    }
+    return count;
+}
+
+/*
+ * Publishes the rules without the one at `removed` (none when it is the
+ * rule count) and with `added`, if not NULL, after the rules of the same
+ * or a higher priority.
+ */
+static int linear_update(struct pie_table* table, uint32_t removed,
+                         const struct linear_header* added)
+{
+    struct pie_linear* linear = &table->linear;
+    struct linear_list* old = linear->list;
+    uint32_t count = old ? old->count : 0;
+    uint32_t size = linear->rule_size;
+    struct linear_list* list = malloc(sizeof(*list) + (size_t)(count + 1) * size);
+    if (list == NULL)
+        return -ENOMEM;
+    list->count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        struct linear_header* rule = linear_at(table, old, i);
+        if (added != NULL && rule->priority < added->priority) {
+            memcpy(linear_at(table, list, list->count++), added, size);
+            added = NULL;
+        }
+        if (i != removed)
+            memcpy(linear_at(table, list, list->count++), rule, size);
+    }
+    if (added != NULL)
+        memcpy(linear_at(table, list, list->count++), added, size);
+    STORE_RELEASE(&linear->list, list);
+    if (old != NULL)
+        pie_rcu_defer(free_object, old, 0);
+    return 0;
+}
+
+static int linear_add(struct pie_table* table, const uint8_t* key, const uint8_t* mask,
+                      int32_t priority, uint32_t action, uint32_t hit, const void* data)
+{
+    uint8_t buffer[table->linear.rule_size] __attribute__((aligned(8)));
+    struct linear_header* rule = (struct linear_header*)buffer;
+    memset(buffer, 0, sizeof(buffer));
+    rule->priority = priority;
+    set_entry(table, linear_entry(rule), action, hit, data);
+    linear_set(table, rule, key, mask);
+    return linear_update(table, linear_find(table, table->linear.list, rule), rule);
+}
+
+static int linear_delete(struct pie_table* table, const uint8_t* key, const uint8_t* mask)
+{
+    uint8_t buffer[table->linear.rule_size] __attribute__((aligned(8)));
+    struct linear_header* rule = (struct linear_header*)buffer;
+    memset(buffer, 0, sizeof(buffer));
+    linear_set(table, rule, key, mask);
+    const struct linear_list* list = table->linear.list;
+    uint32_t index = linear_find(table, list, rule);
+    if (list == NULL || index == list->count)
+        return -ENOENT;
+    return linear_update(table, index, NULL);
+}
+
+const struct pie_entry* pie_linear_lookup(struct pie_table* table, const uint8_t* key)
+{
+    const struct linear_list* list = LOAD_ACQUIRE(&table->linear.list);
+    for (uint32_t i = 0; list != NULL && i < list->count; i++) {
+        struct linear_header* rule = linear_at(table, list, i);
+        const uint8_t* masked = linear_key(table, rule);
+        const uint8_t* mask = linear_mask(table, rule);
+        uint32_t j = 0;
+        while (j < table->key_size && (key[j] & mask[j]) == masked[j])
+            j++;
+        if (j == table->key_size)
+            return linear_entry(rule);
+    }
+    return LOAD_ACQUIRE(&table->default_entry);
+}
+
+/* ------------------------------------------------------------------ tables */
+
+const struct pie_entry* pie_exact_lookup(struct pie_table* table, const uint8_t* key)
+{
+    struct slot_header* slot = hash_find(&table->exact, key, pie_hash(key, table->key_size));
+    return slot ? slot_entry(slot) : LOAD_ACQUIRE(&table->default_entry);
+}
+
+const struct pie_entry* pie_table_lookup(struct pie_table* table, const uint8_t* key)
+{
+    switch (table->kind) {
+    case PIE_TABLE_LPM:
+        return pie_lpm_lookup(table, key);
+    case PIE_TABLE_TERNARY:
+        return pie_ternary_lookup(table, key);
+    case PIE_TABLE_LINEAR:
+        return pie_linear_lookup(table, key);
+    default:
+        return pie_exact_lookup(table, key);
+    }
+}
+
+struct pie_table* pie_table_create(const char* name, uint32_t kind, uint32_t key_size,
+                                   uint32_t lpm_start, uint32_t data_size, uint32_t size)
+{
+    if (kind > PIE_TABLE_LINEAR)
+        return NULL;
+    struct pie_table* table = calloc(1, sizeof(*table));
+    if (table == NULL)
+        return NULL;
+    pthread_mutex_init(&table->lock, NULL);
+    name = name ? name : "";
+    table->name = malloc(strlen(name) + 1);
+    if (table->name != NULL)
+        strcpy(table->name, name);
+    table->kind = kind;
+    table->key_size = key_size;
+    table->lpm_start = lpm_start;
+    table->data_size = data_size;
+    table->entry_size = sizeof(struct pie_entry) + ALIGN8(data_size);
+    table->linear.rule_size =
+        sizeof(struct linear_header) + table->entry_size + 2 * ALIGN8(key_size);
+    table->default_entry = calloc(1, table->entry_size);
+    int failed = table->name == NULL || table->default_entry == NULL;
+    if (table->default_entry != NULL)
+        table->default_entry->action = PIE_NO_ACTION;
+
+    if (!failed && kind == PIE_TABLE_EXACT) {
+        failed = hash_init(&table->exact, key_size, table->entry_size, size) != 0;
+    } else if (!failed && kind == PIE_TABLE_LPM) {
+        struct pie_lpm* lpm = &table->lpm;
+        lpm->dir24 = key_size == 4 && lpm_start == 0;
+        failed = hash_init(&lpm->rules, key_size + 4, sizeof(struct pie_entry), size) != 0;
+        if (!failed && lpm->dir24) {
+            lpm->tbl24 = calloc(1u << 24, sizeof(uint32_t));
+            failed = lpm->tbl24 == NULL;
+        }
+    }
+    if (failed) {
+        pie_table_destroy(table);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&registry_lock);
+    table->next = registry;
+    registry = table;
+    pthread_mutex_unlock(&registry_lock);
+    return table;
+}
+
+void pie_table_destroy(struct pie_table* table)
+{
+    if (table == NULL)
+        return;
+    pthread_mutex_lock(&registry_lock);
+    for (struct pie_table** link = &registry; *link != NULL; link = &(*link)->next) {
+        if (*link == table) {
+            *link = table->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    /* Memory retired by earlier updates may belong to this table. */
+    pie_rcu_synchronize();
+    hash_free(&table->exact);
+    hash_free(&table->lpm.rules);
+    free(table->lpm.tbl24);
+    free(table->lpm.tbl8);
+    free(table->lpm.hops);
+    free(table->lpm.retired);
+    trie_free(table->lpm.trie);
+    struct tss_list* list = table->ternary.list;
+    for (uint32_t i = 0; list != NULL && i < list->count; i++)
+        group_free(list->groups[i], 0);
+    free(list);
+    free(table->linear.list);
+    cells_free(table->cells);
+    free(table->default_entry);
+    free(table->name);
+    pthread_mutex_destroy(&table->lock);
+    free(table);
+}
+
+struct pie_table* pie_table_find(const char* name)
+{
+    struct pie_table* found = NULL;
+    pthread_mutex_lock(&registry_lock);
+    for (struct pie_table* table = registry; table != NULL; table = table->next) {
+        if (strcmp(table->name, name) == 0) {
+            found = table;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return found;
+}
+
+/* Identity of an entry, as a key of the owners of cells. */
+static void cell_identity(const struct pie_table* table, uint8_t* identity, const uint8_t* key,
+                          const uint8_t* mask, uint32_t prefix_len)
+{
+    uint32_t size = table->key_size;
+    uint32_t len = 0;
+    if (table->kind == PIE_TABLE_LPM) {
+        len = table->lpm_start + prefix_len;
+        mask_prefix(identity, key, size, len);
+        memset(identity + size, 0, size);
+    } else {
+        for (uint32_t i = 0; i < size; i++) {
+            uint8_t bits = mask != NULL && table->kind != PIE_TABLE_EXACT ? mask[i] : 0xff;
+            identity[i] = key[i] & bits;
+            identity[size + i] = bits;
+        }
+    }
+    memcpy(identity + 2 * size, &len, 4);
+}
+
+/*
+ * Finds the cell of the entry, or takes a free one and clears it, in which
+ * case *claimed is set.
+ */
+static int cell_claim(struct pie_table* table, const uint8_t* key, const uint8_t* mask,
+                      uint32_t prefix_len, uint32_t* cell, int* claimed)
+{
+    struct pie_cells* cells = table->cells;
+    uint8_t identity[cells->owners.key_size];
+    cell_identity(table, identity, key, mask, prefix_len);
+    struct slot_header* owner =
+        hash_find(&cells->owners, identity, pie_hash(identity, cells->owners.key_size));
+    if (owner != NULL) {
+        *cell = slot_entry(owner)->action;
+        return 0;
+    }
+    if (cells->free_count == 0)
+        return -ENOSPC;
+    struct free_cell* next = &cells->free[cells->first];
+    /* Readers may still count into the cell for the entry it had. */
+    if (!pie_rcu_expired(next->cookie))
+        pie_rcu_synchronize();
+    struct slot_header* replaced;
+    owner = hash_prepare(&cells->owners, identity, &replaced);
+    if (owner == NULL)
+        return -ENOMEM;
+    *cell = next->cell;
+    slot_entry(owner)->action = *cell;
+    hash_publish(&cells->owners, owner, replaced);
+    cells->first = (cells->first + 1) % cells->size;
+    cells->free_count--;
+    if (cells->counter != NULL)
+        pie_counter_clear(cells->counter, *cell);
+    if (cells->meter != NULL)
+        pie_meter_clear(cells->meter, *cell);
+    *claimed = 1;
+    return 0;
+}
+
+static void cell_release(struct pie_table* table, const uint8_t* key, const uint8_t* mask,
+                         uint32_t prefix_len)
+{
+    struct pie_cells* cells = table->cells;
+    uint8_t identity[cells->owners.key_size];
+    cell_identity(table, identity, key, mask, prefix_len);
+    struct slot_header* owner =
+        hash_find(&cells->owners, identity, pie_hash(identity, cells->owners.key_size));
+    if (owner == NULL)
+        return;
+    struct free_cell* last = &cells->free[(cells->first + cells->free_count) % cells->size];
+    last->cell = slot_entry(owner)->action;
+    last->cookie = pie_rcu_retire();
+    cells->free_count++;
+    hash_remove(&cells->owners, identity);
+}
+
+static int table_add(struct pie_table* table, const uint8_t* key, const uint8_t* mask,
+                     uint32_t prefix_len, int32_t priority, uint32_t action, uint32_t hit,
+                     const void* data)
+{
+    switch (table->kind) {
+    case PIE_TABLE_LPM:
+        return lpm_add(table, key, prefix_len, action, hit, data);
+    case PIE_TABLE_TERNARY:
+        if (mask == NULL)
+            return -EINVAL;
+        return tss_add(table, key, mask, priority, action, hit, data);
+    case PIE_TABLE_LINEAR:
+        return linear_add(table, key, mask, priority, action, hit, data);
+    default: {
+        struct slot_header* replaced;
+        struct slot_header* slot = hash_prepare(&table->exact, key, &replaced);
+        if (slot == NULL)
+            return -ENOMEM;
+        set_entry(table, slot_entry(slot), action, hit, data);
+        hash_publish(&table->exact, slot, replaced);
+        return 0;
+    }
+    }
+}
+
+static uint64_t table_entries(const struct pie_table* table)
+{
+    switch (table->kind) {
+    case PIE_TABLE_LPM:
+        return table->lpm.rules.count;
+    case PIE_TABLE_TERNARY: {
+        const struct tss_list* list = table->ternary.list;
+        uint64_t entries = 0;
+        for (uint32_t i = 0; list != NULL && i < list->count; i++)
+            entries += list->groups[i]->hash.count;
+        return entries;
+    }
+    case PIE_TABLE_LINEAR:
+        return table->linear.list ? table->linear.list->count : 0;
+    default:
+        return table->exact.count;
+    }
+}
+
+static void profile_entries(struct pie_table* table)
+{
+    if (table->max_entries == NULL)
+        return;
+    /* Other processes may share the profile file. */
+    uint64_t entries = table_entries(table);
+    uint64_t most = __atomic_load_n(table->max_entries, __ATOMIC_RELAXED);
+    while (entries > most &&
+           !__atomic_compare_exchange_n(table->max_entries, &most, entries, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+int pie_table_add(struct pie_table* table, const uint8_t* key, const uint8_t* mask,
+                  uint32_t prefix_len, int32_t priority, uint32_t action, const void* data)
+{
+    if (table->kind == PIE_TABLE_TERNARY && mask == NULL)
+        return -EINVAL;
+    pthread_mutex_lock(&table->lock);
+    uint32_t cell = 0;
+    int claimed = 0;
+    int result = table->sealed ? -EPERM : 0;
+    if (result == 0 && table->cells != NULL)
+        result = cell_claim(table, key, mask, prefix_len, &cell, &claimed);
+    if (result == 0)
+        result = table_add(table, key, mask, prefix_len, priority, action, 1 + cell, data);
+    if (result == 0)
+        profile_entries(table);
+    else if (claimed)
+        cell_release(table, key, mask, prefix_len);
+    pthread_mutex_unlock(&table->lock);
+    return result;
+}
+
+static int table_delete(struct pie_table* table, const uint8_t* key, const uint8_t* mask,
+                        uint32_t prefix_len)
+{
+    switch (table->kind) {
+    case PIE_TABLE_LPM:
+        return lpm_delete(table, key, prefix_len);
+    case PIE_TABLE_TERNARY:
+        if (mask == NULL)
+            return -EINVAL;
+        return tss_delete(table, key, mask);
+    case PIE_TABLE_LINEAR:
+        return linear_delete(table, key, mask);
+    default:
+        return hash_remove(&table->exact, key);
+    }
+}
+
+int pie_table_delete(struct pie_table* table, const uint8_t* key, const uint8_t* mask,
+                     uint32_t prefix_len)
+{
+    pthread_mutex_lock(&table->lock);
+    int result = table->sealed ? -EPERM : table_delete(table, key, mask, prefix_len);
+    if (result == 0 && table->cells != NULL)
+        cell_release(table, key, mask, prefix_len);
+    pthread_mutex_unlock(&table->lock);
+    return result;
+}
+
+void pie_table_set_default(struct pie_table* table, uint32_t action, const void* data)
+{
+    pthread_mutex_lock(&table->lock);
+    struct pie_entry* old = table->default_entry;
+    struct pie_entry* entry = malloc(table->entry_size);
+    if (entry != NULL) {
+        set_entry(table, entry, action, 0, data);
+        STORE_RELEASE(&table->default_entry, entry);
+        pie_rcu_defer(free_object, old, 0);
+    } else {
+        /* Without memory, lookups may briefly see a mix of both actions. */
+        set_entry(table, old, action, 0, data);
+    }
+    pthread_mutex_unlock(&table->lock);
+}
+
+void pie_table_seal(struct pie_table* table)
+{
+    pthread_mutex_lock(&table->lock);
+    table->sealed = 1;
+    pthread_mutex_unlock(&table->lock);
+}
+
+const struct pie_entry* pie_table_default(struct pie_table* table)
+{
+    return LOAD_ACQUIRE(&table->default_entry);
+}
+
+int pie_table_set_direct(struct pie_table* table, struct pie_counter* counter,
+                         struct pie_meter* meter)
+{
+    uint32_t size = UINT32_MAX;
+    if (counter != NULL)
+        size = pie_counter_size(counter);
+    if (meter != NULL && pie_meter_size(meter) < size)
+        size = pie_meter_size(meter);
+    if (size == UINT32_MAX || size == 0)
+        return -EINVAL;
+    struct pie_cells* cells = calloc(1, sizeof(*cells));
+    if (cells == NULL)
+        return -ENOMEM;
+    cells->counter = counter;
+    cells->meter = meter;
+    cells->size = size;
+    cells->free_count = size;
+    cells->free = calloc(size, sizeof(*cells->free));
+    if (cells->free == NULL ||
+        hash_init(&cells->owners, 2 * table->key_size + 4, sizeof(struct pie_entry), 16) != 0) {
+        cells_free(cells);
+        return -ENOMEM;
+    }
+    for (uint32_t i = 0; i < size; i++)
+        cells->free[i].cell = i;
+
+    pthread_mutex_lock(&table->lock);
+    int result = table_entries(table) == 0 && table->cells == NULL ? 0 : -EBUSY;
+    if (result == 0)
+        table->cells = cells;
+    pthread_mutex_unlock(&table->lock);
+    if (result != 0)
+        cells_free(cells);
+    return result;
+}
+
+void pie_table_profile(struct pie_table* table, uint64_t* max_entries)
+{
+    pthread_mutex_lock(&table->lock);
+    table->max_entries = max_entries;
+    profile_entries(table);
+    pthread_mutex_unlock(&table->lock);
+}
@@ -0,0 +1,473 @@
+#include "stf.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "runtime/pie_harness.h"
+
+namespace pie {
+
+namespace {
+
+/// Splits an STF line into names and numbers (which may hold `*`, `$` and
+/// `[]`) and the punctuation `:(),/=`. Names may be quoted, as p4testgen
+/// writes them; comments start with `#`.
+std::vector<std::string> tokenize(const std::string& line)
+{
+    std::vector<std::string> tokens;
+    size_t i = 0;
+    while (i < line.size() && line[i] != '#') {
+        char c = line[i];
+        if (isspace(static_cast<unsigned char>(c))) {
+            i++;
+        } else if (c == '"') {
+            size_t end = line.find('"', i + 1);
+            end = end != std::string::npos ? end : line.size();
+            tokens.push_back(line.substr(i + 1, end - i - 1));
+            i = end + 1;
+        } else if (strchr(":(),/=", c) != nullptr) {
+            tokens.emplace_back(1, c);
+            i++;
+        } else {
+            size_t start = i;
+            while (i < line.size() && !isspace(static_cast<unsigned char>(line[i])) &&
+                   strchr(":(),/=#\"", line[i]) == nullptr)
+                i++;
+            tokens.push_back(line.substr(start, i - start));
+        }
+    }
+    return tokens;
+}
+
+bool parse_port(const std::string& text, uint32_t& port)
+{
+    char* end = nullptr;
+    auto value = strtoul(text.c_str(), &end, 0);
+    if (end == text.c_str() || *end != 0 || value > UINT32_MAX)
+        return false;
+    port = value;
+    return true;
+}
+
+int digit_value(char c)
+{
+    static const char digits[] = "0123456789abcdef";
+    auto digit = c != 0 ? strchr(digits, tolower(static_cast<unsigned char>(c))) : nullptr;
+    return digit != nullptr ? digit - digits : -1;
+}
+
+/// A number of an STF entry as a `width`-bit value, big-endian in
+/// (width + 7) / 8 bytes, with a mask of the bits its digits give: `*`
+/// digits and the bits left of the first digit are not given (bmv2stf.py
+/// masks ternary values that way), except in decimal numbers.
+struct Value
+{
+    std::vector<uint8_t> bits;
+    std::vector<uint8_t> mask;
+    /// Bits given from the most significant one, for LPM values without
+    /// a prefix length.
+    unsigned prefix = 0;
+
+    /// The mask of the top `prefix` bits of `width`.
+    static std::vector<uint8_t> prefix_mask(unsigned width, unsigned prefix)
+    {
+        std::vector<uint8_t> mask((width + 7) / 8, 0);
+        for (unsigned bit = width - prefix; bit < width; bit++)
+            set(mask, bit, true);
+        return mask;
+    }
+
+    static void set(std::vector<uint8_t>& bytes, unsigned bit, bool value)
+    {
+        auto& byte = bytes[bytes.size() - 1 - bit / 8];
+        byte = value ? byte | (1u << (bit % 8)) : byte & ~(1u << (bit % 8));
+    }
+
+    bool parse(const std::string& text, unsigned width)
+    {
+        size_t size = (width + 7) / 8;
+        bits.assign(size, 0);
+        mask.assign(size, 0);
+        unsigned digitBits = 0;
+        if (text.size() > 2 && text[0] == '0') {
+            char base = tolower(static_cast<unsigned char>(text[1]));
+            digitBits = base == 'x' ? 4 : base == 'b' ? 1 : base == 'o' ? 3 : 0;
+        }
+
+        if (digitBits == 0) {
+            // Decimal: multiply the bytes by 10 and add each digit.
+            for (char c : text) {
+                if (!isdigit(static_cast<unsigned char>(c)))
+                    return false;
+                unsigned carry = c - '0';
+                for (size_t i = size; i-- > 0;) {
+                    carry += bits[i] * 10u;
+                    bits[i] = carry & 0xff;
+                    carry >>= 8;
+                }
+                if (carry != 0)
+                    return false;
+            }
+            mask = prefix_mask(width, width);
+            prefix = width;
+        } else {
+            unsigned bit = 0;
+            for (size_t i = text.size(); i-- > 2; bit += digitBits) {
+                char c = text[i];
+                int digit = c == '*' ? 0 : digit_value(c);
+                if (digit < 0 || digit >= (1 << digitBits))
+                    return false;
+                if (c != '*')
+                    prefix += digitBits;
+                for (unsigned j = 0; j < digitBits; j++) {
+                    if (bit + j >= width) {
+                        if ((digit >> j) & 1)
+                            return false;
+                        continue;
+                    }
+                    set(bits, bit + j, (digit >> j) & 1);
+                    set(mask, bit + j, c != '*');
+                }
+            }
+            prefix = std::min(prefix, width);
+        }
+        // The bits above `width` must be zero.
+        if (width % 8 != 0 && size > 0 && (bits[0] >> (width % 8)) != 0)
+            return false;
+        return true;
+    }
+};
+
+bool matches(const std::string& name, const std::string& wanted)
+{
+    return name == wanted ||
+           (name.size() > wanted.size() &&
+            name.compare(name.size() - wanted.size(), wanted.size(), wanted) == 0 &&
+            name[name.size() - wanted.size() - 1] == '.');
+}
+
+}  // namespace
+
+PieStf::Result PieStf::run(const std::filesystem::path& path, std::ostream& out)
+{
+    std::ifstream file(path);
+    if (!file) {
+        out << path.string() << ": cannot read the file" << std::endl;
+        return Result::FAILED;
+    }
+    bool ok = true;
+    std::string line;
+    for (unsigned number = 1; std::getline(file, line); number++) {
+        auto tokens = tokenize(line);
+        if (tokens.empty())
+            continue;
+        std::ostringstream error;
+        if (!execute(tokens, line, error)) {
+            out << path.string() << ":" << number << ": " << error.str() << std::endl;
+            if (unsupported)
+                return Result::UNSUPPORTED;
+            ok = false;
+        }
+    }
+    return compare(out) && ok ? Result::PASSED : Result::FAILED;
+}
+
+bool PieStf::execute(const std::vector<std::string>& tokens, const std::string& line,
+                     std::ostream& out)
+{
+    auto& command = tokens[0];
+    if (command == "packet" || command == "expect") {
+        uint32_t port;
+        if (tokens.size() < 2 || !parse_port(tokens[1], port)) {
+            out << command << ": expected a port";
+            return false;
+        }
+        std::string data;
+        for (size_t i = 2; i < tokens.size(); i++)
+            data += tokens[i];
+        if (command == "expect") {
+            expected[port];
+            if (data.empty()) {
+                anyPacket.insert(port);
+                return true;
+            }
+            bool exactLength = data.back() == '$';
+            if (exactLength)
+                data.pop_back();
+            if (data.find_first_not_of("0123456789abcdefABCDEF*") != std::string::npos) {
+                out << "expect: invalid packet data";
+                return false;
+            }
+            expected[port].push_back({ data, exactLength });
+            return true;
+        }
+        if (data.size() % 2 != 0 ||
+            data.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos) {
+            out << "packet: invalid packet data";
+            return false;
+        }
+        Packet packet = { port, {} };
+        for (size_t i = 0; i < data.size(); i += 2)
+            packet.data.push_back(strtoul(data.substr(i, 2).c_str(), nullptr, 16));
+        expected[port];
+        send(packet);
+        packets.push_back(std::move(packet));
+        return true;
+    }
+    if (command == "add" || command == "setdefault")
+        return add_entry(tokens, command == "setdefault", out);
+    if (command == "wait" || command == "no_packet")
+        return true;
+    out << "'" << line << "' is not supported by the pie backend";
+    unsupported = true;
+    return false;
+}
+
+const pie_table_info* PieStf::find_table(const std::string& name) const
+{
+    for (uint32_t i = 0; i < pipeline->table_count; i++) {
+        if (matches(pipeline->tables[i].name, name))
+            return &pipeline->tables[i];
+    }
+    return nullptr;
+}
+
+bool PieStf::add_entry(const std::vector<std::string>& tokens, bool setDefault,
+                       std::ostream& out)
+{
+    size_t next = 1;
+    auto peek = [&](size_t offset) -> std::string {
+        return next + offset < tokens.size() ? tokens[next + offset] : std::string();
+    };
+    auto expect = [&](const char* token) {
+        if (peek(0) != token) {
+            out << "expected '" << token << "'";
+            return false;
+        }
+        next++;
+        return true;
+    };
+
+    auto table = find_table(peek(0));
+    if (table == nullptr) {
+        out << "no table " << peek(0);
+        return false;
+    }
+    next++;
+    int32_t priority = 0;
+    if (!setDefault && peek(1) != ":" && !peek(0).empty() && isdigit(peek(0)[0])) {
+        priority = strtol(peek(0).c_str(), nullptr, 0);
+        next++;
+    }
+
+    // Fields the entry does not name match anything, as in bmv2stf.py.
+    std::vector<uint8_t> key(table->key_size, 0);
+    std::vector<uint8_t> mask(table->key_size, 0);
+    uint32_t prefixLength = 0;
+    for (uint32_t i = 0; i < table->key_count; i++) {
+        auto& field = table->keys[i];
+        if (field.match == PIE_MATCH_EXACT) {
+            auto all = Value::prefix_mask(field.width, field.width);
+            memcpy(mask.data() + field.offset, all.data(), field.size);
+        }
+    }
+    while (!setDefault && peek(1) == ":") {
+        auto name = peek(0);
+        auto text = peek(2);
+        next += 3;
+        const pie_field_info* field = nullptr;
+        for (uint32_t i = 0; i < table->key_count && field == nullptr; i++) {
+            if (matches(table->keys[i].name, name))
+                field = &table->keys[i];
+        }
+        if (field == nullptr) {
+            out << table->name << " has no key field " << name;
+            return false;
+        }
+        Value value;
+        if (!value.parse(text, field->width)) {
+            out << text << " is not a " << field->width << "-bit value";
+            return false;
+        }
+        unsigned prefix = field->match == PIE_MATCH_LPM ? value.prefix : field->width;
+        if (field->match == PIE_MATCH_LPM && peek(0) == "/") {
+            prefix = strtoul(peek(1).c_str(), nullptr, 0);
+            next += 2;
+            if (prefix > field->width) {
+                out << "prefix length " << prefix << " is longer than " << name;
+                return false;
+            }
+        }
+        if (field->match == PIE_MATCH_EXACT || field->match == PIE_MATCH_LPM) {
+            // Exact and prefix matches give every bit, or the top `prefix`.
+            value.mask = Value::prefix_mask(field->width, prefix);
+            prefixLength = field->match == PIE_MATCH_LPM ? prefix : prefixLength;
+        }
+        for (uint32_t i = 0; i < field->size; i++) {
+            key[field->offset + i] = value.bits[i] & value.mask[i];
+            mask[field->offset + i] = value.mask[i];
+        }
+    }
+
+    const pie_action_info* action = nullptr;
+    uint32_t actionId = 0;
+    for (; actionId < table->action_count; actionId++) {
+        if (matches(table->actions[actionId].name, peek(0))) {
+            action = &table->actions[actionId];
+            break;
+        }
+    }
+    if (action == nullptr) {
+        out << table->name << " has no action " << peek(0);
+        return false;
+    }
+    next++;
+
+    // pie_table_add() reads the action data of the largest action.
+    size_t dataSize = 8;
+    for (uint32_t i = 0; i < table->action_count; i++)
+        dataSize = std::max<size_t>(dataSize, table->actions[i].data_size);
+    std::vector<uint8_t> data(dataSize, 0);
+    if (!expect("("))
+        return false;
+    while (peek(0) != ")") {
+        auto name = peek(0);
+        next++;
+        if (!expect(":"))
+            return false;
+        auto text = peek(0);
+        next++;
+        const pie_field_info* param = nullptr;
+        for (uint32_t i = 0; i < action->param_count && param == nullptr; i++) {
+            if (name == action->params[i].name)
+                param = &action->params[i];
+        }
+        if (param == nullptr) {
+            out << action->name << " has no parameter " << name;
+            return false;
+        }
+        Value value;
+        if (!value.parse(text, param->width) || value.bits.size() > param->size) {
+            out << text << " is not a " << param->width << "-bit value";
+            return false;
+        }
+        // Parameters are C integers in host byte order.
+        for (size_t i = 0; i < value.bits.size(); i++) {
+            auto byte = value.bits[value.bits.size() - 1 - i];
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            data[param->offset + param->size - 1 - i] = byte;
+#else
+            data[param->offset + i] = byte;
+#endif
+        }
+        if (peek(0) == ",")
+            next++;
+    }
+
+    auto runtimeTable = pie_table_find(table->name);
+    if (runtimeTable == nullptr) {
+        out << "table " << table->name << " was not created";
+        return false;
+    }
+    if (setDefault) {
+        pie_table_set_default(runtimeTable, actionId, data.data());
+        return true;
+    }
+    int ret = pie_table_add(runtimeTable, key.data(), mask.data(), prefixLength, priority,
+                            actionId, data.data());
+    if (ret != 0) {
+        out << "cannot add the entry to " << table->name << ": " << strerror(-ret);
+        return false;
+    }
+    return true;
+}
+
+void PieStf::send(const Packet& packet)
+{
+    std::vector<uint8_t> buffer(PIE_HEADROOM + packet.data.size());
+    auto data = buffer.data() + PIE_HEADROOM;
+    memcpy(data, packet.data.data(), packet.data.size());
+    pie_metadata meta = {};
+    meta.ingress_port = packet.port;
+    meta.packet_length = packet.data.size();
+    auto length = pipeline->process_packet(data, packet.data.size(), &meta);
+    if (length == PIE_DROPPED)
+        return;
+    auto start = data + meta.packet_offset;
+    sent[meta.egress_spec].emplace_back(start, start + length);
+}
+
+bool PieStf::compare(std::ostream& out) const
+{
+    static const char digits[] = "0123456789ABCDEF";
+    bool ok = true;
+    for (auto& [port, packets] : sent) {
+        if (expected.count(port) == 0) {
+            out << "expected no packets on port " << port << ", got " << packets.size()
+                << std::endl;
+            ok = false;
+        }
+    }
+    for (auto& [port, packets] : expected) {
+        if (anyPacket.count(port) != 0)
+            continue;
+        auto it = sent.find(port);
+        size_t count = it != sent.end() ? it->second.size() : 0;
+        if (count != packets.size()) {
+            out << "expected " << packets.size() << " packets on port " << port << ", got "
+                << count << std::endl;
+            ok = false;
+            continue;
+        }
+        for (size_t i = 0; i < count; i++) {
+            std::string received;
+            for (auto byte : it->second[i]) {
+                received += digits[byte >> 4];
+                received += digits[byte & 0xf];
+            }
+            auto& expect = packets[i];
+            bool same = received.size() >= expect.data.size() &&
+                        !(expect.exactLength && received.size() > expect.data.size());
+            for (size_t j = 0; same && j < expect.data.size(); j++) {
+                char c = toupper(static_cast<unsigned char>(expect.data[j]));
+                same = c == '*' || c == received[j];
+            }
+            if (!same) {
+                out << "packet " << i << " on port " << port << " differs:\n  expected "
+                    << expect.data << (expect.exactLength ? "$" : "") << "\n  received "
+                    << received << std::endl;
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+double PieStf::measure(unsigned repeat) const
+{
+    std::vector<pie_packet> burst;
+    for (auto& packet : packets)
+        burst.push_back({ packet.data.data(), uint32_t(packet.data.size()), packet.port });
+    if (burst.empty())
+        return 0;
+
+    pie_harness_config config = {};
+    config.process_burst = pipeline->process_burst;
+    config.workers = 1;
+    auto harness = pie_harness_create(&config);
+    if (harness == nullptr)
+        return 0;
+    double rate = 0;
+    if (pie_harness_run(harness, burst.data(), burst.size(), repeat) == 0) {
+        auto stats = pie_harness_stats(harness, 0);
+        rate = stats->seconds > 0 ? stats->packets / stats->seconds : 0;
+    }
+    pie_harness_destroy(harness);
+    return rate;
+}
+
+}  // end of namespace pie
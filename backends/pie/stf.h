@@ -0,0 +1,77 @@
+#ifndef __BACKENDS_PIE_STF_H__
+#define __BACKENDS_PIE_STF_H__
+
+#include <filesystem>
+#include <iosfwd>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "runtime/pie_runtime.h"
+
+namespace pie {
+
+/// Runs an STF test, the format of backends/bmv2/run-bmv2-test.py, through
+/// a compiled pipeline, so that pie is checked against the expectations
+/// written for bmv2.
+///
+/// Commands run in file order. `add` and `setdefault` go to the tables
+/// through the pipeline descriptor (pie_pipeline); tables, actions and key
+/// fields are found by name or by a suffix of it, as bmv2stf.py does.
+/// `packet` runs a packet through process_packet, which sends it to its
+/// egress_spec; `expect` queues what bmv2 sends on a port. At the end the
+/// packets sent on every port that the test mentions are compared with the
+/// expected ones, in order: `*` digits match anything and a trailing `$`
+/// requires the exact length. A packet sent on any other port fails the
+/// test. Tests with commands for externs, mirroring or
+/// multicast, which pie does not support, stop there as unsupported.
+class PieStf
+{
+ public:
+    enum class Result { PASSED, FAILED, UNSUPPORTED };
+
+    explicit PieStf(const pie_pipeline* pipeline)
+        : pipeline(pipeline) {}
+
+    /// Runs the test in `path` and reports every difference to `out`. It
+    /// passes when the pipeline sent what bmv2 is expected to.
+    Result run(const std::filesystem::path& path, std::ostream& out);
+
+    /// Runs the packets of the test through process_burst `repeat` times,
+    /// with the tables as the test left them, and returns the packet rate.
+    double measure(unsigned repeat) const;
+
+ private:
+    struct Packet
+    {
+        uint32_t port;
+        std::vector<uint8_t> data;
+    };
+    struct Expected
+    {
+        /// Hex digits and `*`; empty for any packet.
+        std::string data;
+        bool exactLength;
+    };
+
+    bool execute(const std::vector<std::string>& tokens, const std::string& line,
+                 std::ostream& out);
+    bool add_entry(const std::vector<std::string>& tokens, bool setDefault, std::ostream& out);
+    void send(const Packet& packet);
+    bool compare(std::ostream& out) const;
+
+    const pie_table_info* find_table(const std::string& name) const;
+
+    const pie_pipeline* pipeline;
+    std::vector<Packet> packets;
+    /// Ports mentioned by the test, with the packets expected and sent.
+    std::map<uint32_t, std::vector<Expected>> expected;
+    std::set<uint32_t> anyPacket;
+    std::map<uint32_t, std::vector<std::vector<uint8_t>>> sent;
+    bool unsupported = false;
+};
+
+}  // end of namespace pie
+
+#endif  // end of __BACKENDS_PIE_STF_H__
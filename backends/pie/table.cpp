@@ -0,0 +1,107 @@
+#include "table.h"
+
+#include <algorithm>
+
+#include "frontends/p4/coreLibrary.h"
+#include "frontends/p4/fromv1.0/v1model.h"
+#include "lib/error.h"
+#include "runtime/pie_runtime.h"
+
+namespace pie {
+
+PieTable::PieTable(const IR::P4Table* table, P4::ReferenceMap* refMap, P4::TypeMap* typeMap,
+                   PieTypeFactory& types)
+    : table(table)
+    , name(table->controlPlaneName())
+    , kind(PIE_TABLE_EXACT)
+{
+    auto& core = P4::P4CoreLibrary::instance();
+    auto& v1model = P4V1::V1Model::instance;
+
+    auto sizeProperty = table->getSizeProperty();
+    size = sizeProperty != nullptr ? sizeProperty->asUnsigned() : 1024;
+
+    bool hasLpm = false;
+    if (auto key = table->getKey()) {
+        for (auto element : key->keyElements) {
+            auto matchKind = element->matchType->path->name.name;
+            auto width = types.value_width(typeMap->getType(element->expression, true));
+            // Like the bmv2 JSON, so that STF tests name the same fields.
+            cstring keyName = element->expression->toString();
+            if (auto annotation = element->getAnnotation(IR::Annotation::nameAnnotation)) {
+                if (annotation->expr.size() == 1 && annotation->expr[0]->is<IR::StringLiteral>())
+                    keyName = annotation->expr[0]->to<IR::StringLiteral>()->value;
+            }
+            keys.push_back({ element, keyName, matchKind, PIE_MATCH_EXACT, width, 0,
+                             (width + 7) / 8 });
+            if (matchKind == core.ternaryMatch.name ||
+                matchKind == v1model.optionalMatchType.name) {
+                keys.back().match = matchKind == core.ternaryMatch.name ? PIE_MATCH_TERNARY
+                                                                       : PIE_MATCH_OPTIONAL;
+                kind = PIE_TABLE_TERNARY;
+            } else if (matchKind == core.lpmMatch.name) {
+                if (hasLpm)
+                    ::error(ErrorType::ERR_INVALID, "%1%: more than one lpm key field", element);
+                hasLpm = true;
+                keys.back().match = PIE_MATCH_LPM;
+                if (kind == PIE_TABLE_EXACT)
+                    kind = PIE_TABLE_LPM;
+            } else if (matchKind != core.exactMatch.name) {
+                ::error(ErrorType::ERR_UNSUPPORTED,
+                        "%1%: match kind not supported by the pie backend", element->matchType);
+            }
+        }
+    }
+
+    // The prefix of an LPM table covers the exact fields, then the LPM field.
+    for (auto& field : keys) {
+        if (field.matchKind == core.lpmMatch.name && kind == PIE_TABLE_LPM)
+            continue;
+        field.offset = keySize;
+        keySize += field.size;
+    }
+    for (auto& field : keys) {
+        if (field.matchKind != core.lpmMatch.name || kind != PIE_TABLE_LPM)
+            continue;
+        field.offset = keySize;
+        keySize += field.size;
+        lpmStart = 8 * field.offset + (8 * field.size - field.width);
+    }
+
+    if (auto actionList = table->getActionList()) {
+        for (auto element : actionList->actionList) {
+            auto decl = refMap->getDeclaration(element->getPath(), true);
+            auto action = decl->to<IR::P4Action>();
+            if (action == nullptr) {
+                ::error(ErrorType::ERR_INVALID, "%1%: not an action", element);
+                continue;
+            }
+            ids.emplace(action, actions.size());
+            actions.push_back(element);
+            declarations.push_back(action);
+        }
+    }
+}
+
+void PieTable::use_profile(const PieProfile& profile)
+{
+    // Up to this many entries, comparing every masked key beats hashing it.
+    static const uint64_t linearEntries = 8;
+    auto entries = counter("entries"_cs);
+    uint64_t applied = profile.get(counter("hit"_cs)) + profile.get(counter("miss"_cs));
+    if (!profile.has(entries) || applied == 0)
+        return;
+    uint64_t held = profile.get(entries);
+    if ((kind == PIE_TABLE_EXACT || kind == PIE_TABLE_TERNARY) && held <= linearEntries)
+        kind = PIE_TABLE_LINEAR;
+    else if (kind == PIE_TABLE_EXACT)
+        size = static_cast<unsigned>(std::min<uint64_t>(held, UINT32_MAX));
+}
+
+int PieTable::action_id(const IR::P4Action* action) const
+{
+    auto it = ids.find(action);
+    return it != ids.end() ? static_cast<int>(it->second) : -1;
+}
+
+}  // end of namespace pie
@@ -0,0 +1,91 @@
+#ifndef __BACKENDS_PIE_TABLE_H__
+#define __BACKENDS_PIE_TABLE_H__
+
+#include <map>
+#include <vector>
+
+#include "ir/ir.h"
+#include "frontends/p4/typeMap.h"
+#include "frontends/common/resolveReferences/referenceMap.h"
+#include "externs.h"
+#include "llvm-ir.h"
+#include "profile.h"
+#include "type.h"
+
+namespace llvm {
+class GlobalVariable;
+class StructType;
+}
+
+namespace pie {
+
+/// Layout of a P4 table in the pie runtime (runtime/pie_table.c).
+///
+/// The lookup structure is chosen from the match kinds of the key: ternary
+/// and optional fields make a tuple-space table, an lpm field a trie (or
+/// DIR-24-8 for a lone 32-bit address), anything else a hash table. Key
+/// fields are packed into a byte string as described in pie_runtime.h;
+/// the LPM field is moved to the end so that its prefix is contiguous.
+///
+/// A profile may change that choice: an exact or ternary table that never
+/// held more than a few entries is scanned linearly, and an exact table is
+/// sized by the entries it held rather than by its `size` property.
+class PieTable
+{
+ public:
+    struct KeyField
+    {
+        const IR::KeyElement* element;
+        /// Control-plane name: the @name of the element, or its expression.
+        cstring name;
+        cstring matchKind;
+        /// The PIE_MATCH_* kind of matchKind.
+        unsigned match;
+        unsigned width;
+        /// Position in the key buffer, in bytes.
+        unsigned offset;
+        unsigned size;
+    };
+
+    PieTable(const IR::P4Table* table, P4::ReferenceMap* refMap, P4::TypeMap* typeMap,
+             PieTypeFactory& types);
+
+    const IR::P4Table* table;
+    /// Name used by the control plane (pie_table_find()).
+    cstring name;
+    /// One of the PIE_TABLE_* kinds.
+    unsigned kind;
+    std::vector<KeyField> keys;
+    unsigned keySize = 0;
+    unsigned lpmStart = 0;
+    unsigned size;
+    /// The actions of the table in id order.
+    std::vector<const IR::ActionListElement*> actions;
+    /// Their declarations, and the structs of their action data, which
+    /// PieControl fills in when it creates the table.
+    std::vector<const IR::P4Action*> declarations;
+    std::vector<llvm::StructType*> dataTypes;
+    /// Holds the `struct pie_table*` once pie_init() has run.
+    llvm::GlobalVariable* global = nullptr;
+    /// The direct_counter and direct_meter of the table, if any.
+    const PieExterns::Instance* directCounter = nullptr;
+    const PieExterns::Instance* directMeter = nullptr;
+
+    /// Id of `action`, or -1 when the table cannot run it.
+    int action_id(const IR::P4Action* action) const;
+
+    /// Name of the profile counter `what` of this table (see PieProfile).
+    cstring counter(cstring what) const
+    {
+        return "table:" + name + ":" + what;
+    }
+    /// Chooses the kind and size of the table from the counts of `profile`.
+    void use_profile(const PieProfile& profile);
+
+ private:
+    std::map<const IR::P4Action*, unsigned> ids;
+};
+
+}  // end of namespace pie
+
+#endif  // end of __BACKENDS_PIE_TABLE_H__
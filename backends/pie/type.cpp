@@ -0,0 +1,127 @@
+#include "type.h"
+
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/IRBuilder.h>
+
+#include "lib/error.h"
+
+namespace pie {
+
+const IR::Type* PieTypeFactory::canonical(const IR::Type* type) const
+{
+    if (type->is<IR::Type_Name>() || type->is<IR::Type_Specialized>())
+        return typeMap->getTypeType(type, true);
+    if (auto tt = type->to<IR::Type_Type>())
+        return canonical(tt->type);
+    return type;
+}
+
+unsigned PieTypeFactory::storage_width(unsigned width)
+{
+    if (width <= 8)
+        return 8;
+    if (width <= 128)
+        return llvm::PowerOf2Ceil(width);
+    return (width + 63) / 64 * 64;
+}
+
+unsigned PieTypeFactory::value_width(const IR::Type* type)
+{
+    return value_type(type)->getIntegerBitWidth();
+}
+
+unsigned PieTypeFactory::error_code(cstring name) const
+{
+    BUG_CHECK(errorType != nullptr, "error type not set");
+    unsigned code = 0;
+    for (auto member : errorType->members) {
+        if (member->name.name == name)
+            return code;
+        code++;
+    }
+    BUG("%1%: unknown error", name);
+}
+
+llvm::Type* PieTypeFactory::value_type(const IR::Type* type)
+{
+    type = canonical(type);
+    auto& b = builder.get_builder();
+    if (type->is<IR::Type_Boolean>())
+        return b.getInt1Ty();
+    if (auto bits = type->to<IR::Type_Bits>())
+        return b.getIntNTy(bits->width_bits());
+    if (type->is<IR::Type_InfInt>())
+        return b.getInt64Ty();
+    if (auto serEnum = type->to<IR::Type_SerEnum>())
+        return value_type(serEnum->type);
+    if (type->is<IR::Type_Error>() || type->is<IR::Type_Enum>())
+        return b.getInt32Ty();
+    return storage_type(type);
+}
+
+llvm::Type* PieTypeFactory::storage_type(const IR::Type* type)
+{
+    type = canonical(type);
+    auto& b = builder.get_builder();
+    if (type->is<IR::Type_Boolean>())
+        return b.getInt8Ty();
+    if (auto bits = type->to<IR::Type_Bits>())
+        return b.getIntNTy(storage_width(bits->width_bits()));
+    if (type->is<IR::Type_InfInt>())
+        return b.getInt64Ty();
+    if (auto serEnum = type->to<IR::Type_SerEnum>())
+        return storage_type(serEnum->type);
+    if (type->is<IR::Type_Error>() || type->is<IR::Type_Enum>())
+        return b.getInt32Ty();
+    if (auto st = type->to<IR::Type_StructLike>())
+        return get_layout(st)->type;
+    if (auto stack = type->to<IR::Type_Stack>()) {
+        auto it = stacks.find(stack);
+        if (it != stacks.end())
+            return it->second;
+        if (!stack->sizeKnown()) {
+            ::error(ErrorType::ERR_UNSUPPORTED, "%1%: header stack size must be a constant",
+                    stack);
+            return b.getInt8Ty();
+        }
+        // { [size x header], nextIndex }
+        auto elements = llvm::ArrayType::get(storage_type(stack->elementType), stack->getSize());
+        auto result = llvm::StructType::get(builder.get_context(), {elements, b.getInt32Ty()});
+        stacks.emplace(stack, result);
+        return result;
+    }
+    ::error(ErrorType::ERR_UNSUPPORTED, "%1%: type not supported by the pie backend", type);
+    return b.getInt8Ty();
+}
+
+const PieStructLayout* PieTypeFactory::get_layout(const IR::Type_StructLike* type)
+{
+    auto it = layouts.find(type->name.name);
+    if (it != layouts.end())
+        return it->second;
+
+    auto layout = new PieStructLayout;
+    std::vector<llvm::Type*> fields;
+    for (auto field : type->fields) {
+        if (canonical(field->type)->is<IR::Type_Varbits>()) {
+            ::error(ErrorType::ERR_UNSUPPORTED, "%1%: varbit fields are not supported", field);
+            continue;
+        }
+        layout->fieldIndex.emplace(field->name.name, fields.size());
+        fields.push_back(storage_type(field->type));
+    }
+    if (type->is<IR::Type_Header>()) {
+        layout->validIndex = fields.size();
+        fields.push_back(builder.get_builder().getInt8Ty());
+        layout->originIndex = fields.size();
+        fields.push_back(builder.get_builder().getInt32Ty());
+    }
+    auto name = "struct." + type->name.name;
+    layout->type = llvm::StructType::create(builder.get_context(), fields, name.c_str());
+    layouts.emplace(type->name.name, layout);
+    return layout;
+}
+
+}  // end of namespace pie
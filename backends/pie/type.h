@@ -0,0 +1,71 @@
+#ifndef __BACKENDS_PIE_TYPE_H__
+#define __BACKENDS_PIE_TYPE_H__
+
+#include <map>
+
+#include "ir/ir.h"
+#include "frontends/p4/typeMap.h"
+#include "llvm-ir.h"
+
+namespace llvm {
+class StructType;
+}
+
+namespace pie {
+
+/// In-memory layout of a P4 struct, header or header union.
+/// Headers carry two extra fields after their own: a validity byte and an
+/// i32 origin, which is 1 + the offset of the packet bytes the header was
+/// extracted from, or 0 if it was not extracted. Copying a header copies its
+/// origin; the deparser uses it to leave unmodified headers in place.
+struct PieStructLayout
+{
+    llvm::StructType* type = nullptr;
+    std::map<cstring, unsigned> fieldIndex;
+    int validIndex = -1;
+    int originIndex = -1;
+};
+
+/// Maps P4 types to the LLVM types used to hold them.
+///
+/// Every value has two representations: the SSA value (`bit<W>` is `iW`,
+/// `bool` is `i1`) and the storage in memory, where widths are rounded up
+/// to a power of two so that loads and stores stay naturally sized.
+class PieTypeFactory
+{
+ public:
+    PieTypeFactory(PieIrBuilder& builder, const P4::TypeMap* typeMap)
+        : builder(builder)
+        , typeMap(typeMap) {}
+
+    /// Resolves type names and returns the canonical type of `type`.
+    const IR::Type* canonical(const IR::Type* type) const;
+
+    llvm::Type* value_type(const IR::Type* type);
+    llvm::Type* storage_type(const IR::Type* type);
+    const PieStructLayout* get_layout(const IR::Type_StructLike* type);
+
+    /// Storage width used for a `bit<width>` value.
+    static unsigned storage_width(unsigned width);
+
+    /// Width in bits of the SSA value of a scalar type.
+    unsigned value_width(const IR::Type* type);
+
+    /// P4 `error` values are numbered in declaration order, as in bmv2.
+    void set_error_type(const IR::Type_Error* type)
+    {
+        errorType = type;
+    }
+    unsigned error_code(cstring name) const;
+
+ private:
+    PieIrBuilder& builder;
+    const P4::TypeMap* typeMap;
+    const IR::Type_Error* errorType = nullptr;
+    std::map<cstring, PieStructLayout*> layouts;
+    std::map<const IR::Type_Stack*, llvm::StructType*> stacks;
+};
+
+}  // end of namespace pie
+
+#endif  // end of __BACKENDS_PIE_TYPE_H__
@@ -0,0 +1,174 @@
+/*
+Copyright 2024-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "irCache.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include "ir/ir.h"
+#include "ir/json_generator.h"
+#include "ir/json_loader.h"
+#include "ir/visitor.h"
+#include "lib/hash.h"
+#include "lib/log.h"
+#include "lib/source_file.h"
+
+namespace P4 {
+
+namespace {
+
+/// Replaces the node ids in @json, which depend on how many nodes the compiler happened to
+/// create before, by their order of first appearance; shared nodes keep referring to the
+/// same number.
+std::string canonicalNodeIds(const std::string &json) {
+    static const std::string tag = "\"Node_ID\" : ";
+    std::unordered_map<std::string_view, size_t> ids;
+    std::string rv;
+    rv.reserve(json.size());
+    size_t pos = 0;
+    for (size_t found; (found = json.find(tag, pos)) != std::string::npos;) {
+        size_t start = found + tag.size();
+        size_t end = json.find_first_not_of("-0123456789", start);
+        if (end == std::string::npos) end = json.size();
+        auto id = ids.emplace(std::string_view(json).substr(start, end - start), ids.size());
+        rv.append(json, pos, start - pos);
+        rv += std::to_string(id.first->second);
+        pos = end;
+    }
+    rv.append(json, pos, std::string::npos);
+    return rv;
+}
+
+/// Collects the nodes of a program that have a source position, in visit order.
+class CollectSourcePositions : public Inspector {
+ public:
+    std::vector<const IR::Node *> nodes;
+
+    bool preorder(const IR::Node *node) override {
+        if (node->srcInfo.isValid()) nodes.push_back(node);
+        return true;
+    }
+};
+
+std::vector<const IR::Node *> nodesWithSourcePositions(const IR::P4Program *program) {
+    CollectSourcePositions collect;
+    program->apply(collect);
+    return std::move(collect.nodes);
+}
+
+}  // namespace
+
+std::string IRCache::key(const IR::P4Program *program, std::string_view context) {
+    std::stringstream json;
+    JSONGenerator(json) << program;
+    uint64_t hash = Util::hash(canonicalNodeIds(json.str()));
+    // Positions are keyed too: the result of a program that only moved in its file would
+    // otherwise point diagnostics and source_info at the old places.
+    for (const auto *node : nodesWithSourcePositions(program)) {
+        const auto &start = node->srcInfo.getStart();
+        const auto &end = node->srcInfo.getEnd();
+        hash = Util::hash_combine(hash, start.getLineNumber(), start.getColumnNumber(),
+                                  end.getLineNumber(), end.getColumnNumber());
+    }
+    hash = Util::hash_combine(hash, Util::hash(context.data(), context.size()));
+    std::stringstream rv;
+    rv << std::hex;
+    rv.width(16);
+    rv.fill('0');
+    rv << hash;
+    return rv.str();
+}
+
+const IR::P4Program *IRCache::load(const std::string &key, const IR::P4Program *parsed) const {
+    std::ifstream in(directory / (key + ".json"));
+    if (!in) return nullptr;
+    JSONLoader loader(in);
+    auto *object = loader.json ? loader.json->to<JsonObject>() : nullptr;
+    if (object == nullptr || object->get_type() != "P4Program") {
+        LOG1("IR cache: ignoring unreadable entry " << key);
+        return nullptr;
+    }
+    auto *program = new IR::P4Program(loader);
+
+    // The key covers the positions of @parsed, so those stored with the entry are positions
+    // in the same input sources.
+    const Util::InputSources *sources = nullptr;
+    auto parsedNodes = nodesWithSourcePositions(parsed);
+    if (!parsedNodes.empty()) sources = parsedNodes.front()->srcInfo.getSources();
+    std::string tag;
+    size_t count = 0;
+    if (!(in >> tag >> count) || tag != "positions") {
+        LOG1("IR cache: ignoring entry without source positions " << key);
+        return nullptr;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        int id;
+        unsigned startLine, startColumn, endLine, endColumn;
+        if (!(in >> id >> startLine >> startColumn >> endLine >> endColumn)) {
+            LOG1("IR cache: ignoring entry with truncated source positions " << key);
+            return nullptr;
+        }
+        auto node = loader.node_refs.find(id);
+        if (node == loader.node_refs.end() || sources == nullptr) {
+            LOG1("IR cache: ignoring entry with stray source positions " << key);
+            return nullptr;
+        }
+        node->second->srcInfo =
+            Util::SourceInfo(sources, Util::SourcePosition(startLine, startColumn),
+                             Util::SourcePosition(endLine, endColumn));
+    }
+    LOG1("IR cache: hit " << key);
+    return program;
+}
+
+void IRCache::store(const std::string &key, const IR::P4Program *program) const {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) return;
+    // Written under a name of its own and renamed, so that concurrent compilations never
+    // read a partial entry.
+    auto path = directory / (key + ".json");
+    auto tmp = directory / (key + ".json." + std::to_string(getpid()));
+    {
+        std::ofstream out(tmp);
+        if (!out) return;
+        JSONGenerator(out) << program << std::endl;
+        auto nodes = nodesWithSourcePositions(program);
+        out << "positions " << nodes.size() << std::endl;
+        for (const auto *node : nodes) {
+            const auto &start = node->srcInfo.getStart();
+            const auto &end = node->srcInfo.getEnd();
+            out << node->id << ' ' << start.getLineNumber() << ' ' << start.getColumnNumber()
+                << ' ' << end.getLineNumber() << ' ' << end.getColumnNumber() << '\n';
+        }
+        if (!out) {
+            out.close();
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) std::filesystem::remove(tmp, ec);
+    LOG1("IR cache: stored " << key);
+}
+
+}  // namespace P4
@@ -0,0 +1,58 @@
+/*
+Copyright 2024-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef FRONTENDS_COMMON_IRCACHE_H_
+#define FRONTENDS_COMMON_IRCACHE_H_
+
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace IR {
+class P4Program;
+}  // namespace IR
+
+namespace P4 {
+
+/// A persistent cache of compiler results, in a directory which may be shared by any number
+/// of compilations, including concurrent ones. Entries are programs serialized with
+/// JSONGenerator and read back with JSONLoader, followed by the source position of each of
+/// their nodes. Keys cover the source positions of the program a result was computed from, so
+/// the positions of a result read back refer to the input of the compilation that reads it.
+///
+/// Only the frontend uses it, for whole programs: a change anywhere in a program, including
+/// one that only moves its declarations, misses, and no part of a previous result is reused.
+class IRCache {
+    std::filesystem::path directory;
+
+ public:
+    explicit IRCache(std::filesystem::path directory) : directory(std::move(directory)) {}
+
+    /// The key of @program: a hash of its IR, ignoring node ids, of the source positions of its
+    /// nodes, and of @context, which must describe everything else the cached result depends
+    /// on (compiler version, options, diagnostic actions, ...).
+    static std::string key(const IR::P4Program *program, std::string_view context);
+
+    /// @return the program stored under @key, the key of @parsed, with its source positions
+    /// in the input sources of @parsed; nullptr if there is none or it can't be read.
+    const IR::P4Program *load(const std::string &key, const IR::P4Program *parsed) const;
+    /// Stores @program under @key. The cache is only an optimization: failures are ignored.
+    void store(const std::string &key, const IR::P4Program *program) const;
+};
+
+}  // namespace P4
+
+#endif /* FRONTENDS_COMMON_IRCACHE_H_ */
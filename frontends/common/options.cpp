@@ -57,6 +57,24 @@ CompilerOptions::CompilerOptions() : ParserOptions() {
             return true;
         },
         "Dump the compiler IR after the midend as JSON in the specified file.");
+    registerOption(
+        "--toBinaryIR", "file",
+        [this](const char *arg) {
+            dumpBinaryIRFile = arg;
+            return true;
+        },
+        "Dump the compiler IR after the midend in the specified file, in a compact\n"
+        "binary format which --fromJSON also reads.");
+    registerOption(
+        "--ir-cache", "dir",
+        [this](const char *arg) {
+            irCacheDir = arg;
+            return true;
+        },
+        "Reuse the result of the frontend from the specified directory when the same\n"
+        "program, at the same source positions, was compiled before with the same\n"
+        "options, and store it there otherwise. Only whole programs are cached, and\n"
+        "the midend and backend always run.");
     registerOption(
         "--ndebug", nullptr,
         [this](const char *) {
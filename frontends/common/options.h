@@ -55,8 +55,12 @@ class CompilerOptions : public ParserOptions {
     std::vector<cstring> passesToExcludeBackend;
     // Dump a JSON representation of the IR in the file.
     std::filesystem::path dumpJsonFile;
+    // Dump the IR in the file in the binary format of IRBinaryWriter.
+    std::filesystem::path dumpBinaryIRFile;
     // Dump and undump the IR tree.
     bool debugJson = false;
+    // Directory of the cache of frontend results; no caching if empty.
+    std::filesystem::path irCacheDir;
     // if this flag is true, compile program in non-debug mode.
     bool ndebug = false;
     // Write a P4Runtime control plane API description to the specified file.
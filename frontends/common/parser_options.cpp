@@ -30,6 +30,7 @@ limitations under the License.
 #include "absl/strings/str_format.h"
 #include "frontends/p4/toP4/toP4.h"
 #include "ir/json_generator.h"
+#include "ir/pass_profile.h"
 #include "lib/exceptions.h"
 #include "lib/exename.h"
 #include "lib/log.h"
@@ -293,6 +294,14 @@ ParserOptions::ParserOptions() : Util::Options(defaultMessage) {
             return true;
         },
         "[Compiler debugging] Folder where P4 programs are dumped\n");
+    registerOption(
+        "--pass-profile", "file",
+        [](const char *arg) {
+            PassProfile::enable(arg);
+            return true;
+        },
+        "[Compiler debugging] Record the time and memory used by every pass, and\n"
+        "write them at exit to the specified file in the Chrome trace-event format\n");
     registerOption(
         "--parser-inline-opt", nullptr,
         [this](const char *) {
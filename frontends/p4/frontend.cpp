@@ -18,13 +18,18 @@ limitations under the License.
 
 #include <fstream>
 #include <iostream>
+#include <optional>
+#include <sstream>
+#include <typeinfo>
 
+#include "../common/irCache.h"
 #include "../common/options.h"
 #include "frontends/common/resolveReferences/resolveReferences.h"
 #include "frontends/p4/fromv1.0/v1model.h"
 #include "frontends/p4/typeChecking/bindVariables.h"
 #include "frontends/p4/typeMap.h"
 #include "ir/ir.h"
+#include "lib/compile_context.h"
 #include "lib/nullstream.h"
 // Passes
 #include "actionsInlining.h"
@@ -276,10 +281,33 @@ const IR::P4Program *FrontEnd::run(const CompilerOptions &options, const IR::P4P
         passes.removePasses(options.passesToExcludeFrontend);
     }
 
+    // Only compilations that need no output of the frontend passes themselves can be cached:
+    // a hit runs none of them, nor the debug hooks of the policy or of addDebugHook().
+    std::optional<IRCache> cache;
+    std::string cacheKey;
+    if (!options.irCacheDir.empty() && !options.excludeFrontendPasses &&
+        options.prettyPrintFile.empty() && options.top4.empty() && hooks.empty()) {
+        std::stringstream context;
+        context << options.exe_name << ' ' << options.compilerVersion << ' '
+                << static_cast<int>(options.langVersion) << ' ' << options.optimizationLevel
+                << ' ' << options.optimizeParserInlining << ' ' << typeid(*policy).name()
+                << ' ';
+        // A result stored while some warning was disabled must not be served to a compilation
+        // that would report it.
+        BaseCompileContext::get().errorReporter().printDiagnosticActions(context);
+        cache.emplace(options.irCacheDir);
+        cacheKey = IRCache::key(program, context.str());
+        if (const auto *cached = cache->load(cacheKey, program)) return cached;
+    }
+
     passes.setName("FrontEnd");
     passes.setStopOnError(true);
     passes.addDebugHooks(hooks, true);
+    unsigned diagnostics = ::diagnosticCount();
     const IR::P4Program *result = program->apply(passes);
+    // Results with diagnostics are not stored, as a cache hit would not report them again.
+    if (cache && result != nullptr && ::diagnosticCount() == diagnostics)
+        cache->store(cacheKey, result);
     return result;
 }
 
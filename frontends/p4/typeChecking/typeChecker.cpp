@@ -238,6 +238,22 @@ TypeVariableSubstitution *TypeInference::unifyBase(
     CHECK_NULL(srcType);
     if (srcType == destType) return new TypeVariableSubstitution();
 
+    // Unifications that don't depend on the current substitution are memoized in the
+    // typeMap, which outlives this pass, so the repeated ones are only solved once.
+    bool closed = typeMap->isClosed(destType) && typeMap->isClosed(srcType);
+    if (closed && typeMap->knownUnifiable(destType, srcType, allowCasts))
+        return new TypeVariableSubstitution();
+    auto method = destType->to<IR::Type_MethodBase>();
+    auto call = srcType->to<IR::Type_MethodCall>();
+    if (method && call) {
+        if (auto returnType = typeMap->knownCallResult(method, call)) {
+            auto tvs = new TypeVariableSubstitution();
+            tvs->setBinding(call->returnType, returnType);
+            addSubstitutions(tvs);
+            return tvs;
+        }
+    }
+
     TypeConstraint *constraint;
     TypeConstraints constraints(typeMap->getSubstitutions(), typeMap);
     if (allowCasts)
@@ -247,6 +263,15 @@ TypeVariableSubstitution *TypeInference::unifyBase(
     if (!errorFormat.empty()) constraint->setError(errorFormat, errorArgs);
     constraints.add(constraint);
     auto tvs = constraints.solve();
+    if (tvs != nullptr) {
+        if (closed && tvs->isIdentity()) {
+            typeMap->setUnifiable(destType, srcType, allowCasts);
+        } else if (method && call && tvs->size() == 1) {
+            // A call whose arguments are closed only binds its return type.
+            if (auto returnType = tvs->lookup(call->returnType))
+                typeMap->setCallResult(method, call, returnType);
+        }
+    }
     addSubstitutions(tvs);
     return tvs;
 }
@@ -375,8 +400,12 @@ const IR::Type *TypeInference::canonicalize(const IR::Type *type) {
         if (et == nullptr) return nullptr;
         if (et->is<IR::Type_Stack>() || et->is<IR::Type_Set>() || et->is<IR::Type_HeaderUnion>())
             ::error(ErrorType::ERR_TYPE_ERROR, "%1%: Sets of %2% are not supported", type, et);
-        if (et == set->elementType) return type;
-        const IR::Type *canon = new IR::Type_Set(type->srcInfo, et);
+        const IR::Type *canon;
+        if (et == set->elementType)
+            canon = type;
+        else
+            canon = new IR::Type_Set(type->srcInfo, et);
+        canon = typeMap->getCanonical(canon);
         return canon;
     } else if (auto stack = type->to<IR::Type_Stack>()) {
         auto et = canonicalize(stack->elementType);
@@ -422,7 +451,7 @@ const IR::Type *TypeInference::canonicalize(const IR::Type *type) {
         else
             canon = type;
         canon = typeMap->getCanonical(canon);
-        if (anySet) canon = new IR::Type_Set(type->srcInfo, canon);
+        if (anySet) canon = typeMap->getCanonical(new IR::Type_Set(type->srcInfo, canon));
         return canon;
     } else if (auto tuple = type->to<IR::Type_Tuple>()) {
         auto fields = new IR::Vector<IR::Type>();
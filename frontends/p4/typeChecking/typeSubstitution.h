@@ -38,6 +38,7 @@ class TypeSubstitution : public IHasDbPrint {
 
     /** True if this is the empty substitution, which does not replace anything. */
     bool isIdentity() const { return binding.size() == 0; }
+    size_t size() const { return binding.size(); }
     const IR::Type *lookup(T t) const { return ::get(binding, t); }
     const IR::Type *get(T t) const { return ::get(binding, t); }
 
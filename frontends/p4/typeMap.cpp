@@ -86,6 +86,7 @@ void TypeMap::clear() {
     leftValues.clear();
     constants.clear();
     allTypeVariables.clear();
+    clearUnificationMemo();
     program = nullptr;
     ProgramMap::clear();
 }
@@ -331,18 +332,55 @@ bool TypeMap::implicitlyConvertibleTo(const IR::Type *from, const IR::Type *to)
     return false;
 }
 
-// Used for tuples, stacks and lists only
+// A hash of the parts of a type that equivalent() compares strictly, so that
+// equivalent types have equal hashes.  Types that are compared as a whole, such as
+// methods, only hash their class.
+size_t TypeMap::structuralHash(const IR::Type *type) {
+    if (type == nullptr) return 0;
+    size_t hash = Util::Hash{}(type->node_type_name());
+    if (auto bt = type->to<IR::Type_Bits>()) return Util::Hash{}(hash, bt->size, bt->isSigned);
+    if (auto tn = type->to<IR::Type_Name>()) return Util::Hash{}(hash, tn->path->name.name);
+    if (auto tv = type->to<IR::ITypeVar>()) return Util::Hash{}(hash, tv->getVarName());
+    if (type->is<IR::Type_Enum>() || type->is<IR::Type_SerEnum>() ||
+        type->is<IR::Type_Newtype>() || type->is<IR::Type_Extern>())
+        return Util::Hash{}(hash, type->to<IR::Type_Declaration>()->name.name);
+    if (auto tt = type->to<IR::Type_Type>()) return Util::Hash{}(hash, structuralHash(tt->type));
+    if (auto sl = type->to<IR::Type_StructLike>()) {
+        // Only unknown structs are equivalent to structs of another name.
+        if (!sl->is<IR::Type_UnknownStruct>()) hash = Util::Hash{}(hash, sl->name.name);
+        for (auto f : sl->fields) hash = Util::Hash{}(hash, f->name.name);
+        return hash;
+    }
+    if (auto bl = type->to<IR::Type_BaseList>()) {
+        for (auto c : bl->components) hash = Util::Hash{}(hash, structuralHash(c));
+        return hash;
+    }
+    if (auto st = type->to<IR::Type_Stack>()) {
+        hash = Util::Hash{}(hash, structuralHash(st->elementType));
+        return st->sizeKnown() ? Util::Hash{}(hash, st->getSize()) : hash;
+    }
+    if (auto pl = type->to<IR::Type_P4List>())
+        return Util::Hash{}(hash, structuralHash(pl->elementType));
+    if (auto set = type->to<IR::Type_Set>())
+        return Util::Hash{}(hash, structuralHash(set->elementType));
+    if (auto sc = type->to<IR::Type_SpecializedCanonical>()) {
+        hash = Util::Hash{}(hash, structuralHash(sc->baseType));
+        for (auto a : *sc->arguments) hash = Util::Hash{}(hash, structuralHash(a));
+        return hash;
+    }
+    if (auto mt = type->to<IR::Type_MethodBase>())
+        return Util::Hash{}(hash, mt->parameters->size(), structuralHash(mt->returnType));
+    return hash;
+}
+
+// Used for tuples, lists, stacks, p4lists and sets only
 const IR::Type *TypeMap::getCanonical(const IR::Type *type) {
-    // Currently a linear search; hopefully this won't be too expensive in practice
     std::vector<const IR::Type *> *searchIn;
     if (type->is<IR::Type_Stack>())
         searchIn = &canonicalStacks;
-    else if (type->is<IR::Type_Tuple>())
-        searchIn = &canonicalTuples;
-    else if (type->is<IR::Type_List>())
-        searchIn = &canonicalLists;
-    else if (type->is<IR::Type_P4List>())
-        searchIn = &canonicalP4lists;
+    else if (type->is<IR::Type_Tuple>() || type->is<IR::Type_List>() ||
+             type->is<IR::Type_P4List>() || type->is<IR::Type_Set>())
+        searchIn = &canonicalTypes[structuralHash(type)];
     else
         BUG("%1%: unexpected type", type);
 
@@ -353,6 +391,77 @@ const IR::Type *TypeMap::getCanonical(const IR::Type *type) {
     return type;
 }
 
+bool TypeMap::isClosed(const IR::Type *type) {
+    if (auto it = closedTypes.find(type); it != closedTypes.end()) return it->second;
+    bool closed = false;
+    if (auto bt = type->to<IR::Type_Bits>()) {
+        closed = bt->expression == nullptr;
+    } else if (type->is<IR::Type_Base>() || type->is<IR::Type_Enum>() ||
+               type->is<IR::Type_SerEnum>() || type->is<IR::Type_Error>()) {
+        closed = true;
+    } else if (auto st = type->to<IR::Type_StructLike>()) {
+        closed = !st->is<IR::Type_UnknownStruct>() && st->typeParameters->empty();
+        for (auto f : st->fields) {
+            if (!closed) break;
+            closed = isClosed(f->type);
+        }
+    } else if (auto bl = type->to<IR::Type_BaseList>()) {
+        closed = true;
+        for (auto c : bl->components) {
+            if (!closed) break;
+            closed = isClosed(c);
+        }
+    } else if (auto st = type->to<IR::Type_Stack>()) {
+        closed = st->sizeKnown() && isClosed(st->elementType);
+    } else if (auto pl = type->to<IR::Type_P4List>()) {
+        closed = isClosed(pl->elementType);
+    }
+    closedTypes.emplace(type, closed);
+    return closed;
+}
+
+void TypeMap::setUnifiable(const IR::Type *dest, const IR::Type *src, bool allowCasts) {
+    BUG_CHECK(isClosed(dest) && isClosed(src), "%1%, %2%: unification of open types", dest,
+              src);
+    if (memoizeUnifications) unifiable.emplace(dest, src, allowCasts);
+}
+
+bool TypeMap::callSignature(const IR::Type_MethodBase *method, const IR::Type_MethodCall *call,
+                            CallSignature &signature) {
+    if (!method->typeParameters->empty() || !call->typeArguments->empty()) return false;
+    if (method->returnType != nullptr && !isClosed(method->returnType)) return false;
+    for (auto p : method->parameters->parameters) {
+        if (!isClosed(p->type)) return false;
+    }
+    signature.first = method;
+    for (auto arg : *call->arguments) {
+        if (!isClosed(arg->type)) return false;
+        signature.second.emplace_back(arg->type, arg->leftValue, arg->compileTimeConstant,
+                                      arg->argument->name.name.string_view());
+    }
+    return true;
+}
+
+const IR::Type *TypeMap::knownCallResult(const IR::Type_MethodBase *method,
+                                         const IR::Type_MethodCall *call) {
+    CallSignature signature;
+    if (!memoizeUnifications || !callSignature(method, call, signature)) return nullptr;
+    return ::get(callResults, signature);
+}
+
+void TypeMap::setCallResult(const IR::Type_MethodBase *method, const IR::Type_MethodCall *call,
+                            const IR::Type *returnType) {
+    CallSignature signature;
+    if (memoizeUnifications && callSignature(method, call, signature))
+        callResults.emplace(signature, returnType);
+}
+
+void TypeMap::clearUnificationMemo() {
+    closedTypes.clear();
+    unifiable.clear();
+    callResults.clear();
+}
+
 int TypeMap::widthBits(const IR::Type *type, const IR::Node *errorPosition, bool max) {
     CHECK_NULL(type);
     const IR::Type *t;
@@ -17,6 +17,11 @@ limitations under the License.
 #ifndef FRONTENDS_P4_TYPEMAP_H_
 #define FRONTENDS_P4_TYPEMAP_H_
 
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "frontends/common/programMap.h"
@@ -40,11 +45,29 @@ Objects that have a type in the map:
 */
 class TypeMap final : public ProgramMap {
     // We want to have the same canonical type for two
-    // different tuples, lists, stacks, or p4lists with the same signature.
-    std::vector<const IR::Type *> canonicalTuples;
+    // different tuples, lists, stacks, p4lists or sets with the same signature.
+    // The candidates are bucketed by structuralHash(), except for stacks: comparing
+    // stacks reports those of unknown size, so they are all compared in order.
+    absl::flat_hash_map<size_t, std::vector<const IR::Type *>> canonicalTypes;
     std::vector<const IR::Type *> canonicalStacks;
-    std::vector<const IR::Type *> canonicalP4lists;
-    std::vector<const IR::Type *> canonicalLists;
+
+    /// Argument types, left-value and compile-time constant flags, and names of a call.
+    using CallSignature = std::pair<const IR::Type_MethodBase *,
+                                    std::vector<std::tuple<const IR::Type *, bool, bool,
+                                                           std::string_view>>>;
+    // Memo of the unifications done by TypeInference.  They are only kept for closed types,
+    // whose unification does not depend on the current type variable substitution.
+    absl::flat_hash_map<const IR::Type *, bool, Util::Hash> closedTypes;
+    // (destination, source, implicit casts allowed) known to unify.
+    absl::flat_hash_set<std::tuple<const IR::Type *, const IR::Type *, bool>, Util::Hash>
+        unifiable;
+    // Return types of calls to non-generic methods known to type-check.
+    absl::flat_hash_map<CallSignature, const IR::Type *> callResults;
+    bool memoizeUnifications = true;
+
+    static size_t structuralHash(const IR::Type *type);
+    bool callSignature(const IR::Type_MethodBase *method, const IR::Type_MethodCall *call,
+                       CallSignature &signature);
 
     // Map each node to its canonical type
     absl::flat_hash_map<const IR::Node *, const IR::Type *, Util::Hash> typeMap;
@@ -67,7 +90,10 @@ class TypeMap final : public ProgramMap {
     /// If true we require structs to have the same name to be
     /// equivalent, if false only that the have the same fields.
     bool strictStruct;
-    void setStrictStruct(bool value) { strictStruct = value; }
+    void setStrictStruct(bool value) {
+        if (value != strictStruct) clearUnificationMemo();
+        strictStruct = value;
+    }
     bool contains(const IR::Node *element) { return typeMap.count(element) != 0; }
     void setType(const IR::Node *element, const IR::Type *type);
     const IR::Type *getType(const IR::Node *element, bool notNull = false) const;
@@ -99,8 +125,33 @@ class TypeMap final : public ProgramMap {
     /// is used when initializing a struct with a list expression.
     bool implicitlyConvertibleTo(const IR::Type *from, const IR::Type *to) const;
 
-    // Used for tuples and stacks only
+    // Used for tuples, lists, stacks, p4lists and sets only
     const IR::Type *getCanonical(const IR::Type *type);
+
+    /// True if @type contains nothing that unification could bind, such as type variables,
+    /// or that needs more than its structure to check, such as methods.  Unifying two
+    /// closed types either fails or succeeds with an empty substitution.
+    bool isClosed(const IR::Type *type);
+    /// True if the closed types @dest and @src were already found to unify.
+    bool knownUnifiable(const IR::Type *dest, const IR::Type *src, bool allowCasts) const {
+        return memoizeUnifications && unifiable.count(std::make_tuple(dest, src, allowCasts)) != 0;
+    }
+    void setUnifiable(const IR::Type *dest, const IR::Type *src, bool allowCasts);
+    /// The return type of @call to @method if an identical call, to a non-generic
+    /// method with closed arguments, already type-checked; nullptr otherwise.
+    const IR::Type *knownCallResult(const IR::Type_MethodBase *method,
+                                    const IR::Type_MethodCall *call);
+    void setCallResult(const IR::Type_MethodBase *method, const IR::Type_MethodCall *call,
+                       const IR::Type *returnType);
+    void clearUnificationMemo();
+    /// Turns the memo of unifications on (the default) or off; for testing.
+    void setUnificationMemo(bool enabled) {
+        memoizeUnifications = enabled;
+        clearUnificationMemo();
+    }
+    /// The number of memoized unifications and calls.
+    size_t unificationMemoSize() const { return unifiable.size() + callResults.size(); }
+
     /// The width in bits of this type.  If the width is not
     /// well-defined this will report an error and return -1.
     /// max indicates whether we want the max width or min width.
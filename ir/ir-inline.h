@@ -136,6 +136,10 @@ template <class T>
 void IR::Vector<T>::toJSON(JSONGenerator &json) const {
     const char *sep = "";
     Node::toJSON(json);
+    if (json.isBinary()) {
+        json << vec;
+        return;
+    }
     json << "," << std::endl << json.indent++ << "\"vec\" : [";
     for (auto &k : vec) {
         json << sep << std::endl << json.indent << k;
@@ -185,6 +189,10 @@ template <class T>
 void IR::IndexedVector<T>::toJSON(JSONGenerator &json) const {
     const char *sep = "";
     Vector<T>::toJSON(json);
+    if (json.isBinary()) {
+        json << declarations;
+        return;
+    }
     json << "," << std::endl << json.indent++ << "\"declarations\" : {";
     for (const auto &k : declarations) {
         json << sep << std::endl << json.indent << k.first << " : " << k.second;
@@ -276,6 +284,10 @@ template <class T, template <class K, class V, class COMP, class ALLOC> class MA
 void IR::NameMap<T, MAP, COMP, ALLOC>::toJSON(JSONGenerator &json) const {
     const char *sep = "";
     Node::toJSON(json);
+    if (json.isBinary()) {
+        json << symbols;
+        return;
+    }
     json << "," << std::endl << json.indent++ << "\"symbols\" : {";
     for (auto &k : symbols) {
         json << sep << std::endl << json.indent << k.first << " : " << k.second;
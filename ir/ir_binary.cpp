@@ -0,0 +1,241 @@
+/*
+Copyright 2024-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "ir_binary.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <ostream>
+
+#include "ir/ir.h"
+#include "ir/json_generator.h"
+#include "ir/json_loader.h"
+#include "lib/error.h"
+#include "lib/exceptions.h"
+#include "lib/map.h"
+
+namespace {
+
+const char magic[] = "P4IRBIN1";
+const size_t magicSize = sizeof(magic) - 1;
+const size_t trailerSize = 3 * sizeof(uint64_t);
+
+/// Thrown by IRBinaryReader::corrupt() and caught by the outermost IRBinaryReader::node(), so
+/// that nodes which are half decoded are dropped.
+struct CorruptIR {
+    const char *what;
+};
+
+}  // namespace
+
+void IRBinaryWriter::varint(uint64_t v) {
+    while (v >= 0x80) {
+        buffer += char(v | 0x80);
+        v >>= 7;
+    }
+    buffer += char(v);
+}
+
+void IRBinaryWriter::bytes(std::string_view v) {
+    varint(v.size());
+    buffer.append(v);
+}
+
+void IRBinaryWriter::string(cstring v) {
+    if (v.isNull()) {
+        varint(0);
+        return;
+    }
+    auto it = strings.emplace(v, stringTable.size());
+    if (it.second) stringTable.push_back(v);
+    varint(it.first->second + 1);
+}
+
+void IRBinaryWriter::node(const IR::Node *v) {
+    if (v == nullptr) {
+        varint(0);
+        return;
+    }
+    varint(uint64_t(v->id) + 1);
+    if (seen.insert(v->id).second) pending.push_back(v);
+}
+
+void IRBinaryWriter::write(std::ostream &out, const IR::Node *root) {
+    BUG_CHECK(root != nullptr, "No IR to write");
+    buffer.assign(magic, magicSize);
+    seen.insert(root->id);
+    pending.push_back(root);
+
+    // Nodes are written breadth first, each one queueing the nodes it refers to, so deep
+    // trees don't recurse.
+    JSONGenerator json(*this);
+    std::vector<std::pair<int, uint64_t>> index;
+    while (!pending.empty()) {
+        const IR::Node *n = pending.front();
+        pending.pop_front();
+        index.emplace_back(n->id, buffer.size());
+        svarint(n->id);
+        string(n->node_type_name());
+        n->toJSON(json);
+    }
+
+    uint64_t stringsOffset = buffer.size();
+    varint(stringTable.size());
+    for (auto s : stringTable) bytes(s.string_view());
+    uint64_t indexOffset = buffer.size();
+    varint(index.size());
+    for (auto &[id, offset] : index) {
+        svarint(id);
+        varint(offset);
+    }
+    for (uint64_t word : {stringsOffset, indexOffset, uint64_t(int64_t(root->id))})
+        for (size_t i = 0; i < sizeof(word); ++i) buffer += char(word >> (8 * i));
+    out.write(buffer.data(), buffer.size());
+
+    buffer.clear();
+    strings.clear();
+    stringTable.clear();
+    seen.clear();
+}
+
+IRBinaryReader::IRBinaryReader(const std::filesystem::path &file) {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && size_t(st.st_size) >= magicSize + trailerSize) {
+        void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            data = static_cast<const uint8_t *>(map);
+            size = st.st_size;
+        }
+    }
+    close(fd);
+    if (data == nullptr) return;
+
+    const uint8_t *trailer = data + size - trailerSize;
+    auto word = [trailer](size_t i) {
+        uint64_t v = 0;
+        for (size_t b = sizeof(v); b-- > 0;) v = (v << 8) | trailer[8 * i + b];
+        return v;
+    };
+    uint64_t stringsOffset = word(0), indexOffset = word(1);
+    if (memcmp(data, magic, magicSize) != 0 || stringsOffset < magicSize ||
+        stringsOffset > indexOffset || indexOffset > size - trailerSize) {
+        unmap();
+        return;
+    }
+    rootId = int(int64_t(word(2)));
+    recordsEnd = data + stringsOffset;
+
+    try {
+        IRBinaryCursor strings{data + stringsOffset, data + indexOffset};
+        for (uint64_t n = varint(strings); n > 0; --n) stringData.push_back(bytes(strings));
+        stringCache.resize(stringData.size());
+        IRBinaryCursor index{data + indexOffset, trailer};
+        for (uint64_t n = varint(index); n > 0; --n) {
+            int id = svarint(index);
+            offsets[id] = varint(index);
+        }
+    } catch (const CorruptIR &) {
+        unmap();
+    }
+}
+
+void IRBinaryReader::unmap() {
+    if (data) munmap(const_cast<uint8_t *>(data), size);
+    data = nullptr;
+}
+
+bool IRBinaryReader::isBinaryIR(const std::filesystem::path &file) {
+    std::ifstream in(file, std::ios::binary);
+    char header[magicSize];
+    return in.read(header, magicSize) && memcmp(header, magic, magicSize) == 0;
+}
+
+void IRBinaryReader::corrupt(const char *what) { throw CorruptIR{what}; }
+
+const IR::Node *IRBinaryReader::node(int id, IR::Node *(*factory)(JSONLoader &)) {
+    if (auto it = nodes.find(id); it != nodes.end()) return it->second;
+    // A node refers to the nodes it is decoded with, so the error is reported once, by the
+    // call which started the decoding.
+    if (decoding) return decode(id, factory);
+    if (!valid() || offsets.count(id) == 0) return nullptr;
+    const IR::Node *rv = nullptr;
+    decoding = true;
+    try {
+        rv = decode(id, factory);
+    } catch (const CorruptIR &e) {
+        inProgress.clear();
+        ::error(ErrorType::ERR_INVALID, "Corrupt binary IR: %1% while reading node %2%", e.what,
+                id);
+    } catch (...) {
+        inProgress.clear();
+        decoding = false;
+        throw;
+    }
+    decoding = false;
+    return rv;
+}
+
+const IR::Node *IRBinaryReader::decode(int id, IR::Node *(*factory)(JSONLoader &)) {
+    // Nodes are only recorded once decoded, so a cycle would recurse forever.
+    if (!inProgress.insert(id).second) corrupt("cyclic reference");
+    auto offset = offsets.find(id);
+    if (offset == offsets.end()) corrupt("reference to a missing node");
+    if (offset->second >= size_t(recordsEnd - data)) corrupt("bad offset");
+    IRBinaryCursor cursor{data + offset->second, recordsEnd};
+    if (svarint(cursor) != id) corrupt("bad record");
+    cstring type = string(cursor);
+    if (factory == nullptr) factory = get(IR::unpacker_table, type);
+    if (factory == nullptr) corrupt("unknown node type");
+    JSONLoader loader(*this, cursor, nodes, id);
+    IR::Node *rv = nodes[id] = factory(loader);
+    inProgress.erase(id);
+    return rv;
+}
+
+uint64_t IRBinaryReader::varint(IRBinaryCursor &c) {
+    uint64_t v = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        if (c.pos >= c.end || shift >= 64) corrupt("bad integer");
+        uint8_t byte = *c.pos++;
+        v |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return v;
+    }
+}
+
+std::string_view IRBinaryReader::bytes(IRBinaryCursor &c) {
+    uint64_t length = varint(c);
+    if (length > uint64_t(c.end - c.pos)) corrupt("bad string");
+    std::string_view rv(reinterpret_cast<const char *>(c.pos), length);
+    c.pos += length;
+    return rv;
+}
+
+cstring IRBinaryReader::string(IRBinaryCursor &c) {
+    uint64_t index = varint(c);
+    if (index == 0) return cstring();
+    if (index > stringData.size()) corrupt("bad string index");
+    // Strings are only interned when a decoded node uses them.
+    cstring &rv = stringCache[index - 1];
+    if (rv.isNull()) rv = cstring(stringData[index - 1]);
+    return rv;
+}
@@ -0,0 +1,128 @@
+/*
+Copyright 2024-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef IR_IR_BINARY_H_
+#define IR_IR_BINARY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "lib/cstring.h"
+
+class JSONLoader;
+
+namespace IR {
+class Node;
+}  // namespace IR
+
+/// A compact binary alternative to the JSON dump of an IR tree.  It is written by the
+/// toJSON() methods and read by the JSONLoader constructors of the IR classes, which
+/// JSONGenerator and JSONLoader run in a binary mode, so every class generated by the
+/// ir-generator supports it.
+///
+/// A file is the magic "P4IRBIN1", one record per node, the string table, an index of the
+/// records, and a trailer holding the offsets of the string table and of the index and the id
+/// of the root.  A record is the id of the node and its type name followed by its fields in
+/// the order toJSON() writes them.  Integers are LEB128 varints (zigzag-encoded when signed),
+/// strings are indexes in the string table, and references to other nodes are their id + 1,
+/// with 0 standing for nullptr.  The trailer is three little-endian 64-bit words.
+class IRBinaryWriter {
+    std::string buffer;
+    std::unordered_map<cstring, uint64_t> strings;
+    std::vector<cstring> stringTable;
+    std::unordered_set<int> seen;
+    std::deque<const IR::Node *> pending;
+
+ public:
+    /// Writes the tree rooted at @root to @out.
+    void write(std::ostream &out, const IR::Node *root);
+
+    // The encoding of field values, used by JSONGenerator.
+    void varint(uint64_t v);
+    void svarint(int64_t v) { varint((uint64_t(v) << 1) ^ uint64_t(v >> 63)); }
+    void bytes(std::string_view v);
+    void string(cstring v);
+    void node(const IR::Node *v);
+};
+
+/// The position in the record being decoded.
+struct IRBinaryCursor {
+    const uint8_t *pos, *end;
+};
+
+/// Reads a file written by IRBinaryWriter.  The file is mapped in memory and nodes are only
+/// decoded when first needed: root() or node() decode the requested node and the ones it
+/// refers to, so a tool interested in a part of a program doesn't pay for the rest.  IR nodes
+/// hold plain pointers to their children, so a node is decoded with everything reachable from
+/// it, and root() decodes the whole program.  The reader must outlive the calls to root() and
+/// node(); the nodes they return don't refer to the mapping.
+///
+/// A file which doesn't decode, e.g. a truncated or stale cache, is reported with error() and
+/// root() and node() return nullptr, so that the caller can compile from source instead.
+class IRBinaryReader {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    const uint8_t *recordsEnd = nullptr;
+    int rootId = -1;
+    std::vector<std::string_view> stringData;
+    std::vector<cstring> stringCache;
+    std::unordered_map<int, uint64_t> offsets;
+    std::unordered_map<int, IR::Node *> nodes;
+    bool decoding = false;
+    std::unordered_set<int> inProgress;  // The nodes being decoded.
+
+    void unmap();
+    const IR::Node *decode(int id, IR::Node *(*factory)(JSONLoader &));
+
+ public:
+    explicit IRBinaryReader(const std::filesystem::path &file);
+    IRBinaryReader(const IRBinaryReader &) = delete;
+    ~IRBinaryReader() { unmap(); }
+
+    /// @return true if @file starts like a file written by IRBinaryWriter.
+    static bool isBinaryIR(const std::filesystem::path &file);
+
+    /// False if the file couldn't be read or isn't in this format.
+    bool valid() const { return data != nullptr; }
+    const IR::Node *root() { return node(rootId); }
+    /// The node with @id, created by @factory or, if it is nullptr, the factory registered
+    /// for its type in IR::unpacker_table.  nullptr if there is no such node or if its record
+    /// or one it refers to is corrupt, which is reported with error().
+    const IR::Node *node(int id, IR::Node *(*factory)(JSONLoader &) = nullptr);
+
+    /// Abandons the decoding of the current node because its record is malformed.
+    [[noreturn]] static void corrupt(const char *what);
+
+    // The decoding of field values, used by JSONLoader.
+    uint64_t varint(IRBinaryCursor &c);
+    int64_t svarint(IRBinaryCursor &c) {
+        uint64_t v = varint(c);
+        return int64_t(v >> 1) ^ -int64_t(v & 1);
+    }
+    std::string_view bytes(IRBinaryCursor &c);
+    cstring string(IRBinaryCursor &c);
+};
+
+#endif /* IR_IR_BINARY_H_ */
@@ -17,10 +17,15 @@ limitations under the License.
 #ifndef IR_JSON_GENERATOR_H_
 #define IR_JSON_GENERATOR_H_
 
+#include <cstring>
+#include <map>
 #include <optional>
+#include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_set>
 
+#include "ir/ir_binary.h"
 #include "ir/node.h"
 #include "lib/bitvec.h"
 #include "lib/cstring.h"
@@ -35,6 +40,14 @@ class JSONGenerator {
     std::unordered_set<int> node_refs;
     std::ostream &out;
     bool dumpSourceInfo;
+    /// Set when writing an IRBinaryWriter record rather than JSON text; the text goes to a
+    /// stream that discards it.
+    IRBinaryWriter *binary = nullptr;
+
+    static std::ostream &nullStream() {
+        static std::ostream null(nullptr);
+        return null;
+    }
 
     template <typename T>
     class has_toJSON {
@@ -57,6 +70,10 @@ class JSONGenerator {
 
     explicit JSONGenerator(std::ostream &out, bool dumpSourceInfo = false)
         : out(out), dumpSourceInfo(dumpSourceInfo) {}
+    explicit JSONGenerator(IRBinaryWriter &binary)
+        : out(nullStream()), dumpSourceInfo(false), binary(&binary) {}
+
+    bool isBinary() const { return binary != nullptr; }
 
     template <typename T>
     void generate(const safe_vector<T> &v) {
@@ -98,6 +115,10 @@ class JSONGenerator {
 
     template <typename T, typename U>
     void toJSON(const std::pair<T, U> &v) {
+        if (binary) {
+            encode(v);
+            return;
+        }
         out << indent << "\"first\" : ";
         generate(v.first);
         out << "," << std::endl << indent << "\"second\" : ";
@@ -263,6 +284,119 @@ class JSONGenerator {
         out << "]";
     }
 
+    // The binary encoding of the values generate() writes as JSON; see IRBinaryWriter.
+    template <typename C>
+    void encodeRange(const C &v) {
+        binary->varint(v.size());
+        for (auto &e : v) encode(e);
+    }
+    template <typename T>
+    void encode(const safe_vector<T> &v) {
+        encodeRange(v);
+    }
+    template <typename T>
+    void encode(const std::vector<T> &v) {
+        encodeRange(v);
+    }
+    template <typename T, typename U>
+    void encode(const std::pair<T, U> &v) {
+        encode(v.first);
+        encode(v.second);
+    }
+    template <typename T>
+    void encode(const std::optional<T> &v) {
+        binary->varint(v.has_value());
+        if (v) encode(*v);
+    }
+    template <typename T>
+    void encode(const std::set<T> &v) {
+        encodeRange(v);
+    }
+    template <typename T>
+    void encode(const ordered_set<T> &v) {
+        encodeRange(v);
+    }
+    template <typename K, typename V, typename... Rest>
+    void encode(const std::map<K, V, Rest...> &v) {
+        encodeRange(v);
+    }
+    template <typename K, typename V, typename... Rest>
+    void encode(const std::multimap<K, V, Rest...> &v) {
+        encodeRange(v);
+    }
+    template <typename K, typename V, typename... Rest>
+    void encode(const ordered_map<K, V, Rest...> &v) {
+        encodeRange(v);
+    }
+
+    void encode(bool v) { binary->varint(v); }
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type encode(T v) {
+        if (std::is_signed<T>::value)
+            binary->svarint(v);
+        else
+            binary->varint(v);
+    }
+    void encode(double v) {
+        char bytes[sizeof(v)];
+        memcpy(bytes, &v, sizeof(v));
+        binary->bytes(std::string_view(bytes, sizeof(bytes)));
+    }
+    template <typename T>
+    typename std::enable_if<std::is_same<T, big_int>::value>::type encode(const T &v) {
+        std::stringstream str;
+        str << v;
+        binary->bytes(str.str());
+    }
+
+    void encode(cstring v) { binary->string(v); }
+    template <typename T>
+    typename std::enable_if<std::is_enum<T>::value>::type encode(T v) {
+        binary->svarint(static_cast<int64_t>(v));
+    }
+    template <typename T>
+    typename std::enable_if<std::is_same<T, LTBitMatrix>::value>::type encode(const T &v) {
+        std::stringstream str;
+        str << v;
+        binary->bytes(str.str());
+    }
+
+    void encode(const bitvec &v) {
+        std::stringstream str;
+        str << v;
+        binary->bytes(str.str());
+    }
+
+    void encode(const match_t &v) {
+        encode(v.word0);
+        encode(v.word1);
+    }
+
+    template <typename T>
+    typename std::enable_if<has_toJSON<T>::value && !std::is_base_of<IR::Node, T>::value>::type
+    encode(const T &v) {
+        v.toJSON(*this);
+    }
+
+    void encode(const IR::Node &v) { binary->node(&v); }
+
+    template <typename T>
+    typename std::enable_if<std::is_pointer<T>::value &&
+                            has_toJSON<typename std::remove_pointer<T>::type>::value>::type
+    encode(T v) {
+        if constexpr (std::is_base_of<IR::INode, typename std::remove_pointer<T>::type>::value) {
+            binary->node(v ? v->getNode() : nullptr);
+        } else {
+            binary->varint(v != nullptr);
+            if (v) encode(*v);
+        }
+    }
+
+    template <typename T, size_t N>
+    void encode(const T (&v)[N]) {
+        for (auto &e : v) encode(e);
+    }
+
     JSONGenerator &operator<<(char ch) {
         out << ch;
         return *this;
@@ -281,7 +415,10 @@ class JSONGenerator {
     }
     template <typename T>
     JSONGenerator &operator<<(const T &v) {
-        generate(v);
+        if (binary)
+            encode(v);
+        else
+            generate(v);
         return *this;
     }
 };
@@ -17,6 +17,7 @@ limitations under the License.
 #ifndef IR_JSON_LOADER_H_
 #define IR_JSON_LOADER_H_
 
+#include <cstring>
 #include <map>
 #include <optional>
 #include <string>
@@ -24,6 +25,7 @@ limitations under the License.
 #include <utility>
 
 #include "ir.h"
+#include "ir_binary.h"
 #include "json_parser.h"
 #include "lib/bitvec.h"
 #include "lib/cstring.h"
@@ -70,7 +72,20 @@ class JSONLoader {
         if (auto *obj = unpacker.json->to<JsonObject>()) json = get(obj, field);
     }
 
+    /// Decodes the record of node @id from an IRBinaryReader, positioned at its first field.
+    JSONLoader(IRBinaryReader &reader, IRBinaryCursor &cursor,
+               std::unordered_map<int, IR::Node *> &refs, int id)
+        : node_refs(refs), binary(&reader), cursor(&cursor), binaryId(id) {}
+
+    bool isBinary() const { return binary != nullptr; }
+    /// The id of the node whose record is being decoded.
+    int binaryNodeId() const { return binaryId; }
+
  private:
+    IRBinaryReader *binary = nullptr;
+    IRBinaryCursor *cursor = nullptr;
+    int binaryId = -1;
+
     const IR::Node *get_node() {
         if (!json || !json->is<JsonObject>()) return nullptr;  // invalid json exception?
         int id = json->as<JsonObject>().get_id();
@@ -315,6 +330,203 @@ class JSONLoader {
         }
     }
 
+    // The decoding of the values JSONGenerator::encode() writes.  The fields of a record are
+    // read in order, so unlike unpack_json() these don't look them up by name.
+    const IR::Node *decodeNode(IR::Node *(*factory)(JSONLoader &) = nullptr) {
+        uint64_t ref = binary->varint(*cursor);
+        return ref ? binary->node(int(ref - 1), factory) : nullptr;
+    }
+
+    template <typename T>
+    void decode(safe_vector<T> &v) {
+        for (uint64_t n = binary->varint(*cursor); n > 0; --n) {
+            T temp;
+            decode(temp);
+            v.push_back(temp);
+        }
+    }
+
+    template <typename T>
+    void decode(std::set<T> &v) {
+        for (uint64_t n = binary->varint(*cursor); n > 0; --n) {
+            T temp;
+            decode(temp);
+            v.insert(temp);
+        }
+    }
+
+    template <typename T>
+    void decode(ordered_set<T> &v) {
+        for (uint64_t n = binary->varint(*cursor); n > 0; --n) {
+            T temp;
+            decode(temp);
+            v.insert(temp);
+        }
+    }
+
+    template <typename T>
+    void decode(IR::Vector<T> &v) {
+        const IR::Vector<T> *p;
+        decode(p);
+        if (p) v = *p;
+    }
+    template <typename T>
+    void decode(const IR::Vector<T> *&v) {
+        v = static_cast<const IR::Vector<T> *>(decodeNode(
+            [](JSONLoader &json) -> IR::Node * { return IR::Vector<T>::fromJSON(json); }));
+    }
+    template <typename T>
+    void decode(IR::IndexedVector<T> &v) {
+        const IR::IndexedVector<T> *p;
+        decode(p);
+        if (p) v = *p;
+    }
+    template <typename T>
+    void decode(const IR::IndexedVector<T> *&v) {
+        v = static_cast<const IR::IndexedVector<T> *>(decodeNode(
+            [](JSONLoader &json) -> IR::Node * { return IR::IndexedVector<T>::fromJSON(json); }));
+    }
+    template <class T, template <class K, class V, class COMP, class ALLOC> class MAP, class COMP,
+              class ALLOC>
+    void decode(IR::NameMap<T, MAP, COMP, ALLOC> &m) {
+        const IR::NameMap<T, MAP, COMP, ALLOC> *p;
+        decode(p);
+        if (p) m = *p;
+    }
+    template <class T, template <class K, class V, class COMP, class ALLOC> class MAP, class COMP,
+              class ALLOC>
+    void decode(const IR::NameMap<T, MAP, COMP, ALLOC> *&m) {
+        m = static_cast<const IR::NameMap<T, MAP, COMP, ALLOC> *>(
+            decodeNode([](JSONLoader &json) -> IR::Node * {
+                return IR::NameMap<T, MAP, COMP, ALLOC>::fromJSON(json);
+            }));
+    }
+
+    template <typename M>
+    void decodeMap(M &v) {
+        for (uint64_t n = binary->varint(*cursor); n > 0; --n) {
+            std::pair<typename M::key_type, typename M::mapped_type> temp;
+            decode(temp);
+            v.insert(temp);
+        }
+    }
+    template <typename K, typename V, typename... Rest>
+    void decode(std::map<K, V, Rest...> &v) {
+        decodeMap(v);
+    }
+    template <typename K, typename V, typename... Rest>
+    void decode(ordered_map<K, V, Rest...> &v) {
+        decodeMap(v);
+    }
+    template <typename K, typename V, typename... Rest>
+    void decode(std::multimap<K, V, Rest...> &v) {
+        decodeMap(v);
+    }
+
+    template <typename T>
+    void decode(std::vector<T> &v) {
+        for (uint64_t n = binary->varint(*cursor); n > 0; --n) {
+            T temp;
+            decode(temp);
+            v.push_back(temp);
+        }
+    }
+
+    template <typename T, typename U>
+    void decode(std::pair<T, U> &v) {
+        decode(v.first);
+        decode(v.second);
+    }
+
+    template <typename T>
+    void decode(std::optional<T> &v) {
+        if (!binary->varint(*cursor)) {
+            v = std::nullopt;
+            return;
+        }
+        T value;
+        decode(value), v = std::move(value);
+    }
+
+    void decode(bool &v) { v = binary->varint(*cursor) != 0; }
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value>::type decode(T &v) {
+        if (std::is_signed<T>::value)
+            v = binary->svarint(*cursor);
+        else
+            v = binary->varint(*cursor);
+    }
+    void decode(double &v) {
+        auto bytes = binary->bytes(*cursor);
+        if (bytes.size() != sizeof(v)) IRBinaryReader::corrupt("bad double");
+        memcpy(&v, bytes.data(), sizeof(v));
+    }
+    void decode(big_int &v) { v = big_int(std::string(binary->bytes(*cursor))); }
+    void decode(cstring &v) { v = binary->string(*cursor); }
+    void decode(IR::ID &v) {
+        if (cstring name = binary->string(*cursor)) v.name = name;
+    }
+
+    void decode(LTBitMatrix &m) { std::string(binary->bytes(*cursor)).c_str() >> m; }
+
+    void decode(bitvec &v) { std::string(binary->bytes(*cursor)).c_str() >> v; }
+
+    template <typename T>
+    typename std::enable_if<std::is_enum<T>::value>::type decode(T &v) {
+        v = static_cast<T>(binary->svarint(*cursor));
+    }
+
+    void decode(match_t &v) {
+        decode(v.word0);
+        decode(v.word1);
+    }
+
+    // Like the JSON text, the binary format only records whether there is a constant.
+    void decode(UnparsedConstant *&v) {
+        binary->varint(*cursor);
+        v = nullptr;
+    }
+
+    template <typename T>
+    typename std::enable_if<
+        has_fromJSON<T>::value && !std::is_base_of<IR::INode, T>::value &&
+        std::is_pointer<decltype(T::fromJSON(std::declval<JSONLoader &>()))>::value>::type
+    decode(T *&v) {
+        v = binary->varint(*cursor) ? T::fromJSON(*this) : nullptr;
+    }
+
+    template <typename T>
+    typename std::enable_if<
+        has_fromJSON<T>::value && !std::is_base_of<IR::INode, T>::value &&
+        std::is_pointer<decltype(T::fromJSON(std::declval<JSONLoader &>()))>::value>::type
+    decode(T &v) {
+        v = *(T::fromJSON(*this));
+    }
+
+    template <typename T>
+    typename std::enable_if<
+        has_fromJSON<T>::value && !std::is_base_of<IR::INode, T>::value &&
+        !std::is_pointer<decltype(T::fromJSON(std::declval<JSONLoader &>()))>::value>::type
+    decode(T &v) {
+        v = T::fromJSON(*this);
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_base_of<IR::INode, T>::value>::type decode(T &v) {
+        if (auto *node = decodeNode()) v = node->as<T>();
+    }
+    template <typename T>
+    typename std::enable_if<std::is_base_of<IR::INode, T>::value>::type decode(const T *&v) {
+        auto *node = decodeNode();
+        v = node ? node->checkedTo<T>() : nullptr;
+    }
+
+    template <typename T, size_t N>
+    void decode(T (&v)[N]) {
+        for (auto &e : v) decode(e);
+    }
+
  public:
     template <typename T>
     void load(JsonData *json, T &v) {
@@ -323,6 +535,10 @@ class JSONLoader {
 
     template <typename T>
     void load(const std::string field, T *&v) {
+        if (binary) {
+            decode(v);
+            return;
+        }
         JSONLoader loader(*this, field);
         if (loader.json == nullptr) {
             v = nullptr;
@@ -333,6 +549,10 @@ class JSONLoader {
 
     template <typename T>
     void load(const std::string field, T &v) {
+        if (binary) {
+            decode(v);
+            return;
+        }
         JSONLoader loader(*this, field);
         if (loader.json == nullptr) return;
         loader.unpack_json(v);
@@ -340,7 +560,10 @@ class JSONLoader {
 
     template <typename T>
     JSONLoader &operator>>(T &v) {
-        unpack_json(v);
+        if (binary)
+            decode(v);
+        else
+            unpack_json(v);
         return *this;
     }
 };
@@ -45,15 +45,20 @@ void IR::Node::traceCreation() const {
     LOG5("Created node " << id);
 }
 
-int IR::Node::currentId = 0;
+std::atomic<int> IR::Node::currentId = 0;
 
 void IR::Node::toJSON(JSONGenerator &json) const {
+    // The id and type of a node start its binary record, which IRBinaryWriter writes itself.
+    if (json.isBinary()) return;
     json << json.indent << "\"Node_ID\" : " << id << "," << std::endl
          << json.indent << "\"Node_Type\" : " << node_type_name();
 }
 
 IR::Node::Node(JSONLoader &json) : id(-1) {
-    json.load("Node_ID", id);
+    if (json.isBinary())
+        id = json.binaryNodeId();
+    else
+        json.load("Node_ID", id);
     if (id < 0)
         id = currentId++;
     else if (id >= currentId)
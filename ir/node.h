@@ -17,6 +17,7 @@ limitations under the License.
 #ifndef IR_NODE_H_
 #define IR_NODE_H_
 
+#include <atomic>
 #include <iosfwd>
 
 #include "ir-tree-macros.h"
@@ -108,7 +109,7 @@ class Node : public virtual INode {
     Node &operator=(Node &&) = default;
 
  protected:
-    static int currentId;
+    static std::atomic<int> currentId;  // atomic, as ParallelPass creates nodes on many threads
     void traceVisit(const char *visitor) const;
     friend class ::Visitor;
     friend class ::Inspector;
@@ -16,15 +16,23 @@ limitations under the License.
 
 #include "pass_manager.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <exception>
 #include <memory>
 #include <ostream>
 #include <stdexcept>
 #include <string>
 #include <utility>
+#ifdef MULTITHREAD
+#include <thread>
+#endif
 
 #include "ir/dump.h"
+#include "ir/ir.h"
 #include "ir/node.h"
+#include "ir/pass_profile.h"
 #include "ir/visitor.h"
 #include "lib/error.h"
 #include "lib/gc.h"
@@ -59,7 +67,7 @@ void PassManager::listPasses(std::ostream &out, cstring sep) const {
 
 const IR::Node *PassManager::apply_visitor(const IR::Node *program, const char *) {
     safe_vector<std::pair<safe_vector<Visitor *>::iterator, const IR::Node *>> backup;
-    static indent_t log_indent(-1);
+    static thread_local indent_t log_indent(-1);
     struct indent_nesting {
         indent_t &indent;
         explicit indent_nesting(indent_t &i) : indent(i) { ++indent; }
@@ -79,7 +87,9 @@ const IR::Node *PassManager::apply_visitor(const IR::Node *program, const char *
         try {
             try {
                 LOG1(log_indent << name() << " invoking " << v->name());
+                PassProfile::Event profile(v->name(), program);
                 program = program->apply(**it);
+                profile.finish(program);
                 if (LOGGING(3)) {
                     size_t maxmem, mem = gc_mem_inuse(&maxmem);  // triggers gc
                     LOG3(log_indent << "heap after " << v->name() << ": in use " << n4(mem)
@@ -175,3 +185,68 @@ const IR::Node *PassIf::apply_visitor(const IR::Node *program, const char *name)
     }
     return program;
 }
+
+const IR::Node *ParallelPass::apply_visitor(const IR::Node *root, const char *) {
+    const auto *program = root->to<IR::P4Program>();
+    if (program == nullptr) return root->apply(*pass);
+
+    std::vector<size_t> local;
+    for (size_t i = 0; i < program->objects.size(); ++i) {
+        const auto *object = program->objects.at(i);
+        if (object->is<IR::P4Control>() || object->is<IR::P4Parser>() ||
+            object->is<IR::P4Action>())
+            local.push_back(i);
+    }
+
+#ifdef MULTITHREAD
+    unsigned workers = threads ? threads : std::thread::hardware_concurrency();
+    workers = std::max(1u, std::min(workers, static_cast<unsigned>(local.size())));
+#else
+    unsigned workers = 1;
+#endif
+    // The copies are made here, as clone() is not expected to be threadsafe.
+    std::vector<Visitor *> visitors{pass};
+    while (visitors.size() < workers) visitors.push_back(make());
+
+    std::vector<const IR::Node *> results(program->objects.begin(), program->objects.end());
+    std::vector<std::exception_ptr> errors(workers);
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    auto work = [&](unsigned worker) {
+        try {
+            for (size_t n; !failed && (n = next++) < local.size();)
+                results[local[n]] = program->objects.at(local[n])->apply(*visitors[worker]);
+        } catch (...) {
+            errors[worker] = std::current_exception();
+            failed = true;
+        }
+    };
+    LOG1(name() << " visiting " << local.size() << " declarations on " << workers
+                << " threads");
+#ifdef MULTITHREAD
+    std::vector<std::thread> pool;
+    for (unsigned worker = 1; worker < workers; ++worker) {
+        pool.emplace_back([&work, worker]() {
+            gc_register_thread();
+            work(worker);
+            gc_unregister_thread();
+        });
+    }
+    work(0);
+    for (auto &thread : pool) thread.join();
+#else
+    work(0);
+#endif
+    for (auto &error : errors)
+        if (error) std::rethrow_exception(error);
+
+    bool changed = false;
+    for (size_t i = 0; i < results.size(); ++i)
+        changed |= results[i] != program->objects.at(i);
+    if (!changed) return program;
+    IR::Vector<IR::Node> objects;
+    for (const auto *result : results) objects.pushBackOrAppend(result);
+    auto *rv = program->clone();
+    rv->objects = objects;
+    return rv;
+}
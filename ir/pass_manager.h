@@ -218,4 +218,32 @@ class DynamicVisitor : virtual public Visitor {
     DynamicVisitor *clone() const override { return new DynamicVisitor(*this); }
 };
 
+/// Applies a pass to each top-level P4Control, P4Parser and P4Action of a P4Program
+/// concurrently, and reassembles the program from the results; any other root is
+/// visited serially. Threads are only used when the compiler is built with
+/// ENABLE_MULTITHREAD, otherwise the declarations are visited one after another.
+///
+/// Each declaration is the root of its own visit, on one of the per-thread copies of the
+/// pass, so only passes local to a declaration may run this way: they must not look at
+/// the context above the declaration, nor update state shared with the other copies,
+/// such as a ReferenceMap or a TypeMap. Diagnostics of different declarations may be
+/// reported in any order.
+class ParallelPass : virtual public Visitor {
+    Visitor *pass;
+    /// Makes the copies of the pass for threads other than the calling one.
+    std::function<Visitor *()> make;
+    unsigned threads;
+
+ public:
+    /// Runs on up to @threads threads, 0 for one per hardware thread; the copies of
+    /// @pass are made with its clone() method.
+    explicit ParallelPass(Visitor *pass, unsigned threads = 0)
+        : pass(pass), make([pass]() { return pass->clone(); }), threads(threads) {}
+    /// As above, with the copies of the pass made by @make.
+    explicit ParallelPass(std::function<Visitor *()> make, unsigned threads = 0)
+        : pass(make()), make(make), threads(threads) {}
+    const IR::Node *apply_visitor(const IR::Node *root, const char * = 0) override;
+    ParallelPass *clone() const override { return new ParallelPass(*this); }
+};
+
 #endif /* IR_PASS_MANAGER_H_ */
@@ -0,0 +1,180 @@
+/*
+Copyright 2024-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "pass_profile.h"
+
+#include <time.h>
+
+#include <atomic>
+#include <chrono>  // NOLINT linter forbids using chrono, but we don't have alternatives
+#include <cstdlib>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+#ifdef MULTITHREAD
+#include <mutex>
+#endif
+
+#include "ir/ir.h"
+#include "lib/gc.h"
+
+namespace {
+
+struct Record {
+    std::string name;
+    int tid;
+    int64_t wallStart, wallDuration, cpuDuration;
+    int64_t heapGrowth, allocated, nodesDelta;
+    size_t nodes;
+};
+
+bool profiling = false;
+std::filesystem::path traceFile;
+std::vector<Record> records;
+#ifdef MULTITHREAD
+std::mutex recordsLock;
+#endif
+const auto startTime = std::chrono::steady_clock::now();
+
+int64_t wallMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - startTime)
+        .count();
+}
+
+int64_t cpuMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+/// Trace-event thread ids, in the order threads first record a pass.
+int threadId() {
+    static std::atomic<int> next(1);
+    static thread_local int id = next++;
+    return id;
+}
+
+/// The number of distinct nodes reachable from a root.
+struct CountNodes : public Inspector {
+    size_t count = 0;
+    bool preorder(const IR::Node *) override {
+        ++count;
+        return true;
+    }
+};
+
+/// The result of a pass is usually the root of the next one, so its size is remembered. The
+/// root is held in a global rather than a thread_local, which libgc would not scan.
+size_t countNodes(const IR::Node *root) {
+    static const IR::Node *lastRoot = nullptr;
+    static size_t lastCount = 0;
+    if (root == nullptr) return 0;
+#ifdef MULTITHREAD
+    static std::mutex lock;
+    std::lock_guard<std::mutex> acquire(lock);
+#endif
+    if (root != lastRoot) {
+        CountNodes counter;
+        root->apply(counter);
+        lastRoot = root;
+        lastCount = counter.count;
+    }
+    return lastCount;
+}
+
+void writeString(std::ostream &out, const std::string &s) {
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') out << '\\';
+        out << c;
+    }
+    out << '"';
+}
+
+void writeAtExit() {
+    if (traceFile.empty()) return;
+    std::ofstream out(traceFile);
+    if (out) PassProfile::write(out);
+}
+
+}  // namespace
+
+void PassProfile::enable(std::filesystem::path file) {
+    static bool writerRegistered = false;
+    if (!writerRegistered) std::atexit(writeAtExit);
+    writerRegistered = true;
+    profiling = true;
+    traceFile = std::move(file);
+}
+
+void PassProfile::disable() {
+    profiling = false;
+    traceFile.clear();
+#ifdef MULTITHREAD
+    std::lock_guard<std::mutex> acquire(recordsLock);
+#endif
+    records.clear();
+}
+
+bool PassProfile::enabled() { return profiling; }
+
+void PassProfile::write(std::ostream &out) {
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char *sep = "\n";
+    for (const auto &r : records) {
+        out << sep << "{\"name\": ";
+        writeString(out, r.name);
+        out << ", \"cat\": \"pass\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << r.tid
+            << ", \"ts\": " << r.wallStart << ", \"dur\": " << r.wallDuration
+            << ", \"tdur\": " << r.cpuDuration << ", \"args\": {\"cpu_us\": " << r.cpuDuration
+            << ", \"heap_growth\": " << r.heapGrowth << ", \"allocated\": " << r.allocated
+            << ", \"nodes\": " << r.nodes << ", \"nodes_delta\": " << r.nodesDelta << "}}";
+        sep = ",\n";
+    }
+    out << "\n]}" << std::endl;
+}
+
+PassProfile::Event::Event(const char *name, const IR::Node *root) : name(name) {
+    if (!profiling) return;
+    // Counted before the clocks start, so that the pass is not charged for it.
+    nodesStart = countNodes(root);
+    gc_heap_usage(&heapStart, &allocatedStart);
+    cpuStart = cpuMicros();
+    wallStart = wallMicros();
+}
+
+void PassProfile::Event::finish(const IR::Node *result) {
+    if (!profiling) return;
+    int64_t wallEnd = wallMicros(), cpuEnd = cpuMicros();
+    size_t heap, allocated;
+    gc_heap_usage(&heap, &allocated);
+    size_t nodes = countNodes(result);
+    Record record{name,
+                  threadId(),
+                  wallStart,
+                  wallEnd - wallStart,
+                  cpuEnd - cpuStart,
+                  int64_t(heap) - int64_t(heapStart),
+                  int64_t(allocated) - int64_t(allocatedStart),
+                  int64_t(nodes) - int64_t(nodesStart),
+                  nodes};
+#ifdef MULTITHREAD
+    std::lock_guard<std::mutex> acquire(recordsLock);
+#endif
+    records.push_back(std::move(record));
+}
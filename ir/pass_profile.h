@@ -0,0 +1,57 @@
+/*
+Copyright 2024-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef IR_PASS_PROFILE_H_
+#define IR_PASS_PROFILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iosfwd>
+
+namespace IR {
+class Node;
+}  // namespace IR
+
+/// Records the cost of every pass run by a PassManager: wall and CPU time, growth of the GC
+/// heap, bytes allocated, and the change in the number of nodes of the IR it returns. The
+/// records are written in the Chrome trace-event format, which chrome://tracing and Perfetto
+/// display as a flame graph, nested passes below the PassManager that runs them.
+class PassProfile {
+ public:
+    /// Starts recording; the trace is written to @file when the compiler exits.
+    static void enable(std::filesystem::path file);
+    /// Stops recording and forgets the trace recorded so far, which is then not written.
+    static void disable();
+    static bool enabled();
+    /// Writes the trace recorded so far to @out.
+    static void write(std::ostream &out);
+
+    /// Measures one run of a pass, from construction to finish(); a pass that does not
+    /// finish, e.g. because it throws, is not recorded. Costs nothing unless enabled.
+    class Event {
+        const char *name;
+        int64_t wallStart = 0, cpuStart = 0;
+        size_t heapStart = 0, allocatedStart = 0, nodesStart = 0;
+
+     public:
+        Event(const char *name, const IR::Node *root);
+        Event(const Event &) = delete;
+        void finish(const IR::Node *result);
+    };
+};
+
+#endif /* IR_PASS_PROFILE_H_ */
@@ -19,7 +19,14 @@ limitations under the License.
 #include <stdlib.h>
 #include <time.h>
 
-#include "absl/container/flat_hash_map.h"
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "absl/container/node_hash_map.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "ir/ir-generated.h"
@@ -41,6 +48,195 @@ limitations under the License.
 
 enum class VisitStatus : unsigned { New, Revisit, Busy, Done };
 
+namespace {
+
+/// The state of the nodes seen by a traversal.  Entries are kept in a hash map, until a
+/// traversal has seen enough nodes whose ids are dense: the frontend numbers a whole program at
+/// once, and a Transform clones the changed nodes of a path together, but ids are global, so
+/// the nodes of a small program, or of a part of one, may be spread over a large range.  Once
+/// at least half of the id range seen so far is used, the new entries go in pages indexed by
+/// node id; the entries already in the map stay there.  The pages never span more than twice
+/// the ids of the entries, and a node beyond them goes to the map.  Ids are not unique (nodes
+/// read from JSON keep theirs), so an entry also holds its node, and a node whose entry is
+/// taken by another one also goes to the map.
+///
+/// A table is reused by later traversals without clearing it: reset() starts a new generation,
+/// which starts with the map again, and a page is only wiped when the new generation first
+/// uses it.  reset() frees the pages the last generation did not use, so a table keeps at most
+/// the nodes of one traversal alive.
+template <class Info>
+class NodeTable {
+    static constexpr unsigned pageBits = 6;
+    static constexpr int pageMask = (1 << pageBits) - 1;
+    /// The number of entries from which the density of the ids is checked, then again each
+    /// time the map doubles.
+    static constexpr size_t firstDensityCheck = 256;
+    struct Entry {
+        const IR::Node *node;
+        Info info;
+    };
+    struct Page {
+        unsigned generation = 0;
+        Entry entries[1 << pageBits];
+    };
+    /// Page i holds the ids of page firstPage + i.
+    std::vector<std::unique_ptr<Page>> pages;
+    size_t firstPage = 0;
+    bool paged = false;
+    /// The number of entries in pages.
+    size_t pageEntries = 0;
+    /// The pages used by the current and by the previous generation.
+    std::vector<size_t> used, previouslyUsed;
+    absl::node_hash_map<const IR::Node *, Info, Util::Hash> map;
+    /// The range of the ids in the map, while not paged.
+    int minId = 0, maxId = -1;
+    size_t nextDensityCheck = firstDensityCheck;
+    unsigned generation = 1;
+
+    /// @return the index in @pages of the page of @n, or -1 if @n has no page.
+    ptrdiff_t pageIndex(const IR::Node *n) const {
+        if (!paged || n->id < 0) return -1;
+        size_t page = size_t(n->id) >> pageBits;
+        if (page < firstPage) return -1;
+        return page - firstPage;
+    }
+
+    /// The number of pages new entries may use.
+    size_t pageLimit() const { return 2 * ((map.size() + pageEntries) >> pageBits) + 2; }
+
+    Entry *entry(const IR::Node *n) const {
+        ptrdiff_t page = pageIndex(n);
+        if (page < 0 || size_t(page) >= pages.size()) return nullptr;
+        Page *p = pages[page].get();
+        if (p == nullptr || p->generation != generation) return nullptr;
+        return &p->entries[n->id & pageMask];
+    }
+
+    Entry &claim(size_t page, const IR::Node *n) {
+        if (page >= pages.size()) pages.resize(page + 1);
+        if (!pages[page]) pages[page] = std::make_unique<Page>();
+        Page *p = pages[page].get();
+        if (p->generation != generation) {
+            std::fill(std::begin(p->entries), std::end(p->entries), Entry{});
+            p->generation = generation;
+            used.push_back(page);
+        }
+        return p->entries[n->id & pageMask];
+    }
+
+    /// Switches to pages if at least half of the ids in the range of the map are used.
+    void checkDensity() {
+        nextDensityCheck *= 2;
+        if (maxId < minId) return;
+        size_t first = size_t(minId) >> pageBits, last = size_t(maxId) >> pageBits;
+        size_t span = last - first + 1;
+        if (map.size() * 2 < span << pageBits) return;
+        if (first != firstPage) {
+            // The pages left are all from previous generations.
+            pages.clear();
+            previouslyUsed.clear();
+        }
+        paged = true;
+        firstPage = first;
+    }
+
+ public:
+    Info *find(const IR::Node *n) {
+        if (auto *e = entry(n); e && e->node == n) return &e->info;
+        if (map.empty()) return nullptr;
+        auto it = map.find(n);
+        return it == map.end() ? nullptr : &it->second;
+    }
+    const Info *find(const IR::Node *n) const { return const_cast<NodeTable *>(this)->find(n); }
+
+    /// @return the info of @n, inserted as @info if @n had none, and whether it was inserted.
+    /// The info stays at the same address until reset().
+    std::pair<Info *, bool> emplace(const IR::Node *n, Info info) {
+        if (ptrdiff_t page = pageIndex(n); page >= 0 && size_t(page) < pageLimit()) {
+            Entry &e = claim(size_t(page), n);
+            if (e.node == n) return {&e.info, false};
+            if (e.node == nullptr && (map.empty() || !map.count(n))) {
+                e = Entry{n, info};
+                ++pageEntries;
+                return {&e.info, true};
+            }
+        }
+        auto [it, inserted] = map.emplace(n, info);
+        if (inserted && !paged && n->id >= 0) {
+            minId = maxId < minId ? n->id : std::min(minId, n->id);
+            maxId = std::max(maxId, n->id);
+            if (map.size() >= nextDensityCheck) checkDensity();
+        }
+        return {&it->second, inserted};
+    }
+
+    /// Removes the entries whose info satisfies @pred.
+    template <class Pred>
+    void erase_if(Pred pred) {
+        for (size_t page : used)
+            for (auto &e : pages[page]->entries)
+                if (e.node && pred(e.info)) {
+                    e.node = nullptr;
+                    --pageEntries;
+                }
+        absl::erase_if(map, [&pred](const auto &kv) { return pred(kv.second); });
+    }
+
+    /// Forgets all the entries.
+    void reset() {
+        for (size_t page : previouslyUsed)
+            if (pages[page]->generation != generation) pages[page].reset();
+        previouslyUsed.swap(used);
+        used.clear();
+        map.clear();
+        paged = false;
+        pageEntries = 0;
+        minId = 0;
+        maxId = -1;
+        nextDensityCheck = firstDensityCheck;
+        // All the pages left belong to the generation that ends, so on a wrap around skipping
+        // 0, which marks new pages, is enough.
+        if (++generation == 0) generation = 1;
+    }
+};
+
+/// Trackers are reused: when a traversal ends, its tracker becomes the spare one of its kind,
+/// which the next traversal takes instead of allocating a new tracker.  The spare trackers are
+/// globals rather than thread_locals, which libgc would not scan.
+template <class Tracker>
+std::shared_ptr<Tracker> spareTracker;
+#ifdef MULTITHREAD
+std::mutex spareTrackerLock;
+#define LOCK_SPARE_TRACKER std::lock_guard<std::mutex> acquire(spareTrackerLock);
+#else
+#define LOCK_SPARE_TRACKER
+#endif
+
+template <class Tracker, class... Args>
+std::shared_ptr<Tracker> acquireTracker(Args... args) {
+    std::shared_ptr<Tracker> rv;
+    {
+        LOCK_SPARE_TRACKER
+        rv = std::move(spareTracker<Tracker>);
+    }
+    if (!rv) return std::make_shared<Tracker>(args...);
+    rv->reuse(args...);
+    return rv;
+}
+
+/// Drops @tracker, which becomes the spare one unless a clone of the visitor still uses it.
+template <class Tracker>
+void releaseTracker(std::shared_ptr<Tracker> &tracker) {
+    if (tracker && tracker.use_count() == 1) {
+        tracker->clear();
+        LOCK_SPARE_TRACKER
+        spareTracker<Tracker> = std::move(tracker);
+    }
+    tracker.reset();
+}
+
+}  // namespace
+
 /** @class Visitor::ChangeTracker
  *  @brief Assists visitors in traversing the IR.
 
@@ -50,22 +246,42 @@ enum class VisitStatus : unsigned { New, Revisit, Busy, Done };
  *  returns the new IR if it changed.
  */
 class Visitor::ChangeTracker {
-    struct visit_info_t {
-        // FIXME: We should be able to put these two bools into low 2 bits of
-        // `result` saving 8 bytes per record
-        bool visit_in_progress;
-        bool visitOnce;
-        const IR::Node *result;
+    /// The result of visiting a node, with the visit_in_progress and visitOnce flags in its two
+    /// low bits, which are clear in any node pointer.  libgc takes the tagged word for an
+    /// interior pointer, so it still keeps the result alive.
+    class visit_info_t {
+        static constexpr uintptr_t inProgressBit = 1, visitOnceBit = 2;
+        uintptr_t bits = 0;
+
+        void set(uintptr_t bit, bool value) { bits = value ? bits | bit : bits & ~bit; }
+
+     public:
+        visit_info_t() = default;
+        visit_info_t(bool visit_in_progress, bool visitOnce, const IR::Node *result)
+            : bits(reinterpret_cast<uintptr_t>(result) | (visit_in_progress ? inProgressBit : 0) |
+                   (visitOnce ? visitOnceBit : 0)) {}
+        bool visit_in_progress() const { return bits & inProgressBit; }
+        bool visitOnce() const { return bits & visitOnceBit; }
+        const IR::Node *result() const {
+            return reinterpret_cast<const IR::Node *>(bits & ~(inProgressBit | visitOnceBit));
+        }
+        void set_visit_in_progress(bool value) { set(inProgressBit, value); }
+        void set_visitOnce(bool value) { set(visitOnceBit, value); }
+        void set_result(const IR::Node *result) {
+            bits = reinterpret_cast<uintptr_t>(result) | (bits & (inProgressBit | visitOnceBit));
+        }
     };
-    using visited_t = absl::flat_hash_map<const IR::Node *, visit_info_t, Util::Hash>;
+    static_assert(alignof(IR::Node) >= 4, "visit_info_t needs two free bits in node pointers");
     bool forceClone;
-    visited_t visited;
+    NodeTable<visit_info_t> visited;
 
  public:
-    explicit ChangeTracker(bool forceClone)
-        : forceClone(forceClone),
-          visited(16) {}  // Pre-allocate 16 slots as usually these maps are small, but we do create
-                          // lots of them. This saves quite some time for rehashes
+    explicit ChangeTracker(bool forceClone) : forceClone(forceClone) {}
+
+    /** Prepare a tracker released by clear() for a new traversal. */
+    void reuse(bool forceClone) { this->forceClone = forceClone; }
+    /** Forget all nodes, at the end of a traversal. */
+    void clear() { visited.reset(); }
 
     /** Begin tracking @n during a visiting pass.  Use `finish(@n)` to mark @n as
      * visited once the pass completes.
@@ -77,12 +293,12 @@ class Visitor::ChangeTracker {
      */
     [[nodiscard]] VisitStatus try_start(const IR::Node *n, bool defaultVisitOnce) {
         // Initialization
-        auto [it, inserted] = visited.emplace(n, visit_info_t{true, defaultVisitOnce, n});
+        auto [info, inserted] = visited.emplace(n, visit_info_t{true, defaultVisitOnce, n});
 
         if (!inserted) {  // We already seen this node, determine its status
-            if (it->second.visit_in_progress) return VisitStatus::Busy;
-            if (it->second.visitOnce) return VisitStatus::Done;
-            it->second.visit_in_progress = true;
+            if (info->visit_in_progress()) return VisitStatus::Busy;
+            if (info->visitOnce()) return VisitStatus::Done;
+            info->set_visit_in_progress(true);
             return VisitStatus::Revisit;
         }
 
@@ -103,22 +319,21 @@ class Visitor::ChangeTracker {
      * previously been invoked.
      */
     bool finish(const IR::Node *orig, const IR::Node *final) {
-        auto it = visited.find(orig);
-        if (it == visited.end()) BUG("visitor state tracker corrupted");
+        visit_info_t *orig_visit_info = visited.find(orig);
+        if (!orig_visit_info) BUG("visitor state tracker corrupted");
 
-        visit_info_t *orig_visit_info = &(it->second);
-        orig_visit_info->visit_in_progress = false;
+        orig_visit_info->set_visit_in_progress(false);
         if (!final) {
-            orig_visit_info->result = final;
+            orig_visit_info->set_result(final);
             return true;
         } else if (forceClone || (final != orig && *final != *orig)) {
-            orig_visit_info->result = final;
-            visited.emplace(final, visit_info_t{false, orig_visit_info->visitOnce, final});
+            orig_visit_info->set_result(final);
+            visited.emplace(final, visit_info_t{false, orig_visit_info->visitOnce(), final});
             return true;
-        } else if (visited.count(final)) {
+        } else if (visited.find(final)) {
             // coalescing with some previously visited node, so we don't want to undo
             // the coalesce
-            orig_visit_info->result = final;
+            orig_visit_info->set_result(final);
             return true;
         } else {
             // FIXME -- not safe if the visitor resurrects the node (which it shouldn't)
@@ -130,22 +345,15 @@ class Visitor::ChangeTracker {
 
     /** Return a visitOnce flag for node @n */
     [[nodiscard]] bool shouldVisitOnce(const IR::Node *n) const {
-        auto it = visited.find(n);
-        if (it == visited.end()) BUG("visitor state tracker corrupted");
-        return it->second.visitOnce;
+        const visit_info_t *info = visited.find(n);
+        if (!info) BUG("visitor state tracker corrupted");
+        return info->visitOnce();
     }
 
     /** Forget nodes that have already been visited, allowing them to be visited
      * again. */
     void revisit_visited() {
-        for (auto it = visited.begin(); it != visited.end();) {
-            if (!it->second.visit_in_progress)
-                // `visited` is abseil map, therefore erase does not return iterator, use
-                // post-increment
-                visited.erase(it++);
-            else
-                ++it;
-        }
+        visited.erase_if([](const visit_info_t &info) { return !info.visit_in_progress(); });
     }
 
     /** Determine whether @n is currently being visited and the visitor has not finished
@@ -154,8 +362,8 @@ class Visitor::ChangeTracker {
      * @return true if @n is being visited and has not finished
      */
     [[nodiscard]] bool busy(const IR::Node *n) const {
-        auto it = visited.find(n);
-        return it != visited.end() && it->second.visit_in_progress;
+        const visit_info_t *info = visited.find(n);
+        return info && info->visit_in_progress();
     }
 
     /** Determine whether @n has been visited and the visitor has finished
@@ -166,8 +374,8 @@ class Visitor::ChangeTracker {
      * @return true if @n has been visited and the visitor is finished and visitOnce is true
      */
     [[nodiscard]] bool done(const IR::Node *n) const {
-        auto it = visited.find(n);
-        return it != visited.end() && !it->second.visit_in_progress && it->second.visitOnce;
+        const visit_info_t *info = visited.find(n);
+        return info && !info->visit_in_progress() && info->visitOnce();
     }
 
     /** Produce the result of visiting @n.
@@ -177,9 +385,9 @@ class Visitor::ChangeTracker {
      * if `start(@n)` has not been invoked.
      */
     const IR::Node *result(const IR::Node *n) const {
-        auto it = visited.find(n);
-        if (it == visited.end()) return n;
-        return it->second.result;
+        const visit_info_t *info = visited.find(n);
+        if (!info) return n;
+        return info->result();
     }
 
     /** Produce the final result of visiting @n.
@@ -188,21 +396,21 @@ class Visitor::ChangeTracker {
      * been invoked.
      */
     const IR::Node *finalResult(const IR::Node *n) const {
-        auto it = visited.find(n);
-        bool done = it != visited.end() && !it->second.visit_in_progress && it->second.visitOnce;
-        return done ? it->second.result : nullptr;
+        const visit_info_t *info = visited.find(n);
+        bool done = info && !info->visit_in_progress() && info->visitOnce();
+        return done ? info->result() : nullptr;
     }
 
     void visitOnce(const IR::Node *n) {
-        auto it = visited.find(n);
-        if (it == visited.end()) BUG("visitor state tracker corrupted");
-        it->second.visitOnce = true;
+        visit_info_t *info = visited.find(n);
+        if (!info) BUG("visitor state tracker corrupted");
+        info->set_visitOnce(true);
     }
 
     void visitAgain(const IR::Node *n) {
-        auto it = visited.find(n);
-        if (it == visited.end()) BUG("visitor state tracker corrupted");
-        it->second.visitOnce = false;
+        visit_info_t *info = visited.find(n);
+        if (!info) BUG("visitor state tracker corrupted");
+        info->set_visitOnce(false);
     }
 };
 
@@ -214,29 +422,22 @@ class Visitor::ChangeTracker {
  *  `done` method determines whether the node has been visited.
  */
 class Visitor::Tracker {
-    // FIXME: We can squeeze these into low 2 bits of key, eliminating the value entirely
+    // FIXME: We can squeeze these into low 2 bits of the node of the entry
     struct info_t {
         bool done, visitOnce;
     };
-    using visited_t = absl::flat_hash_map<const IR::Node *, info_t, Util::Hash>;
-    visited_t visited;
+    NodeTable<info_t> visited;
 
  public:
-    Tracker()
-        : visited(16) {}  // Pre-allocate 16 slots as usually these maps are small, but we do create
-                          // lots of them. This saves quite some time for rehashes
+    /** Prepare a tracker released by clear() for a new traversal. */
+    void reuse() {}
+    /** Forget all nodes, at the end of a traversal. */
+    void clear() { visited.reset(); }
 
     /** Forget nodes that have already been visited, allowing them to be visited
      * again. */
     void revisit_visited() {
-        for (auto it = visited.begin(); it != visited.end();) {
-            if (it->second.done)
-                // `visited` is abseil map, therefore erase does not return iterator, use
-                // post-increment
-                visited.erase(it++);
-            else
-                ++it;
-        }
+        visited.erase_if([](const info_t &info) { return info.done; });
     }
 
     /** Begin tracking @n during a visiting pass.  Use `finish(@n)` to mark @n as
@@ -250,12 +451,12 @@ class Visitor::Tracker {
      */
     [[nodiscard]] VisitStatus try_start(const IR::Node *n, bool defaultVisitOnce) {
         // Initialization
-        auto [it, inserted] = visited.emplace(n, info_t{false, defaultVisitOnce});
+        auto [info, inserted] = visited.emplace(n, info_t{false, defaultVisitOnce});
 
         if (!inserted) {  // We already seen this node, determine its status
-            if (!it->second.done) return VisitStatus::Busy;
-            if (it->second.visitOnce) return VisitStatus::Done;
-            it->second.done = false;
+            if (!info->done) return VisitStatus::Busy;
+            if (info->visitOnce) return VisitStatus::Done;
+            info->done = false;
             return VisitStatus::Revisit;
         }
 
@@ -274,10 +475,10 @@ class Visitor::Tracker {
      * previously been invoked.
      */
     void finish(const IR::Node *n) {
-        auto it = visited.find(n);
-        if (it == visited.end()) BUG("visitor state tracker corrupted");
+        info_t *info = visited.find(n);
+        if (!info) BUG("visitor state tracker corrupted");
 
-        it->second.done = true;
+        info->done = true;
     }
 
     /** Determine whether @n is currently being visited and the visitor has not finished
@@ -286,8 +487,8 @@ class Visitor::Tracker {
      * @return true if @n is being visited and has not finished
      */
     [[nodiscard]] bool busy(const IR::Node *n) const {
-        auto it = visited.find(n);
-        return it != visited.end() && !it->second.done;
+        const info_t *info = visited.find(n);
+        return info && !info->done;
     }
 
     /** Determine whether @n has been visited and the visitor has finished
@@ -298,27 +499,27 @@ class Visitor::Tracker {
      * @return true if @n has been visited and the visitor is finished and visitOnce is true
      */
     [[nodiscard]] bool done(const IR::Node *n) const {
-        auto it = visited.find(n);
-        return it != visited.end() && it->second.done && it->second.visitOnce;
+        const info_t *info = visited.find(n);
+        return info && info->done && info->visitOnce;
     }
 
     /** Return a visitOnce flag for node @n */
     bool shouldVisitOnce(const IR::Node *n) const {
-        auto it = visited.find(n);
-        if (it == visited.end()) BUG("visitor state tracker corrupted");
-        return it->second.visitOnce;
+        const info_t *info = visited.find(n);
+        if (!info) BUG("visitor state tracker corrupted");
+        return info->visitOnce;
     }
 
     void visitOnce(const IR::Node *n) {
-        auto it = visited.find(n);
-        if (it == visited.end()) BUG("visitor state tracker corrupted");
-        it->second.visitOnce = true;
+        info_t *info = visited.find(n);
+        if (!info) BUG("visitor state tracker corrupted");
+        info->visitOnce = true;
     }
 
     void visitAgain(const IR::Node *n) {
-        auto it = visited.find(n);
-        if (it == visited.end()) BUG("visitor state tracker corrupted");
-        it->second.visitOnce = false;
+        info_t *info = visited.find(n);
+        if (!info) BUG("visitor state tracker corrupted");
+        info->visitOnce = false;
     }
 };
 
@@ -355,31 +556,34 @@ Visitor::profile_t Visitor::init_apply(const IR::Node *root, const Context *pare
 }
 Visitor::profile_t Modifier::init_apply(const IR::Node *root) {
     auto rv = Visitor::init_apply(root);
-    visited = std::make_shared<ChangeTracker>(forceClone);
+    releaseTracker(visited);
+    visited = acquireTracker<ChangeTracker>(forceClone);
     return rv;
 }
 Visitor::profile_t Inspector::init_apply(const IR::Node *root) {
     auto rv = Visitor::init_apply(root);
-    visited = std::make_shared<Tracker>();
+    releaseTracker(visited);
+    visited = acquireTracker<Tracker>();
     return rv;
 }
 Visitor::profile_t Transform::init_apply(const IR::Node *root) {
     auto rv = Visitor::init_apply(root);
-    visited = std::make_shared<ChangeTracker>(forceClone);
+    releaseTracker(visited);
+    visited = acquireTracker<ChangeTracker>(forceClone);
     return rv;
 }
 void Visitor::end_apply() {}
 void Visitor::end_apply(const IR::Node *) {}
 
-static indent_t profile_indent;
+static thread_local indent_t profile_indent;
+// Set once by the first pass to start; ParallelPass workers race for it.
 static absl::Time first_start = absl::InfinitePast();
+static std::once_flag first_start_once;
 
 Visitor::profile_t::profile_t(Visitor &v_) : v(v_) {
     start = absl::Now();
-    LOG3(profile_indent << v.name() << " statrting at +"
-                        << (first_start != absl::InfinitePast()
-                                ? start - first_start
-                                : (first_start = start, start - first_start)));
+    std::call_once(first_start_once, [this] { first_start = start; });
+    LOG3(profile_indent << v.name() << " statrting at +" << (start - first_start));
     ++profile_indent;
 }
 Visitor::profile_t::profile_t(profile_t &&a) : v(a.v), start(a.start) {
@@ -494,7 +698,7 @@ const IR::Node *Modifier::apply_visitor(const IR::Node *n, const char *name) {
     if (ctxt)
         ctxt->child_index++;
     else
-        visited.reset();
+        releaseTracker(visited);
     return n;
 }
 
@@ -520,9 +724,8 @@ const IR::Node *Inspector::apply_visitor(const IR::Node *n, const char *name) {
     }
     if (ctxt)
         ctxt->child_index++;
-    else {
-        visited.reset();
-    }
+    else
+        releaseTracker(visited);
     return n;
 }
 
@@ -589,7 +792,7 @@ const IR::Node *Transform::apply_visitor(const IR::Node *n, const char *name) {
     if (ctxt)
         ctxt->child_index++;
     else
-        visited.reset();
+        releaseTracker(visited);
     return n;
 }
 
@@ -805,6 +1008,13 @@ cstring Visitor::demangle(const char *str) { return cstring(str); }
  */
 
 static std::map<const Backtrack::trigger *, size_t> trigger_gc_roots;
+#ifdef MULTITHREAD
+#include <mutex>
+static std::mutex trigger_gc_roots_lock;
+#define LOCK_TRIGGER_GC_ROOTS std::lock_guard<std::mutex> acquire(trigger_gc_roots_lock);
+#else
+#define LOCK_TRIGGER_GC_ROOTS
+#endif
 #endif /* HAVE_LIBGC */
 
 void Backtrack::trigger::register_for_gc(size_t
@@ -814,6 +1024,7 @@ void Backtrack::trigger::register_for_gc(size_t
 ) {
 #if HAVE_LIBGC
     if (!GC_is_heap_ptr(this)) {
+        LOCK_TRIGGER_GC_ROOTS
         trigger_gc_roots[this] = sz;
         GC_add_roots(this, reinterpret_cast<char *>(this) + sz);
     }
@@ -822,6 +1033,7 @@ void Backtrack::trigger::register_for_gc(size_t
 
 Backtrack::trigger::~trigger() {
 #if HAVE_LIBGC
+    LOCK_TRIGGER_GC_ROOTS
     if (auto sz = ::get(trigger_gc_roots, this)) {
         GC_remove_roots(this, reinterpret_cast<char *>(this) + sz);
         trigger_gc_roots.erase(this);
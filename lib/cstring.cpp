@@ -16,7 +16,7 @@ limitations under the License.
 
 #include "cstring.h"
 
-#include "absl/container/node_hash_set.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_replace.h"
 
@@ -27,191 +27,178 @@ limitations under the License.
 #define IF_HAVE_LIBGC(X)
 #endif /* HAVE_LIBGC */
 
+#ifdef MULTITHREAD
+#include <mutex>
+#define MTONLY(...) __VA_ARGS__
+#else
+#define MTONLY(...)
+#endif
+
 #include <algorithm>
 #include <cctype>
 #include <iomanip>
 #include <ios>
+#include <limits>
+#include <stdexcept>
 #include <string>
-#include <unordered_set>
 
 #include "hash.h"
 
 namespace {
-enum class table_entry_flags {
-    none,
-    no_need_copy = 1 << 0,
-    require_destruction = 1 << 1,
-    inplace = 1 << 2,
+
+// An interned string.  The characters live in an arena chunk, see copy_string, or in the caller's
+// storage for literals and unique strings, so entries can move when the table grows.  32-bit
+// lengths and hashes keep the entries small; the tables never hold 2^32 strings.
+struct table_entry {
+    const char *string;
+    uint32_t length;
+    uint32_t hash;
 };
 
-inline table_entry_flags operator&(table_entry_flags l, table_entry_flags r) {
-    return static_cast<table_entry_flags>(static_cast<int>(l) & static_cast<int>(r));
-}
+// A string looked up with its hash, so that it is only computed once per interning.
+struct table_key {
+    std::string_view string;
+    uint32_t hash;
 
-inline table_entry_flags operator|(table_entry_flags l, table_entry_flags r) {
-    return static_cast<table_entry_flags>(static_cast<int>(l) | static_cast<int>(r));
-}
+    explicit table_key(std::string_view s)
+        : string(s), hash(static_cast<uint32_t>(Util::hash(s.data(), s.size()))) {}
+};
 
-// cache entry, ordered by string length
-class table_entry {
-    std::size_t m_length = 0;
-    table_entry_flags m_flags = table_entry_flags::none;
+// We'd make Util::Hash to be transparent instead. However, this would enable
+// transparent hashing globally and in some cases in very undesired manner. So
+// for now aim for more fine-grained approach.
+struct TableEntryHash {
+    using is_transparent = void;
 
-    union {
-        const char *m_string;
-        char m_inplace_string[sizeof(const char *)];
-    };
+    size_t operator()(const table_entry &entry) const { return entry.hash; }
+    size_t operator()(const table_key &key) const { return key.hash; }
+};
 
- public:
-    // entry ctor, makes copy of passed string
-    table_entry(const char *string, std::size_t length, table_entry_flags flags)
-        : m_length(length) {
-        if ((flags & table_entry_flags::no_need_copy) == table_entry_flags::no_need_copy) {
-            // No need to copy object, it's view of string, string literal or string allocated
-            // on heap and wrapped with cstring.
-            // Inherit require_destruction flag here, because string can be allready
-            // allocated on heap and wrapped with cstring object, so cstring owns the string now
-
-            m_flags = flags & table_entry_flags::require_destruction;
-            m_string = string;
-            return;
-        }
+struct TableEntryEq {
+    using is_transparent = void;
 
-        if (length < sizeof(const char *)) {
-            // String with length less than size of pointer store directly
-            // in pointer, that hint allows reduce stack fragmentation.
-            // We can make such optimization because std::unordered_set never
-            // moves objects in memory on new element insert
-            std::memcpy(m_inplace_string, string, length);
-            m_inplace_string[length] = '\0';
-            m_flags = table_entry_flags::inplace;
-        } else {
-            // Make copy of string elsewhere
-            auto copy = new IF_HAVE_LIBGC((NoGC)) char[length + 1];
-            std::memcpy(copy, string, length);
-            copy[length] = '\0';
-            m_string = copy;
-
-            // destruction required, because we own copy of string
-            m_flags = table_entry_flags::require_destruction;
-        }
+    static bool equal(const table_entry &entry, std::string_view s) {
+        return entry.length == s.size() && std::memcmp(entry.string, s.data(), s.size()) == 0;
     }
-
-    // table_entry moveable only
-    table_entry(const table_entry &) = delete;
-
-    table_entry(table_entry &&other) : m_length(other.m_length), m_flags(other.m_flags) {
-        // this object for internal usage only, length will never be accessed
-        // if object was moved, so do not zero other.m_length here
-
-        if (is_inplace()) {
-            std::memcpy(m_inplace_string, other.m_inplace_string, sizeof(m_inplace_string));
-        } else {
-            m_string = other.string();
-            other.m_string = nullptr;
-        }
+    bool operator()(const table_entry &a, const table_entry &b) const {
+        return a.hash == b.hash && equal(a, {b.string, b.length});
     }
-
-    ~table_entry() {
-        if ((m_flags & table_entry_flags::require_destruction) ==
-            table_entry_flags::require_destruction) {
-            // null pointer checked in operator delete [], so we don't need
-            // to check it explicitly
-
-            delete[] m_string;
-        }
+    bool operator()(const table_entry &a, const table_key &b) const {
+        return a.hash == b.hash && equal(a, b.string);
     }
+    bool operator()(const table_key &a, const table_entry &b) const { return (*this)(b, a); }
+};
 
-    std::size_t length() const { return m_length; }
-
-    const char *string() const {
-        if (is_inplace()) {
-            return m_inplace_string;
+// Copies of the interned strings.  Each thread has its own chunk, so copying needs no lock
+// and keeps the strings a thread interns together.  Chunks are uncollectable and never
+// freed, as interned strings live until the end of the program; this is also why libgc not
+// scanning thread_locals is fine here.
+const char *copy_string(std::string_view s) {
+    static constexpr std::size_t chunkSize = 16 * 1024;
+    static thread_local char *next = nullptr, *end = nullptr;
+
+    std::size_t size = s.size() + 1;
+    char *rv;
+    if (size > chunkSize / 4) {
+        rv = new IF_HAVE_LIBGC((NoGC)) char[size];
+    } else {
+        if (std::size_t(end - next) < size) {
+            next = new IF_HAVE_LIBGC((NoGC)) char[chunkSize];
+            end = next + chunkSize;
         }
-
-        return m_string;
+        rv = next;
+        next += size;
     }
+    std::memcpy(rv, s.data(), s.size());
+    rv[s.size()] = '\0';
+    return rv;
+}
 
-    bool operator==(const table_entry &other) const {
-        return length() == other.length() && std::memcmp(string(), other.string(), length()) == 0;
-    }
+// The cache is split in shards picked by the top bits of the hash, each with its own table
+// and, with MULTITHREAD, lock, so that threads interning different strings rarely wait for
+// each other.
+class shard {
+    absl::flat_hash_set<table_entry, TableEntryHash, TableEntryEq> table;
 
-    bool operator==(std::string_view other) const {
-        return length() == other.length() && std::memcmp(string(), other.data(), length()) == 0;
+ public:
+    MTONLY(std::mutex lock;)
+
+    // @copy is false if the string outlives the cache: a literal, or a string given to it.
+    const char *intern(const table_key &key, bool copy) {
+        MTONLY(std::lock_guard<std::mutex> acquire(lock);)
+        return table
+            .lazy_emplace(key,
+                          [&key, copy](const auto &ctor) {
+                              ctor(table_entry{copy ? copy_string(key.string) : key.string.data(),
+                                               static_cast<uint32_t>(key.string.size()),
+                                               key.hash});
+                          })
+            ->string;
     }
 
- private:
-    bool is_inplace() const {
-        return (m_flags & table_entry_flags::inplace) == table_entry_flags::inplace;
+    const char *find(const table_key &key) {
+        MTONLY(std::lock_guard<std::mutex> acquire(lock);)
+        auto entry = table.find(key);
+        return entry == table.end() ? nullptr : entry->string;
     }
-};
 
-// We'd make Util::Hash to be transparent instead. However, this would enable
-// transparent hashing globally and in some cases in very undesired manner. So
-// for now aim for more fine-grained approach.
-struct TableEntryHash {
-    using is_transparent = void;
-
-    // IMPORTANT: These two hashes MUST match in order for heterogenous
-    // lookup to work properly
-    size_t operator()(const table_entry &entry) const {
-        return Util::hash(entry.string(), entry.length());
-    }
-
-    size_t operator()(std::string_view entry) const {
-        return Util::hash(entry.data(), entry.length());
+    std::size_t size(std::size_t &count) {
+        MTONLY(std::lock_guard<std::mutex> acquire(lock);)
+        count += table.size();
+        std::size_t rv = 0;
+        for (auto &e : table) rv += sizeof(e) + e.length;
+        return rv;
     }
 };
 
-auto &cache() {
-    // We need node_hash_set due to SSO: we return address of embedded string
-    // that should be stable
-    static absl::node_hash_set<table_entry, TableEntryHash, std::equal_to<>> g_cache;
+constexpr std::size_t shardBits = 6;
 
+auto &cache() {
+    static shard g_cache[std::size_t(1) << shardBits];
     return g_cache;
 }
 
-const char *save_to_cache(const char *string, std::size_t length, table_entry_flags flags) {
-    // Checks if string is already cached and if not, calls ctor to construct in
-    // place.  As a result, only a single lookup is performed regardless whether
-    // entry is in cache or not.
-    return cache()
-        .lazy_emplace(table_entry(string, length, table_entry_flags::no_need_copy),
-                      [string, length, flags](const auto &ctor) { ctor(string, length, flags); })
-        ->string();
+shard &shard_of(const table_key &key) {
+    return cache()[key.hash >> (std::numeric_limits<uint32_t>::digits - shardBits)];
+}
+
+const char *save_to_cache(const char *string, std::size_t length, bool copy) {
+    if (length > std::numeric_limits<uint32_t>::max())
+        throw std::length_error("string too long for the cstring cache");
+    table_key key({string, length});
+    return shard_of(key).intern(key, copy);
 }
 
 }  // namespace
 
-bool cstring::is_cached(std::string_view s) { return cache().contains(s); }
+bool cstring::is_cached(std::string_view s) {
+    table_key key(s);
+    return shard_of(key).find(key) != nullptr;
+}
 
 cstring cstring::get_cached(std::string_view s) {
-    auto entry = cache().find(s);
-    if (entry == cache().end()) return nullptr;
-
+    table_key key(s);
     cstring res;
-    res.str = entry->string();
-
+    res.str = shard_of(key).find(key);
     return res;
 }
 
 void cstring::construct_from_shared(const char *string, std::size_t length) {
-    str = save_to_cache(string, length, table_entry_flags::none);
+    str = save_to_cache(string, length, true);
 }
 
 void cstring::construct_from_unique(const char *string, std::size_t length) {
-    str = save_to_cache(string, length,
-                        table_entry_flags::no_need_copy | table_entry_flags::require_destruction);
+    str = save_to_cache(string, length, false);
 }
 
 void cstring::construct_from_literal(const char *string, std::size_t length) {
-    str = save_to_cache(string, length, table_entry_flags::no_need_copy);
+    str = save_to_cache(string, length, false);
 }
 
 size_t cstring::cache_size(size_t &count) {
     size_t rv = 0;
-    count = cache().size();
-    for (auto &s : cache()) rv += sizeof(s) + s.length();
+    count = 0;
+    for (auto &s : cache()) rv += s.size(count);
     return rv;
 }
 
@@ -52,8 +52,10 @@ limitations under the License.
  *     std::string.
  *   - Interned strings can never be freed, so they'll stick around for the
  *     lifetime of the program.
- *   - The string interning cstring performs is currently not threadsafe, so you
- *     can't safely use cstrings off the main thread.
+ *   - The string interning cstring performs is only threadsafe when the
+ *     compiler is built with ENABLE_MULTITHREAD, in which case every
+ *     interning takes a global lock; otherwise, you can't safely use cstrings
+ *     off the main thread.
  *
  * Given these tradeoffs, the general rule of thumb to follow is that you should
  * try to convert strings to cstrings early and keep them in that form. That
@@ -18,8 +18,13 @@ limitations under the License.
 #define LIB_ERROR_REPORTER_H_
 
 #include <iostream>
+#include <map>
+#ifdef MULTITHREAD
+#include <mutex>
+#endif
 #include <ostream>
 #include <set>
+#include <string_view>
 #include <type_traits>
 #include <unordered_map>
 
@@ -56,6 +61,21 @@ class ErrorReporter {
     /// Track errors or warnings that have already been issued for a particular source location
     std::set<std::pair<int, const Util::SourceInfo>> errorTracker;
 
+#ifdef MULTITHREAD
+    /// Serializes diagnostics issued by passes running on several threads. Recursive, as
+    /// diagnose() overloads call each other; a copied reporter gets a lock of its own.
+    struct Lock {
+        std::recursive_mutex mutex;
+        Lock() = default;
+        Lock(const Lock &) {}
+        Lock &operator=(const Lock &) { return *this; }
+    };
+    Lock lock;
+#define ERROR_REPORTER_LOCK std::lock_guard<std::recursive_mutex> acquire(lock.mutex);
+#else
+#define ERROR_REPORTER_LOCK
+#endif
+
     /// Output the message and flush the stream
     virtual void emit_message(const ErrorMessage &msg) {
         *outputstream << msg.toString();
@@ -73,6 +93,7 @@ class ErrorReporter {
     /// list of seen errors, and return false.
     bool error_reported(int err, const Util::SourceInfo source) {
         if (!source.isValid()) return false;
+        ERROR_REPORTER_LOCK
         auto p = errorTracker.emplace(err, source);
         return !p.second;  // if insertion took place, then we have not seen the error.
     }
@@ -142,6 +163,7 @@ class ErrorReporter {
     void diagnose(DiagnosticAction action, const char *diagnosticName, const char *format,
                   const char *suffix, Args &&...args) {
         if (action == DiagnosticAction::Ignore) return;
+        ERROR_REPORTER_LOCK
 
         ErrorMessage::MessageType msgType = ErrorMessage::MessageType::None;
         if (action == DiagnosticAction::Info) {
@@ -198,6 +220,7 @@ class ErrorReporter {
     /// position information provided by Bison.
     template <typename T>
     void parser_error(const Util::SourceInfo &location, const T &message) {
+        ERROR_REPORTER_LOCK
         errorCount++;
         std::stringstream ss;
         ss << message;
@@ -213,6 +236,7 @@ class ErrorReporter {
      */
     template <typename... Args>
     void parser_error(const Util::InputSources *sources, const char *fmt, Args &&...args) {
+        ERROR_REPORTER_LOCK
         errorCount++;
 
         Util::SourcePosition position = sources->getCurrentPosition();
@@ -265,6 +289,18 @@ class ErrorReporter {
         defaultInfoDiagnosticAction = action;
     }
 
+    /// Writes every diagnostic action in effect, defaults and overrides, in a canonical order:
+    /// two reporters that react the same way to every diagnostic write the same text.
+    void printDiagnosticActions(std::ostream &out) const {
+        std::map<std::string_view, DiagnosticAction> sorted;
+        for (const auto &[name, action] : diagnosticActions)
+            sorted.emplace(name.string_view(), action);
+        out << static_cast<int>(defaultInfoDiagnosticAction) << ' '
+            << static_cast<int>(defaultWarningDiagnosticAction) << ' ' << maxErrorCount;
+        for (const auto &[name, action] : sorted)
+            out << ' ' << name << '=' << static_cast<int>(action);
+    }
+
  private:
     /// The default diagnostic action for calls to `::info()`.
     DiagnosticAction defaultInfoDiagnosticAction;
@@ -276,4 +312,6 @@ class ErrorReporter {
     std::unordered_map<cstring, DiagnosticAction> diagnosticActions;
 };
 
+#undef ERROR_REPORTER_LOCK
+
 #endif /* LIB_ERROR_REPORTER_H_ */
@@ -29,6 +29,9 @@ limitations under the License.
 #endif
 
 #if HAVE_LIBGC
+#ifdef MULTITHREAD
+#define GC_THREADS
+#endif
 #include <gc.h>
 #include <gc_cpp.h>
 #include <gc_mark.h>
@@ -58,7 +61,7 @@ static char emergency_pool[16 * 1024];
 static char *emergency_ptr;
 
 static alloc_trace_cb_t trace_cb;
-static bool tracing = false;
+static thread_local bool tracing = false;
 #if !HAVE_EXECINFO_H
 #define backtrace(BUFFER, SIZE) memset(BUFFER, 0, (SIZE) * sizeof(void *))
 #endif
@@ -75,6 +78,9 @@ static void maybe_initialize_gc() {
     if (!done_init) {
         started_init = true;
         GC_INIT();
+#ifdef MULTITHREAD
+        GC_allow_register_threads();
+#endif
         done_init = true;
     }
 }
@@ -319,6 +325,31 @@ void setup_gc_logging() {
 #endif /* HAVE_LIBGC */
 }
 
+void gc_heap_usage(size_t *heap, size_t *allocated) {
+#if HAVE_LIBGC
+    GC_word heapsize, total;
+    GC_get_heap_usage_safe(&heapsize, 0, 0, 0, &total);
+    *heap = heapsize;
+    *allocated = total;
+#else
+    *heap = *allocated = 0;
+#endif
+}
+
+void gc_register_thread() {
+#if HAVE_LIBGC && defined(MULTITHREAD)
+    maybe_initialize_gc();
+    struct GC_stack_base base;
+    if (GC_get_stack_base(&base) == GC_SUCCESS) GC_register_my_thread(&base);
+#endif
+}
+
+void gc_unregister_thread() {
+#if HAVE_LIBGC && defined(MULTITHREAD)
+    GC_unregister_my_thread();
+#endif
+}
+
 size_t gc_mem_inuse(size_t *max) {
 #if HAVE_LIBGC
     GC_word heapsize, heapfree;
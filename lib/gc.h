@@ -21,6 +21,15 @@ limitations under the License.
 
 void setup_gc_logging();
 size_t gc_mem_inuse(size_t *max = 0);  // trigger GC, return inuse after
+/// The size of the heap and the number of bytes allocated since startup, without
+/// triggering a collection; both are 0 without GC.
+void gc_heap_usage(size_t *heap, size_t *allocated);
+
+/// Threads other than the main one must be registered with the collector before they
+/// allocate, and unregistered before they exit, so that their stacks are scanned for roots.
+/// Both are no-ops unless the compiler is built with ENABLE_MULTITHREAD.
+void gc_register_thread();
+void gc_unregister_thread();
 
 #define ALLOC_TRACE_DEPTH 5
 struct alloc_trace_cb_t {
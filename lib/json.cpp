@@ -178,4 +178,132 @@ JsonObject *JsonObject::emplace_non_null(cstring label, IJson *value) {
     return this;
 }
 
+void JsonSpooledArray::serialize(std::ostream &out) const {
+    out << "[";
+    if (count != 0) out << text << '\n' << indent_t(depth - 1);
+    out << "]";
+}
+
+JsonSpooledArray *JsonSpooledArray::append(const IJson *value) {
+    if (value == nullptr || value->is<JsonValue>())
+        throw std::logic_error("Only objects and arrays can be spooled");
+    std::stringstream str;
+    if (count != 0) str << ",";
+    str << '\n' << indent_t(depth);
+    indent_t::getindent(str) = indent_t(depth);
+    JsonWriter(str).write(value);
+    text += str.str();
+    ++count;
+    return this;
+}
+
+JsonWriter::JsonWriter(std::ostream &out)
+    : out(out), indent(indent_t::getindent(out)) {}
+
+void JsonWriter::newline() { out << '\n' << indent; }
+
+/// Starts a value which is not buffered.
+void JsonWriter::element() {
+    if (levels.empty() || !levels.back().array) return;
+    auto &level = levels.back();
+    if (level.small) {
+        level.small = false;
+        ++indent;
+        for (auto &s : level.scalars) {
+            if (!level.first) out << ",";
+            newline();
+            out << s;
+            level.first = false;
+        }
+        level.scalars.clear();
+    }
+    if (!level.first) out << ",";
+    newline();
+    level.first = false;
+}
+
+JsonWriter &JsonWriter::beginObject() {
+    element();
+    out << "{";
+    ++indent;
+    levels.emplace_back(false);
+    return *this;
+}
+
+JsonWriter &JsonWriter::key(cstring label) {
+    if (label.isNullOrEmpty()) throw std::logic_error("Empty label");
+    auto &level = levels.back();
+    if (!level.first) out << ",";
+    level.first = false;
+    newline();
+    out << "\"" << label << "\"" << " : ";
+    return *this;
+}
+
+JsonWriter &JsonWriter::endObject() {
+    --indent;
+    newline();
+    out << "}";
+    levels.pop_back();
+    return *this;
+}
+
+JsonWriter &JsonWriter::beginArray() {
+    element();
+    out << "[";
+    levels.emplace_back(true);
+    return *this;
+}
+
+JsonWriter &JsonWriter::endArray() {
+    auto &level = levels.back();
+    if (level.small) {
+        const char *sep = "";
+        for (auto &s : level.scalars) {
+            out << sep << s;
+            sep = ", ";
+        }
+    } else {
+        --indent;
+        newline();
+    }
+    out << "]";
+    levels.pop_back();
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(const JsonValue &v) {
+    if (buffering()) {
+        std::stringstream str;
+        v.serialize(str);
+        levels.back().scalars.push_back(str.str());
+    } else {
+        element();
+        v.serialize(out);
+    }
+    return *this;
+}
+
+JsonWriter &JsonWriter::write(const IJson *json) {
+    if (json == nullptr) return value(*JsonValue::null);
+    if (auto *v = json->to<JsonValue>()) return value(*v);
+    if (auto *spooled = json->to<JsonSpooledArray>()) {
+        // Already laid out for its depth.
+        element();
+        spooled->serialize(out);
+        return *this;
+    }
+    if (auto *array = json->to<JsonArray>()) {
+        beginArray();
+        for (auto *e : *array) write(e);
+        return endArray();
+    }
+    beginObject();
+    for (auto &it : *json->checkedTo<JsonObject>()) {
+        key(it.first);
+        write(it.second);
+    }
+    return endObject();
+}
+
 }  // namespace Util
@@ -19,6 +19,7 @@ limitations under the License.
 
 #include <iostream>
 #include <stdexcept>
+#include <string>
 #include <type_traits>
 #include <vector>
 
@@ -28,6 +29,7 @@ limitations under the License.
 #include "lib/big_int_util.h"
 #include "lib/castable.h"
 #include "lib/cstring.h"
+#include "lib/indent.h"
 #include "lib/map.h"
 #include "lib/ordered_map.h"
 
@@ -193,6 +195,74 @@ class JsonObject final : public IJson, public ordered_map<cstring, IJson *> {
     DECLARE_TYPEINFO(JsonObject, IJson);
 };
 
+/// An array of objects or arrays which are serialized as they are appended, so that their
+/// trees can be collected while the rest of the document is still being built. Meant for the
+/// large sections of a document whose elements are final once appended. The elements are
+/// indented for nesting depth @depth (2 for an array held by the top-level object), so the
+/// array serializes as the equivalent JsonArray would only at that depth.
+class JsonSpooledArray final : public IJson {
+    int depth;
+    size_t count = 0;
+    /// The serialized elements, each preceded by its separator and indentation.
+    std::string text;
+
+ public:
+    explicit JsonSpooledArray(int depth) : depth(depth) {}
+    void serialize(std::ostream &out) const override;
+    /// Serializes @value, which must be an object or an array, as the next element.
+    JsonSpooledArray *append(const IJson *value);
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    DECLARE_TYPEINFO(JsonSpooledArray, IJson);
+};
+
+/// Writes JSON to a stream as it is produced, without building a tree of IJson objects.  The
+/// output is byte for byte the serialization of the equivalent tree, and parts of a document
+/// which do exist as trees can be written with write().  Scalars in an array are buffered
+/// until the array ends or gets an object or array element, which decides between the one
+/// line and the one element per line layouts of JsonArray::serialize.
+class JsonWriter {
+    struct Level {
+        bool array;
+        bool first = true;
+        /// Whether an array only had scalar elements so far, which are held in @scalars.
+        bool small = true;
+        std::vector<std::string> scalars;
+        explicit Level(bool array) : array(array) {}
+    };
+
+    std::ostream &out;
+    indent_t indent;
+    std::vector<Level> levels;
+
+    bool buffering() const { return !levels.empty() && levels.back().array && levels.back().small; }
+    void newline();
+    void element();
+
+ public:
+    explicit JsonWriter(std::ostream &out);
+
+    JsonWriter &beginObject();
+    JsonWriter &key(cstring label);
+    JsonWriter &endObject();
+    JsonWriter &beginArray();
+    JsonWriter &endArray();
+    JsonWriter &value(const JsonValue &v);
+    template <typename T>
+    JsonWriter &value(T v) {
+        static_assert(!std::is_convertible<T, const IJson *>::value, "use write()");
+        return value(JsonValue(v));
+    }
+    /// Writes @json, which may be nullptr, as the next value.
+    JsonWriter &write(const IJson *json);
+    template <typename T>
+    JsonWriter &field(cstring label, T v) {
+        key(label);
+        return value(v);
+    }
+};
+
 }  // namespace Util
 
 #endif /* LIB_JSON_H_ */
@@ -187,6 +187,9 @@ class SourceInfo final {
 
     const SourcePosition &getEnd() const { return this->end; }
 
+    /// The input sources in which the positions are interpreted.
+    const InputSources *getSources() const { return this->sources; }
+
     /**
        True if this comes 'before' this source position.
        'invalid' source positions come first.
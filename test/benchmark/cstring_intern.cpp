@@ -0,0 +1,98 @@
+/*
+Copyright 2024-present Barefoot Networks, Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// Reports the time to intern new strings and existing ones in the cstring cache, on one
+/// thread and, with MULTITHREAD, on several at once.  Usage: cstring-intern-bench [count]
+
+#include <algorithm>
+#include <chrono>  // NOLINT linter forbids using chrono, but we don't have alternatives
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "lib/cstring.h"
+#ifdef MULTITHREAD
+#include <thread>
+
+#include "lib/gc.h"
+#endif
+
+using namespace P4;
+
+namespace {
+
+std::vector<std::string> benchStrings(const char *prefix, int count) {
+    std::vector<std::string> rv;
+    for (int i = 0; i < count; ++i) rv.push_back(prefix + std::to_string(i));
+    return rv;
+}
+
+/// Interns @strings, and @return the average time per string in nanoseconds.
+double internStrings(const std::vector<std::string> &strings, std::vector<cstring> &interned) {
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &s : strings) interned.emplace_back(s);
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / strings.size();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 200000;
+    if (count <= 0) {
+        std::cerr << "usage: " << argv[0] << " [count]" << std::endl;
+        return 1;
+    }
+    auto strings = benchStrings("cstring benchmark string #", count);
+    std::vector<cstring> inserted, found;
+    inserted.reserve(count);
+    found.reserve(count);
+    double insertTime = internStrings(strings, inserted);
+    double lookupTime = internStrings(strings, found);
+    for (int run = 0; run < 4; ++run) {
+        std::vector<cstring> again;
+        again.reserve(count);
+        lookupTime = std::min(lookupTime, internStrings(strings, again));
+    }
+    std::cout << "interning " << count << " strings: " << insertTime << " ns/string new, "
+              << lookupTime << " ns/string existing" << std::endl;
+
+#ifdef MULTITHREAD
+    constexpr int threads = 4;
+    // Every thread interns the same strings, half of them new, in a different order.
+    auto shared = benchStrings("cstring benchmark shared string #", count);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            gc_register_thread();
+            std::vector<cstring> result;
+            result.reserve(count);
+            for (int i = 0; i < count; ++i) {
+                int index = (i + t * count / threads) % count;
+                result.emplace_back(i % 2 ? shared[index] : strings[index]);
+            }
+            gc_unregister_thread();
+        });
+    }
+    for (auto &w : workers) w.join();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "interning " << count << " strings on each of " << threads
+              << " threads: " << elapsed.count() / (count * threads) << " ns/string" << std::endl;
+#endif
+    return 0;
+}
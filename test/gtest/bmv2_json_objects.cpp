@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+
+#include "backends/bmv2/common/JsonObjects.h"
+#include "lib/json.h"
+
+namespace Test {
+
+using namespace P4::literals;
+
+// The actions and pipelines are serialized as they are added, and the document is still the
+// one their trees would give.
+TEST(JsonObjects, SpooledSectionsMatchTrees) {
+    BMV2::JsonObjects json;
+    auto *actions = new Util::JsonArray();
+    for (int i = 0; i < 3; i++) {
+        auto *params = new Util::JsonArray();
+        if (i > 0) {
+            auto *param = new Util::JsonObject();
+            param->emplace("name"_cs, "port"_cs);
+            param->emplace("bitwidth"_cs, 9);
+            params->append(param);
+        }
+        auto *body = new Util::JsonArray();
+        for (int p = 0; p < i; p++) {
+            auto *primitive = new Util::JsonObject();
+            primitive->emplace("op"_cs, "mark_to_drop"_cs);
+            primitive->emplace("parameters"_cs, new Util::JsonArray());
+            body->append(primitive);
+        }
+        cstring name = cstring("action_" + std::to_string(i));
+        unsigned id = json.add_action(name, params, body);
+        auto *action = new Util::JsonObject();
+        action->emplace("name"_cs, name);
+        action->emplace("id"_cs, id);
+        action->emplace("runtime_data"_cs, params);
+        action->emplace("primitives"_cs, body);
+        actions->append(action);
+    }
+    auto *pipelines = new Util::JsonArray();
+    for (auto name : {"ingress"_cs, "egress"_cs}) {
+        auto *pipeline = new Util::JsonObject();
+        pipeline->emplace("name"_cs, name);
+        pipeline->emplace("init_table"_cs, Util::JsonValue::null);
+        pipeline->emplace("tables"_cs, new Util::JsonArray());
+        json.pipelines->append(pipeline);
+        pipelines->append(pipeline);
+    }
+
+    auto *trees = new Util::JsonObject();
+    for (const auto &[label, value] : *json.toplevel) {
+        if (label == "actions")
+            trees->emplace(label, actions);
+        else if (label == "pipelines")
+            trees->emplace(label, pipelines);
+        else
+            trees->emplace(label, value);
+    }
+    std::stringstream expected, serialized;
+    trees->serialize(expected);
+    json.toplevel->serialize(serialized);
+    EXPECT_EQ(expected.str(), serialized.str());
+}
+
+}  // namespace Test
@@ -18,6 +18,14 @@ limitations under the License.
 
 #include <gtest/gtest.h>
 
+#include <string>
+#include <vector>
+#ifdef MULTITHREAD
+#include <thread>
+
+#include "lib/gc.h"
+#endif
+
 namespace Test {
 
 using namespace P4::literals;
@@ -158,4 +166,39 @@ TEST(cstring, get_cached) {
     EXPECT_FALSE(cstring::get_cached("test").isNullOrEmpty());
 }
 
+TEST(cstring, cache_size) {
+    size_t count, size = cstring::cache_size(count);
+    cstring c("a string added to the cstring cache by cache_size");
+    size_t newCount, newSize = cstring::cache_size(newCount);
+    EXPECT_EQ(newCount, count + 1);
+    EXPECT_GE(newSize, size + c.size());
+}
+
+#ifdef MULTITHREAD
+// Threads interning the same new strings in different orders get the same cstrings.
+TEST(cstring, internConcurrently) {
+    constexpr int count = 2000, threads = 4;
+    std::vector<std::string> strings;
+    for (int i = 0; i < count; ++i)
+        strings.push_back("cstring concurrent string #" + std::to_string(i));
+    std::vector<std::vector<cstring>> results(threads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            gc_register_thread();
+            for (int i = 0; i < count; ++i)
+                results[t].emplace_back(strings[(i + t * count / threads) % count]);
+            gc_unregister_thread();
+        });
+    }
+    for (auto &w : workers) w.join();
+    for (int t = 0; t < threads; ++t) {
+        for (int i = 0; i < count; ++i) {
+            const auto &s = strings[(i + t * count / threads) % count];
+            EXPECT_EQ(results[t][i].c_str(), cstring::get_cached(s).c_str());
+        }
+    }
+}
+#endif
+
 }  // namespace Test
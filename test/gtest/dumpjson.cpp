@@ -15,10 +15,19 @@ limitations under the License.
 */
 
 #include <gtest/gtest.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <string>
 
+#include "frontends/common/parseInput.h"
+#include "helpers.h"
 #include "ir/ir.h"
+#include "ir/ir_binary.h"
 #include "ir/json_loader.h"
 #include "ir/visitor.h"
 
@@ -37,3 +46,86 @@ TEST(IR, DumpJSON) {
     loader >> e2;
     JSONGenerator(std::cout) << e2 << std::endl;
 }
+
+TEST(IR, BinaryIR) {
+    const auto *program = P4::parseP4String(P4_SOURCE(R"(
+        header h_t { bit<8> f; }
+        control c(inout h_t h) {
+            action a(bit<8> v) { h.f = v; }
+            table t { actions = { a; } default_action = a(8w1); }
+            apply { if (h.isValid()) t.apply(); }
+        }
+    )"),
+                                            CompilerOptions::FrontendVersion::P4_16);
+    ASSERT_TRUE(program);
+    const auto *control = program->objects.back()->to<IR::P4Control>();
+    ASSERT_TRUE(control);
+
+    // The reader maps a file; one per process, so that concurrent test runs do not collide.
+    auto file = std::filesystem::path(testing::TempDir()) /
+                ("p4c-gtest-ir-" + std::to_string(getpid()) + ".bin");
+    {
+        std::ofstream out(file, std::ios::binary);
+        IRBinaryWriter().write(out, program);
+    }
+    EXPECT_TRUE(IRBinaryReader::isBinaryIR(file));
+
+    // Nodes keep their ids, so the program dumps as the same JSON.
+    std::stringstream expected, actual;
+    JSONGenerator(expected) << program;
+    {
+        IRBinaryReader reader(file);
+        ASSERT_TRUE(reader.valid());
+        const auto *loaded = reader.root();
+        ASSERT_TRUE(loaded && loaded->is<IR::P4Program>());
+        EXPECT_TRUE(loaded->equiv(*program));
+        JSONGenerator(actual) << loaded;
+    }
+    EXPECT_EQ(expected.str(), actual.str());
+
+    // A part of the program can be read on its own.
+    {
+        IRBinaryReader reader(file);
+        const auto *body = reader.node(control->body->id);
+        ASSERT_TRUE(body);
+        EXPECT_TRUE(body->equiv(*control->body));
+        EXPECT_EQ(reader.node(-1), nullptr);
+    }
+    std::filesystem::remove(file);
+}
+
+class BinaryIRTest : public Test::P4CTest {};
+
+TEST_F(BinaryIRTest, Corrupt) {
+    const auto *program = P4::parseP4String(P4_SOURCE(R"(
+        header h_t { bit<8> f; }
+        control c(inout h_t h) {
+            apply { if (h.isValid()) h.f = 1; }
+        }
+    )"),
+                                            CompilerOptions::FrontendVersion::P4_16);
+    ASSERT_TRUE(program);
+    std::stringstream out;
+    IRBinaryWriter().write(out, program);
+    std::string bytes = out.str();
+
+    // Clobber the second half of the records, which precede the string table, whose offset
+    // is the first word of the trailer.
+    uint64_t stringsOffset = 0;
+    for (size_t i = 8; i-- > 0;)
+        stringsOffset = (stringsOffset << 8) | uint8_t(bytes[bytes.size() - 24 + i]);
+    ASSERT_LT(stringsOffset, bytes.size());
+    std::fill(bytes.begin() + stringsOffset / 2, bytes.begin() + stringsOffset, '\xff');
+
+    auto file = std::filesystem::path(testing::TempDir()) /
+                ("p4c-gtest-corrupt-ir-" + std::to_string(getpid()) + ".bin");
+    std::ofstream(file, std::ios::binary) << bytes;
+    {
+        // The root refers to every node, so decoding it reaches the corrupt records.
+        IRBinaryReader reader(file);
+        ASSERT_TRUE(reader.valid());
+        EXPECT_EQ(reader.root(), nullptr);
+        EXPECT_EQ(::errorCount(), 1U);
+    }
+    std::filesystem::remove(file);
+}
@@ -1,9 +1,16 @@
 #include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
 
 #include "frontends/common/constantFolding.h"
+#include "frontends/common/irCache.h"
 #include "frontends/common/parseInput.h"
 #include "frontends/common/resolveReferences/referenceMap.h"
 #include "frontends/common/resolveReferences/resolveReferences.h"
+#include "frontends/p4/frontend.h"
 #include "frontends/p4/moveDeclarations.h"
 #include "frontends/p4/typeChecking/typeChecker.h"
 #include "helpers.h"
@@ -197,4 +204,316 @@ TEST_F(P4CFrontendMoveInitializers, P4ControlSrcInfo) {
     }
 }
 
+// Tests for IRCache
+namespace {
+
+std::filesystem::path irCacheDirectory(const char *name) {
+    return std::filesystem::path(testing::TempDir()) /
+           (std::string("p4c-gtest-") + name + "-" + std::to_string(getpid()));
+}
+
+/// The position and source fragment of every node, as diagnostics and bmv2 source_info see them.
+class SourcePositions : public Inspector {
+ public:
+    std::vector<std::string> positions;
+
+    bool preorder(const IR::Node *node) override {
+        if (node->srcInfo.isValid())
+            positions.push_back(node->srcInfo.toPositionString() + ":" +
+                                std::to_string(node->srcInfo.getStart().getColumnNumber()) + " " +
+                                node->srcInfo.toBriefSourceFragment());
+        return true;
+    }
+};
+
+std::vector<std::string> sourcePositions(const IR::Node *node) {
+    SourcePositions collect;
+    node->apply(collect);
+    return collect.positions;
+}
+
+const char *irCacheProgram = R"(
+        struct Headers { bit<8> value; }
+        struct Metadata { }
+        parser parse(packet_in p, out Headers h, inout Metadata m,
+                     inout standard_metadata_t sm) {
+            state start { transition accept; } }
+        control checksum(inout Headers h, inout Metadata m) { apply { } }
+        control mau(inout Headers h, inout Metadata m,
+                    inout standard_metadata_t sm) {
+            apply { h.value = h.value + 8w1; } }
+        control deparse(packet_out p, in Headers h) { apply { } }
+        V1Switch(parse(), checksum(), mau(), mau(), checksum(), deparse()) main;
+    )";
+
+}  // namespace
+
+TEST_F(P4CFrontend, IRCache) {
+    std::string source = P4_SOURCE(R"(
+        control c(inout bit<8> x) {
+            apply { x = x + 8w1; }
+        }
+    )");
+    std::string changed = P4_SOURCE(R"(
+        control c(inout bit<8> x) {
+            apply { x = x + 8w2; }
+        }
+    )");
+    std::string moved = P4_SOURCE(R"(
+
+        control c(inout bit<8> x) {
+            apply { x = x + 8w1; }
+        }
+    )");
+    const auto *program = P4::parseP4String(source, CompilerOptions::FrontendVersion::P4_16);
+    const auto *again = P4::parseP4String(source, CompilerOptions::FrontendVersion::P4_16);
+    const auto *other = P4::parseP4String(changed, CompilerOptions::FrontendVersion::P4_16);
+    const auto *elsewhere = P4::parseP4String(moved, CompilerOptions::FrontendVersion::P4_16);
+    ASSERT_TRUE(program && again && other && elsewhere);
+
+    // Keys do not depend on node ids, but do on the IR, its positions and the context.
+    auto key = P4::IRCache::key(program, "test");
+    EXPECT_EQ(key, P4::IRCache::key(again, "test"));
+    EXPECT_NE(key, P4::IRCache::key(other, "test"));
+    EXPECT_NE(key, P4::IRCache::key(elsewhere, "test"));
+    EXPECT_NE(key, P4::IRCache::key(program, "other"));
+
+    auto directory = irCacheDirectory("ir-cache");
+    std::filesystem::remove_all(directory);
+    P4::IRCache cache(directory);
+    EXPECT_EQ(cache.load(key, again), nullptr);
+    cache.store(key, program);
+    const auto *loaded = cache.load(key, again);
+    ASSERT_TRUE(loaded);
+    EXPECT_TRUE(loaded->equiv(*program));
+    std::filesystem::remove_all(directory);
+}
+
+TEST_F(P4CFrontend, IRCacheHitMatchesMiss) {
+    auto source = P4_SOURCE(P4Headers::V1MODEL, irCacheProgram);
+    CompilerOptions options;
+    options.langVersion = CompilerOptions::FrontendVersion::P4_16;
+    RedirectStderr errors;
+
+    const auto *parsed = P4::parseP4String(source, options.langVersion);
+    ASSERT_TRUE(parsed);
+    const auto *miss = P4::FrontEnd().run(options, parsed);
+    ASSERT_TRUE(miss);
+
+    auto directory = irCacheDirectory("ir-cache-hit");
+    std::filesystem::remove_all(directory);
+    P4::IRCache cache(directory);
+    auto key = P4::IRCache::key(parsed, "test");
+    cache.store(key, miss);
+
+    // A later compilation of the same source gets the same program, with the same positions
+    // and source fragments, now taken from its own input.
+    const auto *reparsed = P4::parseP4String(source, options.langVersion);
+    ASSERT_TRUE(reparsed);
+    ASSERT_EQ(P4::IRCache::key(reparsed, "test"), key);
+    const auto *hit = cache.load(key, reparsed);
+    ASSERT_TRUE(hit);
+    EXPECT_TRUE(hit->equiv(*miss));
+    auto positions = sourcePositions(miss);
+    EXPECT_FALSE(positions.empty());
+    EXPECT_EQ(sourcePositions(hit), positions);
+    std::filesystem::remove_all(directory);
+}
+
+TEST_F(P4CFrontend, IRCacheDiagnosticActions) {
+    // The parser leaves its out parameter uninitialized, which the frontend warns about.
+    auto source = P4_SOURCE(P4Headers::V1MODEL, irCacheProgram);
+    auto directory = irCacheDirectory("ir-cache-diagnostics");
+    std::filesystem::remove_all(directory);
+    CompilerOptions options;
+    options.langVersion = CompilerOptions::FrontendVersion::P4_16;
+    options.irCacheDir = directory;
+    auto &reporter = BaseCompileContext::get().errorReporter();
+
+    // Stored, since with warnings disabled the frontend reports nothing.
+    reporter.setDefaultWarningDiagnosticAction(DiagnosticAction::Ignore);
+    const auto *parsed = P4::parseP4String(source, options.langVersion);
+    ASSERT_TRUE(parsed);
+    ASSERT_TRUE(P4::FrontEnd().run(options, parsed));
+    EXPECT_EQ(::diagnosticCount(), 0u);
+    EXPECT_FALSE(std::filesystem::is_empty(directory));
+
+    // Not served once warnings are enabled again: the warning is still reported.
+    reporter.setDefaultWarningDiagnosticAction(DiagnosticAction::Warn);
+    RedirectStderr errors;
+    parsed = P4::parseP4String(source, options.langVersion);
+    ASSERT_TRUE(parsed);
+    ASSERT_TRUE(P4::FrontEnd().run(options, parsed));
+    errors.reset();
+    EXPECT_GT(::diagnosticCount(), 0u);
+    EXPECT_TRUE(errors.contains("uninitialized"));
+    std::filesystem::remove_all(directory);
+}
+
+TEST_F(P4CFrontend, IRCacheDebugHooks) {
+    // Compilations with debug hooks are neither served from the cache nor stored in it, as the
+    // hooks must see every frontend pass.
+    auto source = P4_SOURCE(P4Headers::V1MODEL, irCacheProgram);
+    auto directory = irCacheDirectory("ir-cache-hooks");
+    std::filesystem::remove_all(directory);
+    CompilerOptions options;
+    options.langVersion = CompilerOptions::FrontendVersion::P4_16;
+    options.irCacheDir = directory;
+    RedirectStderr errors;
+
+    for (int i = 0; i < 2; i++) {
+        const auto *parsed = P4::parseP4String(source, options.langVersion);
+        ASSERT_TRUE(parsed);
+        unsigned passes = 0;
+        P4::FrontEnd frontend;
+        frontend.addDebugHook([&](const char *, unsigned, const char *, const IR::Node *) {
+            passes++;
+        });
+        ASSERT_TRUE(frontend.run(options, parsed));
+        EXPECT_GT(passes, 0u);
+        EXPECT_FALSE(std::filesystem::exists(directory));
+    }
+    std::filesystem::remove_all(directory);
+}
+
+TEST_F(P4CFrontend, TypeMapUnificationMemo) {
+    P4::TypeMap typeMap;
+    auto *b8 = IR::Type_Bits::get(8);
+    auto *b16 = IR::Type_Bits::get(16);
+
+    // Structurally equal tuples share a canonical type.
+    auto *tuple = new IR::Type_Tuple(IR::Vector<IR::Type>({b8, b16}));
+    EXPECT_EQ(typeMap.getCanonical(tuple), tuple);
+    EXPECT_EQ(typeMap.getCanonical(new IR::Type_Tuple(IR::Vector<IR::Type>({b8, b16}))), tuple);
+    EXPECT_NE(typeMap.getCanonical(new IR::Type_Tuple(IR::Vector<IR::Type>({b16, b8}))), tuple);
+    auto *set = new IR::Type_Set(tuple);
+    EXPECT_EQ(typeMap.getCanonical(set), set);
+    EXPECT_EQ(typeMap.getCanonical(new IR::Type_Set(tuple)), set);
+
+    // A stack is compared with every earlier one, which reports those of unknown size.
+    auto *header = new IR::Type_Header(IR::ID(cstring("H")), IR::IndexedVector<IR::StructField>());
+    auto *stack = new IR::Type_Stack(header, new IR::Constant(2));
+    auto *other = new IR::Type_Stack(header, new IR::Constant(3));
+    EXPECT_EQ(typeMap.getCanonical(stack), stack);
+    EXPECT_EQ(typeMap.getCanonical(other), other);
+    auto errors = ::errorCount();
+    RedirectStderr stderrBuffer;
+    auto *unknown = new IR::Type_Stack(header, new IR::PathExpression(IR::ID(cstring("n"))));
+    EXPECT_EQ(typeMap.getCanonical(unknown), unknown);
+    stderrBuffer.reset();
+    EXPECT_EQ(::errorCount(), errors + 2);
+    EXPECT_TRUE(stderrBuffer.contains("Size of header stack type should be a constant"));
+
+    EXPECT_TRUE(typeMap.isClosed(tuple));
+    auto *var = new IR::Type_Var(IR::ID(cstring("T")));
+    EXPECT_FALSE(typeMap.isClosed(new IR::Type_Tuple(IR::Vector<IR::Type>({b8, var}))));
+    EXPECT_FALSE(typeMap.isClosed(IR::Type_InfInt::get()));
+
+    EXPECT_FALSE(typeMap.knownUnifiable(tuple, tuple, false));
+    typeMap.setUnifiable(tuple, tuple, false);
+    EXPECT_TRUE(typeMap.knownUnifiable(tuple, tuple, false));
+    EXPECT_FALSE(typeMap.knownUnifiable(tuple, tuple, true));
+    typeMap.clear();
+    EXPECT_FALSE(typeMap.knownUnifiable(tuple, tuple, false));
+}
+
+namespace {
+
+const char *typeMemoProgram = R"(
+        struct A { bit<8> x; bit<16> y; }
+        struct B { bit<8> x; bit<16> y; }
+        struct Headers { bit<8> value; }
+        struct Metadata { A a; }
+        bit<8> inc(in bit<8> v) { return v + 8w1; }
+        parser parse(packet_in p, out Headers h, inout Metadata m,
+                     inout standard_metadata_t sm) {
+            state start { transition accept; } }
+        control checksum(inout Headers h, inout Metadata m) { apply { } }
+        control mau(inout Headers h, inout Metadata m,
+                    inout standard_metadata_t sm) {
+            action set(bit<8> v) { h.value = inc(v); }
+            table t {
+                key = { h.value : exact; }
+                actions = { set; NoAction; }
+                default_action = NoAction();
+            }
+            apply {
+                h.value = inc(h.value);
+                h.value = inc(inc(h.value));
+                m.a.x = inc(m.a.x);
+                tuple<bit<8>, bit<16>> p = { h.value, m.a.y };
+                t.apply();
+                B b = m.a;  // only accepted without strictStruct
+                h.value = b.x;
+            }
+        }
+        control deparse(packet_out p, in Headers h) { apply { } }
+        V1Switch(parse(), checksum(), mau(), mau(), checksum(), deparse()) main;
+    )";
+
+/// The types, left-value and compile-time constant flags of the expressions of a program.
+struct ExpressionTypes : public Inspector {
+    const P4::TypeMap *typeMap;
+    std::vector<std::string> types;
+    explicit ExpressionTypes(const P4::TypeMap *typeMap) : typeMap(typeMap) {}
+    void postorder(const IR::Expression *expression) override {
+        const auto *type = typeMap->getType(expression);
+        types.push_back(std::string(expression->toString()) + " : " +
+                        (type ? std::string(type->toString()) : "<none>") +
+                        (typeMap->isLeftValue(expression) ? " lvalue" : "") +
+                        (typeMap->isCompileTimeConstant(expression) ? " constant" : ""));
+    }
+};
+
+struct TypeInferenceRun {
+    const IR::P4Program *program;
+    unsigned errors;
+    std::vector<std::string> types;
+};
+
+/// Runs TypeInference on @program with @typeMap, as the frontend does, with or without
+/// strictStruct.
+TypeInferenceRun typeInference(const IR::P4Program *program, P4::TypeMap *typeMap,
+                               bool strictStruct) {
+    unsigned errors = ::errorCount();
+    typeMap->setStrictStruct(strictStruct);
+    program = program->apply(P4::TypeInference(typeMap, false, false));
+    typeMap->setStrictStruct(false);
+    ExpressionTypes types(typeMap);
+    if (program) program->apply(types);
+    return {program, ::errorCount() - errors, types.types};
+}
+
+}  // namespace
+
+// The unification memo of a TypeMap does not change what TypeInference infers, including
+// after strictStruct changes: the non-strict memo must not let a strict run accept the
+// assignment of an A to a B.
+TEST_F(P4CFrontend, TypeInferenceMemoMatchesNoMemo) {
+    auto source = P4_SOURCE(P4Headers::V1MODEL, typeMemoProgram);
+    const auto *parsed = P4::parseP4String(source, CompilerOptions::FrontendVersion::P4_16);
+    ASSERT_TRUE(parsed);
+    RedirectStderr errors;
+
+    P4::TypeMap memoized, unmemoized;
+    unmemoized.setUnificationMemo(false);
+    auto memo = typeInference(parsed, &memoized, false);
+    auto noMemo = typeInference(parsed, &unmemoized, false);
+    EXPECT_GT(memoized.unificationMemoSize(), 0u);
+    EXPECT_EQ(unmemoized.unificationMemoSize(), 0u);
+    ASSERT_TRUE(memo.program && noMemo.program);
+    EXPECT_EQ(memo.errors, 0u);
+    EXPECT_EQ(noMemo.errors, 0u);
+    EXPECT_TRUE(memo.program->equiv(*noMemo.program));
+    EXPECT_EQ(memo.types, noMemo.types);
+
+    // The frontend runs TypeInference again with strictStruct, on the same maps.
+    auto strictMemo = typeInference(memo.program, &memoized, true);
+    auto strictNoMemo = typeInference(noMemo.program, &unmemoized, true);
+    EXPECT_GT(strictNoMemo.errors, 0u);
+    EXPECT_EQ(strictMemo.errors, strictNoMemo.errors);
+    errors.reset();
+    EXPECT_TRUE(errors.contains("Cannot unify"));
+}
+
 }  // namespace Test
@@ -72,4 +72,75 @@ TEST(Util, Json) {
               obj->toString());
 }
 
+TEST(Util, JsonWriter) {
+    auto arr = new JsonArray();
+    arr->append(5);
+    arr->append("5");
+    auto inner = new JsonObject();
+    inner->emplace("k"_cs, 3);
+    arr->append(inner);
+    arr->append(new JsonArray());
+    auto obj = new JsonObject();
+    obj->emplace("x"_cs, "x");
+    obj->emplace("y"_cs, arr);
+    obj->emplace("e"_cs, new JsonObject());
+    obj->emplace("z"_cs, new JsonArray());
+
+    // Writing a tree is byte for byte the same as serializing it.
+    std::stringstream expected, actual;
+    obj->serialize(expected);
+    JsonWriter(actual).write(obj);
+    EXPECT_EQ(expected.str(), actual.str());
+
+    // So is streaming the same document.
+    std::stringstream streamed;
+    JsonWriter writer(streamed);
+    writer.beginObject().field("x"_cs, "x").key("y"_cs).beginArray().value(5).value("5");
+    writer.beginObject().field("k"_cs, 3).endObject();
+    writer.beginArray().endArray().endArray();
+    writer.key("e"_cs).beginObject().endObject();
+    writer.key("z"_cs).beginArray().endArray().endObject();
+    EXPECT_EQ(expected.str(), streamed.str());
+
+    std::stringstream small;
+    JsonWriter(small).beginArray().value(1).value(true).value("a").endArray();
+    EXPECT_EQ("[1, true, \"a\"]", small.str());
+}
+
+TEST(Util, JsonSpooledArray) {
+    auto element = [](int i) {
+        auto obj = new JsonObject();
+        obj->emplace("id"_cs, i);
+        auto params = new JsonArray();
+        params->append(i);
+        params->append(new JsonObject());
+        obj->emplace("params"_cs, params);
+        return obj;
+    };
+
+    // At the depth it was made for, a spooled array serializes as the equivalent array.
+    for (int count : {0, 1, 3}) {
+        auto spooled = new JsonSpooledArray(2);
+        auto array = new JsonArray();
+        for (int i = 0; i < count; ++i) {
+            spooled->append(element(i));
+            array->append(element(i));
+        }
+        EXPECT_EQ(size_t(count), spooled->size());
+        auto spooledTop = new JsonObject();
+        spooledTop->emplace("x"_cs, 1);
+        spooledTop->emplace("actions"_cs, spooled);
+        auto arrayTop = new JsonObject();
+        arrayTop->emplace("x"_cs, 1);
+        arrayTop->emplace("actions"_cs, array);
+
+        std::stringstream expected, serialized, written;
+        arrayTop->serialize(expected);
+        spooledTop->serialize(serialized);
+        JsonWriter(written).write(spooledTop);
+        EXPECT_EQ(expected.str(), serialized.str());
+        EXPECT_EQ(expected.str(), written.str());
+    }
+}
+
 }  // namespace Util
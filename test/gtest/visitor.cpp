@@ -14,11 +14,19 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <unistd.h>
+
+#include <filesystem>
+#include <sstream>
+#include <string>
+
 #include "frontends/common/parseInput.h"
 #include "frontends/common/resolveReferences/resolveReferences.h"
 #include "gtest/gtest.h"
 #include "helpers.h"
 #include "ir/ir.h"
+#include "ir/pass_manager.h"
+#include "ir/pass_profile.h"
 #include "midend_pass.h"
 
 namespace Test {
@@ -160,4 +168,127 @@ TEST_F(P4CVisitor, MultiVisitModifierLoop) {
     ASSERT_TRUE(program != nullptr);
 }
 
+struct IncrementConstants : public Transform {
+    const IR::Node *postorder(IR::Constant *constant) override {
+        return new IR::Constant(constant->srcInfo, constant->type, constant->value + 1);
+    }
+    IncrementConstants *clone() const override { return new IncrementConstants(*this); }
+};
+
+struct CollectConstants : public Inspector {
+    std::vector<big_int> values;
+    void postorder(const IR::Constant *constant) override { values.push_back(constant->value); }
+};
+
+std::string getParallelSource() {
+    std::string source = "const bit<8> C = 8w7;\n";
+    for (int i = 0; i < 8; ++i)
+        source += "control c" + std::to_string(i) +
+                  "(inout bit<8> x) { apply { x = x + 8w10; } }\n";
+    return source;
+}
+
+// ParallelPass only visits the local declarations, and gives the same program whatever the
+// number of threads.
+TEST_F(P4CVisitor, ParallelPass) {
+    const auto *program =
+        P4::parseP4String(getParallelSource(), CompilerOptions::FrontendVersion::P4_16);
+    ASSERT_TRUE(program != nullptr);
+
+    const auto *serial = program->apply(ParallelPass(new IncrementConstants(), 1));
+    const auto *parallel = program->apply(ParallelPass(new IncrementConstants(), 4));
+    ASSERT_TRUE(serial != nullptr && parallel != nullptr);
+    EXPECT_TRUE(serial->equiv(*parallel));
+
+    CollectConstants constants;
+    parallel->apply(constants);
+    std::vector<big_int> expected{7, 11, 11, 11, 11, 11, 11, 11, 11};
+    EXPECT_EQ(constants.values, expected);
+}
+
+// Every pass of a PassManager is recorded as a complete trace event, with the size of its result.
+TEST_F(P4CVisitor, PassProfile) {
+    const auto *program =
+        P4::parseP4String(getParallelSource(), CompilerOptions::FrontendVersion::P4_16);
+    ASSERT_TRUE(program != nullptr);
+
+    PassProfile::enable(std::filesystem::path(testing::TempDir()) /
+                        ("p4c-gtest-pass-profile-" + std::to_string(getpid()) + ".json"));
+    PassManager passes({new IncrementConstants(), new CollectConstants()});
+    passes.setName("ProfiledPasses");
+    program->apply(passes);
+
+    std::stringstream trace;
+    PassProfile::write(trace);
+    EXPECT_NE(trace.str().find("\"traceEvents\""), std::string::npos);
+    EXPECT_NE(trace.str().find("\"name\": \"Test::IncrementConstants\", \"cat\": \"pass\", "
+                               "\"ph\": \"X\""),
+              std::string::npos);
+    EXPECT_NE(trace.str().find("\"Test::CollectConstants\""), std::string::npos);
+    EXPECT_NE(trace.str().find("\"nodes_delta\": 0}"), std::string::npos);
+
+    // The tests that follow run unprofiled, and no trace is written when they are done.
+    PassProfile::disable();
+    EXPECT_FALSE(PassProfile::enabled());
+    trace.str("");
+    PassProfile::write(trace);
+    EXPECT_EQ(trace.str().find("\"Test::IncrementConstants\""), std::string::npos);
+}
+
+// The trackers find nodes by id, which is not unique: nodes read from JSON keep theirs.  A
+// node shared by two parents is still visited once, a node with the id of another is still a
+// different node, and a tracker reused by the next traversal has forgotten the previous one.
+TEST_F(P4CVisitor, TrackerNodeIds) {
+    auto *shared = new IR::Constant(1);
+    auto *sameId = new IR::Constant(10);
+    sameId->id = shared->id;
+    auto *negativeId = new IR::Constant(100);
+    negativeId->id = -1;
+    const IR::Node *tree = new IR::Vector<IR::Expression>({shared, sameId, shared, negativeId});
+
+    for (int i = 0; i < 2; ++i) {
+        tree = tree->apply(IncrementConstants());
+        const auto *vec = tree->to<IR::Vector<IR::Expression>>();
+        ASSERT_TRUE(vec != nullptr);
+        ASSERT_EQ(vec->size(), 4u);
+        EXPECT_EQ(vec->at(0), vec->at(2));
+
+        CollectConstants constants;
+        tree->apply(constants);
+        EXPECT_EQ(constants.values, std::vector<big_int>({2 + i, 11 + i, 101 + i}));
+    }
+}
+
+// Traversals of many nodes switch from the hash map to pages when their ids are dense, and
+// stay with the map when they are spread out; either way every node is visited once.
+TEST_F(P4CVisitor, TrackerManyNodes) {
+    for (bool dense : {true, false}) {
+        IR::Vector<IR::Expression> constants;
+        for (int i = 0; i < 2000; ++i) {
+            auto *constant = new IR::Constant(i);
+            if (!dense) constant->id = i * 100003;
+            constants.push_back(constant);
+        }
+        auto *sameId = new IR::Constant(-1);
+        sameId->id = constants.at(1000)->id;
+        constants.push_back(sameId);
+        constants.push_back(constants.at(1500));
+        const IR::Node *tree = new IR::Vector<IR::Expression>(constants);
+
+        for (int i = 0; i < 2; ++i) {
+            tree = tree->apply(IncrementConstants());
+            const auto *vec = tree->to<IR::Vector<IR::Expression>>();
+            ASSERT_TRUE(vec != nullptr);
+            ASSERT_EQ(vec->size(), 2002u);
+            EXPECT_EQ(vec->at(1500), vec->at(2001));
+
+            CollectConstants collected;
+            tree->apply(collected);
+            ASSERT_EQ(collected.values.size(), 2001u);
+            for (int j = 0; j < 2000; ++j) EXPECT_EQ(collected.values[j], j + 1 + i);
+            EXPECT_EQ(collected.values[2000], i);
+        }
+    }
+}
+
 }  // namespace Test
@@ -239,8 +239,9 @@ const ordered_map<cstring, IrMethod::info_t> IrMethod::Generate = {
                   << std::endl;
           for (auto f : *cl->getFields()) {
               if (*f->type == NamedType::SourceInfo()) continue;  // FIXME -- deal with SourcInfo
+              // The binary format has no field names, so every field is written.
               if (!f->isInline && f->nullOK)
-                  buf << cl->indent << "if (" << f->name << " != nullptr) ";
+                  buf << cl->indent << "if (json.isBinary() || " << f->name << " != nullptr) ";
               buf << cl->indent << "json << \",\" << std::endl << json.indent << \"\\\"" << f->name
                   << "\\\" : \" << " << "this->" << f->name << ";" << std::endl;
           }